@@ -14,10 +14,24 @@
 #include <WiFiUdp.h>
 #include "SPI.h"
 #include "SPIFFS.h"
+#include "settingsStore.h"
 #include "alarm.h"
+#include "alarmJournal.h"
+#include "alarmTable.h"
+#include "alarmEvents.h"
+#include "tzRules.h"
+#include "modeMgmt.h"
+#include "rtcWake.h"
+#include "sntpClient.h"
+#include "rtcDrift.h"
+#include "timebase.h"
+#include "netService.h"
+#include "wifiLink.h"
 #include <DS3232RTC.h>      // https://github.com/JChristensen/DS3232RTC
-#include <JSON_Decoder.h>
-#include <OpenWeather.h>
+#include "weatherStore.h"
+#include "wxConditions.h"
+#include "weatherSchedule.h"
+#include "oneCallParser.h"
 #include <math.h>
 #include "SPIFFS_Support.h"
 #include <esp_int_wdt.h>
@@ -30,6 +44,8 @@ extern "C" {
 #include "ledCtrl.h"
 
 #define SECONDS_FROM_1970_TO_2000 946684800
+#define RTC_EDGE_TIMEOUT 1100 // ms to wait for the RTC's seconds to tick over
+#define RTC_EDGE_WINDOW 20 // ms either side of the CPU clock's edge to look for the RTC's, once they are lined up
 
 // ------------------------------------ Global Variables -----------------------------------------
 
@@ -37,15 +53,17 @@ extern "C" {
 
 const char ssid[] = "yourSSID";  //  your network SSID (name)
 const char pass[] = "yourpassword";       // your network password
+// A fixed address for the clock. Leave the IP at 0.0.0.0 to use DHCP.
+const IPAddress staticIP(0, 0, 0, 0);
+const IPAddress staticGateway(0, 0, 0, 0);
+const IPAddress staticSubnet(255, 255, 255, 0);
+const IPAddress staticDns(0, 0, 0, 0);
 const String latitude =  "40.000"; // 90.0000 to -90.0000 negative for Southern hemisphere
 const String longitude = "-70.00000"; // 180.000 to -180.000 negative for West
 const String api_key = "00000000000000000000000000000000"; // Obtain this from your Dark Sky account
+const char timeZoneRule[] = "EST5EDT,M3.2.0,M11.1.0"; // POSIX TZ rule. US Eastern. See tzRules.h.
                 
 
-// NTP buffer
-const int NTP_PACKET_SIZE = 48; // NTP time is in the first 48 bytes of message
-byte packetBuffer[NTP_PACKET_SIZE]; //buffer to hold incoming & outgoing packets
-
 // Display management object - holds global interprocess communication variables
 displayMgr disp;
 
@@ -60,15 +78,31 @@ rollingSprite sprite3;
 // Non-Volitile storage object
 Preferences prefs;
 
+// RAM cache of the persistent settings, written back to NVS when edits settle
+settingsStore settings;
+
 const unsigned int localPort = 8888;  // local port to listen for UDP packets
+
+// fast WiFi joins. The cache lives in RTC memory, so it's there after a restart.
+RTC_NOINIT_ATTR wifiLease wifiLeaseCache;
+wifiLink wlan;
 WiFiUDP Udp;
 
+// asks the NTP servers. See getNtpTime().
+sntpClient sntp;
+
+// learns and trims the RTC's drift, and decides when to ask NTP again
+rtcDrift drift;
+
+// the local clock in microseconds, and the second and minute edge events
+timebase clockBase;
+
 DS3232RTC RTC(false);  // set up but do not start the RTC
 // a mutex to lock the RTC during updates
 SemaphoreHandle_t rtcMutex;
-
-// a mutex to lock the ledStrip updates and flash during updates
-SemaphoreHandle_t ledMutex;
+// the RTC hardware alarms, and the flag its INT line sets
+rtcWake wake;
+volatile bool rtcIntFlag = false;
 
 //A mutex to protect critical code sections
 portMUX_TYPE criticalMutex = portMUX_INITIALIZER_UNLOCKED;
@@ -76,30 +110,22 @@ portMUX_TYPE criticalMutex = portMUX_INITIALIZER_UNLOCKED;
 // a mutex to protect OpenWeather data
 SemaphoreHandle_t owMutex;  // a mutex to lock the owWeather objects
 
-// a mutex to protect OpenWeather data
-SemaphoreHandle_t wifiMutex;  // a mutex to lock the wifi interface
-
-OW_Weather ow; // Weather forecast library instance
-OW_current *currentA;
-OW_hourly *hourlyA;
-OW_daily  *dailyA;
-OW_current *currentB;
-OW_hourly *hourlyB;
-OW_daily  *dailyB;
-OW_current *current = currentA;
-OW_hourly *hourly = hourlyA;
-OW_daily  *daily = dailyA;
-OW_current *notCurrent = currentB;
-OW_hourly *notHourly = hourlyB;
-OW_daily *notDaily = dailyB;
-
-
-uint32_t OwAPICalls = 0;
-
-//  NTP Servers
+// a mutex to lock the wifi interface. Only the network task (netMgr) takes it.
+SemaphoreHandle_t wifiMutex;
+
+// the weather the display draws from, see weatherStore.h
+weatherStore weather;
+oneCallParser oneCall; // gets the forecast into it
+wxConditions conditions; // the text and icon for each condition ID
+weatherSchedule wxSchedule; // when to get it
+
+//  NTP Servers. All are asked at once. Add ":port" to use another port, e.g. for tools/sntp_standin.py.
 const String ntpServerName[] = {"us.pool.ntp.org", "time.nist.gov", "time-a.timefreq.bldrdoc.gov", "time-b.timefreq.bldrdoc.gov", "time-c.timefreq.bldrdoc.gov", "time.google.com"} ;
 
-int timeZone = -5; // Leave the NTP time zone as EST for boot up
+// local time rules, from timeZoneRule
+tzRules zone;
+int32_t clockOffset = 0; // s the CPU clock (now()) is ahead of UTC. Only timeMgr changes it.
+time_t lastClockTime = 0; // the last RTC reading getClockTime() believed
 
 // set up task handles
 TaskHandle_t timeTask;
@@ -107,27 +133,35 @@ TaskHandle_t displayTask;
 TaskHandle_t spriteTask;
 TaskHandle_t modeTask;
 TaskHandle_t alarmTask;
+TaskHandle_t audioTask;
 TaskHandle_t ledTask;
 TaskHandle_t ledDriverTask;
+TaskHandle_t netTask;
 
 // external alarms
-extern alarmData alarm1;
-extern alarmData alarm2;
-extern alarmData alarm3;
+extern alarmTable alarms;
+extern alarmEventQueue alarmEvents;
 
 // ------------------------------------ Function prototypes -----------------------------------------
 // Functions found in THIS file
 void timeMgr( void * parameter);
-void setDST(time_t);
 bool setRTC(time_t ts);
 const char* wl_status_to_string(wl_status_t status);
 bool connectToWifi();
 void disconnectFromWiFi();
 time_t getNtpTime();
+bool queryNtp(sntpSample &sample);
+time_t waitForUtcSecond(const sntpSample &sample);
+bool syncRtcFromNtp();
+bool resetRtcFromNtp(bool oscStopped);
 time_t getClockTime();
-void sendNTPpacket(IPAddress &address);
-bool isDST(time_t tn);
+bool waitRtcTick(uint32_t timeoutMs);
+time_t readRtcOnEdge();
+void setLocalClock(time_t utc);
+time_t utcNow();
+void applyZone();
 bool getCurrentWeather();
+void IRAM_ATTR rtcIntISR();
 
 // Functions found in DisplayMgmt file
 void dispMgr( void * parameter);
@@ -161,6 +195,10 @@ void spriteMgr( void * parameter);
 
 // Functions found in alarmMgmt file
 void alarmMgr( void * parameter );
+void audioMgr( void * parameter );
+
+// Functions found in netMgmt file
+void netMgr( void * parameter );
 
 // Functions found in LedMgmt file
 void ledMgr( void * parameter);
@@ -200,12 +238,6 @@ void setup()
   if (rtcMutex != NULL) {
     Serial.println("Setup:rtcMutex Created.");
   }
-  if (ledMutex == NULL) {
-    ledMutex = xSemaphoreCreateMutex();
-  }
-  if (ledMutex != NULL) {
-    Serial.println("Setup:ledMutex Created.");
-  }
   if (wifiMutex == NULL) {
     wifiMutex = xSemaphoreCreateMutex();
   }
@@ -216,6 +248,21 @@ void setup()
   esp_task_wdt_init(60, true); // Task WDT set for 60 seconds and reboot if it expires
 
   prefs.begin("alarms", false);
+  settings.begin();
+  alarms.begin();
+  alarmEvents.begin(); // before the tasks, timeMgr posts to it
+  clockBase.begin(); // and they subscribe to its edges
+  zone.begin(timeZoneRule);
+  net.begin(); // timeMgr posts to it from the start
+  wxSchedule.begin();
+  RTC.begin(); // timeMgr starts it again; it's only read here for the saved forecast's age
+  time_t bootUtc = RTC.oscStopped(false) ? 0 : RTC.get(); // leave the flag for timeMgr
+  if (weather.load((bootUtc > 0) ? bootUtc : 0)) { // last time's forecast, to show until the first fetch
+    disp.setWeatherValid(true);
+    disp.setMainPgMessage(String("Saved forecast. Updating."));
+    disp.setMainPgMessageColor(TFT_ORANGE);
+  }
+  wlan.begin(staticIP, staticGateway, staticSubnet, staticDns);
 
   if (!SPIFFS.begin()) {
     Serial.println("Setup: ERROR! SPIFFS initialisation failed!");
@@ -291,6 +338,17 @@ void setup()
     1 // Core
   );
 
+  // spawn the audio process. Above alarmMgr so the decoder is never waiting on it.
+  xTaskCreatePinnedToCore(
+    audioMgr, // Function to implement the task
+    "audioMgr", // Name of the task
+    4000,  // Stack size in words
+    NULL,  // Task input parameter
+    6,  // Priority of the task
+    &audioTask,  // Task handle.
+    1 // Core
+  );
+
   // spawn the led manager process
   xTaskCreatePinnedToCore(
     ledMgr, // Function to implement the task
@@ -312,6 +370,16 @@ void setup()
     &ledDriverTask,  // Task handle.
     0 // Core
   );
+
+  // spawn the network process. It has the TLS stack for the weather, so it gets the big stack.
+  xTaskCreate(
+    netMgr, // Function to implement the task
+    "netMgr", // Name of the task
+    10000,  // Stack size in words
+    NULL,  // Task input parameter
+    1,  // Priority of the task
+    &netTask  // Task handle.
+  );
 }
 
 void loop()
@@ -326,8 +394,6 @@ void loop()
 //================================================================
 void timeMgr( void * parameter) {
 
-  extern SemaphoreHandle_t alarmSemaphore;
-
   if (xSemaphoreTake(rtcMutex, (TickType_t) 250) == pdTRUE ) {
     RTC.begin(); // start the clock
     xSemaphoreGive(rtcMutex);
@@ -348,16 +414,14 @@ void timeMgr( void * parameter) {
 
   if (xSemaphoreTake(rtcMutex, (TickType_t) 250) == pdTRUE ) {
     tn = RTC.get();
+    drift.begin();
     if (RTC.oscStopped(true) || tn <= 0) { // the clock has stopped and needs to be reset
       Serial.println("timeMgr: The RTC stopped. Resetting from the Internet");
-      tn = getNtpTime();
-      if (!RTC.set(tn)) {
-        Serial.println("timeMgr: Write to RTC FAILED!!!");
-      }
-      setTime(tn + (timeZone * SECS_PER_HOUR) + 1 );
+      net.request(NET_RTC_LOST); // the clock is set again once it's done
+      setLocalClock((tn > 0) ? tn : 0);
     }
     else {
-      setTime(tn + (timeZone * SECS_PER_HOUR) + 1 );
+      setLocalClock(readRtcOnEdge());
     }
     xSemaphoreGive(rtcMutex);
   }
@@ -366,100 +430,112 @@ void timeMgr( void * parameter) {
   }
 
   // setSyncInterval(75);
-  setDST(now());
+  alarms.rebuild(now()); // the table was built before the clock was read
+
+  // the RTC alarms wake us for the next ring and sunrise
+#ifdef RTC_LIGHT_SLEEP // only then is the INT wire there. Without it GPIO27 floats.
+  pinMode(RTC_INT_PIN, INPUT_PULLUP);
+  attachInterrupt(RTC_INT_PIN, rtcIntISR, FALLING);
+#endif
+  wake.begin();
+  uint32_t lastAlarmChange = alarms.getChangeCount() - 1; // force the first program()
   // setSyncProvider(getClockTime);
 
   if (esp_task_wdt_reset() != ESP_OK) {
     Serial.println("timeMgr: Unable to reset timeMgr taskWDT!");
   }
 
-  if (getCurrentWeather()) {
-    Serial.println("timeMgr: Startup Weather Check Successful");
-    disp.setDrawLowerScreen(true);
-  }
-  else {
-    Serial.println("timeMgr: Startup Weather Check Successful");
-  }
-
-
   TickType_t xLastWakeTime;
-  const TickType_t xFrequency = 500 / portTICK_PERIOD_MS; // Run the loop twice a second
+  const TickType_t xFrequency = 500 / portTICK_PERIOD_MS; // Run the loop twice a second, and on each second edge
   xLastWakeTime = xTaskGetTickCount();
+  clockBase.subscribe(TIMEBASE_SECOND); // so the alarms are tested right as the second changes
+  time_t lastTs = now();
 
   for (;;) { // Begin main loop
 
+    if (net.takeRtcSet()) { // the network task just set the RTC from NTP
+      lastClockTime = 0; // so trust it, however far it moved
+      time_t utc = getClockTime();
+      if (utc != 0) {
+        setLocalClock(utc);
+      }
+    }
+    applyZone(); // DST changes land on the second, as this runs on each edge
     time_t ts = now();
     uint8_t minuteNow = minute(ts);
 
+    // RTC/NTP resyncs and DST changes step the local clock. The alarm table only cares about steps back.
+    alarms.timeChanged(lastTs, ts);
+    lastTs = ts;
+
+    // keep the RTC alarms on the next ring and sunrise start. The zone is rechecked each minute.
+    wake.service();
+    if (alarms.getChangeCount() != lastAlarmChange || minuteNow != minutePrevious) {
+      lastAlarmChange = alarms.getChangeCount();
+      wake.program(alarms.nextFireTime(), alarms.nextSunriseStart(ts), ts);
+    }
+
+    // Test the alarms. Only the top of the heap is looked at.
+    int32_t alarmDue = alarms.due(ts);
+    if (alarmDue >= 0) {
+      Serial.println("timeMgr: ALARM" + String(alarmDue + 1) + "!!!");
+      disp.setAlarmRinging(alarmDue + 1);
+      alarmEvents.postRing(alarmDue + 1);
+    }
+
+    // the weather, when the schedule says. Not while an alarm is going off.
+    time_t nextAlarm = alarms.nextFireTime();
+    if (disp.getAlarmRinging() == 0 && !net.isPending(NET_WEATHER) &&
+        wxSchedule.due(utcNow(), (nextAlarm > ts) ? (int32_t)(nextAlarm - ts) : 0, disp.checkRecentTouch())) {
+      Serial.println("timeMgr: Asking for the weather from OpenWeather.");
+      net.request(NET_WEATHER);
+    }
+
     if (minuteNow != minutePrevious) {
       minutePrevious = minuteNow;
 
-      // Test the alarms
-      if (alarm1.alarmTest(ts)) {
-        Serial.println("timeMgr: ALARM1!!!");
-        disp.setAlarmRinging(1);
-        xSemaphoreGive(alarmSemaphore);
-      }
-      else if (alarm2.alarmTest(ts)) {
-        Serial.println("timeMgr: ALARM2!!!");
-        disp.setAlarmRinging(2);
-        xSemaphoreGive(alarmSemaphore);
-      }
-      else if (alarm3.alarmTest(ts)) {
-        Serial.println("timeMgr: ALARM3!!!");
-        disp.setAlarmRinging(3);
-        xSemaphoreGive(alarmSemaphore);
-      }
-
       if (minuteNow % 5 == 0) {
         // Every 5 minutes, print heap status
         Serial.println("timeMgr: Current free data memory: " + String(xPortGetFreeHeapSize()));
         Serial.println("timeMgr: Minimum free data memory: " + String(xPortGetMinimumEverFreeHeapSize()));
 
-        setTime(getClockTime()); // set the CPU time from the RTC
-
-        if (disp.getAlarmRinging() != 0)
-        { // don't try and get the weather if there is an alarm going off. Try in 2.5 minutes
-          Serial.println("timeMgr: Alarm is ringing. skip getting the weather.");
-        }
-        else {
-          Serial.println("timeMgr: Getting the weather from OpenWeather.");
-          if (getCurrentWeather()) {
-          }
-          else {
-            Serial.println("timeMgr: Failed to retrieve weather!");
-          }
+        time_t utc = getClockTime();
+        if (utc != 0) {
+          setLocalClock(utc); // set the CPU time from the RTC
         }
         disp.setDrawLowerScreen(true); // set the lower screen to be redrawn every 5 minutes
       }
 
-      if (hour(ts) != hourPrevious) { // this is to check to see if we go into or out of DST
+      if (hour(ts) != hourPrevious) {
         Serial.println("timeMgr: BONG! new hour. Running hourly tasks.");
+        wake.reportStats();
+        clockBase.reportStats();
+        net.reportStats();
+        wlan.reportStats();
+        wxSchedule.reportStats(utcNow());
         hourPrevious = hour(ts);
-        // check NTP once an hour
-        if (disp.getAlarmRinging() == 0) { // don't try and get the time if there is an alarm going off! Try in 2 minutes
-          if (setRTC(getNtpTime())) {
-            Serial.println("timeMgr: RTC set from from NTP server");
-          }
-          else {
-            Serial.println("timeMgr: Unable to set RTC from NTP server.");
-          }
+        // check NTP when the drift model says. Hourly at first, backing off as the RTC is trimmed.
+        if (disp.getAlarmRinging() == 0 && drift.ntpDue(utcNow())) { // don't try and get the time if there is an alarm going off!
+          net.request(NET_NTP_SYNC);
         }
-        setDST(ts); // check to see if DST status changed
       }
 
       if (day(ts) != dayPrevious) { // Run Daily Tasks
         Serial.println("timeMgr: BONG! new day. Running daily tasks.");
         dayPrevious = day(ts);
-        OwAPICalls  = 0;
         disp.setFullReDraw(true); // force a full screen re-paint
       }
     }
 
+    settings.flushIfQuiet(); // write any settled setting changes to flash
+    journal.flush(); // and any new alarm journal records
+
     if (xPortGetMinimumEverFreeHeapSize() < 2048) { // Reset if we ever get to less than 2K of free memory
       Serial.println("\n\ntimeMgr: ========================================");
       Serial.println("timeMgr: Minimum free memory too low. Restarting.");
       Serial.println("timeMgr: ========================================\n\n");
+      settings.flush();
+      weather.flush();
       ESP.restart();
     }
 
@@ -467,17 +543,53 @@ void timeMgr( void * parameter) {
       Serial.println("timeMgr: Unable to reset timeMgr taskWDT!");
     }
 
-    vTaskDelayUntil( &xLastWakeTime, xFrequency );
+#ifdef RTC_LIGHT_SLEEP
+    // Nothing going on? Sleep to the next minute (the clock redraw) or the RTC INT, whichever is first.
+    // Light sleep stops the I2S DMA, so not while the sleep sound plays or an alarm sound is armed.
+    if (disp.getAlarmRinging() == 0 && alarms.firstSnoozed() == NULL && !disp.checkRecentTouch() &&
+        !audio.isSleepPlaying() && !audio.isArmed() && !ledMaster.getSunriseLightState() && !ledMaster.isDithering() &&
+        !net.isBusy() && WiFi.status() != WL_CONNECTED) {
+      uint32_t sleepMs = (60 - second(now())) * 1000;
+      time_t nextRing = alarms.nextFireTime();
+      if (nextRing != 0) { // wake by the time alarmMgr should pre-arm the ring
+        int64_t untilPrearm = clockBase.edgeMicros(nextRing - ALARM_PREARM_TIME) - esp_timer_get_time();
+        sleepMs = (untilPrearm <= 0) ? 0 : min(sleepMs, (uint32_t)(untilPrearm / 1000));
+      }
+      if (wake.lightSleep(sleepMs) > 0) {
+        xLastWakeTime = xTaskGetTickCount();
+        continue;
+      }
+    }
+#endif
+    clockBase.waitUntil( &xLastWakeTime, xFrequency );
   }
 }
 
+//================================================================
+//================ RTC INT ISR ===================================
+//================================================================
+void IRAM_ATTR rtcIntISR() {
+  rtcIntFlag = true;
+}
+
 //================================================================
 //================ Get NTP Time ==================================
 //================================================================
+// Ask all the NTP servers at once and return the UTC time. Waits for the next whole second before
+// returning, so whoever sets the RTC with the result does it right on the edge.
 time_t getNtpTime() {
+  sntpSample sample;
+  if (!queryNtp(sample)) {
+    return 0; // return 0 if unable to get the time
+  }
+  return waitForUtcSecond(sample);
+}
 
-  char serverName [50];
-  IPAddress ntpServerIP; // NTP server's ip address
+//================================================================
+//================ Query NTP =====================================
+//================================================================
+// Connect and ask the NTP servers. Returns false if none answered.
+bool queryNtp(sntpSample &sample) {
 
   Serial.println("Wifi status is: " + String(wl_status_to_string(WiFi.status())));
 
@@ -485,94 +597,116 @@ time_t getNtpTime() {
 
     if (WiFi.status() != WL_CONNECTED) {
       if (connectToWifi() == false) {
-        Serial.println("getNtpTime: Unable to get NTP Time. Disconnecting.");
+        Serial.println("queryNtp: Unable to get NTP Time. Disconnecting.");
         disp.setCurrWiFiStatus(false);
         disconnectFromWiFi();
         xSemaphoreGive(wifiMutex);
-        return 0;
+        return false;
       }
     }
 
-    while (Udp.parsePacket() > 0) ; // discard any previously received packets
-
-    for (int i = 0; i < (sizeof(ntpServerName) / sizeof(ntpServerName[0])); i++)
-    {
-      Serial.println("getNtpTime: Transmit NTP Request");
-      ntpServerName[i].toCharArray(serverName, 50);
-      WiFi.hostByName(serverName, ntpServerIP);
-      Serial.print(serverName);
-      Serial.print(": ");
-      Serial.println(ntpServerIP);
-      sendNTPpacket(ntpServerIP);
-      uint32_t beginWait = millis();
-      while (millis() - beginWait < 2500) {
-        int size = Udp.parsePacket();
-        if (size >= NTP_PACKET_SIZE) {
-          Serial.println("getNtpTime: Receive NTP Response");
-          Udp.read(packetBuffer, NTP_PACKET_SIZE);  // read packet into the buffer
-          unsigned long secsSince1900;
-          // convert four bytes starting at location 40 to a long integer
-          secsSince1900 =  (unsigned long)packetBuffer[40] << 24;
-          secsSince1900 |= (unsigned long)packetBuffer[41] << 16;
-          secsSince1900 |= (unsigned long)packetBuffer[42] << 8;
-          secsSince1900 |= (unsigned long)packetBuffer[43];
-          disp.setCurrWiFiStatus(true);
-          disconnectFromWiFi();
-          xSemaphoreGive(wifiMutex);
-          drawWiFiStatus(true);
-          //Serial.println("getNtpTime: recieved time: " + String(secsSince1900 - 2208988800UL));
-          Serial.print("getNtpTime: Recieved time: ");
-          Serial.println(secsSince1900 - 2208988800UL);
-          return secsSince1900 - 2208988800UL;
-        }
-      }
-      Serial.println("getNtpTime: No NTP Response from " + String(serverName));
+    uint32_t startMs = millis();
+    bool answered = sntp.query(Udp, ntpServerName, sizeof(ntpServerName) / sizeof(ntpServerName[0]), sample);
+    net.timeStage(NET_STAGE_NTP, millis() - startMs);
+    if (!answered) {
+      disp.setCurrWiFiStatus(false);
+      Serial.println ("queryNtp: Failed to get NTP time. Disconnecting");
+      disconnectFromWiFi();
+      xSemaphoreGive(wifiMutex);
+      drawWiFiStatus(false);
+      return false;
     }
-    disp.setCurrWiFiStatus(false);
-    Serial.println ("getNtpTime: Failed to get NTP time. Disconnecting");
+    disp.setCurrWiFiStatus(true);
     disconnectFromWiFi();
     xSemaphoreGive(wifiMutex);
-    drawWiFiStatus(false);
-    return 0; // return 0 if unable to get the time
+    drawWiFiStatus(true);
+    return true;
   }
   else {
-    Serial.println("getNtpTime: Unable to get wifi Mutex");
-    return 0; // return 0 if unable to get the time
+    Serial.println("queryNtp: Unable to get wifi Mutex");
+    return false;
+  }
+}
+
+//================================================================
+//================ Wait For UTC Second ===========================
+//================================================================
+// Wait for the next whole UTC second by the NTP sample and return it. Nothing is printed, the
+// caller wants to use it straight away.
+time_t waitForUtcSecond(const sntpSample &sample) {
+  // sleep to just short of the next second, then spin the last bit
+  int64_t nextSecond = ((esp_timer_get_time() + sample.offset) / 1000000 + 1) * 1000000;
+  int64_t edge = nextSecond - sample.offset; // in esp_timer time
+  int32_t sleepMs = (int32_t)((edge - esp_timer_get_time()) / 1000) - 2;
+  if (sleepMs > 0) {
+    vTaskDelay(sleepMs / portTICK_PERIOD_MS);
+  }
+  while (esp_timer_get_time() < edge) ;
+  return (time_t)(nextSecond / 1000000);
+}
+
+//================================================================
+//================ Sync RTC From NTP =============================
+//================================================================
+// Measure how far the RTC has drifted, set it from NTP on a second edge, and let the drift model
+// trim the RTC and pick the next sync time.
+bool syncRtcFromNtp() {
+  sntpSample sample;
+  if (!queryNtp(sample)) {
+    drift.ntpFailed(utcNow());
+    return false;
+  }
+
+  int64_t rtcError = DRIFT_NO_MEASUREMENT;
+  if (xSemaphoreTake(rtcMutex, (TickType_t) 250) == pdTRUE ) {
+    rtcError = drift.measure(sample.offset);
+    xSemaphoreGive(rtcMutex);
+  }
+  if (rtcError != DRIFT_NO_MEASUREMENT) {
+    Serial.println("syncRtcFromNtp: RTC is " + String((int32_t)(rtcError / 1000)) + "ms ahead of NTP");
+  }
+
+  time_t utc = waitForUtcSecond(sample);
+  if (!setRTC(utc)) {
+    drift.ntpFailed(utc);
+    return false;
+  }
+  if (xSemaphoreTake(rtcMutex, (TickType_t) 250) == pdTRUE ) {
+    drift.synced(utc, rtcError);
+    xSemaphoreGive(rtcMutex);
   }
+  return true;
 }
 
 //================================================================
-//================ Send NTP Packet ===============================
+//================ Reset RTC From NTP ============================
 //================================================================
-// send an NTP request to the time server at the given address
-void sendNTPpacket(IPAddress & address) {
-  // set all bytes in the buffer to 0
-  memset(packetBuffer, 0, NTP_PACKET_SIZE);
-  // Initialize values needed to form NTP request
-  // (see URL above for details on the packets)
-  packetBuffer[0] = 0b11100011;   // LI, Version, Mode
-  packetBuffer[1] = 0;     // Stratum, or type of clock
-  packetBuffer[2] = 6;     // Polling Interval
-  packetBuffer[3] = 0xEC;  // Peer Clock Precision
-  // 8 bytes of zero for Root Delay & Root Dispersion
-  packetBuffer[12] = 49;
-  packetBuffer[13] = 0x4E;
-  packetBuffer[14] = 49;
-  packetBuffer[15] = 52;
-  // all NTP fields have been given values, now
-  // you can send a packet requesting a timestamp:
-  Udp.beginPacket(address, 123); //NTP requests are to port 123
-  Udp.write(packetBuffer, NTP_PACKET_SIZE);
-  Udp.endPacket();
+// Set the RTC from NTP when its time can't be trusted. Nothing is learned about its drift.
+bool resetRtcFromNtp(bool oscStopped) {
+  time_t utc = getNtpTime();
+  if (utc == 0 || !setRTC(utc)) {
+    return false;
+  }
+  if (xSemaphoreTake(rtcMutex, (TickType_t) 250) == pdTRUE ) {
+    drift.restart(utc, oscStopped);
+    xSemaphoreGive(rtcMutex);
+  }
+  return true;
 }
 
 //================================================================
 //================ Connect to WiFi ===============================
 //================================================================
-// Connect to the WiFi network
+// Connect to the WiFi network. The cached access point and lease first (see wifiLink.h), then a
+// full scan if that fails.
 bool connectToWifi() {
   int retryCount = 0;
   int tryTimeout;
+  uint32_t startMs = millis();
+  bool fast = wlan.fastConnect(ssid, pass);
+  if (!fast) {
+    wlan.prepareFullConnect();
+  }
   while (WiFi.status() != WL_CONNECTED && retryCount < 3) {
     tryTimeout = 0;
     retryCount++;
@@ -603,8 +737,11 @@ bool connectToWifi() {
     return false;
   }
   else {
+    uint32_t joinMs = millis() - startMs;
+    net.timeStage(NET_STAGE_JOIN, joinMs);
+    wlan.joined(fast, joinMs);
     Serial.println();
-    Serial.print("connectToWifi: IP number assigned by DHCP is ");
+    Serial.print("connectToWifi: " + String(fast ? "Fast" : "Full") + " join in " + String(joinMs) + "ms. IP number is ");
     Serial.println(WiFi.localIP());
     Serial.print("connectToWifi: DNS IP: ");
     Serial.println(WiFi.dnsIP());
@@ -619,8 +756,11 @@ bool connectToWifi() {
 //================================================================
 //============= Disconnect From WiFi =============================
 //================================================================
-// Disconnect from the network
+// Disconnect from the network. With WIFI_STAY_CONNECTED a working link is left up, in modem sleep.
 void disconnectFromWiFi() {
+  if (!wlan.release()) {
+    return;
+  }
   Serial.println("disconnectFromWiFi: WiFi closing down.");
   ESP_ERROR_CHECK( esp_wifi_disconnect());
   vTaskDelay(10 / portTICK_PERIOD_MS);
@@ -670,15 +810,53 @@ bool setRTC(time_t ts) {
   }
 }
 
+//================================================================
+//================ Read RTC On Edge ==============================
+//================================================================
+// Wait for the RTC's seconds to tick over and return the new time. The RTC is set on a second
+// edge (see getNtpTime()), so setting the CPU clock from this lines the two up to a few ms.
+// Call with rtcMutex held.
+time_t readRtcOnEdge() {
+  waitRtcTick(RTC_EDGE_TIMEOUT);
+  return RTC.get();
+}
+
+// Poll the RTC's seconds until they tick over. Returns false if they haven't in timeoutMs.
+// Call with rtcMutex held.
+bool waitRtcTick(uint32_t timeoutMs) {
+  uint8_t startSecond = RTC.readRTC(RTC_SECONDS);
+  uint32_t startMs = millis();
+  while (RTC.readRTC(RTC_SECONDS) == startSecond) {
+    if (millis() - startMs >= timeoutMs) return false;
+    vTaskDelay(2 / portTICK_PERIOD_MS);
+  }
+  return true;
+}
+
 //================================================================
 //================ Get Clock Time ================================
 //================================================================
+// Read the RTC on its second edge and return the UTC time, or 0 if it can't be read.
+// Once a reading has been believed the CPU clock's edges are the RTC's, give or take the drift since,
+// a few ms. So sleep to just before the next CPU edge and only poll the RTC around it, rather than
+// for up to a second with the rtcMutex held.
 time_t getClockTime() {
 
-  static time_t lastTime = 0;
+  bool linedUp = (lastClockTime != 0);
+  if (linedUp) {
+    int64_t wait = clockBase.edgeMicros(now() + 1) - (RTC_EDGE_WINDOW * 1000) - esp_timer_get_time();
+    if (wait > 0) vTaskDelay((wait / 1000) / portTICK_PERIOD_MS);
+  }
+
   time_t ts;
   if (xSemaphoreTake(rtcMutex, (TickType_t) 250) == pdTRUE ) { // no rush to do this
-    ts = RTC.get() + (timeZone * SECS_PER_HOUR) + 1 ; // +1 second to account for delays
+    if (linedUp && waitRtcTick(2 * RTC_EDGE_WINDOW)) {
+      ts = RTC.get();
+    }
+    else {
+      if (linedUp) Serial.println("getClockTime: The RTC's edge wasn't near the CPU clock's. Waiting for it.");
+      ts = readRtcOnEdge(); // on the edge, so the CPU clock ticks with the RTC
+    }
     Serial.print("getClockTime: time from RTC: ");
     Serial.println(ts);
     if (ts < 0) { // negative time error
@@ -686,7 +864,7 @@ time_t getClockTime() {
       I2C_ClearBus(false); // Reset the RTC bus
       vTaskDelay(100 / portTICK_PERIOD_MS); // time to get things sorted out
       RTC.begin();
-      ts = RTC.get() + (timeZone * SECS_PER_HOUR) + 1 ; // +1 second to account for delays
+      ts = readRtcOnEdge(); // on the edge, so the CPU clock ticks with the RTC
       Serial.print("getClockTime: RTC restarted. New time: ");
       Serial.println(ts);
       if (ts < 0) {
@@ -696,29 +874,21 @@ time_t getClockTime() {
       }
     }
 
-    if (lastTime != 0 && (abs(ts - lastTime) > 3720)) { // rationality check time should not change by 62 minutes in 60 seconds
+    if (lastClockTime != 0 && (abs(ts - lastClockTime) > 3720)) { // rationality check time should not change by 62 minutes in 60 seconds
       Serial.println("getClockTime: unreasonable time recieved from RTC.");
-      Serial.println("getClockTime: ts: " + String(ts) + "   lastTime: " + String(lastTime));
-      Serial.println("getClockTime: Difference: " + String(abs(ts - lastTime)));
+      Serial.println("getClockTime: ts: " + String(ts) + "   lastTime: " + String(lastClockTime));
+      Serial.println("getClockTime: Difference: " + String(abs(ts - lastClockTime)));
       Serial.println("getClockTime: Attempting I2C bus reset.");
       I2C_ClearBus(false); // Reset the RTC bus
       RTC.begin(); // restart the RTC
       vTaskDelay(100 / portTICK_PERIOD_MS); // time to get things sorted out
-      Serial.println("getClockTime: Resetting RTC from NTP source.");
-      RTC.set(getNtpTime()); // reset the RTC
-      ts = RTC.get() + (timeZone * SECS_PER_HOUR) + 1 ; // +1 second to account for delays
-      Serial.print("getClockTime: RTC reset. New time: ");
-      Serial.println(ts);
-      /*
-        if (abs(ts - lastTime) > 3720) {
-        Serial.println("getClockTime: Failed.");
-        xSemaphoreGive(rtcMutex);
-        return 0;
-        }
-      */
+      Serial.println("getClockTime: Asking for the RTC to be reset from NTP.");
+      net.request(NET_RTC_RESET); // the CPU clock is set again once it's done
+      xSemaphoreGive(rtcMutex);
+      return 0;
     }
 
-    lastTime = ts;
+    lastClockTime = ts;
     xSemaphoreGive(rtcMutex);
     return ts;
   }
@@ -729,88 +899,38 @@ time_t getClockTime() {
 }
 
 //================================================================
-//===================== Set DST ==================================
+//=================== Set Local Clock ============================
 //================================================================
-void setDST(time_t ts) // set DST Time Zone
-{
-  Serial.print("setDST: Checking DST: ");
-  if (isDST(ts)) {
-    Serial.println ("Yes. DST");
-    timeZone = -4;  // USA Eastern DST
-  }
-  else {
-    Serial.println ("No. Not DST");
-    timeZone = -5; // USA Eastern
-  }
+// Set the CPU clock (now() is local time) from a UTC time, right on its second edge.
+void setLocalClock(time_t utc) {
+  zone.service(utc);
+  clockOffset = zone.offsetAt(utc);
+  clockBase.setClock(utc + clockOffset);
+}
+
+time_t utcNow() {
+  return now() - clockOffset;
 }
 
 //================================================================
-//====================== Is DST ==================================
+//===================== Apply Zone ===============================
 //================================================================
-bool isDST(time_t tn)
-{
-  tn -= (3600 * 5); // apply US Eastern Time zone correction
-  uint8_t myMonth = month(tn);
-  uint8_t myDay = day(tn);
-  uint8_t myWeekday = weekday(tn);
-  uint8_t myHour = hour(tn);
-
-  // January, February, and December are out.
-  if (myMonth < 3 || myMonth > 11) {
-    return false;
-  }
-  // April to October are in
-  if (myMonth > 3 && myMonth < 11) {
-    return true;
-  }
-
-  uint8_t previousSunday = myDay - (myWeekday - 1); // need weekday 0-6 not 1-7
-
-  //In march, we are DST if our previous sunday was on or after the 8th.
-  if (myMonth == 3) {
-    if (previousSunday > 8) {
-      return true;
-    }
-    else if (previousSunday < 8) {
-      return false;
-    }
-    else { //previousSunday == 8)
-      if (myWeekday == 1) { // it's spring forward Sunday!
-        if (myHour < 2) {
-          return false;
-        }
-        else {
-          return true;
-        }
-      }
-      else {
-        return true;
-      }
-    }
-  }
-
-  //In november we must be before the first sunday to be DST.
-  //That means the previous sunday must be before the 1st.
-  if (previousSunday < 0) {
-    return true;
-  }
-  else if (previousSunday > 0) {
-
-    if (previousSunday == 1 && myWeekday == 1) { // it's fall back Sunday
-      if (hour(tn) < 2) {
-        return true;
-      }
-      else {
-        return false;
-      }
-    }
-    return false;
-  }
+// Step the CPU clock if the zone's offset has changed (DST started or ended). Only the seconds
+// move, so it stays on the RTC's edge.
+void applyZone() {
+  time_t utc = utcNow();
+  int32_t offset = zone.offsetAt(utc);
+  if (offset == clockOffset) return;
+  clockBase.shiftClock(offset - clockOffset);
+  clockOffset = offset;
+  Serial.println("applyZone: Now " + String(zone.name(utc)) + ", " + String(offset / 60) + " minutes from UTC");
 }
 
 //================================================================
 //================ Get Current Weather ===========================
 //================================================================
+// Call with an API call already taken from wxSchedule, for the first attempt. A second attempt
+// takes another, and isn't made if there are none left.
 bool getCurrentWeather() {
 
   // For the OpenWeather query
@@ -844,97 +964,52 @@ bool getCurrentWeather() {
 
     Serial.println("\ngetCurrentWeather: Requesting weather information from OpenWeather... ");
 
-    if (current == currentA) {
-      // clear the old data
-      delete currentB;
-      delete hourlyB;
-      delete dailyB;
-      // create the objects to hold the new weather data
-      currentB = new OW_current;
-      hourlyB = new OW_hourly;
-      dailyB =  new OW_daily;
-
-      notCurrent = currentB;
-      notHourly = hourlyB;
-      notDaily = dailyB;
+    if (esp_task_wdt_reset() != ESP_OK) { // reset watchdog, just in case
+      Serial.println("getCurrentWeather: Unable to reset taskWDT!");
     }
-    else if (current == currentB) {
-      // clear the old data
-      delete currentA;
-      delete hourlyA;
-      delete dailyA;
-      // create the objects to hold the new weather data
-      currentA = new OW_current;
-      hourlyA = new OW_hourly;
-      dailyA =  new OW_daily;
-
-      notCurrent = currentA;
-      notHourly = hourlyA;
-      notDaily = dailyA;
+
+    // Look the server up first. The lookup in connect() then comes from the cache, so this is
+    // the DNS time.
+    uint32_t stageMs = millis();
+    IPAddress owIP;
+    if (WiFi.hostByName(OW_HOST, owIP)) {
+      net.timeStage(NET_STAGE_DNS, millis() - stageMs);
     }
     else {
-      Serial.println("getCurrentWeather: ERROR should not get here!");
-    }
-
-    if (esp_task_wdt_reset() != ESP_OK) { // reset watchdog, just in case
-      Serial.println("timeMgr: Unable to reset timeMgr taskWDT!");
+      Serial.println("getCurrentWeather: Unable to resolve " + String(OW_HOST));
     }
 
     Serial.println("getCurrentWeather: Entering 1st attempt.");
     Serial.println("getCurrentWeather: Wifi status is: " + String(wl_status_to_string(WiFi.status())));
-    result = ow.getForecast(notCurrent, notHourly, notDaily, api_key, latitude, longitude, units, language);
-    OwAPICalls++;
+    stageMs = millis();
+    wxSnapshot *wx = weather.back();
+    result = oneCall.fetch(wx, api_key, latitude, longitude, units, language);
+    net.timeStage(NET_STAGE_FETCH, millis() - stageMs);
     Serial.println("getCurrentWeather: Exit 1st attempt.");
 
     if (esp_task_wdt_reset() != ESP_OK) { // reset watchdog, just in case
-      Serial.println("timeMgr: Unable to reset timeMgr taskWDT!");
+      Serial.println("getCurrentWeather: Unable to reset taskWDT!");
     }
 
-    if (result == false) { //something went wrong. Try again
+    if (result == false && !wxSchedule.takeCall(utcNow())) {
+      Serial.println("getCurrentWeather: Failed to get weather on 1st attempt, and no API calls are left to try again.");
+      ++weatherFails;
+    }
+    else if (result == false) { //something went wrong. Try again
       vTaskDelay(10 / portTICK_PERIOD_MS); // wait just a tick
       Serial.println("getCurrentWeather: Failed to get weather on 1st attempt. Trying again.");
-      if (current == currentA) {
-        // clear the old data
-        delete currentB;
-        delete hourlyB;
-        delete dailyB;
-        // create the objects to hold the new weather data
-        currentB = new OW_current;
-        hourlyB = new OW_hourly;
-        dailyB =  new OW_daily;
-
-        notCurrent = currentB;
-        notHourly = hourlyB;
-        notDaily = dailyB;
-      }
-      else if (current == currentB) {
-        // clear the old data
-        delete currentA;
-        delete hourlyA;
-        delete dailyA;
-        // create the objects to hold the new weather data
-        currentA = new OW_current;
-        hourlyA = new OW_hourly;
-        dailyA =  new OW_daily;
-
-        notCurrent = currentA;
-        notHourly = hourlyA;
-        notDaily = dailyA;
-      }
-      else {
-        Serial.println("getCurrentWeather: ERROR should not get here!");
-      }
-
       if (esp_task_wdt_reset() != ESP_OK) { // reset watchdog, just in case
-        Serial.println("timeMgr: Unable to reset timeMgr taskWDT!");
+        Serial.println("getCurrentWeather: Unable to reset taskWDT!");
       }
       Serial.println("getCurrentWeather: Entering 2nd attempt.");
-      result = ow.getForecast(notCurrent, notHourly, notDaily, api_key, latitude, longitude, units, language);
-      OwAPICalls++;
+      stageMs = millis();
+      wx = weather.back(); // cleared again
+      result = oneCall.fetch(wx, api_key, latitude, longitude, units, language);
+      net.timeStage(NET_STAGE_FETCH, millis() - stageMs);
       Serial.println("getCurrentWeather: Exiting 2nd attempt.");
 
       if (esp_task_wdt_reset() != ESP_OK) { // reset watchdog, just in case
-        Serial.println("timeMgr: Unable to reset timeMgr taskWDT!");
+        Serial.println("getCurrentWeather: Unable to reset taskWDT!");
       }
 
       if (!result) {
@@ -947,34 +1022,28 @@ bool getCurrentWeather() {
     if (result) {
       Serial.println("getCurrentWeather: Successfully parsed weather JSON object.");
 
-      if (xSemaphoreTake(owMutex, (TickType_t) 100) == pdTRUE ) {
-        if (current == currentA) {
-          current = currentB; hourly = hourlyB; daily = dailyB;
-        }
-        else if (current == currentB) {
-          current = currentA; hourly = hourlyA; daily = dailyA;
-        }
-        else {
-          Serial.println("getCurrentWeather: ERROR! invalid current ptr value! Should never see this!");
-        }
-        xSemaphoreGive(owMutex);
+      wx->fetched = utcNow();
+      // the front snapshot only changes here, so this task can read it without owMutex
+      wxSchedule.fetched(wx->fetched, weather.get(), wx, oneCall.getFreshFor());
+      if (weather.publish()) {
         disp.setWeatherValid(true);
         if (weatherFails > 0) { // if we lost weather and now have it back, redraw the working area of the screen
           disp.setFullReDraw(true);
           disp.setMainPgMessage(String("Data by OpenWeather"));
-          //disp.setMainPgMessage(String("OW API Calls: ") + String(OwAPICalls));
+          //disp.setMainPgMessage(String("OW API Calls: ") + String(wxSchedule.getCallsToday()));
           disp.setMainPgMessageColor(TFT_DARKGREY);
         }
         weatherFails = 0;
         // Debug section
         disp.setFullReDraw(true);
         disp.setMainPgMessage(String("Data by OpenWeather"));
-        //disp.setMainPgMessage(String("OW API Calls: ") + String(OwAPICalls));
+        //disp.setMainPgMessage(String("OW API Calls: ") + String(wxSchedule.getCallsToday()));
         disp.setMainPgMessageColor(TFT_DARKGREY);
       }
       else {
         Serial.println("getCurrentWeather: Unable to take owMutex.");
       }
+      weather.flushIfDue(wx->fetched);
     }
 
     disconnectFromWiFi();
@@ -991,100 +1060,50 @@ bool getCurrentWeather() {
     if (result) {
       Serial.println("getCurrentWeather: Weather from Open Weather Retrieved\n");
       /*
-            int i = 0;
+            const wxSnapshot *wx = weather.get();
 
             Serial.println("############### Current weather ###############\n");
-            Serial.print("dt (time)        : "); Serial.print(strTime(current->dt));
-            Serial.print("sunrise          : "); Serial.print(strTime(current->sunrise));
-            Serial.print("sunset           : "); Serial.print(strTime(current->sunset));
-            Serial.print("temp             : "); Serial.println(current->temp);
-            Serial.print("feels_like       : "); Serial.println(current->feels_like);
-            Serial.print("pressure         : "); Serial.println(current->pressure);
-            Serial.print("humidity         : "); Serial.println(current->humidity);
-            Serial.print("dew_point        : "); Serial.println(current->dew_point);
-            Serial.print("uvi              : "); Serial.println(current->uvi);
-            Serial.print("clouds           : "); Serial.println(current->clouds);
-            Serial.print("visibility       : "); Serial.println(current->visibility);
-            Serial.print("wind_speed       : "); Serial.println(current->wind_speed);
-            Serial.print("wind_gust        : "); Serial.println(current->wind_gust);
-            Serial.print("wind_deg         : "); Serial.println(current->wind_deg);
-            Serial.print("rain             : "); Serial.println(current->rain);
-            Serial.print("snow             : "); Serial.println(current->snow);
-            Serial.println();
-            Serial.print("id               : "); Serial.println(current->id);
-            Serial.print("main             : "); Serial.println(current->main);
-            Serial.print("description      : "); Serial.println(current->description);
-            Serial.print("icon             : "); Serial.println(current->icon);
-
+            Serial.print("dt (time)        : "); Serial.print(strTime(wx->current.dt));
+            Serial.print("sunrise          : "); Serial.print(strTime(wx->current.sunrise));
+            Serial.print("sunset           : "); Serial.print(strTime(wx->current.sunset));
+            Serial.print("temp             : "); Serial.println(wx->current.temp);
+            Serial.print("feels_like       : "); Serial.println(wx->current.feels_like);
+            Serial.print("pressure         : "); Serial.println(wx->current.pressure);
+            Serial.print("humidity         : "); Serial.println(wx->current.humidity);
+            Serial.print("clouds           : "); Serial.println(wx->current.clouds);
+            Serial.print("wind_speed       : "); Serial.println(wx->current.wind_speed);
+            Serial.print("wind_gust        : "); Serial.println(wx->current.wind_gust);
+            Serial.print("wind_deg         : "); Serial.println(wx->current.wind_deg);
+            Serial.print("id               : "); Serial.println(wx->current.id);
+            Serial.print("description      : "); Serial.println(conditions.find(wx->current.id)->text);
             Serial.println();
 
             Serial.println("############### Hourly weather  ###############\n");
-            for (int i = 0; i < MAX_HOURS; i++)
+            for (int i = 0; i < WX_HOURS; i++)
             {
-              Serial.print("Hourly summary  "); if (i < 10) Serial.print(" "); Serial.print(i);
-              Serial.println();
-              Serial.print("dt (time)        : "); Serial.print(strTime(hourly->dt[i]));
-              Serial.print("temp             : "); Serial.println(hourly->temp[i]);
-              Serial.print("feels_like       : "); Serial.println(hourly->feels_like[i]);
-              Serial.print("pressure         : "); Serial.println(hourly->pressure[i]);
-              Serial.print("humidity         : "); Serial.println(hourly->humidity[i]);
-              Serial.print("dew_point        : "); Serial.println(hourly->dew_point[i]);
-              Serial.print("clouds           : "); Serial.println(hourly->clouds[i]);
-              Serial.print("wind_speed       : "); Serial.println(hourly->wind_speed[i]);
-              Serial.print("wind_gust        : "); Serial.println(hourly->wind_gust[i]);
-              Serial.print("wind_deg         : "); Serial.println(hourly->wind_deg[i]);
-              Serial.print("rain             : "); Serial.println(hourly->rain[i]);
-              Serial.print("snow             : "); Serial.println(hourly->snow[i]);
-              Serial.println();
-              Serial.print("id               : "); Serial.println(hourly->id[i]);
-              Serial.print("main             : "); Serial.println(hourly->main[i]);
-              Serial.print("description      : "); Serial.println(hourly->description[i]);
-              Serial.print("icon             : "); Serial.println(hourly->icon[i]);
-              Serial.print("pop              : "); Serial.println(hourly->pop[i]);
-
+              Serial.print("dt (time)        : "); Serial.print(strTime(wx->hourly[i].dt));
+              Serial.print("temp             : "); Serial.println(wx->hourly[i].temp);
+              Serial.print("wind_speed       : "); Serial.println(wx->hourly[i].wind_speed);
+              Serial.print("wind_gust        : "); Serial.println(wx->hourly[i].wind_gust);
+              Serial.print("id               : "); Serial.println(wx->hourly[i].id);
+              Serial.print("description      : "); Serial.println(conditions.find(wx->hourly[i].id)->text);
               Serial.println();
             }
 
-
             Serial.println("###############  Daily weather  ###############\n");
-            for (int i = 0; i < MAX_DAYS; i++)
+            for (int i = 0; i < WX_DAYS; i++)
             {
-              Serial.print("Daily summary   "); if (i < 10) Serial.print(" "); Serial.print(i);
-              Serial.println();
-              Serial.print("dt (time)        : "); Serial.print(strTime(daily->dt[i]));
-              Serial.print("sunrise          : "); Serial.print(strTime(daily->sunrise[i]));
-              Serial.print("sunset           : "); Serial.print(strTime(daily->sunset[i]));
-
-              Serial.print("temp.morn        : "); Serial.println(daily->temp_morn[i]);
-              Serial.print("temp.day         : "); Serial.println(daily->temp_day[i]);
-              Serial.print("temp.eve         : "); Serial.println(daily->temp_eve[i]);
-              Serial.print("temp.night       : "); Serial.println(daily->temp_night[i]);
-              Serial.print("temp.min         : "); Serial.println(daily->temp_min[i]);
-              Serial.print("temp.max         : "); Serial.println(daily->temp_max[i]);
-
-              Serial.print("feels_like.morn  : "); Serial.println(daily->feels_like_morn[i]);
-              Serial.print("feels_like.day   : "); Serial.println(daily->feels_like_day[i]);
-              Serial.print("feels_like.eve   : "); Serial.println(daily->feels_like_eve[i]);
-              Serial.print("feels_like.night : "); Serial.println(daily->feels_like_night[i]);
-
-              Serial.print("pressure         : "); Serial.println(daily->pressure[i]);
-              Serial.print("humidity         : "); Serial.println(daily->humidity[i]);
-              Serial.print("dew_point        : "); Serial.println(daily->dew_point[i]);
-              Serial.print("uvi              : "); Serial.println(daily->uvi[i]);
-              Serial.print("clouds           : "); Serial.println(daily->clouds[i]);
-              Serial.print("visibility       : "); Serial.println(daily->visibility[i]);
-              Serial.print("wind_speed       : "); Serial.println(daily->wind_speed[i]);
-              Serial.print("wind_gust        : "); Serial.println(daily->wind_gust[i]);
-              Serial.print("wind_deg         : "); Serial.println(daily->wind_deg[i]);
-              Serial.print("rain             : "); Serial.println(daily->rain[i]);
-              Serial.print("snow             : "); Serial.println(daily->snow[i]);
-              Serial.print("pop              : "); Serial.println(daily->pop[i]);
-              Serial.println();
-              Serial.print("id               : "); Serial.println(daily->id[i]);
-              Serial.print("main             : "); Serial.println(daily->main[i]);
-              Serial.print("description      : "); Serial.println(daily->description[i]);
-              Serial.print("icon             : "); Serial.println(daily->icon[i]);
-
+              Serial.print("dt (time)        : "); Serial.print(strTime(wx->daily[i].dt));
+              Serial.print("temp.min         : "); Serial.println(wx->daily[i].temp_min);
+              Serial.print("temp.max         : "); Serial.println(wx->daily[i].temp_max);
+              Serial.print("humidity         : "); Serial.println(wx->daily[i].humidity);
+              Serial.print("wind_speed       : "); Serial.println(wx->daily[i].wind_speed);
+              Serial.print("wind_gust        : "); Serial.println(wx->daily[i].wind_gust);
+              Serial.print("pop              : "); Serial.println(wx->daily[i].pop);
+              Serial.print("rain             : "); Serial.println(wx->daily[i].rain);
+              Serial.print("snow             : "); Serial.println(wx->daily[i].snow);
+              Serial.print("id               : "); Serial.println(wx->daily[i].id);
+              Serial.print("description      : "); Serial.println(conditions.find(wx->daily[i].id)->text);
               Serial.println();
             }
       */
@@ -1092,7 +1111,7 @@ bool getCurrentWeather() {
     }
 
     disp.setCurrWiFiStatus(result);
-    Serial.println("getCurrentWeather: OW API Calls: " + String(OwAPICalls));
+    Serial.println("getCurrentWeather: OW API Calls today: " + String(wxSchedule.getCallsToday()));
     return (result);
   }
   else {
@@ -1107,7 +1126,7 @@ bool getCurrentWeather() {
 // ***************************************************************************************
 String strTime(time_t unixTime)
 {
-  unixTime += timeZone * SECS_PER_HOUR;
+  unixTime = zone.toLocal(unixTime);
   return ctime(&unixTime);
 }
 
@@ -1,7 +1,6 @@
 #include "globalInclude.h"
 
 // This file contains most of the functions to handle the display
-#include "modeMgmt.h"
 
 #define HORIZ_DIV_POS 85
 #define VERT_DIV_POS 125
@@ -14,9 +13,7 @@
 //===================================================================
 //======================== Globals ==================================
 //===================================================================
-extern alarmData alarm1;
-extern alarmData alarm2;
-extern alarmData alarm3;
+extern alarmTable alarms;
 
 //button objects
 TFT_eSPI_Button hoursUp, hoursDown, minUp, minDown;
@@ -65,6 +62,7 @@ void dispMgr( void * parameter) {
     Serial.print("Self Diagnostic: 0x"); Serial.println(x, HEX);
 
     tft.fillScreen(TFT_BLACK);
+    conditions.measure(tft, FSS9); // the font the weather descriptions are drawn in
     xSemaphoreGive(tftMutex);
   }
   else {
@@ -75,9 +73,9 @@ void dispMgr( void * parameter) {
   drawTextString("Waiting for Time Sync.", tft.width() / 2, (tft.height() / 2) + 30, FSSB12, 320, MC_DATUM, TFT_WHITE, TFT_BLACK);
   drawTextString("Data by OpenWeather", tft.width() / 2, (tft.height() / 2) - 30 , FSSB12, 320, MC_DATUM, TFT_WHITE, TFT_BLACK);
 
+  if (timeStatus() != timeSet) Serial.println("dispMgr: Delaying start of screen. Status: " + String(timeStatus()));
   while (timeStatus() != timeSet) {
-    vTaskDelay(500 / portTICK_PERIOD_MS);
-    Serial.println("dispMgr: Delaying start of screen. Status: " + String(timeStatus()));
+    vTaskDelay(50 / portTICK_PERIOD_MS); // short, so a saved forecast is up as soon as the clock is
   }
 
   ts = now();
@@ -89,6 +87,7 @@ void dispMgr( void * parameter) {
   }
   const TickType_t xFrequency = 75 / portTICK_PERIOD_MS; // run the master display loop at 20Hz
   xLastWakeTime = xTaskGetTickCount();
+  clockBase.subscribe(TIMEBASE_MINUTE); // and right on the minute, so the time changes on the edge
   // Master Display Loop
   for (;;) {
     ts = now();
@@ -171,7 +170,7 @@ void dispMgr( void * parameter) {
       disp.setDrawTimeSection(false);
       drawTime(now(), false);
     }
-    vTaskDelayUntil( &xLastWakeTime, xFrequency );
+    clockBase.waitUntil( &xLastWakeTime, xFrequency );
   }
 }
 
@@ -288,11 +287,11 @@ void drawTime(time_t ts, bool repaint)
 void drawAlarmIndicator(bool repaint) {
   static bool lastAlarmAct;
   static bool lastSnoozeAct;
-  static bool lastRingAct;
+  static uint16_t lastRingAct;
 
-  bool alarmAct = (alarm1.isActive() || alarm2.isActive() || alarm3.isActive());
-  bool snoozeAct = (alarm1.isSnoozed() || alarm2.isSnoozed() || alarm3.isSnoozed());
-  uint8_t ringAct = disp.getAlarmRinging();
+  bool alarmAct = alarms.anyActive();
+  bool snoozeAct = (alarms.firstSnoozed() != NULL);
+  uint16_t ringAct = disp.getAlarmRinging();
   if (alarmAct != lastAlarmAct || snoozeAct != lastSnoozeAct || ringAct != lastRingAct || repaint) {
     if (snoozeAct || ringAct != 0) {
       String alarmIcon = ("/alarmicon/alarm_red_sm.bmp");
@@ -480,6 +479,7 @@ void drawWeatherDisplay(bool repaint) {
   static String lastIcon = " ";
   bool redrawCurrStat = false;
   static uint32_t lastOwAPICalls;
+  static bool firstFrame = true;
 
   if (hour() < 14 || hour() == 24) { // After 2pm show tomorrow's forcast
     showTomorrow = 0;
@@ -506,12 +506,11 @@ void drawWeatherDisplay(bool repaint) {
       Serial.println("drawWeatherDisplay: Unable to get dfwMutex to update weather display!");
       return;
     }
+    const wxSnapshot *wx = weather.get();
 
     String weatherIcon = "";
-    String currentSummary = current->main;
-    currentSummary.toLowerCase();
 
-    weatherIcon = getMeteoconIcon(current->id, true, 0);
+    weatherIcon = getMeteoconIcon(wx->current.id, true, 0);
     if (weatherIcon != lastIcon || repaint) { // save some work drawing the weather icon
       if (xSemaphoreTake(tftMutex, (TickType_t) 50) == pdTRUE ) {
         drawWeatherIcon(weatherIcon, 12, 105, true);
@@ -524,12 +523,15 @@ void drawWeatherDisplay(bool repaint) {
       }
     }
 
-    drawTextString("Currently", 62, 90, FSS9, 124, TC_DATUM, TFT_YELLOW, TFT_BLACK);
+    // the forecast saved last time, until the first fetch replaces it
+    if (weather.isStale()) drawTextString("Last known", 62, 90, FSS9, 124, TC_DATUM, TFT_ORANGE, TFT_BLACK);
+    else drawTextString("Currently", 62, 90, FSS9, 124, TC_DATUM, TFT_YELLOW, TFT_BLACK);
 
-    msgTmp = String(current->description) + ", " + String((int)round(current->temp)) + " F";
-    msgTmp[0] = msgTmp[0] - 32; // upper case 1st letter
-    lineLength = tft.textWidth(msgTmp, GFXFF);
-    if (msgTmp != lastCurrMsg || repaint || redrawCurrStat || (int)round(current->temp) != lastCurTemp) {
+    const wxCondition *cond = conditions.find(wx->current.id);
+    String tempTmp = ", " + String((int)round(wx->current.temp)) + " F";
+    msgTmp = cond->text + tempTmp;
+    lineLength = conditions.width(cond) + tft.textWidth(tempTmp, GFXFF);
+    if (msgTmp != lastCurrMsg || repaint || redrawCurrStat || (int)round(wx->current.temp) != lastCurTemp) {
       redrawCurrStat = false;
       lastCurrMsg = msgTmp;
       sprite1.delSprite();
@@ -552,16 +554,16 @@ void drawWeatherDisplay(bool repaint) {
       drawTextString("Today's Forecast", 135, 90, FSS9, 194, TL_DATUM, TFT_YELLOW, TFT_BLACK);
     }
 
-    if (disp.getMainPgMessage() != lastMainPgMessage || repaint || lastOwAPICalls != OwAPICalls) {
+    if (disp.getMainPgMessage() != lastMainPgMessage || repaint || lastOwAPICalls != wxSchedule.getCallsToday()) {
       drawTextString(disp.getMainPgMessage(), 135, 215, FSS9, 194, TL_DATUM, disp.getMainPgMessageColor(), TFT_BLACK);
       lastMainPgMessage = disp.getMainPgMessage();
-      lastOwAPICalls = OwAPICalls;
+      lastOwAPICalls = wxSchedule.getCallsToday();
     }
 
 
-    msgTmp = String(daily->description[showTomorrow]);
-    msgTmp[0] = msgTmp[0] - 32; // upper case 1st letter
-    lineLength = tft.textWidth(msgTmp, GFXFF);
+    cond = conditions.find(wx->daily[showTomorrow].id);
+    msgTmp = cond->text;
+    lineLength = conditions.width(cond);
     if (msgTmp != sprite2.currMsg() || repaint) {
       sprite2.delSprite();
       if (xSemaphoreTake(tftMutex, (TickType_t) 50) == pdTRUE ) {
@@ -576,30 +578,34 @@ void drawWeatherDisplay(bool repaint) {
       }
     }
 
-    msgTmp = "Temp:  " + String((int)round(daily->temp_morn[showTomorrow])) + "-" + String((int)round(daily->temp_day[showTomorrow])) + "-" + String((int)round(daily->temp_eve[showTomorrow])) + "-" + String((int)round(daily->temp_night[showTomorrow])) + " F";
+    msgTmp = "Temp:  " + String((int)round(wx->daily[showTomorrow].temp_morn)) + "-" + String((int)round(wx->daily[showTomorrow].temp_day)) + "-" + String((int)round(wx->daily[showTomorrow].temp_eve)) + "-" + String((int)round(wx->daily[showTomorrow].temp_night)) + " F";
     if (lastHighTemp != msgTmp || repaint) {
       drawTextString(msgTmp, 135, 135, FSS9, 194, TL_DATUM, TFT_YELLOW, TFT_BLACK);
       lastHighTemp = msgTmp;
     }
 
-    msgTmp = "Feels:  " + String((int)round(daily->feels_like_morn[showTomorrow])) + "-" + String((int)round(daily->feels_like_day[showTomorrow])) + "-" + String((int)round(daily->feels_like_eve[showTomorrow])) + "-" + String((int)round(daily->feels_like_night[showTomorrow])) + " F";
+    msgTmp = "Feels:  " + String((int)round(wx->daily[showTomorrow].feels_like_morn)) + "-" + String((int)round(wx->daily[showTomorrow].feels_like_day)) + "-" + String((int)round(wx->daily[showTomorrow].feels_like_eve)) + "-" + String((int)round(wx->daily[showTomorrow].feels_like_night)) + " F";
     if (lastLowTemp != msgTmp || repaint) {
       drawTextString(msgTmp, 135, 155, FSS9, 194, TL_DATUM, TFT_YELLOW, TFT_BLACK);
       lastLowTemp = msgTmp;
     }
 
-    msgTmp = formatPrecipString(daily->pop[showTomorrow], daily->rain[showTomorrow], daily->snow[showTomorrow]);
+    msgTmp = formatPrecipString(wx->daily[showTomorrow].pop, wx->daily[showTomorrow].rain, wx->daily[showTomorrow].snow);
     if (lastPercip != msgTmp || repaint) {
       drawTextString(msgTmp, 135, 175, FSS9, 194, TL_DATUM, TFT_YELLOW, TFT_BLACK);
       lastPercip = msgTmp;
     }
 
 
-    msgTmp = "Humidity: " + String(daily->humidity[showTomorrow]) + "%";
+    msgTmp = "Humidity: " + String(wx->daily[showTomorrow].humidity) + "%";
     if (lastHumid != msgTmp || repaint) {
       drawTextString(msgTmp, 135, 195, FSS9, 194, TL_DATUM, TFT_YELLOW, TFT_BLACK);
       lastHumid = msgTmp;
     }
+    if (repaint && firstFrame) { // for the time from boot to a full screen
+      Serial.println("drawWeatherDisplay: First full weather frame at " + String(millis()) + "ms" + (weather.isStale() ? ", saved forecast" : ""));
+      firstFrame = false;
+    }
     xSemaphoreGive(owMutex);
   }
   else
@@ -647,48 +653,47 @@ void drawCurrentWeatherDisplay(bool repaint) {
       Serial.println("drawWeatherDisplay: Unable to get dfwMutex to update weather display!");
       return;
     }
+    const wxSnapshot *wx = weather.get();
 
     if (repaint) {
       drawTextString("Current Weather - 1/2", tft.width() / 2, 90, FSS9, 310, TC_DATUM, TFT_YELLOW, TFT_BLACK);
     }
 
     // draw weather text
-    msgTmp = String(current->description);
-    msgTmp[0] = msgTmp[0] - 32; // upper case 1st letter
-    msgTmp = "Summary: " + msgTmp;
+    msgTmp = "Summary: " + String(conditions.find(wx->current.id)->text);
     // lineLength = tft.textWidth(msgTmp, GFXFF);
     if (msgTmp != lastCurrMsg || repaint ) {
       lastCurrMsg = msgTmp;
       drawTextString(msgTmp, 5, 110, FSS9, 310, TL_DATUM, TFT_YELLOW, TFT_BLACK);
     }
 
-    msgTmp = "Temprature: " + String(current->temp) + " F";
+    msgTmp = "Temprature: " + String(wx->current.temp) + " F";
     // lineLength = tft.textWidth(msgTmp, GFXFF);
     if (msgTmp != lastCurrMsg || repaint ) {
       lastCurrMsg = msgTmp;
       drawTextString(msgTmp, 5, 130, FSS9, 310, TL_DATUM, TFT_YELLOW, TFT_BLACK);
     }
 
-    msgTmp = "Feels Like: " + String(current->feels_like) + " F";
+    msgTmp = "Feels Like: " + String(wx->current.feels_like) + " F";
     // lineLength = tft.textWidth(msgTmp, GFXFF);
     if (msgTmp != lastFeels || repaint ) {
       lastFeels = msgTmp;
       drawTextString(msgTmp, 5, 150, FSS9, 310, TL_DATUM, TFT_YELLOW, TFT_BLACK);
     }
 
-    msgTmp = "Humidity: " + String(current->humidity) + "%  Clouds: " + String(current->clouds) + "%";
+    msgTmp = "Humidity: " + String(wx->current.humidity) + "%  Clouds: " + String(wx->current.clouds) + "%";
     if (lastHumid != msgTmp || repaint) {
       drawTextString(msgTmp, 5, 170, FSS9, 310, TL_DATUM, TFT_YELLOW, TFT_BLACK);
       lastHumid = msgTmp;
     }
 
-    msgTmp = "Presure: " + String(current->pressure) + " mBar";
+    msgTmp = "Presure: " + String(wx->current.pressure) + " mBar";
     if (lastPress != msgTmp || repaint) {
       drawTextString(msgTmp, 5, 190, FSS9, 310, TL_DATUM, TFT_YELLOW, TFT_BLACK);
       lastPress = msgTmp;
     }
 
-    msgTmp = formatWindString(current->wind_speed, current->wind_gust, current->wind_deg);
+    msgTmp = formatWindString(wx->current.wind_speed, wx->current.wind_gust, wx->current.wind_deg);
     //msgTmp = "I am the test case, and this is WAY too long to fit in the availible space.";
     lineLength = tft.textWidth(msgTmp, GFXFF);
     if (msgTmp != sprite1.currMsg() || repaint) {
@@ -739,6 +744,7 @@ void drawHourlyWeatherDisplay(bool repaint) {
       Serial.println("drawWeatherDisplay: Unable to get dfwMutex to update weather display!");
       return;
     }
+    const wxSnapshot *wx = weather.get();
 
     if (repaint) {
       if (xSemaphoreTake(tftMutex, (TickType_t) 75) == pdTRUE ) {
@@ -761,10 +767,8 @@ void drawHourlyWeatherDisplay(bool repaint) {
       }
 
       String weatherIcon = "";
-      String dailySummary = hourly->main[hourCounter];
-      dailySummary.toLowerCase();
 
-      weatherIcon = getMeteoconIcon(hourly->id[hourCounter], false, hourCounter);
+      weatherIcon = getMeteoconIcon(wx->hourly[hourCounter].id, false, hourCounter);
       if (weatherIcon != lastIcon[i] || repaint) { // save some work drawing the weather icon
         if (xSemaphoreTake(tftMutex, (TickType_t) 75) == pdTRUE ) {
           drawWeatherIcon(weatherIcon, 28 + (107 * i), 135, false);
@@ -776,7 +780,7 @@ void drawHourlyWeatherDisplay(bool repaint) {
         }
       }
 
-      msgTmp = String((int)round(hourly->temp[hourCounter])) + " F";
+      msgTmp = String((int)round(wx->hourly[hourCounter].temp)) + " F";
       if (lastTemp[i] != msgTmp || repaint) {
         drawTextString(msgTmp, 53 + (107 * i), 185, FSS9, 103, TC_DATUM, TFT_YELLOW, TFT_BLACK);
         lastTemp[i] = msgTmp;
@@ -794,10 +798,9 @@ void drawHourlyWeatherDisplay(bool repaint) {
         workSprite = &sprite3;
       }
 
-      msgTmp = String(hourly->description[hourCounter]);
-      // msgTmp = "this is a test of the system";
-      msgTmp[0] = msgTmp[0] - 32; // upper case 1st letter
-      lineLength = tft.textWidth(msgTmp, GFXFF);
+      const wxCondition *cond = conditions.find(wx->hourly[hourCounter].id);
+      msgTmp = cond->text;
+      lineLength = conditions.width(cond);
       if (msgTmp != lastDesc[i] || repaint) {
         workSprite->delSprite();
         if (xSemaphoreTake(tftMutex, (TickType_t) 50) == pdTRUE ) {
@@ -814,7 +817,7 @@ void drawHourlyWeatherDisplay(bool repaint) {
         lastDesc[i] = msgTmp;
       }
 
-      msgTmp = String(int(round(hourly->wind_speed[hourCounter]))) + "/" + String(int(round(hourly->wind_gust[hourCounter]))) + "mph";
+      msgTmp = String(int(round(wx->hourly[hourCounter].wind_speed))) + "/" + String(int(round(wx->hourly[hourCounter].wind_gust))) + "mph";
       if (lastWind[i] != msgTmp || repaint) {
         drawTextString(msgTmp, 53 + (107 * i), 222, FSS9, 103, TC_DATUM, TFT_YELLOW, TFT_BLACK);
         lastWind[i] = msgTmp;
@@ -856,6 +859,7 @@ void drawForecastWeatherDisplay(bool repaint) {
       Serial.println("drawWeatherDisplay: Unable to get dfwMutex to update weather display!");
       return;
     }
+    const wxSnapshot *wx = weather.get();
 
     if (repaint) {
       if (xSemaphoreTake(tftMutex, (TickType_t) 75) == pdTRUE ) {
@@ -879,10 +883,8 @@ void drawForecastWeatherDisplay(bool repaint) {
       }
 
       String weatherIcon = "";
-      String dailySummary = daily->main[dayCounter];
-      dailySummary.toLowerCase();
 
-      weatherIcon = getMeteoconIcon(daily->id[dayCounter], false, 0);
+      weatherIcon = getMeteoconIcon(wx->daily[dayCounter].id, false, 0);
       if (weatherIcon != lastIcon[i] || repaint) { // save some work drawing the weather icon
         if (xSemaphoreTake(tftMutex, (TickType_t) 75) == pdTRUE ) {
           drawWeatherIcon(weatherIcon, 28 + (107 * i), 135, false);
@@ -894,7 +896,7 @@ void drawForecastWeatherDisplay(bool repaint) {
         }
       }
 
-      msgTmp = String((int)round(daily->temp_min[dayCounter])) + "-" + String((int)round(daily->temp_max[dayCounter])) + " F";
+      msgTmp = String((int)round(wx->daily[dayCounter].temp_min)) + "-" + String((int)round(wx->daily[dayCounter].temp_max)) + " F";
       if (lastTemp[i] != msgTmp || repaint) {
         drawTextString(msgTmp, 53 + (107 * i), 185, FSS9, 103, TC_DATUM, TFT_YELLOW, TFT_BLACK);
         lastTemp[i] = msgTmp;
@@ -912,10 +914,9 @@ void drawForecastWeatherDisplay(bool repaint) {
       }
 
       // needs work
-      msgTmp = String(daily->description[dayCounter]);
-      // msgTmp = "this is a test of the system";
-      msgTmp[0] = msgTmp[0] - 32; // upper case 1st letter
-      lineLength = tft.textWidth(msgTmp, GFXFF);
+      const wxCondition *cond = conditions.find(wx->daily[dayCounter].id);
+      msgTmp = cond->text;
+      lineLength = conditions.width(cond);
       if (msgTmp != lastDesc[i] || repaint) {
         workSprite->delSprite();
         if (xSemaphoreTake(tftMutex, (TickType_t) 50) == pdTRUE ) {
@@ -932,7 +933,7 @@ void drawForecastWeatherDisplay(bool repaint) {
         lastDesc[i] = msgTmp;
       }
 
-      msgTmp = String(int(round(daily->wind_speed[dayCounter]))) + "/" + String(int(round(daily->wind_gust[dayCounter]))) + "mph";
+      msgTmp = String(int(round(wx->daily[dayCounter].wind_speed))) + "/" + String(int(round(wx->daily[dayCounter].wind_gust))) + "mph";
       if (lastWind[i] != msgTmp || repaint) {
         drawTextString(msgTmp, 53 + (107 * i), 222, FSS9, 103, TC_DATUM, TFT_YELLOW, TFT_BLACK);
         lastWind[i] = msgTmp;
@@ -956,34 +957,23 @@ void drawAlarmDisplay(bool repaint) {
   String alarmIcon;
   char iconChar[30];
   const int alarmIndHoriz = 285;
-  static bool alarm1LastActive;
-  static bool alarm2LastActive;
-  static bool alarm3LastActive;
-  static bool alarm1LastSunrise;
-  static bool alarm2LastSunrise;
-  static bool alarm3LastSunrise;
+  const uint16_t rowOffset[ALARM_DISPLAY_ROWS] = {110, 153, 197};
+  static bool lastActive[ALARM_DISPLAY_ROWS];
+  static bool lastSunrise[ALARM_DISPLAY_ROWS];
 
   if (repaint) {
     drawTextString("Set Alarms", tft.width() / 2, 90, FSS9, 320, TC_DATUM, TFT_WHITE, TFT_BLACK);
   }
 
-  if (alarm1.isActive() != alarm1LastActive || alarm1.isSunriseActive() != alarm1LastSunrise || repaint) {
-    drawAlarmDisplayElem(repaint, 1, 110);
-    alarm1LastActive = alarm1.isActive();
-    alarm1LastSunrise = alarm1.isSunriseActive();
-    drawAlarmIndicator(false);
-  }
-  if (alarm2.isActive() != alarm2LastActive || alarm2.isSunriseActive() != alarm2LastSunrise || repaint) {
-    drawAlarmDisplayElem(repaint, 2, 153);
-    alarm2LastActive = alarm2.isActive();
-    alarm2LastSunrise = alarm2.isSunriseActive();
-    drawAlarmIndicator(false);
-  }
-  if (alarm3.isActive() != alarm3LastActive || alarm3.isSunriseActive() != alarm3LastSunrise || repaint) {
-    drawAlarmDisplayElem(repaint, 3, 197);
-    alarm3LastActive = alarm3.isActive();
-    alarm3LastSunrise = alarm3.isSunriseActive();
-    drawAlarmIndicator(false);
+  uint16_t rows = min((uint16_t)ALARM_DISPLAY_ROWS, alarms.size());
+  for (uint16_t i = 0; i < rows; i++) {
+    alarmData *workAlarm = alarms.get(i);
+    if (workAlarm->isActive() != lastActive[i] || workAlarm->isSunriseActive() != lastSunrise[i] || repaint) {
+      drawAlarmDisplayElem(repaint, i + 1, rowOffset[i]);
+      lastActive[i] = workAlarm->isActive();
+      lastSunrise[i] = workAlarm->isSunriseActive();
+      drawAlarmIndicator(false);
+    }
   }
 }
 
@@ -1001,15 +991,9 @@ void drawAlarmDisplayElem(bool repaint, uint8_t alarmNumber, uint16_t yOff) {
   char iconChar[31];
 
   // set up the pointer to the alarm we are working on
-  alarmData *workAlarm;
-  if (alarmNumber == 1) {
-    workAlarm = &alarm1;
-  }
-  else if (alarmNumber == 2) {
-    workAlarm = &alarm2;
-  }
-  else if (alarmNumber == 3) {
-    workAlarm = &alarm3;
+  alarmData *workAlarm = alarms.get(alarmNumber - 1);
+  if (workAlarm == NULL) {
+    return;
   }
 
   if (repaint) {
@@ -1093,15 +1077,9 @@ void drawAlarmSetDisplay(bool repaint, int alarmNumber) {
   char * shortDow[] = {"Su", "Mo", "Tu", "We", "Th", "Fr", "Sa"};
 
   // set up the pointer to the alarm we are working on
-  alarmData *workAlarm;
-  if (alarmNumber == 1) {
-    workAlarm = &alarm1;
-  }
-  else if (alarmNumber == 2) {
-    workAlarm = &alarm2;
-  }
-  else if (alarmNumber == 3) {
-    workAlarm = &alarm3;
+  alarmData *workAlarm = alarms.get(alarmNumber - 1);
+  if (workAlarm == NULL) {
+    return;
   }
 
   if (repaint) {
@@ -1542,30 +1520,10 @@ const char* wl_status_to_string(wl_status_t status) {
 //***************************************************************************************/
 const String getMeteoconIcon(uint16_t id, bool curWx, uint16_t hourWx)
 {
-  if ( curWx && id / 100 == 8 && (current->dt < current->sunrise || current->dt > current->sunset)) id += 1000;
-  else if ( (hourWx != 0) && id / 100 == 8 && (hourly->dt[hourWx] < current->sunrise || hourly->dt[hourWx] > current->sunset)) id += 1000;
-
-  if (id / 100 == 2) return "thunderstorm";
-  if (id / 100 == 3) return "drizzle";
-  if (id / 100 == 4) return "unknown";
-  if (id == 500 || id == 520) return "lightRain";
-  else if (id == 511) return "sleet";
-  else if (id / 100 == 5) return "rain";
-  if (id == 602 || id == 622) return "heavy-snow";
-  if (id >= 611 && id <= 616) return "sleet";
-  else if (id / 100 == 6) return "snow";
-  if (id >= 701 && id <= 762) return "fog";
-  if (id == 771 || id == 781) return "wind";
-  if (id == 800) return "clear-day";
-  if (id == 801) return "partly-cloudy-day";
-  if (id == 802) return "partly-cloudy-day";
-  if (id == 803) return "cloudy";
-  if (id == 804) return "cloudy";
-  if (id == 1800) return "clear-night";
-  if (id == 1801) return "partly-cloudy-night";
-  if (id == 1802) return "partly-cloudy-night";
-  if (id == 1803) return "cloudy";
-  if (id == 1804) return "cloudy";
-
-  return "unknown";
+  const wxSnapshot *wx = weather.get(); // owMutex is held by the caller
+  bool night = false;
+  if (curWx) night = (wx->current.dt < wx->current.sunrise || wx->current.dt > wx->current.sunset);
+  else if (hourWx != 0) night = (wx->hourly[hourWx].dt < wx->current.sunrise || wx->hourly[hourWx].dt > wx->current.sunset);
+
+  return wxConditions::iconName(wxConditions::icon(wxConditions::find(id), night));
 }
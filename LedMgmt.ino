@@ -14,12 +14,10 @@ void ledMgr( void * parameter) {
   bool lastReadState;
   bool lastRoomState;
   bool lastNightState;
-  bool lastSunriseActive1;
-  bool lastSunriseActive2;
-  bool lastSunriseActive3;
+  int32_t lastSunriseAlarm = -1; // the alarm that last drove the sunrise light
   uint16_t loopcount = 0;
 
-  const float sunriseTime = 900; // seconds to start sunrise time
+  const float sunriseTime = SUNRISE_LEAD_TIME; // seconds to start sunrise time
   const HsbColor blackColor(0, 0, 0);
 
   const HsbColor sunriseStartColor = HsbColor(0.0f, 0.9f, 0.07f);
@@ -50,55 +48,41 @@ void ledMgr( void * parameter) {
     // main loop
     if (loopcount % LED_CTRL_LOOP_FREQUENCY == 0 ) { // check the alarms once a second
       time_t tn = now();
-      if (alarm1.isSunriseActive() && ledMaster.getRoomLightState() == false) {
-        lastSunriseActive1 = true;
-        uint32_t timeRemain = alarm1.secondsToAlarm(tn);
-        if (timeRemain <= sunriseTime) {
-          //Serial.println("ledMgr: timeRemain: " + String(timeRemain));
-          float progress = (sunriseTime - (float)timeRemain) / sunriseTime;
-          //Serial.println("ledMgr: progress: " + String(progress));
-          HsbColor sunriseColor = HsbColor::LinearBlend<NeoHueBlendShortestDistance>(sunriseStartColor, sunriseEndColor, progress);
-          ledMaster.setActiveSunriseRoomLightColorHSB(sunriseColor.H, sunriseColor.S, sunriseColor.B);
-          ledMaster.sunriseLightOn();
+
+      // handle if someone turns off the sunrise alarm function
+      if (lastSunriseAlarm >= 0 && ledMaster.getRoomLightState() == false) {
+        alarmData *lastAlarm = alarms.get(lastSunriseAlarm);
+        if (lastAlarm == NULL || lastAlarm->isSunriseActive() == false) {
+          lastSunriseAlarm = -1;
+          ledMaster.setActiveRoomLightColorHSB(blackColor.H, blackColor.S, blackColor.B);
+          ledMaster.sunriseLightOff();
         }
       }
-      else if (alarm2.isSunriseActive() && ledMaster.getRoomLightState() == false) {
-        lastSunriseActive2 = true;
-        uint32_t timeRemain = alarm2.secondsToAlarm(tn);
-        if (timeRemain <= sunriseTime) {
-          float progress = (sunriseTime - (float)timeRemain) / sunriseTime;
-          HsbColor sunriseColor = HsbColor::LinearBlend<NeoHueBlendShortestDistance>(sunriseStartColor, sunriseEndColor, progress);
-          ledMaster.setActiveSunriseRoomLightColorHSB(sunriseColor.H, sunriseColor.S, sunriseColor.B);
-          ledMaster.sunriseLightOn();
+
+      // the sunrise follows whichever sunrise alarm is closest
+      if (ledMaster.getRoomLightState() == false) {
+        int32_t sunriseAlarm = -1;
+        uint32_t timeRemain = 0;
+        for (uint16_t i = 0; i < alarms.size(); i++) {
+          alarmData *workAlarm = alarms.get(i);
+          if (workAlarm->isSunriseActive()) {
+            uint32_t alarmRemain = workAlarm->secondsToAlarm(tn); // cached next ring, so this is a subtraction
+            if (sunriseAlarm < 0 || alarmRemain < timeRemain) {
+              sunriseAlarm = i;
+              timeRemain = alarmRemain;
+            }
+          }
         }
-      }
-      else if (alarm3.isSunriseActive() && ledMaster.getRoomLightState() == false) {
-        lastSunriseActive3 = true;
-        uint32_t timeRemain = alarm3.secondsToAlarm(tn);
-        if (timeRemain <= sunriseTime) {
+        if (sunriseAlarm >= 0 && timeRemain <= sunriseTime) {
+          lastSunriseAlarm = sunriseAlarm;
+          //Serial.println("ledMgr: timeRemain: " + String(timeRemain));
           float progress = (sunriseTime - (float)timeRemain) / sunriseTime;
+          //Serial.println("ledMgr: progress: " + String(progress));
           HsbColor sunriseColor = HsbColor::LinearBlend<NeoHueBlendShortestDistance>(sunriseStartColor, sunriseEndColor, progress);
           ledMaster.setActiveSunriseRoomLightColorHSB(sunriseColor.H, sunriseColor.S, sunriseColor.B);
           ledMaster.sunriseLightOn();
         }
       }
-
-      // handle if someone turns off the sunrise alarm function
-      if (alarm1.isSunriseActive() == false && lastSunriseActive1 == true && ledMaster.getRoomLightState() == false) {
-        lastSunriseActive1 = false;
-        ledMaster.setActiveRoomLightColorHSB(blackColor.H, blackColor.S, blackColor.B);
-        ledMaster.sunriseLightOff();
-      }
-      if (alarm2.isSunriseActive() == false && lastSunriseActive2 == true && ledMaster.getRoomLightState() == false) {
-        lastSunriseActive2 = false;
-        ledMaster.setActiveRoomLightColorHSB(blackColor.H, blackColor.S, blackColor.B);
-        ledMaster.sunriseLightOff();
-      }
-      if (alarm3.isSunriseActive() == false && lastSunriseActive3 == true && ledMaster.getRoomLightState() == false) {
-        lastSunriseActive3 = false;
-        ledMaster.setActiveRoomLightColorHSB(blackColor.H, blackColor.S, blackColor.B);
-        ledMaster.sunriseLightOff();
-      }
     }
 
     if (loopcount % (10 * LED_CTRL_LOOP_FREQUENCY) == 0 ) { // send a message once every 10 sec. just to be safe
@@ -106,6 +90,11 @@ void ledMgr( void * parameter) {
       vTaskDelay(2 / portTICK_PERIOD_MS); // This is just to feed the IDLE watchdog
     }
 
+    if (loopcount == 0) { // about once a minute
+      ledMaster.reportDitherStats();
+      ledMaster.reportHandoffStats();
+    }
+
     if (esp_task_wdt_reset() != ESP_OK) {
       Serial.println("Unable to reset ledMgr taskWDT!");
     }
@@ -131,21 +120,32 @@ void ledDriver( void * parameter) {
   }
 
   const TickType_t xFrequency = 33 / portTICK_PERIOD_MS; // run the master display loop at about 30Hz
+  const TickType_t xDitherFrequency = 10 / portTICK_PERIOD_MS; // 100Hz while dithering so the steps blend
   xLastWakeTime = xTaskGetTickCount();
   for (;;) {
-    if (ledMaster.CanShow() && ledMaster.IsDirty()) {
-      if (xSemaphoreTake(ledMutex, (TickType_t) 10) == pdTRUE ) {
+    if (ledMaster.CanShow()) { // the strip buffer is this task's alone. Only the targets are handed over.
+      ledMaster.ditherFrame();
+      if (ledMaster.IsDirty()) {
         disp.setSpriteEnable(false);
-        taskENTER_CRITICAL(&criticalMutex);
-        ledMaster.Show();
-        taskEXIT_CRITICAL(&criticalMutex);
-        xSemaphoreGive(ledMutex);
+        if (ledMaster.isDithering()) {
+          ledMaster.Show(); // up to 100 a second. The RMT sends from its own buffer, so no need to mask interrupts.
+        }
+        else {
+          taskENTER_CRITICAL(&criticalMutex);
+          ledMaster.Show();
+          taskEXIT_CRITICAL(&criticalMutex);
+        }
         disp.setSpriteEnable(true);
       }
     }
     if (esp_task_wdt_reset() != ESP_OK) {
       Serial.println("Unable to reset ledMgr taskWDT!");
     }
-    vTaskDelayUntil( &xLastWakeTime, xFrequency );
+    if (ledMaster.isDithering()) {
+      vTaskDelayUntil( &xLastWakeTime, xDitherFrequency );
+    }
+    else {
+      vTaskDelayUntil( &xLastWakeTime, xFrequency );
+    }
   }
 }
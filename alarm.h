@@ -18,10 +18,11 @@
 #define SNOOZE_TIME 1 // snooze for 5 minutes per cycle
 #endif
 
-#include <Preferences.h>
-extern Preferences prefs;
+#define SECS_PER_DAY_L 86400L
+#define NO_ALARM_SECS 1000000 // secondsToAlarm when nothing is scheduled
 
-extern SemaphoreHandle_t ledMutex;
+extern settingsStore settings;
+class alarmTable;
 
 // alarmData - A class to hold the state of an alarm
 class alarmData {
@@ -31,12 +32,17 @@ class alarmData {
     int8_t alarmMinute; // 0-59
     uint8_t alarmDays; // bitfield for days and active state
     bool sunriseActive;
+    time_t nextFire = 0; // next ring (local time) cached by the alarm table, 0 if none
 
     int8_t snoozeHour;
     int8_t snoozeMinute;
     // bool snoozed;
     uint8_t snoozecount = 0;
     String alarmID;
+    uint16_t slot; // index of this alarm in the settings store
+
+    alarmTable *owner = NULL; // the table that schedules this alarm, told about every change
+    void notifyChanged( void ); // defined in alarmTable.h
 
   public:
 
@@ -51,76 +57,54 @@ class alarmData {
       return alarmMinute;
     }
 
-    void initAlarm(String id) {
+    void initAlarm(String id, uint16_t settingsSlot) {
       alarmID = id;
-      char varName[15];
-      char tmpID[10];
-      alarmID.toCharArray(tmpID, 10);
-      strcpy(varName, tmpID);
-      strcat(varName, "Hour");
-      alarmHour = prefs.getChar(varName, 12);
+      slot = settingsSlot;
+      alarmRecord rec = {12, 0, 127, 0};
+      if (!settings.getAlarm(slot, rec)) {
+        Serial.println("alarmData.initAlarm: No stored settings for " + alarmID + ". Using defaults.");
+      }
+      alarmHour = rec.hour;
       snoozeHour  = alarmHour;
-      strcpy(varName, tmpID);
-      strcat(varName, "Min");
-      alarmMinute = prefs.getChar(varName, 0);
+      alarmMinute = rec.minute;
       snoozeMinute = alarmMinute;
-      strcpy(varName, tmpID);
-      strcat(varName, "Days");
-      alarmDays = prefs.getUChar(varName, 127);
+      alarmDays = rec.days;
       snoozecount = 0;
-      strcpy(varName, tmpID);
-      strcat(varName, "Sunrise");
-      sunriseActive = prefs.getBool(varName, false);
+      sunriseActive = rec.flags & ALARM_FLAG_SUNRISE;
+    }
+
+    void setOwner(alarmTable *table) {
+      owner = table;
     }
 
     String getAlarmID (void) {
       return alarmID;
     }
 
+    // Index in the settings store and the alarm table. Alarm numbers are this + 1.
+    uint16_t getSlot (void) {
+      return slot;
+    }
+
+    // Hand the current values to the settings store. It writes them to flash once edits settle.
     void saveAlarmData() {
-      int8_t tmpAlarmHour; // 1-24
-      int8_t tmpAlarmMinute; // 0-59
-      uint8_t tmpAlarmDays; // bitfield for days and active state
-      bool tmpSunriseActive;
-      char varName[15];
-      char tmpID[10];
-      alarmID.toCharArray(tmpID, 10);
-
-      if (xSemaphoreTake(ledMutex, (TickType_t) 1000) == pdTRUE ) {
-        strcpy(varName, tmpID);
-        strcat(varName, "Hour");
-        tmpAlarmHour = prefs.getChar(varName, 15);
-        if (tmpAlarmHour != alarmHour) {
-          prefs.putChar(varName, alarmHour);
-        }
-        strcpy(varName, tmpID);
-        strcat(varName, "Min");
-        tmpAlarmMinute = prefs.getChar(varName, 100);
-        if (tmpAlarmMinute != alarmMinute) {
-          prefs.putChar(varName, alarmMinute);
-        }
-        strcpy(varName, tmpID);
-        strcat(varName, "Days");
-        tmpAlarmDays = prefs.getUChar(varName, NULL);
-        if (tmpAlarmDays != alarmDays) {
-          prefs.putUChar(varName, alarmDays);
-        }
-        strcpy(varName, tmpID);
-        strcat(varName, "Sunrise");
-        tmpSunriseActive = prefs.getUChar(varName, NULL);
-        if (tmpSunriseActive != sunriseActive) {
-          prefs.putBool(varName, sunriseActive);
-        }
-        xSemaphoreGive(ledMutex);
-      }
-      else {
-        Serial.println("alarmData.saveAlarmData: Unable to get the ledMutex. Data NOT WRITTEN TO FLASH!");
-      }
+      alarmRecord rec;
+      rec.hour = alarmHour;
+      rec.minute = alarmMinute;
+      rec.days = alarmDays;
+      rec.flags = sunriseActive ? ALARM_FLAG_SUNRISE : 0;
+      settings.setAlarm(slot, rec);
     }
 
     void setAlarmTime (time_t ts) {
       alarmHour = hour(ts);
+      if (alarmHour == 0) {
+        alarmHour = 24; // correct from 0-23 to 1-24 format
+      }
       alarmMinute = minute(ts);
+      snoozeHour = alarmHour;
+      snoozeMinute = alarmMinute;
+      notifyChanged();
     }
 
     void hoursMod(int modification) {
@@ -136,7 +120,7 @@ class alarmData {
         alarmHour += 24;
       }
       snoozeHour = alarmHour;
-
+      notifyChanged();
     }
 
     void minuteMod(int modification) {
@@ -152,6 +136,7 @@ class alarmData {
         alarmMinute += 60;
       }
       snoozeMinute = alarmMinute;
+      notifyChanged();
     }
 
     void setAlarmDays (bool days[], uint8_t num_elements) { // takes an array of 7 bool values, Sunday-Saturday
@@ -168,6 +153,7 @@ class alarmData {
           alarmDays = alarmDays | (1 << i);
         }
       }
+      notifyChanged();
     }
 
     bool* getDaysArray() {
@@ -187,6 +173,7 @@ class alarmData {
 
     void activate() {
       alarmDays = alarmDays | ACTIVE;
+      notifyChanged();
     }
 
     void deactivate() {
@@ -203,56 +190,53 @@ class alarmData {
       }
     }
 
-    bool alarmTest(time_t ts) { // is it time to triger the alarm?
-      uint8_t locHour = hour(ts);
-      if (locHour == 0) {
-        locHour = 24;  // correct from 0-23 to 1-24 format
+    // Work out the next time this alarm rings at or after ts (local time). Returns 0 if it never will.
+    // Snoozed alarms ring at the snooze time whatever the day.
+    time_t computeNextFire(time_t ts) {
+      if (!(alarmDays & ACTIVE)) {
+        return 0;
       }
-      //Serial.println("alarmTest: hour: " + String(locHour) + " snoozehour: " + String(snoozeHour));
-      //Serial.println("alarmTest: minute: " + String(minute(ts)) + " snoozeminute: " + String(snoozeMinute));
-      if ( (alarmDays & ACTIVE) && (locHour == snoozeHour) && (minute(ts) == snoozeMinute) ) {
-        if (alarmDays & (1 << (weekday(ts) - 1) ) || snoozecount ) {
-          return true;
-        }
+      time_t midnight = ts - (ts % SECS_PER_DAY_L);
+      int32_t offset = ((snoozeHour % 24) * 3600L) + (snoozeMinute * 60L);
+
+      if (snoozecount) {
+        time_t fire = midnight + offset;
+        return (fire >= ts) ? fire : fire + SECS_PER_DAY_L;
       }
-      return false;
-    }
 
-    uint32_t secondsToAlarm ( time_t ts ) { // only returns valid information for alarms in the next 2 days
-      int16_t inMinutes = minute(ts);
-      int16_t inHour = hour(ts);
-      if (inHour == 0) {
-        inHour = 24; // correct from 0-23 to 1-24 format
-      }
-      int16_t inSeconds = second(ts);
-      uint8_t inDay = weekday(ts) - 1;
-      int16_t tmpSnoozeHour = snoozeHour;
-      if (tmpSnoozeHour == 0) {
-        tmpSnoozeHour = 24; // correct from 0-23 to 1-24 format (should not be needed)
-      }
-      
-      // Is the alarm set for today and does it happen in the future?
-      if (alarmDays & (1 << inDay)) { // yes
-        if ((tmpSnoozeHour > inHour) || ((tmpSnoozeHour == inHour) && (snoozeMinute > inMinutes))) { // The alarm is in the future
-          int32_t alarmSecs = (tmpSnoozeHour * 3600) + (snoozeMinute * 60);
-          int32_t calcInSeconds = (inHour * 3600) + (inMinutes * 60) + inSeconds;
-          Serial.println("secondsToAlarm: time remaining: " + String(alarmSecs - calcInSeconds));
-          Serial.println(" ");
-          return alarmSecs - calcInSeconds;
+      uint8_t today = ((ts / SECS_PER_DAY_L) + 4) % 7; // 1 Jan 1970 was a Thursday. 0 = Sunday, as in alarmDays
+      for (uint8_t d = 0; d <= 7; d++) {
+        if (alarmDays & (1 << ((today + d) % 7))) {
+          time_t fire = midnight + (d * SECS_PER_DAY_L) + offset;
+          if (fire >= ts) {
+            return fire;
+          }
         }
       }
-      uint8_t tomorrow = inDay + 1;
-      if (tomorrow == 7) tomorrow = 0; // tomorrow may be a Sunday
+      return 0;
+    }
 
-      if ((alarmDays & (1 << tomorrow))) { // tomorrow has an alarm
-        int32_t alarmSecs = ((tmpSnoozeHour + 24) * 3600) + (snoozeMinute * 60);
-        int32_t calcInSeconds = (inHour * 3600) + (inMinutes * 60) + inSeconds;
-        //Serial.println("secondsToAlarm: time remaining: " + String(alarmSecs - calcInSeconds));
-        //Serial.println(" ");
-        return alarmSecs - calcInSeconds;
-      }
+    // The alarm has been turned off at the button
+    void dismiss( void ) {
+      resetSnooze();
+    }
+
+    // The cached next ring. Only the alarm table should set this, it keeps the heap in step.
+    void setNextFire(time_t ts) {
+      nextFire = ts;
+    }
 
-      return 1000000;
+    time_t getNextFire( void ) {
+      return nextFire;
+    }
+
+    // Seconds until the next ring, looking up to a week ahead. Just a subtraction from the cached
+    // time. It is recomputed on edits, snoozes, and by the table on time jumps.
+    uint32_t secondsToAlarm ( time_t ts ) {
+      if (nextFire == 0 || nextFire < ts) {
+        return NO_ALARM_SECS;
+      }
+      return nextFire - ts;
     }
 
     bool toggleStatus() {
@@ -279,6 +263,7 @@ class alarmData {
           snoozeHour -= 24;
         }
       }
+      notifyChanged();
     }
 
     uint8_t isSnoozed (void) {
@@ -289,6 +274,7 @@ class alarmData {
       snoozeHour = alarmHour;
       snoozeMinute = alarmMinute;
       snoozecount = 0;
+      notifyChanged();
     }
 
     String formatAlarmTime() {
@@ -377,15 +363,18 @@ class alarmData {
       else {
         alarmDays = alarmDays | key;
       }
+      notifyChanged();
     }
 
     void setSunrise( bool val ) {
       sunriseActive = val;
+      notifyChanged(); // the RTC sunrise wake follows this
     }
 
     void toggleSunrise( void ) {
       if (sunriseActive) sunriseActive = false;
       else sunriseActive = true;
+      notifyChanged();
     }
 
     bool isSunriseActive ( void ) {
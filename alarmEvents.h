@@ -0,0 +1,165 @@
+// This file defines the alarmEventQueue class
+// Everything the alarm task reacts to comes in through one queue: alarm rings from timeMgr, and
+// the snooze/dismiss button. The button is interrupt driven. The ISR only passes on debounced
+// level changes, and wait() turns them into press, short release and long hold events, using the
+// queue timeout for the hold. So the alarm task can block on wait() instead of polling the pin.
+
+#include "globalInclude.h"
+
+// #define ALARM_OFF_BUTTON 35
+#define ALARM_OFF_BUTTON 39
+
+//Time in ms to wait before shutting off the alarm vs. snoozing
+#define ALARM_BUTTON_TIME 1750
+#define BUTTON_DEBOUNCE_MS 30
+
+#define ALARM_EVENT_QUEUE_LEN 16
+
+// Event types. The first two only pass between the ISR and wait().
+#define BUTTON_EDGE_DOWN 1
+#define BUTTON_EDGE_UP 2
+#define ALARM_EVENT_RING 3 // alarmNum says which
+#define BUTTON_EVENT_PRESS 4
+#define BUTTON_EVENT_SHORT 5 // released before ALARM_BUTTON_TIME
+#define BUTTON_EVENT_HOLD 6 // still down after ALARM_BUTTON_TIME
+#define BUTTON_EVENT_RELEASE 7 // released after a hold
+
+struct alarmEvent {
+  uint8_t type;
+  uint16_t alarmNum;
+  uint32_t ms; // millis() when it happened
+};
+
+class alarmEventQueue {
+
+  private:
+    QueueHandle_t queue = NULL;
+    volatile bool edgeDown = false; // ISR state
+    volatile uint32_t edgeMs = 0;
+    volatile uint32_t bounces = 0; // edges thrown away by the ISR
+
+    // wait() state. Alarm task only.
+    bool pressed = false;
+    bool held = false;
+    uint32_t pressMs = 0;
+
+    // GPIO 36 and 39 can see spurious interrupts while the ADC or WiFi is in use (ESP32 errata
+    // 3.11), so an edge only counts if the level really changed. Anything inside the debounce time
+    // is dropped. wait() rechecks the pin at the hold time in case the real last edge was dropped.
+    static void IRAM_ATTR buttonISR(void *arg) {
+      alarmEventQueue *self = (alarmEventQueue *)arg;
+      bool down = (digitalRead(ALARM_OFF_BUTTON) == LOW);
+      uint32_t nowMs = millis();
+      if (down == self->edgeDown || nowMs - self->edgeMs < BUTTON_DEBOUNCE_MS) {
+        self->bounces++;
+        return;
+      }
+      self->edgeDown = down;
+      self->edgeMs = nowMs;
+      alarmEvent event;
+      event.type = down ? BUTTON_EDGE_DOWN : BUTTON_EDGE_UP;
+      event.alarmNum = 0;
+      event.ms = nowMs;
+      BaseType_t woken = pdFALSE;
+      xQueueSendFromISR(self->queue, &event, &woken);
+      if (woken) {
+        portYIELD_FROM_ISR();
+      }
+    }
+
+    // Turn a raw edge into a button event. Returns false if there's nothing to report.
+    bool cook(alarmEvent &event) {
+      if (event.type == BUTTON_EDGE_DOWN) {
+        if (pressed) return false;
+        pressed = true;
+        held = false;
+        pressMs = event.ms;
+        event.type = BUTTON_EVENT_PRESS;
+        return true;
+      }
+      if (event.type == BUTTON_EDGE_UP) {
+        if (!pressed) return false;
+        pressed = false;
+        event.type = held ? BUTTON_EVENT_RELEASE : BUTTON_EVENT_SHORT;
+        return true;
+      }
+      return true; // not a button edge
+    }
+
+  public:
+
+    // Call from setup() before the tasks start
+    void begin( void ) {
+      queue = xQueueCreate(ALARM_EVENT_QUEUE_LEN, sizeof(alarmEvent));
+      pinMode(ALARM_OFF_BUTTON, INPUT);
+      edgeDown = (digitalRead(ALARM_OFF_BUTTON) == LOW);
+      pressed = edgeDown;
+      held = edgeDown; // held at boot. Don't act on it.
+      attachInterruptArg(ALARM_OFF_BUTTON, buttonISR, this, CHANGE);
+    }
+
+    // From timeMgr
+    void postRing(uint16_t alarmNum) {
+      alarmEvent event;
+      event.type = ALARM_EVENT_RING;
+      event.alarmNum = alarmNum;
+      event.ms = millis();
+      if (queue == NULL || xQueueSend(queue, &event, 50) != pdTRUE) {
+        Serial.println("alarmEventQueue.postRing: Queue full. Alarm " + String(alarmNum) + " lost.");
+      }
+    }
+
+    // Alarm task only. Wait up to timeout ticks for an event. A pending hold shortens the wait.
+    bool wait(alarmEvent &event, TickType_t timeout) {
+      TickType_t start = xTaskGetTickCount();
+      for (;;) {
+        TickType_t waited = xTaskGetTickCount() - start;
+        TickType_t ticks = (waited >= timeout) ? 0 : timeout - waited;
+        bool holdPending = pressed && !held;
+        if (holdPending) {
+          uint32_t sinceDown = millis() - pressMs;
+          TickType_t untilHold = (sinceDown >= ALARM_BUTTON_TIME) ? 0 : (ALARM_BUTTON_TIME - sinceDown + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+          if (untilHold < ticks) ticks = untilHold;
+        }
+
+        if (xQueueReceive(queue, &event, ticks) == pdTRUE) {
+          if (cook(event)) return true;
+          continue;
+        }
+
+        if (holdPending && millis() - pressMs >= ALARM_BUTTON_TIME) {
+          event.alarmNum = 0;
+          event.ms = millis();
+          if (digitalRead(ALARM_OFF_BUTTON) == LOW) {
+            held = true;
+            event.type = BUTTON_EVENT_HOLD;
+          }
+          else { // the release edge was lost in a bounce
+            pressed = false;
+            edgeDown = false; // or the ISR would take the next press for a bounce
+            event.type = BUTTON_EVENT_SHORT;
+          }
+          return true;
+        }
+        if (xTaskGetTickCount() - start >= timeout) return false;
+      }
+    }
+
+    // Throw away button state and queued button events, e.g. when a ring ends so a press that
+    // started it doesn't also count afterwards. Ring events are kept.
+    void clearButton( void ) {
+      alarmEvent event;
+      UBaseType_t count = uxQueueMessagesWaiting(queue);
+      for (UBaseType_t i = 0; i < count; i++) {
+        if (xQueueReceive(queue, &event, 0) != pdTRUE) break;
+        if (event.type == ALARM_EVENT_RING) xQueueSend(queue, &event, 0);
+      }
+      pressed = (digitalRead(ALARM_OFF_BUTTON) == LOW);
+      edgeDown = pressed;
+      held = pressed; // if it's still down, wait for it to come up before it counts again
+    }
+
+    uint32_t getBounces( void ) {
+      return bounces;
+    }
+};
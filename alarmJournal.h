@@ -0,0 +1,197 @@
+// This file defines the alarmJournal class
+// An append-only record of what the alarms did: rang, snoozed, dismissed, timed out, missed.
+// Records are 16 bytes with their own CRC, kept in a fixed size file in SPIFFS that is used as a
+// ring. SPIFFS spreads the rewrites over the flash. add() only copies into a small RAM queue, so it
+// is safe on the alarm hot path. timeMgr calls flush() to write the queue out.
+// tools/journal_decode.py reads the file, or the lines dump() prints.
+
+#include "globalInclude.h"
+
+#include <SPIFFS.h>
+#include <rom/crc.h>
+
+#define JOURNAL_FILE "/journal.bin"
+#define JOURNAL_RECORDS 512 // 8KB of flash
+#define JOURNAL_PENDING 16 // records held in RAM until the next flush()
+#define JOURNAL_DUMP_MAX 32
+
+// record types
+#define JOURNAL_RANG 1 // detail is the snooze count
+#define JOURNAL_SNOOZED 2 // detail is the new snooze count
+#define JOURNAL_DISMISSED 3 // detail is the seconds it rang for
+#define JOURNAL_TIMED_OUT 4 // rang for MAX_ALARM_TIME
+#define JOURNAL_TURNED_OFF 5 // the alarm was turned off while ringing
+#define JOURNAL_MISSED 6 // more than ALARM_LATE_LIMIT late. detail is the seconds late.
+#define JOURNAL_ONSET 7 // detail is the pre-armed onset error in us (signed, clamped to 16 bits)
+
+static const char *journalTypeNames[] = {"?", "rang", "snoozed", "dismissed", "timed out", "turned off", "missed", "onset"};
+
+struct __attribute__((packed)) journalRecord {
+  uint32_t seq; // counts up forever. Finds the newest record after a restart.
+  uint32_t time; // local time
+  uint8_t type;
+  uint8_t alarm; // alarm number, 1 up
+  uint16_t detail;
+  uint32_t crc; // CRC32 of the 12 bytes above
+};
+
+class alarmJournal {
+
+  private:
+    journalRecord pending[JOURNAL_PENDING];
+    uint8_t pendingCount = 0;
+    portMUX_TYPE pendingMux = portMUX_INITIALIZER_UNLOCKED;
+    uint32_t nextSeq = 1;
+    uint16_t nextSlot = 0; // where the next record goes in the file
+    uint32_t dropped = 0; // records lost because the queue was full
+    bool ready = false;
+
+    static bool valid(const journalRecord &record) {
+      return record.seq != 0 && record.crc == crc32_le(0, (const uint8_t *)&record, sizeof(journalRecord) - sizeof(uint32_t));
+    }
+
+    // Records added before begin() found the newest seq carry on from it
+    void renumber(uint32_t firstSeq) {
+      portENTER_CRITICAL(&pendingMux);
+      nextSeq = firstSeq;
+      for (uint8_t i = 0; i < pendingCount; i++) {
+        pending[i].seq = nextSeq++;
+        pending[i].crc = crc32_le(0, (const uint8_t *)&pending[i], sizeof(journalRecord) - sizeof(uint32_t));
+      }
+      portEXIT_CRITICAL(&pendingMux);
+    }
+
+  public:
+
+    // Call once SPIFFS is mounted. Creates the file if needed and finds the newest record.
+    void begin( void ) {
+      File file = SPIFFS.open(JOURNAL_FILE, "r");
+      if (!file || file.size() != JOURNAL_RECORDS * sizeof(journalRecord)) {
+        if (file) file.close();
+        file = SPIFFS.open(JOURNAL_FILE, "w");
+        if (!file) {
+          Serial.println("alarmJournal.begin: Unable to create " + String(JOURNAL_FILE));
+          return;
+        }
+        journalRecord blank;
+        memset(&blank, 0, sizeof(blank));
+        for (uint16_t i = 0; i < JOURNAL_RECORDS; i++) {
+          file.write((const uint8_t *)&blank, sizeof(blank));
+        }
+        file.close();
+        Serial.println("alarmJournal.begin: Created " + String(JOURNAL_FILE));
+        renumber(1);
+        ready = true;
+        return;
+      }
+
+      uint32_t newest = 0;
+      uint16_t count = 0;
+      journalRecord record;
+      for (uint16_t i = 0; i < JOURNAL_RECORDS; i++) {
+        if (file.read((uint8_t *)&record, sizeof(record)) != sizeof(record)) break;
+        if (!valid(record)) continue;
+        count++;
+        if (record.seq >= newest) {
+          newest = record.seq;
+          nextSlot = (i + 1) % JOURNAL_RECORDS;
+        }
+      }
+      file.close();
+      renumber(newest + 1);
+      ready = true;
+      Serial.println("alarmJournal.begin: " + String(count) + " records, next is " + String(nextSeq));
+    }
+
+    // Any task. Just a copy into RAM.
+    void add(uint8_t type, uint16_t alarmNum, uint16_t detail) {
+      journalRecord record;
+      record.time = now();
+      record.type = type;
+      record.alarm = alarmNum;
+      record.detail = detail;
+      portENTER_CRITICAL(&pendingMux);
+      if (pendingCount < JOURNAL_PENDING) {
+        record.seq = nextSeq++;
+        record.crc = crc32_le(0, (const uint8_t *)&record, sizeof(journalRecord) - sizeof(uint32_t));
+        pending[pendingCount++] = record;
+      }
+      else {
+        dropped++;
+      }
+      portEXIT_CRITICAL(&pendingMux);
+    }
+
+    // Write any queued records to the file. One open and one write per record.
+    void flush( void ) {
+      if (!ready || pendingCount == 0) return;
+      journalRecord batch[JOURNAL_PENDING];
+      portENTER_CRITICAL(&pendingMux);
+      uint8_t count = pendingCount;
+      memcpy(batch, pending, count * sizeof(journalRecord));
+      pendingCount = 0;
+      portEXIT_CRITICAL(&pendingMux);
+
+      File file = SPIFFS.open(JOURNAL_FILE, "r+");
+      if (!file) {
+        Serial.println("alarmJournal.flush: Unable to open " + String(JOURNAL_FILE) + ". " + String(count) + " records lost.");
+        return;
+      }
+      for (uint8_t i = 0; i < count; i++) {
+        file.seek(nextSlot * sizeof(journalRecord));
+        file.write((const uint8_t *)&batch[i], sizeof(journalRecord));
+        nextSlot = (nextSlot + 1) % JOURNAL_RECORDS;
+      }
+      file.close();
+    }
+
+    // Up to n of the newest records, newest first, including any not written yet. Returns how many.
+    uint16_t last(journalRecord *out, uint16_t n) {
+      uint16_t found = 0;
+      portENTER_CRITICAL(&pendingMux);
+      for (int16_t i = pendingCount - 1; i >= 0 && found < n; i--) {
+        out[found++] = pending[i];
+      }
+      portEXIT_CRITICAL(&pendingMux);
+      if (!ready || found >= n) return found;
+
+      File file = SPIFFS.open(JOURNAL_FILE, "r");
+      if (!file) return found;
+      uint16_t slot = nextSlot;
+      for (uint16_t i = 0; i < JOURNAL_RECORDS && found < n; i++) {
+        slot = (slot + JOURNAL_RECORDS - 1) % JOURNAL_RECORDS;
+        journalRecord record;
+        file.seek(slot * sizeof(journalRecord));
+        if (file.read((uint8_t *)&record, sizeof(record)) != sizeof(record)) break;
+        if (!valid(record)) break; // reached the part never written
+        out[found++] = record;
+      }
+      file.close();
+      return found;
+    }
+
+    // Print the newest n records (up to JOURNAL_DUMP_MAX), with the raw bytes for journal_decode.py
+    void dump(uint16_t n) {
+      journalRecord records[JOURNAL_DUMP_MAX];
+      if (n > JOURNAL_DUMP_MAX) n = JOURNAL_DUMP_MAX;
+      uint16_t got = last(records, n);
+      Serial.println("alarmJournal: Newest " + String(got) + " events" + (dropped ? " (" + String(dropped) + " dropped)" : ""));
+      for (uint16_t i = 0; i < got; i++) {
+        const journalRecord &record = records[i];
+        char hex[2 * sizeof(journalRecord) + 1];
+        const uint8_t *bytes = (const uint8_t *)&record;
+        for (uint8_t b = 0; b < sizeof(journalRecord); b++) {
+          sprintf(hex + 2 * b, "%02x", bytes[b]);
+        }
+        uint8_t type = (record.type < sizeof(journalTypeNames) / sizeof(journalTypeNames[0])) ? record.type : 0;
+        char when[20];
+        sprintf(when, "%04d-%02d-%02d %02d:%02d:%02d", year(record.time), month(record.time), day(record.time),
+                hour(record.time), minute(record.time), second(record.time));
+        Serial.println("journal: " + String(hex) + " " + String(when) + " alarm " + String(record.alarm) + " " +
+                       journalTypeNames[type] + " " + String((int16_t)record.detail));
+      }
+    }
+};
+
+// The one journal. In alarmMgmt.ino.
+extern alarmJournal journal;
@@ -2,157 +2,238 @@
 
 #include "globalInclude.h"
 
-#include "AudioFileSourceSPIFFS.h"
-#include "AudioGeneratorWAV.h"
-#include "AudioOutputI2S.h"
+#include "audioPlayer.h"
 
-// #define ALARM_OFF_BUTTON 35
-#define ALARM_OFF_BUTTON 39
 #define VOLUME_POT 36
-
-#define LRCLK_PIN 26
-#define BCLK_PIN 25
-#define DOUT_PIN 33
-#define AUDIO_SHUTDOWN_PIN 32
+#define VOLUME_OVERSAMPLE 8 // ADC reads averaged per knob reading
+#define VOLUME_FILTER_SHIFT 2 // knob low pass, about 200ms at the 50ms ringAlarm loop
+#define VOLUME_POT_SCALE 1900 // pot counts per 1.0 of gain. Full scale is about 2.16 + the 0.3 base.
 
 #define MAX_ALARM_TIME 3600
+#define ALARM_SOUND_COUNT 3 // alarm1 to alarm3 in SPIFFS. Alarms past the third reuse them.
+#define ALARM_SYNTH_SOUND SYNTH_BEEPS // played if the sound file isn't in SPIFFS
+
+#define ALARM_PREARM_GRACE 5 // seconds after the ring before an armed sound nobody rang is stopped
+
+#define SLEEP_SOUND SYNTH_BROWN // hold the button with no alarm snoozed to start or stop it
+#define SLEEP_TIMER_MINUTES 45
 
-//Time in ms to wat before shutting off the alarm vs. snoozing
-#define ALARM_BUTTON_TIME 1750
+#define RING_WAIT 50 // ms ringAlarm waits for an event before checking the knob and timeout
+#define ALARM_IDLE_WAIT 200 // ms alarmMgr waits for an event before its housekeeping
 
 // =============================================
 // ================ Globals ====================
 // =============================================
-AudioGeneratorWAV *wav;
-AudioFileSourceSPIFFS *file;
-AudioOutputI2S *out;
+// the alarm sound player. Its own task does the decoding (see audioMgr).
+audioPlayer audio;
+
+// the alarm table. Built in setup() once the settings are loaded.
+alarmTable alarms;
+
+// rings and button events for the alarm task. Started in setup().
+alarmEventQueue alarmEvents;
+
+int32_t volumeKnobFiltered = 0; // filtered pot reading with 4 fraction bits
 
-// create the three alarms
-class alarmData;
-alarmData alarm1;
-alarmData alarm2;
-alarmData alarm3;
+time_t armedFire = 0; // the ring the audio is armed for, 0 if none
 
-SemaphoreHandle_t alarmSemaphore = NULL; // handle for the alarm semaphore
+// what the alarms did, kept in SPIFFS. Opened by alarmMgr, written out by timeMgr.
+alarmJournal journal;
 
 //===================================================================
-//====================== Start WAV ==================================
+//====================== Audio Manager ==============================
 //===================================================================
-void startWAV(String filename) {
-  delete file;
-  char filenameChar[31];
-  filename.toCharArray(filenameChar, 31);
-  file = new AudioFileSourceSPIFFS(filenameChar);
-  digitalWrite(AUDIO_SHUTDOWN_PIN, HIGH);
-  wav->begin(file, out);
+void audioMgr( void * parameter ) {
+
+  if ( esp_task_wdt_add(NULL) != ESP_OK) { // add task to WDT
+    Serial.println("audioMgr: Unable to add audioMgr to taskWDT!");
+  }
+
+  audio.begin();
+  Serial.printf("audioMgr: Audio Manager running\n");
+  audio.run(); // never returns
 }
 
 //===================================================================
-//====================== Ring Alarm =================================
+//====================== Volume Knob ================================
 //===================================================================
-void ringAlarm( uint8_t alarmNum ) {
+// Oversample and low pass the volume pot and return the gain it asks for in Q12 (see
+// audioGainRamp.h). The ESP32 ADC is noisy enough that the raw reading wanders by a few percent.
+// restart skips the filter so a new ring starts at the knob's current level.
+int32_t readVolumeKnob(bool restart) {
+  uint32_t sum = 0;
+  for (uint8_t i = 0; i < VOLUME_OVERSAMPLE; i++) {
+    sum += analogRead(VOLUME_POT);
+  }
+  int32_t reading = (int32_t)((sum << 4) / VOLUME_OVERSAMPLE);
+  if (restart) {
+    volumeKnobFiltered = reading;
+  }
+  else {
+    volumeKnobFiltered += (reading - volumeKnobFiltered) >> VOLUME_FILTER_SHIFT;
+  }
+  return ALARM_BASE_GAIN + ((volumeKnobFiltered * GAIN_ONE) / (VOLUME_POT_SCALE << 4));
+}
 
-  unsigned long buttonDownTime;
+//===================================================================
+//====================== Alarm Sound ================================
+//===================================================================
+// IMA-ADPCM (.ima) if it's there, otherwise the original PCM .wav. Empty for the synth.
+String alarmSoundFile(uint16_t alarmNum) {
+  String soundFile = "/alarm" + String(((alarmNum - 1) % ALARM_SOUND_COUNT) + 1);
+  if (SPIFFS.exists(soundFile + ".ima")) return soundFile + ".ima";
+  if (SPIFFS.exists(soundFile + ".wav")) return soundFile + ".wav";
+  return "";
+}
 
-  time_t alarmStartTime = now(); // Don't play the alarm for more than an hour
+//===================================================================
+//====================== Pre-arm ====================================
+//===================================================================
+// Call from alarmMgr each pass. A few seconds before the next ring the audio is started on a timer,
+// so the alarm is heard right at second :00. timeMgr's due() and ringAlarm then carry on as usual.
+void prearmAlarm( void ) {
+  time_t ts = now();
+
+  if (armedFire != 0) {
+    if (ts < armedFire && alarms.nextFireTime() != armedFire) { // changed or turned off before it rang
+      Serial.println("prearmAlarm: The next ring changed. Cancelling the armed sound.");
+      audio.stop();
+      armedFire = 0;
+    }
+    else if (ts > armedFire + ALARM_PREARM_GRACE) {
+      if (disp.getAlarmRinging() == 0 && audio.isPlaying() && alarms.firstSnoozed() == NULL) { // due() skipped it
+        Serial.println("prearmAlarm: The armed ring never rang. Stopping the sound.");
+        audio.stop();
+      }
+      armedFire = 0;
+    }
+    return;
+  }
 
-  alarmData *workAlarm;
-  if (alarmNum == 1) {
-    workAlarm = &alarm1;
+  int32_t idx = alarms.next();
+  time_t fire = alarms.nextFireTime();
+  if (idx < 0 || fire <= ts || fire - ts > ALARM_PREARM_TIME || disp.getAlarmRinging() != 0 || audio.isPlaying()) {
+    return;
   }
-  else if (alarmNum == 2) {
-    workAlarm = &alarm2;
+  alarmData *workAlarm = alarms.get(idx);
+
+  int64_t onset = clockBase.edgeMicros(fire); // the esp_timer time fire's second starts
+
+  String soundFile = alarmSoundFile(idx + 1);
+  audio.setVolume(readVolumeKnob(true));
+  audio.startAlarm(workAlarm->isSnoozed());
+  if (soundFile.length()) audio.play(soundFile, true, onset);
+  else audio.playSynth(ALARM_SYNTH_SOUND, onset);
+  armedFire = fire;
+  Serial.println("prearmAlarm: " + workAlarm->getAlarmID() + " armed to start in " + String((int32_t)((onset - esp_timer_get_time()) / 1000)) + "ms");
+}
+
+//===================================================================
+//====================== Ring Alarm =================================
+//===================================================================
+void ringAlarm( uint16_t alarmNum ) {
+
+  time_t alarmStartTime = now(); // Don't play the alarm for more than an hour
+
+  alarmData *workAlarm = alarms.get(alarmNum - 1);
+  if (workAlarm == NULL) {
+    Serial.println("ringAlarm: No alarm " + String(alarmNum) + ". Nothing to ring.");
+    disp.setAlarmRinging(0);
+    return;
   }
-  else if (alarmNum == 3) {
-    workAlarm = &alarm3;
+  String soundFile = alarmSoundFile(alarmNum);
+
+  // crescendo on the first ring, louder for every snooze after that. Unless prearmAlarm() already
+  // started it, which did the same.
+  if (!audio.isPlaying()) {
+    audio.setVolume(readVolumeKnob(true));
+    audio.startAlarm(workAlarm->isSnoozed());
   }
 
-  TickType_t xLastWakeTime;
-  const TickType_t xFrequency = 10 / portTICK_PERIOD_MS;
-  xLastWakeTime = xTaskGetTickCount();
+  journal.add(JOURNAL_RANG, alarmNum, workAlarm->isSnoozed());
+
+  alarmEvents.clearButton(); // only a press from now on counts
+  alarmEvent event;
+  bool buttonDown = false; // pressed. Waiting to see if it's a snooze or a dismiss.
+  uint32_t buttonDownTime = 0;
+  uint16_t nextRing = 0; // another alarm that came due while this one rang
   for (;;) {
     time_t ts = now();
 
+    // follow the knob. The audio task ramps to it smoothly.
+    audio.setVolume(readVolumeKnob(false));
 
-    // set the volume
-    float snoozeAdjust = (0.15 * (float)(workAlarm->isSnoozed()));
-    if (snoozeAdjust > 0.8) snoozeAdjust = 0.8;
-    float volumeIn =  (((float)analogRead(VOLUME_POT) / 1900.0) ) + 0.3 + snoozeAdjust; // allow up to a 2.46 amplification, with a minimum of 0.3 + snoozeAdjust
-    out->SetGain(volumeIn);
+    if (ts - alarmStartTime > MAX_ALARM_TIME) { // Turn off the alarm after the maximum allowable time
+      Serial.println("ringAlarm: " + workAlarm->getAlarmID() + " has timed out. Stopping alarm audio.");
+      journal.add(JOURNAL_TIMED_OUT, alarmNum, 0);
+      disp.setAlarmRinging(0);
+      audio.stop();
+      drawAlarmIndicator(false);
+      break;
+    }
 
-    if (xSemaphoreTake(ledMutex, (TickType_t) 5) == pdTRUE ) {
-      if (ts - alarmStartTime > MAX_ALARM_TIME) { // Turn off the alarm after the maximum allowable time
-        Serial.println("ringAlarm: " + workAlarm->getAlarmID() + " has timed out. Stopping alarm audio.");
+    if (!buttonDown) {
+      if (!workAlarm->isActive()) { // someone turned off the alarm directly
+        Serial.println("ringAlarm: Alarm is no longer active. Stopping audio.");
+        journal.add(JOURNAL_TURNED_OFF, alarmNum, 0);
         disp.setAlarmRinging(0);
-        wav->stop();
-        digitalWrite(AUDIO_SHUTDOWN_PIN, LOW);
-        drawAlarmIndicator(false);
-        return;
+        audio.stop();
+        ledMaster.stopFlashing(); // stop the flashing if any
+        disp.resetlastTouch(); // backlight dimming
+        break;
+      }
+      else if (!audio.isPlaying()) { // start the audio. It loops by itself until stopped.
+        if (soundFile.length()) audio.play(soundFile, true);
+        else audio.playSynth(ALARM_SYNTH_SOUND);
+        //If snoozing has been going for a while, flash the lights.
+        if (workAlarm->isSnoozed() >= 3 ) ledMaster.startFlashing();
       }
+    }
 
-      if (disp.getAlarmRinging()) {
-        if (digitalRead(ALARM_OFF_BUTTON) == LOW) { // Stop the alarm
-          Serial.println("ringAlarm: Saw Alarm Off button. Stopping alarm audio.");
-          disp.setAlarmRinging(0);
-          wav->stop();
-          digitalWrite(AUDIO_SHUTDOWN_PIN, LOW);
-          ledMaster.stopFlashing(); // stop the flashing if any
-          buttonDownTime = millis();
-          disp.resetlastTouch(); // backlight dimming
-        }
-        else if (!workAlarm->isActive()) { // someone turned off the alarm directly
-          Serial.println("ringAlarm: Alarm is no longer active. Stopping audio.");
-          disp.setAlarmRinging(0);
-          wav->stop();
-          digitalWrite(AUDIO_SHUTDOWN_PIN, LOW);
-          ledMaster.stopFlashing(); // stop the flashing if any
-          disp.resetlastTouch(); // backlight dimming
-          xSemaphoreGive(ledMutex);
-          return;
-        }
-        else if (wav->isRunning()) { // fill the buffer
-          if (!wav->loop()) wav->stop();
-        }
-        else { // restart the audio
-          startWAV("/alarm" + String(disp.getAlarmRinging()) + ".wav");
-          //If snoozing has been going for a while, flash the lights.
-          if (workAlarm->isSnoozed() >= 3 ) ledMaster.startFlashing();
-        }
+    if (alarmEvents.wait(event, RING_WAIT / portTICK_PERIOD_MS)) {
+      if (event.type == BUTTON_EVENT_PRESS && !buttonDown) { // Stop the alarm
+        Serial.println("ringAlarm: Saw Alarm Off button. Stopping alarm audio.");
+        disp.setAlarmRinging(0);
+        audio.stop();
+        ledMaster.stopFlashing(); // stop the flashing if any
+        buttonDown = true;
+        buttonDownTime = event.ms;
+        disp.resetlastTouch(); // backlight dimming
       }
-      else { // The button has been pressed, but are we snoozed or are we turning off the alarm?
-        unsigned long buttonTotalTime = millis() - buttonDownTime;
-        if (digitalRead(ALARM_OFF_BUTTON) == HIGH) { // the button has been released
-          if (buttonTotalTime < ALARM_BUTTON_TIME) { // less than 1.75 seconds and we are snoozed
-            Serial.println ("ringAlarm: Time elapsed: " + String(buttonTotalTime) + "ms");
-            Serial.println ("ringAlarm: Button released snoozing " + workAlarm->getAlarmID());
-            workAlarm->snooze();
-            xSemaphoreGive(ledMutex);
-            ledMaster.stopFlashing(); // if flashing, stop
-            return;
-          }
-        }
-        if (millis() - buttonDownTime > ALARM_BUTTON_TIME) { // over the time seconds and we discontinue the alarm
-          Serial.println ("ringAlarm: Time elapsed: " + String(buttonTotalTime) + "ms");
-          Serial.println ("ringAlarm: Button released reseting " + workAlarm->getAlarmID());
-          workAlarm->resetSnooze();
-          drawAlarmIndicator(false);
-          if (workAlarm->isSunriseActive()) { // Sunrise alarm is active
-            ledMaster.roomLightOn(); // turn room light on
-            disp.setDrawTimeSection(true);
-          }
-          xSemaphoreGive(ledMutex);
-          ledMaster.stopFlashing(); // if flashing, stop
-          return;
+      else if (event.type == BUTTON_EVENT_SHORT && buttonDown) { // less than 1.75 seconds and we are snoozed
+        Serial.println ("ringAlarm: Time elapsed: " + String(event.ms - buttonDownTime) + "ms");
+        Serial.println ("ringAlarm: Button released snoozing " + workAlarm->getAlarmID());
+        workAlarm->snooze();
+        journal.add(JOURNAL_SNOOZED, alarmNum, workAlarm->isSnoozed());
+        ledMaster.stopFlashing(); // if flashing, stop
+        break;
+      }
+      else if (event.type == BUTTON_EVENT_HOLD && buttonDown) { // held past the time and we discontinue the alarm
+        Serial.println ("ringAlarm: Button held reseting " + workAlarm->getAlarmID());
+        journal.add(JOURNAL_DISMISSED, alarmNum, now() - alarmStartTime);
+        workAlarm->dismiss();
+        workAlarm->saveAlarmData();
+        drawAlarmIndicator(false);
+        if (workAlarm->isSunriseActive()) { // Sunrise alarm is active
+          ledMaster.roomLightOn(); // turn room light on
+          disp.setDrawTimeSection(true);
         }
+        ledMaster.stopFlashing(); // if flashing, stop
+        break;
       }
-
-      if (esp_task_wdt_reset() != ESP_OK) {
-        Serial.println("ringAlarm: Unable to reset alarmMgr taskWDT!");
+      else if (event.type == ALARM_EVENT_RING && event.alarmNum != alarmNum) {
+        nextRing = event.alarmNum;
       }
-      xSemaphoreGive(ledMutex);
-      vTaskDelayUntil( &xLastWakeTime, xFrequency );
+    }
+
+    if (esp_task_wdt_reset() != ESP_OK) {
+      Serial.println("ringAlarm: Unable to reset alarmMgr taskWDT!");
     }
   }
+
+  if (nextRing != 0) { // ring it once this one is done with
+    alarmEvents.postRing(nextRing);
+  }
 }
 
 //===================================================================
@@ -160,88 +241,69 @@ void ringAlarm( uint8_t alarmNum ) {
 //===================================================================
 void alarmMgr( void * parameter ) {
 
-  alarmSemaphore = xSemaphoreCreateBinary();
-
-  pinMode(AUDIO_SHUTDOWN_PIN, OUTPUT);
-  digitalWrite(AUDIO_SHUTDOWN_PIN, LOW);
-
-  unsigned long buttonDownTime = 0;
-  unsigned long buttonTotalTime;
-  float volumeIn;
-
-  // set the alarms' internal IDs
-  alarm1.initAlarm("alarm1");
-  alarm2.initAlarm("alarm2");
-  alarm3.initAlarm("alarm3");
+  alarmEvent event;
 
   if ( esp_task_wdt_add(NULL) != ESP_OK) { // add task to WDT
     Serial.println("dispMgr: Unable to add alarmMgr to taskWDT!");
   }
 
-  pinMode(ALARM_OFF_BUTTON, INPUT);
-
   vTaskDelay(1000 / portTICK_PERIOD_MS);// let other tasks get going
   SPIFFS.begin();
+  journal.begin();
+  journal.dump(8);
   Serial.printf("alarmMgr: Alarm Manager running\n");
 
   //audioLogger = &Serial;
 
-  wav = new AudioGeneratorWAV();
-  out = new AudioOutputI2S();
-  out->SetPinout(BCLK_PIN, LRCLK_PIN, DOUT_PIN);
-
   for (;;) {
-    if ( xSemaphoreTake( alarmSemaphore, 200 ) == pdTRUE ) // reset the WDT and check buttons 5x a second
-    {
-      Serial.println("alarmMgr: we have an alarm to ring.");
-      drawAlarmIndicator(false);
-      ringAlarm(disp.getAlarmRinging());
-    }
-
-    bool buttonState = digitalRead(ALARM_OFF_BUTTON);
+    if (alarmEvents.wait(event, ALARM_IDLE_WAIT / portTICK_PERIOD_MS)) { // reset the WDT and housekeeping 5x a second
+      alarmData *workAlarm = alarms.firstSnoozed();
 
-    if (buttonState == LOW) {
-      disp.resetlastTouch(); // backlight dimming
-    }
-
-    if ((alarm1.isSnoozed() || alarm2.isSnoozed() || alarm3.isSnoozed()) && buttonState == LOW && buttonDownTime == 0) {
-      buttonDownTime = millis();
-      Serial.println("alarmMgr: Saw Alarm Off button.");
-      //disp.resetlastTouch(); // backlight dimming
-    }
-
-    if (buttonDownTime != 0) {
-      alarmData *workAlarm;
-      if (alarm1.isSnoozed()) {
-        workAlarm = &alarm1;
-      }
-      else if (alarm2.isSnoozed()) {
-        workAlarm = &alarm2;
+      if (event.type == ALARM_EVENT_RING) {
+        Serial.println("alarmMgr: we have an alarm to ring.");
+        disp.setAlarmRinging(event.alarmNum);
+        drawAlarmIndicator(false);
+        ringAlarm(event.alarmNum);
       }
-      else if (alarm3.isSnoozed()) {
-        workAlarm = &alarm3;
+      else if (event.type == BUTTON_EVENT_PRESS) {
+        disp.resetlastTouch(); // backlight dimming
+        if (workAlarm != NULL) {
+          Serial.println("alarmMgr: Saw Alarm Off button.");
+        }
       }
-
-      buttonTotalTime = millis() - buttonDownTime;
-
-      if (buttonTotalTime > ALARM_BUTTON_TIME) {
-        Serial.println ("alarmMgr: Time elapsed: " + String(buttonTotalTime) + "ms");
-        Serial.println ("alarmMgr: Button released reseting " + workAlarm->getAlarmID());
-        workAlarm->resetSnooze();
+      else if (event.type == BUTTON_EVENT_HOLD && workAlarm != NULL) {
+        Serial.println ("alarmMgr: Button held reseting " + workAlarm->getAlarmID());
+        journal.add(JOURNAL_DISMISSED, workAlarm->getSlot() + 1, 0);
+        workAlarm->dismiss();
+        workAlarm->saveAlarmData();
         drawAlarmIndicator(false);
-        buttonDownTime = 0;
         if (workAlarm->isSunriseActive()) { // Sunrise alarm is active
           ledMaster.roomLightOn(); // turn room light on
           disp.setDrawTimeSection(true);
         }
       }
-      else if (buttonState == HIGH && buttonTotalTime < ALARM_BUTTON_TIME) { // button was released early
-        Serial.println ("alarmMgr: Time elapsed: " + String(buttonTotalTime) + "ms");
+      else if (event.type == BUTTON_EVENT_HOLD) { // nothing snoozed. Start or stop the sleep sound.
+        if (audio.isSleepPlaying()) {
+          Serial.println("alarmMgr: Stopping the sleep sound.");
+          audio.stop();
+        }
+        else {
+          Serial.println("alarmMgr: Starting the sleep sound for " + String(SLEEP_TIMER_MINUTES) + " minutes.");
+          audio.setVolume(readVolumeKnob(true));
+          audio.playSleep(SLEEP_SOUND, SLEEP_TIMER_MINUTES);
+        }
+      }
+      else if (event.type == BUTTON_EVENT_SHORT && workAlarm != NULL) {
         Serial.println ("alarmMgr: Button released too early. No reset.");
-        buttonDownTime = 0;
       }
     }
 
+    prearmAlarm();
+
+    if (audio.isSleepPlaying()) { // follow the knob
+      audio.setVolume(readVolumeKnob(false));
+    }
+
     if (esp_task_wdt_reset() != ESP_OK) {
       Serial.println("alarmMgr: Unable to reset alarmMgr taskWDT!");
     }
@@ -0,0 +1,311 @@
+// This file defines the alarmTable class
+// The alarms live in a table sized from the settings store. A binary min-heap keyed on each alarm's
+// next ring time sits over it, so the next alarm is always at the top (O(1)) and an edit only has to
+// move one entry (O(log n)). Inactive alarms are kept out of the heap.
+// Other tasks keep the alarmData pointers get() hands out. The table is sized once, in begin(), and
+// an alarm is never moved or freed after that.
+
+#include "globalInclude.h"
+
+#define NO_HEAP_POS 0xFFFF
+#define ALARM_LATE_LIMIT 60 // seconds past its time that an alarm will still ring. Older ones are skipped.
+#define ALARM_DISPLAY_ROWS 3 // alarms shown on the alarm screen
+#define SUNRISE_LEAD_TIME 900 // seconds of sunrise light before a sunrise alarm rings
+#define ALARM_PREARM_TIME 4 // seconds before a ring to open the sound, power the amp and set the start timer
+
+class alarmTable {
+
+  private:
+    alarmData **table = NULL; // each alarm is allocated once and stays put
+    uint16_t count = 0;
+    uint16_t *heap = NULL; // alarm indexes, heap ordered on nextFire
+    uint16_t *heapPos = NULL; // where each alarm is in the heap, or NO_HEAP_POS
+    uint16_t heapSize = 0;
+    volatile uint32_t changeCount = 0; // bumped on every reschedule, so others can tell the schedule moved
+    SemaphoreHandle_t tableMutex = NULL;
+
+    bool before(uint16_t a, uint16_t b) { // heap order. Ties go to the lower alarm number.
+      time_t fireA = table[heap[a]]->getNextFire();
+      time_t fireB = table[heap[b]]->getNextFire();
+      return (fireA < fireB) || (fireA == fireB && heap[a] < heap[b]);
+    }
+
+    void heapSwap(uint16_t a, uint16_t b) {
+      uint16_t tmp = heap[a];
+      heap[a] = heap[b];
+      heap[b] = tmp;
+      heapPos[heap[a]] = a;
+      heapPos[heap[b]] = b;
+    }
+
+    void siftUp(uint16_t pos) {
+      while (pos > 0) {
+        uint16_t parent = (pos - 1) / 2;
+        if (!before(pos, parent)) break;
+        heapSwap(pos, parent);
+        pos = parent;
+      }
+    }
+
+    void siftDown(uint16_t pos) {
+      for (;;) {
+        uint16_t left = (2 * pos) + 1;
+        uint16_t right = left + 1;
+        uint16_t smallest = pos;
+        if (left < heapSize && before(left, smallest)) smallest = left;
+        if (right < heapSize && before(right, smallest)) smallest = right;
+        if (smallest == pos) break;
+        heapSwap(pos, smallest);
+        pos = smallest;
+      }
+    }
+
+    void heapRemove(uint16_t idx) {
+      uint16_t pos = heapPos[idx];
+      if (pos == NO_HEAP_POS) return;
+      heapSize--;
+      if (pos != heapSize) {
+        heapSwap(pos, heapSize);
+        siftDown(pos);
+        siftUp(pos);
+      }
+      heapPos[idx] = NO_HEAP_POS;
+    }
+
+    // call with the tableMutex held
+    void schedule(uint16_t idx, time_t from) {
+      changeCount++;
+      table[idx]->setNextFire(table[idx]->computeNextFire(from));
+      if (table[idx]->getNextFire() == 0) {
+        heapRemove(idx);
+      }
+      else if (heapPos[idx] == NO_HEAP_POS) {
+        heap[heapSize] = idx;
+        heapPos[idx] = heapSize;
+        heapSize++;
+        siftUp(heapSize - 1);
+      }
+      else {
+        siftDown(heapPos[idx]);
+        siftUp(heapPos[idx]);
+      }
+    }
+
+    // The alarms come in one block. Once only, from begin().
+    void allocate(uint16_t size) {
+      alarmData *block = new alarmData[size];
+      table = new alarmData*[size];
+      heap = new uint16_t[size];
+      heapPos = new uint16_t[size];
+      for (uint16_t i = 0; i < size; i++) {
+        table[i] = &block[i];
+        heapPos[i] = NO_HEAP_POS;
+      }
+      count = size;
+      heapSize = 0;
+    }
+
+  public:
+
+    // Build the table from the settings store. Call once, after settings.begin().
+    void begin( void ) {
+      if (tableMutex != NULL) return;
+      tableMutex = xSemaphoreCreateMutex();
+      allocate(settings.getAlarmCount());
+      for (uint16_t i = 0; i < count; i++) {
+        table[i]->initAlarm("alarm" + String(i + 1), i);
+        table[i]->setOwner(this);
+      }
+      rebuild(now());
+      Serial.println("alarmTable.begin: " + String(count) + " alarms, " + String(heapSize) + " scheduled.");
+    }
+
+    uint16_t size( void ) {
+      return count;
+    }
+
+    // The pointer stays good for as long as the clock runs
+    alarmData* get(uint16_t idx) {
+      alarmData *workAlarm = NULL;
+      xSemaphoreTake(tableMutex, portMAX_DELAY); // only ever held briefly
+      if (idx < count) workAlarm = table[idx];
+      xSemaphoreGive(tableMutex);
+      return workAlarm;
+    }
+
+    // Re-schedule one alarm after it has changed. O(log n).
+    void update(uint16_t idx) {
+      if (idx >= count || tableMutex == NULL) return;
+      if (xSemaphoreTake(tableMutex, (TickType_t) 50) == pdTRUE ) {
+        schedule(idx, now() + 1); // an alarm edited to this minute waits for the next one, like the old minute test
+        xSemaphoreGive(tableMutex);
+      }
+      else {
+        Serial.println("alarmTable.update: Unable to get the tableMutex. Alarm " + String(idx + 1) + " not rescheduled!");
+      }
+    }
+
+    // Re-schedule every alarm from the given time, then heapify. O(n).
+    void rebuild(time_t from) {
+      if (xSemaphoreTake(tableMutex, (TickType_t) 100) == pdTRUE ) {
+        changeCount++;
+        heapSize = 0;
+        for (uint16_t i = 0; i < count; i++) {
+          table[i]->setNextFire(table[i]->computeNextFire(from));
+          if (table[i]->getNextFire() != 0) {
+            heap[heapSize] = i;
+            heapPos[i] = heapSize;
+            heapSize++;
+          }
+          else {
+            heapPos[i] = NO_HEAP_POS;
+          }
+        }
+        for (int32_t pos = (heapSize / 2) - 1; pos >= 0; pos--) {
+          siftDown(pos);
+        }
+        xSemaphoreGive(tableMutex);
+      }
+      else {
+        Serial.println("alarmTable.rebuild: Unable to get the tableMutex.");
+      }
+    }
+
+    // The alarm that rings next, or -1 if none are scheduled. O(1).
+    int32_t next( void ) {
+      int32_t idx = -1;
+      if (xSemaphoreTake(tableMutex, (TickType_t) 50) == pdTRUE ) {
+        if (heapSize) idx = heap[0];
+        xSemaphoreGive(tableMutex);
+      }
+      return idx;
+    }
+
+    // When the next alarm rings (local time), or 0 if none are scheduled. O(1).
+    time_t nextFireTime( void ) {
+      time_t fire = 0;
+      if (xSemaphoreTake(tableMutex, (TickType_t) 50) == pdTRUE ) {
+        if (heapSize) fire = table[heap[0]]->getNextFire();
+        xSemaphoreGive(tableMutex);
+      }
+      return fire;
+    }
+
+    uint32_t getChangeCount( void ) {
+      return changeCount;
+    }
+
+    // When the next sunrise light should start after ts (local time), or 0 if no sunrise alarms are due.
+    // Lights already going are left out, so one can't hide a later start.
+    // This one walks the table, so call it when getChangeCount() moves rather than every tick.
+    time_t nextSunriseStart(time_t ts) {
+      time_t best = 0;
+      if (xSemaphoreTake(tableMutex, (TickType_t) 100) != pdTRUE ) {
+        Serial.println("alarmTable.nextSunriseStart: Unable to get the tableMutex.");
+        return 0;
+      }
+      for (uint16_t i = 0; i < count; i++) {
+        alarmData *workAlarm = table[i];
+        time_t fire = workAlarm->getNextFire();
+        if (fire == 0 || fire - SUNRISE_LEAD_TIME <= ts || !workAlarm->isSunriseActive()) {
+          continue;
+        }
+        if (best == 0 || fire - SUNRISE_LEAD_TIME < best) {
+          best = fire - SUNRISE_LEAD_TIME;
+        }
+      }
+      xSemaphoreGive(tableMutex);
+      return best;
+    }
+
+    time_t getNextFire(uint16_t idx) {
+      alarmData *workAlarm = get(idx);
+      return workAlarm ? workAlarm->getNextFire() : 0;
+    }
+
+    // Call when the clock has been stepped. Forward steps need nothing, due() rings anything up to
+    // ALARM_LATE_LIMIT late and skips the rest. A step back (including leaving DST) of more than that
+    // re-derives every alarm from the new time so none are left keyed too far ahead.
+    void timeChanged(time_t previous, time_t ts) {
+      if (ts + ALARM_LATE_LIMIT < previous) {
+        Serial.println("alarmTable.timeChanged: Clock went back " + String((uint32_t)(previous - ts)) + "s. Rescheduling alarms.");
+        rebuild(ts);
+      }
+    }
+
+    // Returns the index of an alarm that should ring now, or -1. Stale rings are rescheduled on the
+    // way.
+    int32_t due(time_t ts) {
+      for (;;) {
+        uint16_t idx;
+        alarmData *workAlarm;
+        time_t fireTime = 0;
+        if (xSemaphoreTake(tableMutex, (TickType_t) 50) == pdTRUE ) {
+          if (heapSize) {
+            idx = heap[0];
+            workAlarm = table[idx];
+            fireTime = workAlarm->getNextFire();
+          }
+          xSemaphoreGive(tableMutex);
+        }
+        if (fireTime == 0 || fireTime > ts) {
+          return -1;
+        }
+
+        if (ts - fireTime > ALARM_LATE_LIMIT) {
+          Serial.println("alarmTable.due: " + workAlarm->getAlarmID() + " was due " + String((uint32_t)(ts - fireTime)) + "s ago. Skipping it.");
+          journal.add(JOURNAL_MISSED, idx + 1, (ts - fireTime > 0xFFFF) ? 0xFFFF : (uint16_t)(ts - fireTime));
+          reschedule(idx, ts);
+        }
+        else {
+          reschedule(idx, fireTime + 60); // ring once per minute at most
+          return idx;
+        }
+      }
+    }
+
+    // Move an alarm to its next ring after from
+    void reschedule(uint16_t idx, time_t from) {
+      if (xSemaphoreTake(tableMutex, (TickType_t) 50) == pdTRUE ) {
+        schedule(idx, from);
+        xSemaphoreGive(tableMutex);
+      }
+      else {
+        Serial.println("alarmTable.reschedule: Unable to get the tableMutex.");
+      }
+    }
+
+    bool anyActive( void ) {
+      bool active = false;
+      xSemaphoreTake(tableMutex, portMAX_DELAY);
+      for (uint16_t i = 0; i < count && !active; i++) {
+        active = table[i]->isActive();
+      }
+      xSemaphoreGive(tableMutex);
+      return active;
+    }
+
+    // The first snoozed alarm, or NULL
+    alarmData* firstSnoozed( void ) {
+      alarmData *snoozed = NULL;
+      xSemaphoreTake(tableMutex, portMAX_DELAY);
+      for (uint16_t i = 0; i < count && snoozed == NULL; i++) {
+        if (table[i]->isSnoozed()) snoozed = table[i];
+      }
+      xSemaphoreGive(tableMutex);
+      return snoozed;
+    }
+
+    void saveAll( void ) {
+      for (uint16_t i = 0; i < count; i++) {
+        alarmData *workAlarm = get(i);
+        if (workAlarm) workAlarm->saveAlarmData();
+      }
+    }
+};
+
+void alarmData::notifyChanged( void ) {
+  if (owner) {
+    owner->update(slot);
+  }
+}
@@ -0,0 +1,221 @@
+// This file defines AudioGeneratorADPCM
+// An ESP8266Audio generator for IMA-ADPCM WAV files (format 0x11, mono, 4 bit). It decodes one
+// block at a time into a small sample buffer and feeds the output just like AudioGeneratorWAV, but
+// reads a quarter of the flash for the same audio. Make the files with tools/wav2ima.py.
+
+#include "globalInclude.h"
+
+#include "AudioGenerator.h"
+
+#define ADPCM_FORMAT_IMA 0x11
+#define ADPCM_MAX_BLOCK 2048
+
+static const int16_t imaStepTable[89] = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+  337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+  2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+  15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t imaIndexTable[16] = {
+  -1, -1, -1, -1, 2, 4, 6, 8,
+  -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+class AudioGeneratorADPCM : public AudioGenerator {
+
+  private:
+    uint8_t *block = NULL;
+    int16_t *samples = NULL;
+    uint16_t blockAlign = 0;
+    uint16_t samplesPerBlock = 0;
+    uint16_t sampleCount = 0; // decoded samples waiting in samples[]
+    uint16_t sampleIdx = 0;
+    uint32_t dataRemaining = 0;
+    uint32_t sampleRate = 0;
+
+    // stats for the current file
+    uint32_t decodeMicros = 0;
+    uint32_t samplesDecoded = 0;
+    uint32_t bytesRead = 0;
+
+    bool readBytes(void *data, uint32_t len) {
+      return file->read(data, len) == len;
+    }
+
+    bool readU32(uint32_t &val) {
+      uint8_t b[4];
+      if (!readBytes(b, 4)) return false;
+      val = b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24);
+      return true;
+    }
+
+    // Walk the RIFF chunks, check the fmt chunk, and stop at the start of the data
+    bool readHeader( void ) {
+      uint32_t id, size;
+      if (!readU32(id) || id != 0x46464952) return false; // "RIFF"
+      if (!readU32(size)) return false;
+      if (!readU32(id) || id != 0x45564157) return false; // "WAVE"
+
+      bool haveFormat = false;
+      for (;;) {
+        if (!readU32(id) || !readU32(size)) return false;
+        if (id == 0x20746d66) { // "fmt "
+          uint8_t fmt[20];
+          if (size < 20 || !readBytes(fmt, 20)) return false;
+          uint16_t formatTag = fmt[0] | (fmt[1] << 8);
+          uint16_t channels = fmt[2] | (fmt[3] << 8);
+          sampleRate = fmt[4] | (fmt[5] << 8) | (fmt[6] << 16) | ((uint32_t)fmt[7] << 24);
+          blockAlign = fmt[12] | (fmt[13] << 8);
+          uint16_t bits = fmt[14] | (fmt[15] << 8);
+          samplesPerBlock = fmt[18] | (fmt[19] << 8);
+          if (formatTag != ADPCM_FORMAT_IMA || channels != 1 || bits != 4 || blockAlign < 5 || blockAlign > ADPCM_MAX_BLOCK ||
+              samplesPerBlock != ((blockAlign - 4) * 2) + 1) {
+            Serial.println("AudioGeneratorADPCM: Not a mono 4 bit IMA-ADPCM file.");
+            return false;
+          }
+          haveFormat = true;
+          if (!file->seek((size - 20) + (size & 1), SEEK_CUR)) return false;
+        }
+        else if (id == 0x61746164) { // "data"
+          dataRemaining = size;
+          return haveFormat;
+        }
+        else if (!file->seek(size + (size & 1), SEEK_CUR)) { // chunks are padded to even lengths
+          return false;
+        }
+      }
+    }
+
+    // Read and decode the next block. Returns false at the end of the data.
+    bool decodeBlock( void ) {
+      uint32_t len = (dataRemaining < blockAlign) ? dataRemaining : blockAlign;
+      if (len < 4) return false;
+      uint32_t got = 0;
+      while (got < len) { // sources like the ring buffer can hand back less than asked
+        uint32_t part = file->read(block + got, len - got);
+        if (part == 0) break;
+        got += part;
+      }
+      bytesRead += got;
+      dataRemaining = (got < len) ? 0 : dataRemaining - got; // a short read is the end of the file
+      if (got < 4) return false;
+
+      unsigned long startTime = micros();
+      int32_t predictor = (int16_t)(block[0] | (block[1] << 8));
+      int32_t index = block[2];
+      if (index > 88) index = 88;
+      samples[0] = predictor;
+      uint16_t n = 1;
+
+      for (uint32_t i = 4; i < got; i++) {
+        uint8_t nibbles = block[i];
+        for (uint8_t half = 0; half < 2; half++) { // low nibble first
+          uint8_t code = half ? (nibbles >> 4) : (nibbles & 0x0F);
+          int32_t step = imaStepTable[index];
+          int32_t diff = step >> 3;
+          if (code & 4) diff += step;
+          if (code & 2) diff += step >> 1;
+          if (code & 1) diff += step >> 2;
+          if (code & 8) predictor -= diff;
+          else predictor += diff;
+          if (predictor > 32767) predictor = 32767;
+          else if (predictor < -32768) predictor = -32768;
+          index += imaIndexTable[code];
+          if (index < 0) index = 0;
+          else if (index > 88) index = 88;
+          samples[n++] = predictor;
+        }
+      }
+      sampleCount = n;
+      sampleIdx = 0;
+      samplesDecoded += n;
+      decodeMicros += micros() - startTime;
+      return true;
+    }
+
+  public:
+
+    AudioGeneratorADPCM() {
+      running = false;
+      block = new uint8_t[ADPCM_MAX_BLOCK];
+      samples = new int16_t[((ADPCM_MAX_BLOCK - 4) * 2) + 1];
+    }
+
+    virtual ~AudioGeneratorADPCM() override {
+      delete[] block;
+      delete[] samples;
+    }
+
+    virtual bool begin(AudioFileSource *source, AudioOutput *output) override {
+      if (!source || !output) return false;
+      file = source;
+      this->output = output;
+      running = false;
+      sampleCount = 0;
+      sampleIdx = 0;
+      lastSample[AudioOutput::LEFTCHANNEL] = 0;
+      lastSample[AudioOutput::RIGHTCHANNEL] = 0;
+      decodeMicros = 0;
+      samplesDecoded = 0;
+      bytesRead = 0;
+
+      if (!file->isOpen() || !readHeader()) {
+        Serial.println("AudioGeneratorADPCM.begin: Unable to read the file header.");
+        return false;
+      }
+      output->SetRate(sampleRate);
+      output->SetBitsPerSample(16);
+      output->SetChannels(1);
+      if (!output->begin()) return false;
+      running = true;
+      return true;
+    }
+
+    // Push samples until the output is full, same as AudioGeneratorWAV
+    virtual bool loop() override {
+      if (running) {
+        if (output->ConsumeSample(lastSample)) { // the sample held over from last time went in
+          do {
+            if (sampleIdx >= sampleCount && !decodeBlock()) {
+              stop();
+              break;
+            }
+            lastSample[AudioOutput::LEFTCHANNEL] = samples[sampleIdx];
+            lastSample[AudioOutput::RIGHTCHANNEL] = samples[sampleIdx];
+            sampleIdx++;
+          } while (output->ConsumeSample(lastSample));
+        }
+      }
+      file->loop();
+      output->loop();
+      return running;
+    }
+
+    virtual bool stop() override {
+      if (!running) return true;
+      running = false;
+      output->stop();
+      return true;
+    }
+
+    virtual bool isRunning() override {
+      return running;
+    }
+
+    uint32_t getSampleRate( void ) {
+      return sampleRate;
+    }
+
+    // Decode cost and flash traffic, both per second of audio played
+    uint32_t decodeMicrosPerSecond( void ) {
+      if (samplesDecoded == 0) return 0;
+      return (uint32_t)(((uint64_t)decodeMicros * sampleRate) / samplesDecoded);
+    }
+
+    uint32_t bytesPerSecond( void ) {
+      if (samplesDecoded == 0) return 0;
+      return (uint32_t)(((uint64_t)bytesRead * sampleRate) / samplesDecoded);
+    }
+};
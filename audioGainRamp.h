@@ -0,0 +1,237 @@
+// This file defines AudioOutputGainRamp
+// An ESP8266Audio output filter that sits between the generator and AudioOutputI2S and applies
+// the alarm volume to every sample in fixed point. The gain is the volume knob level, plus a boost
+// for each snooze, times a crescendo that rises over the first ALARM_CRESCENDO_TIME seconds. Every
+// change is smoothed per sample, so a knob twitch or a snooze step never clicks.
+// The knob itself is read and filtered by alarmMgr, off the audio path. This only sees the result.
+// It's also what makes looping gapless. With setLoopHold(true) a generator stopping at the end of
+// its file doesn't stop I2S, so it can begin() again straight away, and the time between the last
+// sample of one pass and the first of the next is measured.
+
+#include "globalInclude.h"
+
+#include "AudioOutput.h"
+
+#define GAIN_ONE 4096 // Q12 unity gain
+#define GAIN_MAX (4 * GAIN_ONE - 1)
+#define GAIN_SMOOTH_SHIFT 7 // one pole smoothing per sample, ~6ms at 22kHz
+#define GAIN_TARGET_INTERVAL 64 // samples between crescendo target updates
+
+#define ALARM_BASE_GAIN 1229 // 0.3 in Q12. The quietest the alarm can be set.
+#define ALARM_SNOOZE_STEP 614 // 0.15 in Q12 added for each snooze
+#define ALARM_SNOOZE_MAX 3277 // 0.8 in Q12 maximum snooze boost
+#define ALARM_CRESCENDO_TIME 20 // seconds to go from the start level to full volume
+#define ALARM_CRESCENDO_START 1024 // 0.25 in Q12 of the full gain to start at
+
+class AudioOutputGainRamp : public AudioOutput {
+
+  private:
+    AudioOutput *sink;
+    volatile int32_t knobGain = GAIN_ONE; // Q12, set from alarmMgr
+    volatile uint8_t snoozeCount = 0;
+    volatile bool crescendoRestart = false;
+    volatile uint16_t crescendoTime = ALARM_CRESCENDO_TIME; // seconds for the next crescendo
+    uint32_t crescendoSamples = 0; // samples since the crescendo started
+    uint32_t crescendoLength = 0; // samples the crescendo lasts, 0 when it's done
+    int32_t targetGain = 0; // Q12
+    int32_t smoothGain = 0; // Q20, so the per sample step keeps its resolution
+    uint16_t untilTarget = 0;
+
+    // looping
+    bool loopHold = false;
+    bool held = false; // a stop() was held back, the sink is still running
+    bool loopStarting = false; // waiting for the first real sample of the next pass
+    bool dropNext = false; // the sample a generator repeats after begin()
+    unsigned long loopEndMicros = 0;
+
+    void updateTarget( void ) {
+      int32_t boost = snoozeCount * ALARM_SNOOZE_STEP;
+      if (boost > ALARM_SNOOZE_MAX) boost = ALARM_SNOOZE_MAX;
+      int32_t gain = knobGain + boost;
+
+      if (crescendoLength) {
+        if (crescendoSamples >= crescendoLength) {
+          crescendoLength = 0;
+        }
+        else { // start level + (1 - start level) * elapsed / length, all Q12
+          int32_t ramp = ALARM_CRESCENDO_START + (int32_t)(((uint64_t)(GAIN_ONE - ALARM_CRESCENDO_START) * crescendoSamples) / crescendoLength);
+          gain = (gain * ramp) >> 12;
+        }
+      }
+      if (gain > GAIN_MAX) gain = GAIN_MAX;
+      targetGain = gain;
+    }
+
+  public:
+
+    AudioOutputGainRamp(AudioOutput *out) {
+      sink = out;
+    }
+
+    virtual bool SetRate(int hz) override {
+      if (held && hz == hertz) return true; // don't touch the running I2S clock
+      hertz = hz;
+      return sink->SetRate(hz);
+    }
+
+    virtual bool SetBitsPerSample(int bits) override {
+      return sink->SetBitsPerSample(bits);
+    }
+
+    virtual bool SetChannels(int chan) override {
+      return sink->SetChannels(chan);
+    }
+
+    // The plain float gain goes to the sink as usual. The ramp is on top of that.
+    virtual bool SetGain(float f) override {
+      return sink->SetGain(f);
+    }
+
+    virtual bool begin() override {
+      if (crescendoRestart) {
+        crescendoRestart = false;
+        crescendoSamples = 0;
+        crescendoLength = (uint32_t)hertz * crescendoTime;
+        updateTarget();
+        smoothGain = targetGain << 8; // no ramp from zero at the start of the alarm
+      }
+      untilTarget = 0;
+      if (held) { // the next pass of a loop. The sink never stopped.
+        held = false;
+        loopStarting = true;
+        dropNext = true;
+        return true;
+      }
+      return sink->begin();
+    }
+
+    virtual bool ConsumeSample(int16_t sample[2]) override {
+      if (dropNext) { // generators hand over their last (or a zero) sample first after begin()
+        dropNext = false;
+        return true;
+      }
+      if (untilTarget == 0) {
+        updateTarget();
+        untilTarget = GAIN_TARGET_INTERVAL;
+      }
+      int32_t gain = smoothGain >> 8;
+      int32_t left = (sample[LEFTCHANNEL] * gain) >> 12;
+      int32_t right = (sample[RIGHTCHANNEL] * gain) >> 12;
+      if (left > 32767) left = 32767;
+      else if (left < -32768) left = -32768;
+      if (right > 32767) right = 32767;
+      else if (right < -32768) right = -32768;
+
+      int16_t out[2] = {(int16_t)left, (int16_t)right};
+      if (!sink->ConsumeSample(out)) {
+        return false; // the generator will offer this sample again, so don't advance
+      }
+      if (loopStarting) {
+        loopStarting = false;
+        lastGapMicros = micros() - loopEndMicros;
+        lastGapSamples = (uint32_t)(((uint64_t)lastGapMicros * hertz) / 1000000);
+        if (lastGapSamples > maxGapSamples) maxGapSamples = lastGapSamples;
+        loopCount++;
+      }
+      smoothGain += ((targetGain << 8) - smoothGain) >> GAIN_SMOOTH_SHIFT;
+      if (crescendoLength) crescendoSamples++;
+      untilTarget--;
+      return true;
+    }
+
+    virtual bool stop() override {
+      if (loopHold) {
+        held = true;
+        loopEndMicros = micros();
+        return true;
+      }
+      return sink->stop();
+    }
+
+    virtual void flush() override {
+      sink->flush();
+    }
+
+    virtual bool loop() override {
+      return sink->loop();
+    }
+
+    // ===== Looping. Audio task only. =====
+    uint32_t loopCount = 0;
+    uint32_t lastGapMicros = 0;
+    uint32_t lastGapSamples = 0;
+    uint32_t maxGapSamples = 0;
+
+    // While set, stop() leaves the sink running for the next pass
+    void setLoopHold(bool hold) {
+      loopHold = hold;
+      loopCount = 0;
+      maxGapSamples = 0;
+    }
+
+    // Stop holding, and stop the sink if a stop() was held back
+    void release( void ) {
+      loopHold = false;
+      loopStarting = false;
+      dropNext = false;
+      if (held) {
+        held = false;
+        sink->stop();
+      }
+    }
+
+    // ===== Called from other tasks =====
+    // Knob level in Q12 (ALARM_BASE_GAIN and up)
+    void setKnobGain(int32_t gain) {
+      knobGain = gain;
+    }
+
+    void setSnoozeCount(uint8_t count) {
+      snoozeCount = count;
+    }
+
+    // Start a crescendo of the given seconds (0 for none) when the next sound begins
+    void restartCrescendo(uint16_t seconds) {
+      crescendoTime = seconds;
+      crescendoRestart = true;
+    }
+
+    int32_t getGain( void ) {
+      return smoothGain >> 8;
+    }
+
+    int getRate( void ) {
+      return hertz;
+    }
+
+    // Push 1 KB of samples (256 stereo frames) through the gain stage into a sink that takes
+    // everything, and return the average time per 1 KB in us.
+    static uint32_t benchmark(uint16_t passes) {
+      class nullOutput : public AudioOutput {
+        public:
+          virtual bool ConsumeSample(int16_t sample[2]) override {
+            lastSum += sample[0] + sample[1];
+            return true;
+          }
+          int32_t lastSum = 0;
+      } nullSink;
+
+      AudioOutputGainRamp ramp(&nullSink);
+      ramp.SetRate(22050);
+      ramp.setKnobGain(GAIN_ONE * 2);
+      ramp.setSnoozeCount(2);
+      ramp.restartCrescendo(ALARM_CRESCENDO_TIME);
+      ramp.begin();
+
+      int16_t frame[2];
+      unsigned long startTime = micros();
+      for (uint16_t p = 0; p < passes; p++) {
+        for (int16_t i = 0; i < 256; i++) {
+          frame[0] = i * 97;
+          frame[1] = -i * 97;
+          ramp.ConsumeSample(frame);
+        }
+      }
+      return (micros() - startTime) / passes;
+    }
+};
@@ -0,0 +1,593 @@
+// This file defines the audio player used for the alarm sounds
+// A dedicated task owns the decoder and I2S output. It reads the sound file into a RAM ring buffer
+// ahead of the decoder, so a slow SPIFFS read or another task holding a mutex can't starve the
+// I2S DMA. Other tasks only talk to it through a command queue and a couple of volatile values.
+// Samples pass through AudioOutputGainRamp on their way to I2S, which does the alarm volume.
+// Plain PCM .wav files and IMA-ADPCM .ima files (see tools/wav2ima.py) are both played, as well
+// as the synthesised sounds in audioSynth.h. While a sleep sound plays the task drops to
+// AUDIO_SLEEP_PRIORITY, so hours of noise never get ahead of timeMgr or the LED tasks.
+// A play can be armed ahead of time: the file is opened and buffered, the amp powered and I2S kept
+// full of silence, then an esp_timer starts it so the first sample is heard at the given time.
+
+#include "globalInclude.h"
+
+#include <esp_timer.h>
+#include "AudioFileSource.h"
+#include "AudioFileSourceSPIFFS.h"
+#include "AudioGeneratorWAV.h"
+#include "AudioOutputI2S.h"
+#include "audioAdpcm.h"
+#include "audioGainRamp.h"
+#include "audioSynth.h"
+
+#define LRCLK_PIN 26
+#define BCLK_PIN 25
+#define DOUT_PIN 33
+#define AUDIO_SHUTDOWN_PIN 32
+
+#define AUDIO_RING_SIZE 16384 // bytes read ahead. About 0.37s of 22kHz 16 bit mono.
+#define AUDIO_REFILL_CHUNK 2048 // SPIFFS read size. Reads are only done when this much space is free.
+#define AUDIO_TASK_PERIOD 2 // ms between decoder passes while playing
+#define AUDIO_IDLE_WAIT 200 // ms to wait for a command while idle (also the WDT reset rate)
+#define AUDIO_FILENAME_LEN 31
+#define AUDIO_ALARM_PRIORITY 6 // the audioMgr task priority in setup()
+#define AUDIO_SLEEP_PRIORITY 1 // same as timeMgr and ledMgr, so it only gets its share
+#define AUDIO_SLEEP_FADE_IN 10 // seconds
+#define AUDIO_SLEEP_MAX_MINUTES 600
+#define AUDIO_STATS_INTERVAL 600000 // ms between stats while a sleep sound plays
+#define AUDIO_DMA_FRAMES 512 // AudioOutputI2S default, 8 DMA buffers of 64. A loop gap shorter than this is never heard.
+
+// ================================
+// ===== Ring Buffer Source =======
+// ================================
+// An AudioFileSource that serves the decoder from RAM and is topped up from the file by refill().
+// Only the audio task uses it, so it needs no locking.
+// With setLoop(true), refill() carries on from the start of the file once it reaches the end, so
+// the next pass is already in RAM. read() stops at the end of the file as usual, and seek(0) then
+// jumps straight to the buffered start instead of going back to SPIFFS. AudioGeneratorWAV closes
+// its source when it stops at the end of the file, so close() leaves everything alone while looping.
+class audioRingSource : public AudioFileSource {
+
+  private:
+    AudioFileSourceSPIFFS file;
+    uint8_t *ring = NULL;
+    uint32_t readIdx = 0;
+    uint32_t writeIdx = 0;
+    uint32_t fill = 0;
+    uint32_t pos = 0; // position in the file of the next byte read() hands out
+    bool fileEnd = false;
+    bool looping = false;
+    bool wrapPending = false; // the ring holds the end of this pass and then the start of the next
+    uint32_t beforeWrap = 0; // bytes in the ring before the start of the next pass
+
+    void reset( void ) {
+      readIdx = 0;
+      writeIdx = 0;
+      fill = 0;
+      pos = 0;
+      fileEnd = false;
+      wrapPending = false;
+      beforeWrap = 0;
+    }
+
+  public:
+    uint32_t underruns = 0; // reads that came up short before the end of the file
+    uint32_t refills = 0;
+    uint32_t refillMicrosMax = 0;
+    uint32_t minFill = AUDIO_RING_SIZE; // low water mark while playing
+
+    audioRingSource() {
+      ring = new uint8_t[AUDIO_RING_SIZE];
+    }
+
+    virtual ~audioRingSource() override {
+      delete[] ring;
+    }
+
+    virtual bool open(const char *filename) override {
+      file.close();
+      reset();
+      if (!file.open(filename)) {
+        Serial.println("audioRingSource.open: Unable to open " + String(filename));
+        return false;
+      }
+      while (refill()) {} // start with a full buffer
+      return true;
+    }
+
+    void setLoop(bool loop) {
+      looping = loop;
+    }
+
+    // Read one chunk from the file if there is room. Returns true if anything was read.
+    bool refill( void ) {
+      if (fileEnd && looping && !wrapPending && file.seek(0, SEEK_SET)) { // prime the next pass
+        fileEnd = false;
+        wrapPending = true;
+        beforeWrap = fill;
+      }
+      if (fileEnd || !file.isOpen() || (AUDIO_RING_SIZE - fill) < AUDIO_REFILL_CHUNK) {
+        return false;
+      }
+      unsigned long startTime = micros();
+      uint32_t want = AUDIO_REFILL_CHUNK;
+      uint32_t toEnd = AUDIO_RING_SIZE - writeIdx;
+      uint32_t got = file.read(ring + writeIdx, (want < toEnd) ? want : toEnd);
+      if (got == toEnd && want > toEnd) { // wrapped
+        got += file.read(ring, want - toEnd);
+      }
+      writeIdx = (writeIdx + got) % AUDIO_RING_SIZE;
+      fill += got;
+      if (got < want) {
+        fileEnd = true;
+      }
+      refills++;
+      uint32_t elapsed = micros() - startTime;
+      if (elapsed > refillMicrosMax) refillMicrosMax = elapsed;
+      return got > 0;
+    }
+
+    virtual uint32_t read(void *data, uint32_t len) override {
+      uint32_t avail = wrapPending ? beforeWrap : fill; // never hand out the next pass early
+      uint32_t n = (len < avail) ? len : avail;
+      uint32_t toEnd = AUDIO_RING_SIZE - readIdx;
+      uint8_t *dest = (uint8_t *)data;
+      if (n <= toEnd) {
+        memcpy(dest, ring + readIdx, n);
+      }
+      else {
+        memcpy(dest, ring + readIdx, toEnd);
+        memcpy(dest + toEnd, ring, n - toEnd);
+      }
+      readIdx = (readIdx + n) % AUDIO_RING_SIZE;
+      fill -= n;
+      pos += n;
+      if (wrapPending) beforeWrap -= n;
+      if (n < len && !fileEnd && !wrapPending) {
+        underruns++;
+      }
+      if (fill < minFill) minFill = fill;
+      return n;
+    }
+
+    virtual bool seek(int32_t newPos, int dir) override {
+      if (dir == SEEK_CUR) newPos += pos;
+      else if (dir == SEEK_END) newPos += file.getSize();
+      if (newPos < 0) return false;
+
+      if (wrapPending && newPos == 0) { // back to the start of the file, which is already buffered
+        readIdx = (readIdx + beforeWrap) % AUDIO_RING_SIZE;
+        fill -= beforeWrap;
+        pos = 0;
+        wrapPending = false;
+        beforeWrap = 0;
+        return true;
+      }
+      uint32_t ahead = wrapPending ? beforeWrap : fill;
+      if ((uint32_t)newPos >= pos && (uint32_t)newPos - pos <= ahead) { // already buffered, skip ahead
+        uint32_t skip = newPos - pos;
+        readIdx = (readIdx + skip) % AUDIO_RING_SIZE;
+        fill -= skip;
+        pos = newPos;
+        if (wrapPending) beforeWrap -= skip;
+        return true;
+      }
+      if (!file.seek(newPos, SEEK_SET)) return false; // anything else drops the buffer
+      readIdx = 0;
+      writeIdx = 0;
+      fill = 0;
+      pos = newPos;
+      fileEnd = false;
+      wrapPending = false;
+      beforeWrap = 0;
+      refill();
+      return true;
+    }
+
+    virtual bool close() override {
+      if (looping) return true; // the generator finished a pass, the next one is in the ring
+      reset();
+      return file.close();
+    }
+
+    virtual bool isOpen() override {
+      return file.isOpen();
+    }
+
+    virtual uint32_t getSize() override {
+      return file.getSize();
+    }
+
+    virtual uint32_t getPos() override {
+      return pos;
+    }
+
+    uint32_t getFill( void ) {
+      return fill;
+    }
+
+    void resetStats( void ) {
+      underruns = 0;
+      refills = 0;
+      refillMicrosMax = 0;
+      minFill = AUDIO_RING_SIZE;
+    }
+};
+
+// ================================
+// ===== Audio Player =============
+// ================================
+#define AUDIO_CMD_PLAY 1
+#define AUDIO_CMD_STOP 2
+#define AUDIO_CMD_SYNTH 3
+
+struct audioCommand {
+  uint8_t cmd;
+  char filename[AUDIO_FILENAME_LEN];
+  uint8_t sound; // AUDIO_CMD_SYNTH only
+  uint16_t minutes; // sleep timer, 0 for none
+  bool sleep; // a sleep sound rather than an alarm
+  bool loop; // AUDIO_CMD_PLAY only. Play the file over and over with no gap.
+  int64_t startAt; // esp_timer time the first sample should be heard, 0 to start now
+};
+
+class audioPlayer {
+
+  private:
+    AudioGeneratorWAV *wav = NULL;
+    AudioGeneratorADPCM *adpcm = NULL;
+    AudioGeneratorSynth *synth = NULL;
+    AudioGenerator *gen = NULL; // whichever of the three is playing
+    AudioOutputI2S *out = NULL;
+    AudioOutputGainRamp *ramp = NULL; // in front of out
+    audioRingSource *source = NULL;
+    QueueHandle_t cmdQueue = NULL;
+    volatile bool playing = false;
+    volatile bool sleepSound = false; // what's playing is a sleep sound, not an alarm
+    bool looping = false;
+    uint32_t loopMicrosMax = 0;
+    unsigned long lastStats = 0;
+    uint32_t restartMicros = 0;
+    uint32_t reportedLoops = 0;
+
+    // pre-armed start
+    esp_timer_handle_t startTimer = NULL;
+    volatile bool armed = false;
+    int64_t armedOnset = 0; // when the first sample should be heard
+    int64_t timerTarget = 0; // when the timer was set for, armedOnset less the DMA latency
+
+    static void startTimerCallback(void *arg) {
+      xTaskNotifyGive((TaskHandle_t)arg);
+    }
+
+    // I2S latency once the DMA buffers are full, in us
+    int64_t dmaLatency( void ) {
+      int rate = ramp->getRate();
+      return (rate > 0) ? ((int64_t)AUDIO_DMA_FRAMES * 1000000) / rate : 0;
+    }
+
+    // Keep the DMA buffers full of silence while armed, so the latency to the first real sample is
+    // always the full buffer.
+    void feedSilence( void ) {
+      int16_t silence[2] = {0, 0};
+      while (out->ConsumeSample(silence)) {}
+    }
+
+    // Call once the generator has begun. Returns false if the start time has already gone.
+    bool arm(int64_t onset) {
+      armedOnset = onset;
+      timerTarget = onset - dmaLatency();
+      int64_t wait = timerTarget - esp_timer_get_time();
+      if (wait <= 0) {
+        Serial.println("audioPlayer.arm: Start time already passed by " + String((int32_t)(-wait)) + "us. Starting now.");
+        return false;
+      }
+      ulTaskNotifyTake(pdTRUE, 0); // clear anything stale
+      feedSilence();
+      esp_timer_start_once(startTimer, wait);
+      armed = true;
+      Serial.println("audioPlayer.arm: Armed. Starting in " + String((int32_t)(wait / 1000)) + "ms");
+      return true;
+    }
+
+    void disarm( void ) {
+      if (!armed) return;
+      esp_timer_stop(startTimer);
+      armed = false;
+    }
+
+    // The timer went off. Everything written from here is heard one DMA buffer later.
+    void fire( void ) {
+      int64_t fired = esp_timer_get_time();
+      armed = false;
+      gen->loop();
+      int32_t timerLate = (int32_t)(fired - timerTarget);
+      int32_t onsetError = (int32_t)((fired + dmaLatency()) - armedOnset);
+      int32_t onsetSamples = (int32_t)(((int64_t)onsetError * ramp->getRate()) / 1000000);
+      Serial.println("audioPlayer: Alarm onset " + String(onsetError) + "us (" + String(onsetSamples) + " samples) from the target. Timer late by " +
+                     String(timerLate) + "us, DMA latency " + String((int32_t)dmaLatency()) + "us");
+      journal.add(JOURNAL_ONSET, 0, (uint16_t)(int16_t)constrain(onsetError, -32768, 32767));
+    }
+
+    // Alarms get the task's normal priority back, sleep sounds run at the bottom
+    void setSleepMode(bool sleep) {
+      sleepSound = sleep;
+      vTaskPrioritySet(NULL, sleep ? AUDIO_SLEEP_PRIORITY : AUDIO_ALARM_PRIORITY);
+    }
+
+    void startPlaying(const char *filename, bool loop) {
+      disarm();
+      if (gen->isRunning()) gen->stop();
+      ramp->release();
+      setSleepMode(false);
+      const char *ext = strrchr(filename, '.');
+      gen = (ext != NULL && strcmp(ext, ".ima") == 0) ? (AudioGenerator *)adpcm : (AudioGenerator *)wav;
+      source->resetStats();
+      loopMicrosMax = 0;
+      looping = loop;
+      source->setLoop(loop);
+      ramp->setLoopHold(loop);
+      reportedLoops = 0;
+      if (!source->open(filename)) {
+        playing = false;
+        return;
+      }
+      digitalWrite(AUDIO_SHUTDOWN_PIN, HIGH);
+      if (!gen->begin(source, ramp)) {
+        Serial.println("audioPlayer: Unable to start " + String(filename));
+        stopPlaying();
+      }
+    }
+
+    // Next pass of a looping file. The ring already holds the start of the file and the gain stage
+    // kept I2S running, so this is just the header parse.
+    bool restartLoop( void ) {
+      unsigned long startTime = micros();
+      if (!source->seek(0, SEEK_SET) || !gen->begin(source, ramp)) {
+        Serial.println("audioPlayer: Unable to loop the sound. Stopping.");
+        return false;
+      }
+      restartMicros = micros() - startTime;
+      return true;
+    }
+
+    // Called on the first pass after a loop restart, once the gain stage has timed the gap
+    void reportLoop( void ) {
+      Serial.println("audioPlayer: Loop " + String(ramp->loopCount) + " gap: " + String(ramp->lastGapSamples) + " samples (" +
+                     String(ramp->lastGapMicros) + "us, restart " + String(restartMicros) + "us)" +
+                     (ramp->lastGapSamples > AUDIO_DMA_FRAMES ? " longer than the DMA buffer, audible" : ""));
+    }
+
+    void startSynth(const audioCommand &command) {
+      disarm();
+      if (gen->isRunning()) gen->stop();
+      ramp->release();
+      looping = false;
+      source->setLoop(false);
+      source->close();
+      setSleepMode(command.sleep);
+      gen = synth;
+      loopMicrosMax = 0;
+      synth->setSound(command.sound, command.minutes);
+      digitalWrite(AUDIO_SHUTDOWN_PIN, HIGH);
+      if (!synth->begin(NULL, ramp)) {
+        Serial.println("audioPlayer: Unable to start the synth");
+        stopPlaying();
+        return;
+      }
+      Serial.println("audioPlayer: Playing " + String(synthNames[synth->getSound()]) + (command.minutes ? " for " + String(command.minutes) + " minutes" : ""));
+    }
+
+    void stopPlaying( void ) {
+      disarm();
+      if (gen->isRunning()) gen->stop();
+      ramp->release();
+      looping = false;
+      source->setLoop(false);
+      source->close();
+      digitalWrite(AUDIO_SHUTDOWN_PIN, LOW);
+      playing = (uxQueueMessagesWaiting(cmdQueue) > 0); // a play may already be on its way
+      reportStats();
+      setSleepMode(false);
+    }
+
+    void handleCommand(const audioCommand &command) {
+      if (command.cmd == AUDIO_CMD_PLAY) {
+        startPlaying(command.filename, command.loop);
+      }
+      else if (command.cmd == AUDIO_CMD_STOP) {
+        stopPlaying();
+      }
+      else if (command.cmd == AUDIO_CMD_SYNTH) {
+        startSynth(command);
+      }
+      if (command.startAt != 0 && command.cmd != AUDIO_CMD_STOP && playing && gen->isRunning()) {
+        arm(command.startAt);
+      }
+    }
+
+    void sendSynth(uint8_t sound, uint16_t minutes, bool sleep, int64_t startAt) {
+      audioCommand command;
+      command.cmd = AUDIO_CMD_SYNTH;
+      command.filename[0] = 0;
+      command.sound = sound;
+      command.minutes = minutes;
+      command.sleep = sleep;
+      command.loop = false;
+      command.startAt = startAt;
+      sleepSound = sleep;
+      playing = true;
+      if (cmdQueue == NULL || xQueueSend(cmdQueue, &command, 50) != pdTRUE) {
+        Serial.println("audioPlayer.sendSynth: Command queue full. Not played.");
+        playing = false;
+      }
+    }
+
+  public:
+
+    // Call from the audio task before run()
+    void begin( void ) {
+      pinMode(AUDIO_SHUTDOWN_PIN, OUTPUT);
+      digitalWrite(AUDIO_SHUTDOWN_PIN, LOW);
+      cmdQueue = xQueueCreate(4, sizeof(audioCommand));
+      source = new audioRingSource();
+      wav = new AudioGeneratorWAV();
+      adpcm = new AudioGeneratorADPCM();
+      synth = new AudioGeneratorSynth();
+      gen = wav;
+      out = new AudioOutputI2S();
+      out->SetPinout(BCLK_PIN, LRCLK_PIN, DOUT_PIN);
+      out->SetGain(1.0); // all of the volume is done by the ramp
+      ramp = new AudioOutputGainRamp(out);
+
+      esp_timer_create_args_t timerArgs = {};
+      timerArgs.callback = startTimerCallback;
+      timerArgs.arg = xTaskGetCurrentTaskHandle();
+      timerArgs.dispatch_method = ESP_TIMER_TASK;
+      timerArgs.name = "audioStart";
+      esp_timer_create(&timerArgs, &startTimer);
+      Serial.println("audioPlayer: Gain stage takes " + String(AudioOutputGainRamp::benchmark(64)) + "us per 1KB of samples");
+    }
+
+    // ===== Called from other tasks =====
+    // loop plays it over and over, without a gap, until stop(). startAt is the esp_timer time the
+    // first sample should be heard, or 0 for now. Send it a few seconds ahead.
+    void play(String filename, bool loop, int64_t startAt = 0) {
+      audioCommand command;
+      command.cmd = AUDIO_CMD_PLAY;
+      filename.toCharArray(command.filename, AUDIO_FILENAME_LEN);
+      command.sleep = false;
+      command.loop = loop;
+      command.startAt = startAt;
+      sleepSound = false;
+      playing = true; // so callers don't see a gap before the task picks it up
+      if (cmdQueue == NULL || xQueueSend(cmdQueue, &command, 50) != pdTRUE) {
+        Serial.println("audioPlayer.play: Command queue full. " + filename + " not played.");
+        playing = false;
+      }
+    }
+
+    // Play a synthesised alarm sound until stopped. startAt is as for play().
+    void playSynth(uint8_t sound, int64_t startAt = 0) {
+      sendSynth(sound, 0, false, startAt);
+    }
+
+    // Start a sleep sound with a sleep timer (0 minutes runs until stopped). Fades in gently.
+    void playSleep(uint8_t sound, uint16_t minutes) {
+      if (minutes > AUDIO_SLEEP_MAX_MINUTES) minutes = AUDIO_SLEEP_MAX_MINUTES;
+      if (ramp != NULL) {
+        ramp->setSnoozeCount(0);
+        ramp->restartCrescendo(AUDIO_SLEEP_FADE_IN);
+      }
+      sendSynth(sound, minutes, true, 0);
+    }
+
+    void stop( void ) {
+      audioCommand command;
+      command.cmd = AUDIO_CMD_STOP;
+      command.filename[0] = 0;
+      command.startAt = 0;
+      if (cmdQueue == NULL || xQueueSend(cmdQueue, &command, 50) != pdTRUE) {
+        Serial.println("audioPlayer.stop: Command queue full.");
+      }
+    }
+
+    // An alarm sound is playing. A sleep sound doesn't count, an alarm takes over from it.
+    bool isPlaying( void ) {
+      return playing && !sleepSound;
+    }
+
+    // Waiting to start an armed play. isPlaying() is already true.
+    bool isArmed( void ) {
+      return armed;
+    }
+
+    bool isSleepPlaying( void ) {
+      return playing && sleepSound;
+    }
+
+    // Knob level in Q12. See readVolumeKnob().
+    void setVolume(int32_t knobGain) {
+      if (ramp != NULL) ramp->setKnobGain(knobGain);
+    }
+
+    // Call before play() at the start of a ring. The crescendo starts over with the next sound, and
+    // each snooze so far adds to the volume.
+    void startAlarm(uint8_t snoozeCount) {
+      if (ramp == NULL) return;
+      ramp->setSnoozeCount(snoozeCount);
+      ramp->restartCrescendo((snoozeCount == 0) ? ALARM_CRESCENDO_TIME : 0); // snoozed rings start loud
+    }
+
+    // ===== The audio task =====
+    void run( void ) {
+      audioCommand command;
+      for (;;) {
+        if (!playing) {
+          if (xQueueReceive(cmdQueue, &command, AUDIO_IDLE_WAIT / portTICK_PERIOD_MS) == pdTRUE) {
+            handleCommand(command);
+          }
+        }
+        else {
+          while (xQueueReceive(cmdQueue, &command, 0) == pdTRUE) {
+            handleCommand(command);
+          }
+        }
+
+        if (armed) {
+          if (ulTaskNotifyTake(pdTRUE, AUDIO_TASK_PERIOD / portTICK_PERIOD_MS) != 0) {
+            fire();
+          }
+          else {
+            feedSilence();
+          }
+        }
+        else if (playing && gen->isRunning()) {
+          unsigned long startTime = micros();
+          bool more = gen->loop(); // decode from RAM first, then top up the ring
+          uint32_t elapsed = micros() - startTime;
+          if (elapsed > loopMicrosMax) loopMicrosMax = elapsed;
+          source->refill();
+          if (!more) {
+            if (!looping || !restartLoop()) {
+              stopPlaying(); // finished
+            }
+          }
+          else if (ramp->loopCount != reportedLoops) {
+            reportedLoops = ramp->loopCount;
+            reportLoop();
+          }
+          else if (sleepSound && millis() - lastStats > AUDIO_STATS_INTERVAL) {
+            reportStats();
+          }
+          vTaskDelay(AUDIO_TASK_PERIOD / portTICK_PERIOD_MS);
+        }
+        else if (playing) { // open failed or the decoder stopped itself
+          stopPlaying();
+        }
+
+        if (esp_task_wdt_reset() != ESP_OK) {
+          Serial.println("audioMgr: Unable to reset audioMgr taskWDT!");
+        }
+      }
+    }
+
+    void reportStats( void ) {
+      lastStats = millis();
+      Serial.println("audioPlayer: Underruns: " + String(source->underruns) + " Refills: " + String(source->refills) +
+                     " Min buffer: " + String(source->minFill) + "/" + String(AUDIO_RING_SIZE) +
+                     " Max refill: " + String(source->refillMicrosMax) + "us Max decode pass: " + String(loopMicrosMax) + "us" +
+                     " Gain: " + String(ramp->getGain() / (float)GAIN_ONE) +
+                     (ramp->loopCount ? " Loops: " + String(ramp->loopCount) + " Max loop gap: " + String(ramp->maxGapSamples) + " samples" : ""));
+      if (gen == synth) {
+        uint32_t cpu = synth->microsPerSecond();
+        Serial.println("audioPlayer: Synth CPU: " + String(cpu) + "us per second of audio (" + String(cpu / 10000.0) + "%, budget " +
+                       String(SYNTH_CPU_BUDGET / 10000.0) + "%)" + (cpu > SYNTH_CPU_BUDGET ? " OVER BUDGET" : "") +
+                       " Sleep timer: " + String(synth->secondsLeft()) + "s left");
+      }
+      else if (gen == adpcm) {
+        Serial.println("audioPlayer: ADPCM decode: " + String(adpcm->decodeMicrosPerSecond()) + "us per second of audio, flash read: " +
+                       String(adpcm->bytesPerSecond()) + " bytes/s (PCM would be " + String(adpcm->getSampleRate() * 2) + " bytes/s)");
+      }
+    }
+};
@@ -0,0 +1,253 @@
+// This file defines AudioGeneratorSynth
+// An ESP8266Audio generator that makes its sound as it goes instead of reading a file: beep
+// patterns and chirps for alarms, and white, pink or brown noise for falling asleep to. Nothing is
+// read from flash, so a noise can run for hours. A sleep timer fades the sound out and stops it.
+// Everything per sample is integer math. The CPU it takes is measured so reportStats() can show it.
+
+#include "globalInclude.h"
+
+#include "AudioGenerator.h"
+
+#define SYNTH_TONE_RATE 22050 // tones and chirps
+#define SYNTH_NOISE_RATE 11025 // noise has nothing up there worth the CPU or DMA time
+#define SYNTH_EDGE_SAMPLES 64 // attack and release of each tone step, so they don't click
+#define SYNTH_BLOCK 64 // samples between envelope updates
+#define SYNTH_FADE_TIME 30 // seconds the sleep timer takes to fade out
+#define SYNTH_CPU_BUDGET 50000 // us per second of audio (5%) we're willing to spend
+
+#define SYNTH_BEEPS 0
+#define SYNTH_CHIRP 1
+#define SYNTH_WHITE 2
+#define SYNTH_PINK 3
+#define SYNTH_BROWN 4
+#define SYNTH_SOUND_COUNT 5
+
+// One step of a tone pattern. A tone sweeps from startHz to endHz over ms. 0Hz is a rest.
+struct synthStep {
+  uint16_t startHz;
+  uint16_t endHz;
+  uint16_t ms;
+};
+
+static const synthStep synthBeeps[] = {
+  {880, 880, 100}, {0, 0, 100}, {880, 880, 100}, {0, 0, 100},
+  {880, 880, 100}, {0, 0, 100}, {880, 880, 100}, {0, 0, 600}
+};
+
+static const synthStep synthChirp[] = {
+  {600, 2400, 250}, {0, 0, 100}, {600, 2400, 250}, {0, 0, 100},
+  {600, 2400, 250}, {0, 0, 800}
+};
+
+static const char *synthNames[SYNTH_SOUND_COUNT] = {"beeps", "chirp", "white noise", "pink noise", "brown noise"};
+
+class AudioGeneratorSynth : public AudioGenerator {
+
+  private:
+    int16_t sine[256];
+    uint8_t sound = SYNTH_BEEPS;
+    uint32_t sampleRate = SYNTH_TONE_RATE;
+
+    // tone state
+    const synthStep *pattern = NULL;
+    uint8_t patternLen = 0;
+    uint8_t stepIdx = 0;
+    uint32_t stepSamples = 0; // length of the current step
+    uint32_t stepPos = 0;
+    uint32_t phase = 0;
+    uint32_t phaseInc = 0;
+    int32_t phaseIncStep = 0; // chirp slope
+
+    // noise state
+    uint32_t rng = 0x2545F491;
+    int32_t pinkRows[8];
+    int32_t pinkSum = 0;
+    uint32_t pinkCounter = 0;
+    int32_t brown = 0;
+
+    // sleep timer. 0 samples is forever.
+    uint32_t totalSamples = 0;
+    uint32_t samplesMade = 0;
+    uint32_t fadeSamples = 0;
+    int32_t fadeGain = 32767; // Q15, updated every SYNTH_BLOCK samples
+    uint8_t untilBlock = 0;
+
+    // stats for the current sound
+    uint32_t loopMicros = 0;
+
+    uint32_t hzToInc(uint16_t hz) {
+      return (uint32_t)(((uint64_t)hz << 32) / sampleRate);
+    }
+
+    void startStep( void ) {
+      const synthStep &step = pattern[stepIdx];
+      stepSamples = ((uint32_t)step.ms * sampleRate) / 1000;
+      if (stepSamples == 0) stepSamples = 1;
+      stepPos = 0;
+      phaseInc = hzToInc(step.startHz);
+      phaseIncStep = ((int32_t)hzToInc(step.endHz) - (int32_t)phaseInc) / (int32_t)stepSamples;
+    }
+
+    uint32_t nextRandom( void ) { // xorshift32
+      rng ^= rng << 13;
+      rng ^= rng >> 17;
+      rng ^= rng << 5;
+      return rng;
+    }
+
+    int32_t toneSample( void ) {
+      if (stepPos >= stepSamples) {
+        stepIdx = (stepIdx + 1) % patternLen;
+        startStep();
+      }
+      int32_t value = 0;
+      if (pattern[stepIdx].startHz != 0) {
+        uint32_t edge = stepPos;
+        if (stepSamples - stepPos < edge) edge = stepSamples - stepPos;
+        value = sine[phase >> 24];
+        if (edge < SYNTH_EDGE_SAMPLES) value = (value * (int32_t)edge) / SYNTH_EDGE_SAMPLES;
+        phase += phaseInc;
+        phaseInc += phaseIncStep;
+      }
+      stepPos++;
+      return value >> 1; // -6dB. The gain stage has plenty of room.
+    }
+
+    // All three noises are scaled to roughly the same loudness (about -14dBFS RMS).
+    int32_t noiseSample( void ) {
+      int32_t white = (int16_t)(nextRandom() >> 16);
+      if (sound == SYNTH_WHITE) {
+        return (white * 3) >> 3;
+      }
+      if (sound == SYNTH_PINK) { // Voss-McCartney. Row n changes every 2^(n+1) samples.
+        pinkCounter++;
+        uint32_t bits = pinkCounter;
+        uint8_t row = 0;
+        while ((bits & 1) == 0 && row < 7) {
+          bits >>= 1;
+          row++;
+        }
+        int32_t newRow = white >> 4;
+        pinkSum += newRow - pinkRows[row];
+        pinkRows[row] = newRow;
+        return ((pinkSum + ((int16_t)(nextRandom() >> 16) >> 4)) * 3) >> 1;
+      }
+      // brown: a leaky integrator of white noise. The leak keeps it from wandering off.
+      brown += white;
+      brown -= brown >> 6;
+      return brown >> 4;
+    }
+
+  public:
+
+    AudioGeneratorSynth() {
+      running = false;
+      for (int i = 0; i < 256; i++) {
+        sine[i] = (int16_t)(32767.0 * sin(i * 2.0 * PI / 256.0));
+      }
+    }
+
+    // Pick the sound before begin(). minutes is the sleep timer, 0 to run until stopped.
+    void setSound(uint8_t newSound, uint16_t minutes) {
+      sound = (newSound < SYNTH_SOUND_COUNT) ? newSound : SYNTH_BEEPS;
+      sampleRate = (sound >= SYNTH_WHITE) ? SYNTH_NOISE_RATE : SYNTH_TONE_RATE;
+      totalSamples = (uint32_t)minutes * 60 * sampleRate;
+      fadeSamples = (uint32_t)SYNTH_FADE_TIME * sampleRate;
+      if (fadeSamples > totalSamples) fadeSamples = totalSamples;
+    }
+
+    // The source is ignored. There's no file.
+    virtual bool begin(AudioFileSource *source, AudioOutput *output) override {
+      if (!output) return false;
+      file = source;
+      this->output = output;
+      running = false;
+      lastSample[AudioOutput::LEFTCHANNEL] = 0;
+      lastSample[AudioOutput::RIGHTCHANNEL] = 0;
+      samplesMade = 0;
+      loopMicros = 0;
+      fadeGain = 32767;
+      untilBlock = 0;
+
+      if (sound == SYNTH_BEEPS) {
+        pattern = synthBeeps;
+        patternLen = sizeof(synthBeeps) / sizeof(synthStep);
+      }
+      else {
+        pattern = synthChirp;
+        patternLen = sizeof(synthChirp) / sizeof(synthStep);
+      }
+      stepIdx = 0;
+      phase = 0;
+      startStep();
+      memset(pinkRows, 0, sizeof(pinkRows));
+      pinkSum = 0;
+      pinkCounter = 0;
+      brown = 0;
+
+      output->SetRate(sampleRate);
+      output->SetBitsPerSample(16);
+      output->SetChannels(1);
+      if (!output->begin()) return false;
+      running = true;
+      return true;
+    }
+
+    // Make samples until the output is full, same as the file generators
+    virtual bool loop() override {
+      if (running) {
+        unsigned long startTime = micros();
+        if (output->ConsumeSample(lastSample)) {
+          do {
+            if (totalSamples != 0 && samplesMade >= totalSamples) { // sleep timer ran out
+              stop();
+              break;
+            }
+            if (untilBlock == 0) {
+              uint32_t remaining = totalSamples - samplesMade;
+              fadeGain = (totalSamples != 0 && remaining < fadeSamples) ? (int32_t)(((uint64_t)remaining * 32767) / fadeSamples) : 32767;
+              untilBlock = SYNTH_BLOCK;
+            }
+            untilBlock--;
+            int32_t value = (sound >= SYNTH_WHITE) ? noiseSample() : toneSample();
+            value = (value * fadeGain) >> 15;
+            if (value > 32767) value = 32767;
+            else if (value < -32768) value = -32768;
+            lastSample[AudioOutput::LEFTCHANNEL] = value;
+            lastSample[AudioOutput::RIGHTCHANNEL] = value;
+            samplesMade++;
+          } while (output->ConsumeSample(lastSample));
+        }
+        loopMicros += micros() - startTime;
+      }
+      output->loop();
+      return running;
+    }
+
+    virtual bool stop() override {
+      if (!running) return true;
+      running = false;
+      output->stop();
+      return true;
+    }
+
+    virtual bool isRunning() override {
+      return running;
+    }
+
+    uint8_t getSound( void ) {
+      return sound;
+    }
+
+    // CPU time per second of audio made, including handing the samples to the output
+    uint32_t microsPerSecond( void ) {
+      if (samplesMade == 0) return 0;
+      return (uint32_t)(((uint64_t)loopMicros * sampleRate) / samplesMade);
+    }
+
+    // Seconds left on the sleep timer, 0 if there isn't one
+    uint32_t secondsLeft( void ) {
+      if (totalSamples == 0 || samplesMade >= totalSamples) return 0;
+      return (totalSamples - samplesMade) / sampleRate;
+    }
+};
@@ -10,7 +10,7 @@ class displayMgr
     volatile bool drawTimeSection = false;
     volatile bool fullReDraw = true;
     volatile bool spriteEnable = false;
-    volatile uint8_t alarmRinging = 0;
+    volatile uint16_t alarmRinging = 0; // alarm number (1 based), 0 for none
     volatile time_t lastTouch = now();
     volatile uint16_t backlightTimeout = 30;
     volatile uint8_t currentMode = 0;
@@ -72,10 +72,10 @@ class displayMgr
     }
 
     // get/set alarmRinging
-    void setAlarmRinging (uint8_t value) {
+    void setAlarmRinging (uint16_t value) {
       alarmRinging = value;
     }
-    uint8_t getAlarmRinging (void) {
+    uint16_t getAlarmRinging (void) {
       return alarmRinging;
     }
 
@@ -5,10 +5,7 @@
 #include <NeoPixelBus.h>
 #include <NeoPixelAnimator.h>
 
-#include <Preferences.h>
-extern Preferences prefs;
-
-extern SemaphoreHandle_t ledMutex;
+extern settingsStore settings;
 
 const uint8_t PixelPin = 13;  // make sure to set this to the correct pin, ignored for Esp8266
 
@@ -38,7 +35,6 @@ class ledCtrl {
     bool sunriseLightState = false;
     bool readLightState = false;
     bool nightLightState = false;
-    char varName[7];
 
     bool flashState = false;
 
@@ -58,40 +54,74 @@ class ledCtrl {
 
     HsbColor blackColor;
 
-    NeoGamma<NeoGammaTableMethod> colorGamma;
+    // Temporal dithering state. Targets are gamma corrected 8.8 fixed point values (R, G, B, W)
+    // and the accumulators carry each pixel's fractional error from one frame to the next.
+    // ledMgr works out the targets and ledDriver owns the strip buffer. The only thing they share
+    // is the published targets, copied in and out under targetMux. Nothing else happens while it
+    // is held, so neither side ever waits on the other's colour maths or Show().
+    portMUX_TYPE targetMux = portMUX_INITIALIZER_UNLOCKED;
+    uint16_t readTarget[4] = {0, 0, 0, 0}; // published. targetMux.
+    uint16_t roomTarget[4] = {0, 0, 0, 0};
+    bool readTargetChanged = true;
+    bool roomTargetChanged = true;
+    uint16_t sentRead[4] = {0, 0, 0, 0}; // last published. ledMgr only.
+    uint16_t sentRoom[4] = {0, 0, 0, 0};
+    uint16_t driveRead[4] = {0, 0, 0, 0}; // what's being dithered. ledDriver only.
+    uint16_t driveRoom[4] = {0, 0, 0, 0};
+    uint8_t ditherAcc[PixelCount][4];
+    bool readDithering = false;
+    bool roomDithering = false;
+    uint32_t ditherFrames = 0;
+    uint32_t ditherMicrosTotal = 0;
+    uint32_t ditherMicrosMax = 0;
+
+    // hand-off stats. targetMux.
+    uint32_t handoffPublished = 0;
+    uint32_t handoffReplaced = 0; // published again before ledDriver took the last one
+    uint32_t handoffWaitMax = 0; // us spent spinning for targetMux
+    uint32_t handoffHoldMax = 0; // us targetMux was held
+
+    // Call inside targetMux with micros() from before and after taking it
+    void noteHandoff(uint32_t startTime, uint32_t lockedTime) {
+      if (lockedTime - startTime > handoffWaitMax) handoffWaitMax = lockedTime - startTime;
+      uint32_t held = micros() - lockedTime;
+      if (held > handoffHoldMax) handoffHoldMax = held;
+    }
+
+    void publishTarget(uint16_t published[4], bool &changed, const uint16_t target[4]) {
+      uint32_t startTime = micros();
+      portENTER_CRITICAL(&targetMux);
+      uint32_t lockedTime = micros();
+      if (changed) handoffReplaced++;
+      memcpy(published, target, 4 * sizeof(uint16_t));
+      changed = true;
+      handoffPublished++;
+      noteHandoff(startTime, lockedTime);
+      portEXIT_CRITICAL(&targetMux);
+    }
 
   public:
 
     void ledInit ( void ) {
-      // read the saved values from EEPOM
-      strcpy(varName, "RoomH");
-      float roomH =  prefs.getFloat(varName, 0.1);
-      strcpy(varName, "RoomS");
-      float roomS =  prefs.getFloat(varName, 0.5);
-      strcpy(varName, "RoomB");
-      float roomB =  prefs.getFloat(varName, 1.0);
-      strcpy(varName, "ReadH");
-      float readH =  prefs.getFloat(varName, 0.0);
-      strcpy(varName, "ReadS");
-      float readS =  prefs.getFloat(varName, 0.0);
-      strcpy(varName, "ReadB");
-      float readB =  prefs.getFloat(varName, 0.5);
-      strcpy(varName, "NightH");
-      float nightH =  prefs.getFloat(varName, 0.1);
-      strcpy(varName, "NightS");
-      float nightS =  prefs.getFloat(varName, 0.5);
-      strcpy(varName, "NightB");
-      float nightB =  prefs.getFloat(varName, 1.0);
-
-      roomColor = HsbColor(roomH, roomS, roomB);
-      readColor = HsbColor(readH, readS, readB);
-      nightColor = HsbColor(nightH, nightS, nightB);
+      // read the saved values from the settings store
+      lightRecord room = {0.1, 0.5, 1.0};
+      lightRecord read = {0.0, 0.0, 0.5};
+      lightRecord night = {0.1, 0.5, 1.0};
+      settings.getLight(SETTINGS_ROOM_LIGHT, room);
+      settings.getLight(SETTINGS_READ_LIGHT, read);
+      settings.getLight(SETTINGS_NIGHT_LIGHT, night);
+
+      roomColor = HsbColor(room.h, room.s, room.b);
+      readColor = HsbColor(read.h, read.s, read.b);
+      nightColor = HsbColor(night.h, night.s, night.b);
       lastReadColor = HsbColor(0, 0, 0);
       lastRoomColor = HsbColor(0, 0, 0);
       lastNightColor = HsbColor(0, 0, 0);
       blackColor = HsbColor(0, 0, 0);
       activeReadColor = blackColor;
       activeRoomColor = blackColor;
+
+      ditherInit();
     }
 
     void Show( void ) {
@@ -127,35 +157,16 @@ class ledCtrl {
       else flashState = true;
     }
 
+    // Hand the colours to the settings store. It writes them to flash once edits settle.
     void saveLedData() {
-      float tmpVar;
-
-      if (xSemaphoreTake(ledMutex, (TickType_t) 100) == pdTRUE ) {
-        tmpVar = prefs.getFloat("RoomH", -1.0);
-        if (tmpVar != roomColor.H) prefs.putFloat("RoomH", roomColor.H);
-        tmpVar = prefs.getFloat("RoomS", -1.0);
-        if (tmpVar != roomColor.S) prefs.putFloat("RoomS", roomColor.S);
-        tmpVar = prefs.getFloat("RoomB", -1.0);
-        if (tmpVar != roomColor.B) prefs.putFloat("RoomB", roomColor.B);
-
-        tmpVar = prefs.getFloat("ReadH", -1.0);
-        if (tmpVar != readColor.H) prefs.putFloat("ReadH", readColor.H);
-        tmpVar = prefs.getFloat("ReadS", -1.0);
-        if (tmpVar != readColor.S) prefs.putFloat("ReadS", readColor.S);
-        tmpVar = prefs.getFloat("ReadB", -1.0);
-        if (tmpVar != readColor.B) prefs.putFloat("ReadB", readColor.B);
-
-        tmpVar = prefs.getFloat("NightH", -1.0);
-        if (tmpVar != nightColor.H) prefs.putFloat("NightH", nightColor.H);
-        tmpVar = prefs.getFloat("NightS", -1.0);
-        if (tmpVar != nightColor.S) prefs.putFloat("NightS", nightColor.S);
-        tmpVar = prefs.getFloat("NightB", -1.0);
-        if (tmpVar != nightColor.B) prefs.putFloat("NightB", nightColor.B);
-        xSemaphoreGive(ledMutex);
-      }
-      else {
-        Serial.println("ledCtrl.saveLedData: Unable to get the ledMutex. Data NOT WRITTEN TO FLASH!");
-      }
+      lightRecord rec;
+
+      rec = {roomColor.H, roomColor.S, roomColor.B};
+      settings.setLight(SETTINGS_ROOM_LIGHT, rec);
+      rec = {readColor.H, readColor.S, readColor.B};
+      settings.setLight(SETTINGS_READ_LIGHT, rec);
+      rec = {nightColor.H, nightColor.S, nightColor.B};
+      settings.setLight(SETTINGS_NIGHT_LIGHT, rec);
     }
 
     // ================================
@@ -169,6 +180,10 @@ class ledCtrl {
       sunriseLightState = false;
     }
 
+    bool getSunriseLightState() {
+      return sunriseLightState;
+    }
+
     // ================================
     // ===== Room Light Code ==========
     // ================================
@@ -220,7 +235,7 @@ class ledCtrl {
       }
 
       roomColor = HsbColor(h, s, b);
-      if (roomLightState) lightRoomLight(roomColor);
+      if (roomLightState) activeRoomColor = roomColor;
     }
 
     void setActiveRoomLightColorHSB(float h, float s, float b) {
@@ -243,16 +258,10 @@ class ledCtrl {
       }
 
       activeRoomColor = HsbColor(h, s, b);
-      if (roomLightState) {
-        lightRoomLight(activeRoomColor);
-      }
     }
 
     void setActiveSunriseRoomLightColorHSB(float h, float s, float b) {
       activeRoomColor = HsbColor(h, s, b);
-      if (sunriseLightState) {
-        lightRoomLight(activeRoomColor);
-      }
     }
 
     HsbColor getRoomLightColorHSB ( void ) {
@@ -382,7 +391,7 @@ class ledCtrl {
       }
 
       nightColor = HsbColor(h, s, b);
-      if (nightLightState) lightRoomLight(nightColor);
+      if (nightLightState) activeRoomColor = nightColor;
     }
 
     void setActiveNightLightColorHSB(float h, float s, float b) {
@@ -405,7 +414,6 @@ class ledCtrl {
       }
 
       activeRoomColor = HsbColor(h, s, b);
-      if (nightLightState) lightRoomLight(activeRoomColor);
     }
 
 
@@ -417,6 +425,8 @@ class ledCtrl {
     // ===== Strip Setting Code =======
     // ================================
 
+    // ledMgr only. The setters above just change the active colours, this blends towards them and
+    // publishes the result for ledDriver.
     void updateStrip ( void ) { // call this regularly!
 
       static bool flashOn = false;
@@ -449,39 +459,184 @@ class ledCtrl {
 
     void lightReadLight (HsbColor inColor) {
 
-      static RgbwColor lastGammaColor = RgbwColor(0, 0, 0, 0);
-
       HsbColor filtColor = HsbColor::LinearBlend<NeoHueBlendShortestDistance>(lastReadColor, inColor, 0.45f);
 
       lastReadColor = filtColor;
 
-      RgbwColor gammaColor = colorGamma.Correct(RgbwColor(filtColor));
+      uint16_t target[4];
+      colorToTarget(filtColor, target);
 
-      if (gammaColor != lastGammaColor) {
-        if (xSemaphoreTake(ledMutex, (TickType_t) 10) == pdTRUE ) {
-          strip.ClearTo(gammaColor, READ_LIGHT_START_INDEX, READ_LIGHT_STOP_INDEX);
-          xSemaphoreGive(ledMutex);
-          lastGammaColor = gammaColor;
-        }
+      if (memcmp(target, sentRead, sizeof(target)) != 0) {
+        memcpy(sentRead, target, sizeof(target));
+        publishTarget(readTarget, readTargetChanged, target);
       }
     }
 
     void lightRoomLight (HsbColor inColor) {
 
-      static RgbwColor lastGammaColor = RgbwColor(0, 0, 0, 0);
-
       HsbColor filtColor = HsbColor::LinearBlend<NeoHueBlendShortestDistance>(lastRoomColor, inColor, 0.45f);
 
       lastRoomColor = filtColor;
 
-      RgbwColor gammaColor = colorGamma.Correct(RgbwColor(filtColor));
+      uint16_t target[4];
+      colorToTarget(filtColor, target);
+
+      if (memcmp(target, sentRoom, sizeof(target)) != 0) {
+        memcpy(sentRoom, target, sizeof(target));
+        publishTarget(roomTarget, roomTargetChanged, target);
+      }
+    }
+
+    // ================================
+    // ===== Dithering Code ===========
+    // ================================
+    // The light segments are driven from 8.8 fixed point targets. Each frame every pixel adds the
+    // fractional part of the target to its accumulator and outputs one extra step whenever the
+    // accumulator overflows (first order sigma-delta), so the time average matches the target.
+
+    void ditherInit( void ) {
+      // stagger the starting error of each pixel so a segment does not pulse in step
+      for (uint16_t i = 0; i < PixelCount; i++) {
+        for (uint8_t c = 0; c < 4; c++) {
+          ditherAcc[i][c] = (uint8_t)((i * 97) + (c * 61));
+        }
+      }
+      portENTER_CRITICAL(&targetMux);
+      readTargetChanged = true;
+      roomTargetChanged = true;
+      portEXIT_CRITICAL(&targetMux);
+    }
+
+    // ledDriver only, just before Show(). Picks up any new targets. Returns true if the strip
+    // buffer was updated.
+    bool ditherFrame( void ) {
+      uint32_t startTime = micros();
+      portENTER_CRITICAL(&targetMux);
+      uint32_t lockedTime = micros();
+      bool readChanged = readTargetChanged;
+      bool roomChanged = roomTargetChanged;
+      if (readChanged) memcpy(driveRead, readTarget, sizeof(driveRead));
+      if (roomChanged) memcpy(driveRoom, roomTarget, sizeof(driveRoom));
+      readTargetChanged = false;
+      roomTargetChanged = false;
+      noteHandoff(startTime, lockedTime);
+      portEXIT_CRITICAL(&targetMux);
+
+      if (readChanged) readDithering = targetNeedsDither(driveRead);
+      if (roomChanged) roomDithering = targetNeedsDither(driveRoom);
+      if (!readDithering && !roomDithering && !readChanged && !roomChanged) {
+        return false;
+      }
+
+      startTime = micros();
+      if (readDithering || readChanged) {
+        ditherSegment(driveRead, READ_LIGHT_START_INDEX, READ_LIGHT_STOP_INDEX);
+      }
+      if (roomDithering || roomChanged) {
+        ditherSegment(driveRoom, ROOM_LIGHT_START_INDEX, ROOM_LIGHT_STOP_INDEX);
+      }
+      uint32_t elapsed = micros() - startTime;
+
+      ditherFrames++;
+      ditherMicrosTotal += elapsed;
+      if (elapsed > ditherMicrosMax) ditherMicrosMax = elapsed;
+      return true;
+    }
+
+    bool isDithering( void ) {
+      return (readDithering || roomDithering);
+    }
+
+    // Print and reset the per-frame cost of the dithering stage
+    void reportDitherStats( void ) {
+      if (ditherFrames == 0) return;
+      Serial.println("ledCtrl.reportDitherStats: frames: " + String(ditherFrames) + " avg: " + String(ditherMicrosTotal / ditherFrames) + "us max: " + String(ditherMicrosMax) + "us for " + String(PixelCount) + " pixels");
+      ditherFrames = 0;
+      ditherMicrosTotal = 0;
+      ditherMicrosMax = 0;
+    }
 
-      if (gammaColor != lastGammaColor) {
-        if (xSemaphoreTake(ledMutex, (TickType_t) 10) == pdTRUE ) {
-          strip.ClearTo(gammaColor, ROOM_LIGHT_START_INDEX, ROOM_LIGHT_STOP_INDEX);
-          xSemaphoreGive(ledMutex);
-          lastGammaColor = gammaColor;
+    // Print and reset the target hand-off stats. Waits are how long either task spun for
+    // targetMux, holds how long it was kept. Replaced targets were never shown, which is fine,
+    // ledDriver always shows the newest.
+    void reportHandoffStats( void ) {
+      portENTER_CRITICAL(&targetMux);
+      uint32_t published = handoffPublished;
+      uint32_t replaced = handoffReplaced;
+      uint32_t waitMax = handoffWaitMax;
+      uint32_t holdMax = handoffHoldMax;
+      handoffPublished = 0;
+      handoffReplaced = 0;
+      handoffWaitMax = 0;
+      handoffHoldMax = 0;
+      portEXIT_CRITICAL(&targetMux);
+      if (published == 0) return;
+      Serial.println("ledCtrl.reportHandoffStats: targets: " + String(published) + " replaced: " + String(replaced) + " max wait: " + String(waitMax) + "us max hold: " + String(holdMax) + "us");
+    }
+
+  private:
+
+    void ditherSegment(const uint16_t target[4], uint16_t startIndex, uint16_t stopIndex) {
+      for (uint16_t i = startIndex; i <= stopIndex; i++) {
+        uint8_t out[4];
+        for (uint8_t c = 0; c < 4; c++) {
+          uint16_t sum = ditherAcc[i][c] + (target[c] & 0xFF);
+          out[c] = (target[c] >> 8) + (sum >> 8);
+          ditherAcc[i][c] = (uint8_t)sum;
+        }
+        RgbwColor color(out[0], out[1], out[2], out[3]);
+        if (strip.GetPixelColor(i) != color) { // so the strip is only dirty when a byte changes
+          strip.SetPixelColor(i, color);
         }
       }
     }
+
+    bool targetNeedsDither(const uint16_t target[4]) {
+      for (uint8_t c = 0; c < 4; c++) {
+        if (target[c] & 0xFF) return true;
+      }
+      return false;
+    }
+
+    // Same curve as the NeoGamma table, but kept at 16 bit precision. Anything under a quarter
+    // of an 8 bit step is dropped, as single pixels blinking that slowly read as sparkle.
+    uint16_t gamma16(float unit) {
+      if (unit <= 0.0f) return 0;
+      if (unit >= 1.0f) return 0xFF00;
+      uint16_t val = (uint16_t)((powf(unit, 1.0f / 0.45f) * 65280.0f) + 0.5f);
+      if (val < 0x40) val = 0;
+      return val;
+    }
+
+    void colorToTarget(HsbColor color, uint16_t target[4]) {
+      float r, g, b;
+      float v = color.B;
+
+      if (color.S <= 0.0f) {
+        r = g = b = v;
+      }
+      else {
+        float h = color.H * 6.0f;
+        if (h >= 6.0f) h = 0.0f;
+        uint8_t sector = (uint8_t)h;
+        float f = h - sector;
+        float p = v * (1.0f - color.S);
+        float q = v * (1.0f - (color.S * f));
+        float t = v * (1.0f - (color.S * (1.0f - f)));
+
+        switch (sector) {
+          case 0: r = v; g = t; b = p; break;
+          case 1: r = q; g = v; b = p; break;
+          case 2: r = p; g = v; b = t; break;
+          case 3: r = p; g = q; b = v; break;
+          case 4: r = t; g = p; b = v; break;
+          default: r = v; g = p; b = q; break;
+        }
+      }
+
+      target[0] = gamma16(r);
+      target[1] = gamma16(g);
+      target[2] = gamma16(b);
+      target[3] = 0; // HSB colors never drive the white channel
+    }
 };
@@ -1,5 +1,7 @@
 // modeMgmt.h
 
+#define TOUCH_IRQ_PIN   4 // also wakes rtcWake's light sleep
+
 // mode macros
 #define MAIN_MODE             0
 #define CURRENT_WX_MODE       1
@@ -2,11 +2,6 @@
 
 #include "globalInclude.h"
 
-// =============================================
-// ================ Defines ====================
-// =============================================
-#define TOUCH_IRQ_PIN   4
-
 // =============================================
 // ================ Globals ====================
 // =============================================
@@ -318,57 +313,29 @@ void touchAlarmDispMode(uint16_t x, uint16_t y) {
       disp.setScreenTouchActive(true);
     }
     else {
-      alarm1.saveAlarmData();
-      alarm2.saveAlarmData();
-      alarm3.saveAlarmData();
+      alarms.saveAll();
       disp.setCurrentMode(MAIN_MODE);
     }
   }
-  else if (y < 153) {
-    if (alarm1.button.contains(x, y)) {
-      alarm1.toggleStatus();
-      alarm1.saveAlarmData();
-      disp.setDrawLowerScreen(true);
-    }
-    else if (alarm1.dawnButton.contains(x, y)) {
-      alarm1.toggleSunrise();
-      alarm1.saveAlarmData();
-      disp.setDrawLowerScreen(true);
-    }
-    else {
-      disp.setAlarmEdit(1);
-      disp.setCurrentMode(ALARM_SET_MODE);
-    }
-  }
-  else if (y < 197) {
-    if (alarm2.button.contains(x, y)) {
-      alarm2.toggleStatus();
-      alarm2.saveAlarmData();
-      disp.setDrawLowerScreen(true);
-    }
-    else if (alarm2.dawnButton.contains(x, y)) {
-      alarm2.toggleSunrise();
-      alarm2.saveAlarmData();
-      disp.setDrawLowerScreen(true);
-    }
-    else {
-      disp.setAlarmEdit(2);
-      disp.setCurrentMode(ALARM_SET_MODE);
-    }
-  }
   else {
-    if (alarm3.button.contains(x, y)) {
-      alarm3.toggleStatus();
-      alarm3.saveAlarmData();
+    // rows start at 110, 153 and 197 (see drawAlarmDisplay)
+    uint8_t row = (y < 153) ? 0 : ((y < 197) ? 1 : 2);
+    alarmData *workAlarm = alarms.get(row);
+    if (workAlarm == NULL) {
+      return;
+    }
+    if (workAlarm->button.contains(x, y)) {
+      workAlarm->toggleStatus();
+      workAlarm->saveAlarmData();
       disp.setDrawLowerScreen(true);
     }
-    else if (alarm3.dawnButton.contains(x, y)) {
-      alarm3.toggleSunrise();
-      alarm3.saveAlarmData();
+    else if (workAlarm->dawnButton.contains(x, y)) {
+      workAlarm->toggleSunrise();
+      workAlarm->saveAlarmData();
       disp.setDrawLowerScreen(true);
     }
     else {
-      disp.setAlarmEdit(3);
+      disp.setAlarmEdit(row + 1);
       disp.setCurrentMode(ALARM_SET_MODE);
     }
   }
@@ -378,15 +345,10 @@ void touchAlarmDispMode(uint16_t x, uint16_t y) {
 // ============= Alarm Set Mode ================
 // =============================================
 void touchAlarmSetMode(uint16_t x, uint16_t y) {
-  alarmData *workAlarm;
-  if (disp.getAlarmEdit() == 1) {
-    workAlarm = &alarm1;
-  }
-  else if (disp.getAlarmEdit() == 2) {
-    workAlarm = &alarm2;
-  }
-  else if (disp.getAlarmEdit() == 3) {
-    workAlarm = &alarm3;
+  alarmData *workAlarm = alarms.get(disp.getAlarmEdit() - 1);
+  if (workAlarm == NULL) {
+    disp.setCurrentMode(ALARM_DISPLAY_MODE);
+    return;
   }
 
   if (y < HORIZ_DIV_POS) {
@@ -0,0 +1,68 @@
+// This file runs the network task. See netService.h.
+
+#include "globalInclude.h"
+
+// =============================================
+// ================ Globals ====================
+// =============================================
+// requests for the network task. Started in setup().
+netService net;
+
+//===================================================================
+//====================== Network Manager ============================
+//===================================================================
+void netMgr( void * parameter ) {
+
+  if ( esp_task_wdt_add(NULL) != ESP_OK) { // add task to WDT
+    Serial.println("netMgr: Unable to add netMgr to taskWDT!");
+  }
+  Serial.println("netMgr: Network Manager running");
+
+  for (;;) {
+    uint8_t what;
+    if (net.wait(what, NET_IDLE_WAIT / portTICK_PERIOD_MS)) {
+      uint32_t startMs = millis();
+      bool ok = false;
+      wlan.reuse(); // end of any modem sleep
+
+      switch (what) {
+        case NET_WEATHER:
+          if (!wxSchedule.takeCall(utcNow())) { // the day's calls are used up. Nothing was tried, so it isn't a failure.
+            ok = net.lastWorked(NET_WEATHER);
+            break;
+          }
+          ok = getCurrentWeather();
+          if (ok) {
+            disp.setDrawLowerScreen(true);
+          }
+          else {
+            Serial.println("netMgr: Failed to retrieve weather!");
+            wxSchedule.failed(utcNow());
+          }
+          break;
+
+        case NET_NTP_SYNC:
+          ok = syncRtcFromNtp();
+          Serial.println(ok ? "netMgr: RTC set from from NTP server" : "netMgr: Unable to set RTC from NTP server.");
+          break;
+
+        case NET_RTC_RESET:
+        case NET_RTC_LOST:
+          ok = resetRtcFromNtp(what == NET_RTC_LOST);
+          Serial.println(ok ? "netMgr: RTC reset from NTP server" : "netMgr: Unable to reset RTC from NTP server.");
+          break;
+
+        default:
+          Serial.println("netMgr: Unknown request " + String(what));
+          break;
+      }
+
+      net.done(what, ok);
+      Serial.println("netMgr: Request " + String(what) + " took " + String(millis() - startMs) + "ms");
+    }
+
+    if (esp_task_wdt_reset() != ESP_OK) {
+      Serial.println("netMgr: Unable to reset netMgr taskWDT!");
+    }
+  }
+}
@@ -0,0 +1,143 @@
+// This file defines the netService class
+// Everything that needs the network goes through the network task (netMgr). Other tasks post a
+// request and carry on; they never wait on WiFi, DNS or a slow server. netMgr is the only task
+// that takes wifiMutex. A request that's already waiting isn't queued twice. Results come back the
+// way they always have (the weather through owMutex and the displayMgr flags), plus a flag that
+// tells timeMgr the RTC was set, so it can reread it.
+// netMgr also times each stage of a request, so a slow join can be told from a slow server.
+
+#include "globalInclude.h"
+
+#define NET_QUEUE_LEN 8
+#define NET_IDLE_WAIT 5000 // ms netMgr waits for a request before resetting its WDT
+
+// Requests. Each is a bit in the pending mask.
+#define NET_WEATHER 0x01 // get the forecast
+#define NET_NTP_SYNC 0x02 // measure and set the RTC from NTP, for the drift model
+#define NET_RTC_RESET 0x04 // the RTC's time is wrong. Set it from NTP.
+#define NET_RTC_LOST 0x08 // the RTC's oscillator stopped. Set it and forget its drift.
+
+// Stages timed
+#define NET_STAGE_JOIN 0 // WiFi associate and DHCP
+#define NET_STAGE_DNS 1
+#define NET_STAGE_TLS 2
+#define NET_STAGE_HTTP 3 // request sent to the end of the headers
+#define NET_STAGE_PARSE 4
+#define NET_STAGE_FETCH 5 // a whole OneCall request, TLS to parse
+#define NET_STAGE_NTP 6 // an SNTP query to all the servers
+#define NET_STAGE_COUNT 7
+
+class netService {
+
+  private:
+    struct stageStats {
+      uint32_t last; // ms
+      uint32_t worst;
+      uint32_t total;
+      uint32_t count;
+    };
+
+    QueueHandle_t queue = NULL;
+    portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+    uint8_t pending = 0; // requests queued or running
+    volatile uint8_t running = 0;
+    volatile bool rtcSet = false;
+    uint8_t lastOk = 0; // requests that worked last time
+    uint32_t dropped = 0;
+    stageStats stages[NET_STAGE_COUNT];
+
+    static const char *stageName(uint8_t stage) {
+      static const char *names[NET_STAGE_COUNT] = {"join", "dns", "tls", "http", "parse", "fetch", "ntp"};
+      return (stage < NET_STAGE_COUNT) ? names[stage] : "?";
+    }
+
+  public:
+
+    // Call from setup() before the tasks start
+    void begin( void ) {
+      queue = xQueueCreate(NET_QUEUE_LEN, sizeof(uint8_t));
+      memset(stages, 0, sizeof(stages));
+    }
+
+    // Any task. Never blocks. Returns false if it couldn't be queued.
+    bool request(uint8_t what) {
+      portENTER_CRITICAL(&mux);
+      bool already = (pending & what) != 0;
+      pending |= what;
+      portEXIT_CRITICAL(&mux);
+      if (already) return true;
+      if (queue == NULL || xQueueSend(queue, &what, 0) != pdTRUE) {
+        portENTER_CRITICAL(&mux);
+        pending &= ~what;
+        portEXIT_CRITICAL(&mux);
+        dropped++;
+        Serial.println("netService.request: Queue full. Request " + String(what) + " dropped.");
+        return false;
+      }
+      return true;
+    }
+
+    // netMgr only. Wait up to timeout ticks for the next request.
+    bool wait(uint8_t &what, TickType_t timeout) {
+      if (xQueueReceive(queue, &what, timeout) != pdTRUE) return false;
+      running = what;
+      return true;
+    }
+
+    // netMgr only, once a request is finished
+    void done(uint8_t what, bool ok) {
+      portENTER_CRITICAL(&mux);
+      pending &= ~what;
+      portEXIT_CRITICAL(&mux);
+      running = 0;
+      if (ok) lastOk |= what;
+      else lastOk &= ~what;
+      if (ok && (what & (NET_NTP_SYNC | NET_RTC_RESET | NET_RTC_LOST))) rtcSet = true;
+    }
+
+    // timeMgr. True once after the RTC is set, so the CPU clock can be set from it.
+    bool takeRtcSet( void ) {
+      if (!rtcSet) return false;
+      rtcSet = false;
+      return true;
+    }
+
+    bool isPending(uint8_t what) {
+      return (pending & what) != 0;
+    }
+
+    bool isBusy( void ) {
+      return pending != 0;
+    }
+
+    bool lastWorked(uint8_t what) {
+      return (lastOk & what) != 0;
+    }
+
+    // netMgr only
+    void timeStage(uint8_t stage, uint32_t ms) {
+      if (stage >= NET_STAGE_COUNT) return;
+      stageStats &s = stages[stage];
+      s.last = ms;
+      if (ms > s.worst) s.worst = ms;
+      s.total += ms;
+      s.count++;
+    }
+
+    uint32_t getStageLast(uint8_t stage) {
+      return (stage < NET_STAGE_COUNT) ? stages[stage].last : 0;
+    }
+
+    void reportStats( void ) {
+      String msg = "netService: ms last/avg/worst";
+      for (uint8_t i = 0; i < NET_STAGE_COUNT; i++) {
+        const stageStats &s = stages[i];
+        if (s.count == 0) continue;
+        msg += " " + String(stageName(i)) + " " + String(s.last) + "/" + String(s.total / s.count) + "/" + String(s.worst);
+      }
+      if (dropped) msg += ". " + String(dropped) + " requests dropped";
+      Serial.println(msg);
+    }
+};
+
+extern netService net;
@@ -0,0 +1,556 @@
+// This file defines the oneCallParser class
+// Gets the OpenWeather OneCall forecast and parses it straight into a weather snapshot as it comes
+// off the socket. The whole document is never held in RAM, and nothing is allocated. Which fields
+// are wanted is set by the tables below (the projection); everything else, including whole objects
+// and arrays like "minutely", is skipped byte by byte as it's read. Only the first WX_HOURS hourly
+// and WX_DAYS daily entries are kept, and only the first "weather" entry of each.
+// A fetch is timed in stages: TLS (connect and handshake), HTTP (request sent to the end of the
+// headers) and PARSE (the body, which includes waiting for it to arrive).
+// How long the server says the response stays fresh (Cache-Control max-age, less its Age) is kept
+// for the refresh schedule. With OW_STANDIN_HOST defined the forecast comes over plain HTTP from
+// tools/onecall_standin.py instead, to test the schedule.
+
+#include "globalInclude.h"
+
+#include <WiFiClientSecure.h>
+#include <esp_task_wdt.h>
+#include <stddef.h>
+
+#define OW_HOST "api.openweathermap.org"
+#define OW_PORT 443
+// #define OW_STANDIN_HOST "192.168.1.20" // this machine running tools/onecall_standin.py
+#define OW_STANDIN_PORT 8080
+#define OW_PATH "/data/2.5/onecall"
+#define OW_TIMEOUT 10000 // ms a fetch can take, in all
+#define OW_BUF_LEN 512 // bytes read from the socket at a time
+#define OW_KEY_LEN 24 // longer keys are skipped. None wanted are that long.
+#define OW_NUM_LEN 24
+#define OW_PATH_LEN 32 // a field's path within an entry, e.g. "feels_like.morn"
+#define OW_MAX_DEPTH 8 // deeper than this is a bad document
+
+// field types
+#define OW_U32 0
+#define OW_U16 1
+#define OW_U8 2
+#define OW_FLOAT 3
+
+// A wanted field. path is where it is in an entry, with "." between levels. An array on the way
+// is taken to mean its first entry, so "weather.id" is weather[0].id.
+struct owField {
+  const char *path;
+  uint8_t type;
+  uint16_t offset;
+};
+
+static const owField owCurrentFields[] = {
+  {"dt", OW_U32, offsetof(wxCurrent, dt)},
+  {"sunrise", OW_U32, offsetof(wxCurrent, sunrise)},
+  {"sunset", OW_U32, offsetof(wxCurrent, sunset)},
+  {"temp", OW_FLOAT, offsetof(wxCurrent, temp)},
+  {"feels_like", OW_FLOAT, offsetof(wxCurrent, feels_like)},
+  {"pressure", OW_FLOAT, offsetof(wxCurrent, pressure)},
+  {"humidity", OW_U8, offsetof(wxCurrent, humidity)},
+  {"clouds", OW_U8, offsetof(wxCurrent, clouds)},
+  {"wind_speed", OW_FLOAT, offsetof(wxCurrent, wind_speed)},
+  {"wind_gust", OW_FLOAT, offsetof(wxCurrent, wind_gust)},
+  {"wind_deg", OW_U16, offsetof(wxCurrent, wind_deg)},
+  {"weather.id", OW_U16, offsetof(wxCurrent, id)},
+};
+
+static const owField owHourFields[] = {
+  {"dt", OW_U32, offsetof(wxHour, dt)},
+  {"temp", OW_FLOAT, offsetof(wxHour, temp)},
+  {"wind_speed", OW_FLOAT, offsetof(wxHour, wind_speed)},
+  {"wind_gust", OW_FLOAT, offsetof(wxHour, wind_gust)},
+  {"weather.id", OW_U16, offsetof(wxHour, id)},
+};
+
+static const owField owDayFields[] = {
+  {"dt", OW_U32, offsetof(wxDay, dt)},
+  {"temp.min", OW_FLOAT, offsetof(wxDay, temp_min)},
+  {"temp.max", OW_FLOAT, offsetof(wxDay, temp_max)},
+  {"temp.morn", OW_FLOAT, offsetof(wxDay, temp_morn)},
+  {"temp.day", OW_FLOAT, offsetof(wxDay, temp_day)},
+  {"temp.eve", OW_FLOAT, offsetof(wxDay, temp_eve)},
+  {"temp.night", OW_FLOAT, offsetof(wxDay, temp_night)},
+  {"feels_like.morn", OW_FLOAT, offsetof(wxDay, feels_like_morn)},
+  {"feels_like.day", OW_FLOAT, offsetof(wxDay, feels_like_day)},
+  {"feels_like.eve", OW_FLOAT, offsetof(wxDay, feels_like_eve)},
+  {"feels_like.night", OW_FLOAT, offsetof(wxDay, feels_like_night)},
+  {"humidity", OW_U8, offsetof(wxDay, humidity)},
+  {"wind_speed", OW_FLOAT, offsetof(wxDay, wind_speed)},
+  {"wind_gust", OW_FLOAT, offsetof(wxDay, wind_gust)},
+  {"pop", OW_FLOAT, offsetof(wxDay, pop)},
+  {"rain", OW_FLOAT, offsetof(wxDay, rain)},
+  {"snow", OW_FLOAT, offsetof(wxDay, snow)},
+  {"weather.id", OW_U16, offsetof(wxDay, id)},
+};
+
+#define OW_FIELD_COUNT(t) (sizeof(t) / sizeof(owField))
+
+class oneCallParser {
+
+  private:
+    Client *src = NULL;
+    uint8_t buf[OW_BUF_LEN];
+    uint16_t bufLen = 0;
+    uint16_t bufPos = 0;
+    bool chunked = false; // Transfer-Encoding: chunked
+    uint32_t chunkLeft = 0;
+    uint32_t startMs = 0;
+    bool failed = false; // timed out, or the connection closed early
+    int ahead = -1; // a byte read but not used yet
+
+    // what the last parse got
+    bool gotCurrent = false;
+    uint8_t gotHours = 0;
+    uint8_t gotDays = 0;
+    uint32_t bodyBytes = 0;
+    uint32_t skippedBytes = 0;
+    int32_t maxAge = -1; // Cache-Control max-age in s, -1 if none given
+    uint32_t age = 0; // Age, s the response sat in a cache
+
+    // Next byte from the socket, or -1 at the end or on a timeout
+    int rawByte( void ) {
+      if (bufPos >= bufLen) {
+        if (failed || src == NULL) return -1;
+        bufPos = bufLen = 0;
+        while (src->available() == 0) {
+          if (!src->connected() || millis() - startMs > OW_TIMEOUT) {
+            failed = true;
+            return -1;
+          }
+          vTaskDelay(1);
+        }
+        int got = src->read(buf, OW_BUF_LEN);
+        if (got <= 0) {
+          failed = true;
+          return -1;
+        }
+        bufLen = got;
+        esp_task_wdt_reset();
+      }
+      return buf[bufPos++];
+    }
+
+    // Next byte of the body, with any chunk headers taken out
+    int bodyByte( void ) {
+      if (chunked && chunkLeft == 0) {
+        uint32_t len = 0;
+        int c = rawByte();
+        if (c == '\r') c = rawByte(); // the end of the last chunk
+        if (c == '\n') c = rawByte();
+        for (; c >= 0 && c != '\r' && c != '\n' && c != ';'; c = rawByte()) {
+          if (c >= '0' && c <= '9') len = len * 16 + (c - '0');
+          else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') len = len * 16 + ((c | 0x20) - 'a' + 10);
+        }
+        while (c >= 0 && c != '\n') c = rawByte();
+        if (c < 0 || len == 0) return -1;
+        chunkLeft = len;
+      }
+      int c = rawByte();
+      if (c >= 0) {
+        bodyBytes++;
+        if (chunked) chunkLeft--;
+      }
+      return c;
+    }
+
+    int next( void ) {
+      if (ahead >= 0) {
+        int c = ahead;
+        ahead = -1;
+        return c;
+      }
+      return bodyByte();
+    }
+
+    int peek( void ) {
+      if (ahead < 0) ahead = bodyByte();
+      return ahead;
+    }
+
+    // Next byte that isn't white space
+    int nextToken( void ) {
+      int c;
+      do {
+        c = next();
+      } while (c == ' ' || c == '\t' || c == '\r' || c == '\n');
+      return c;
+    }
+
+    int peekToken( void ) {
+      int c = peek();
+      while (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+        next();
+        c = peek();
+      }
+      return c;
+    }
+
+    // Read the rest of a string, after its opening quote. Keeps up to len - 1 chars in dest,
+    // or none if dest is NULL.
+    bool readString(char *dest, uint8_t len) {
+      uint8_t n = 0;
+      for (;;) {
+        int c = next();
+        if (c < 0) return false;
+        if (c == '"') break;
+        if (c == '\\') {
+          c = next();
+          if (c < 0) return false;
+          switch (c) {
+            case 'n': c = '\n'; break;
+            case 't': c = '\t'; break;
+            case 'r': c = '\r'; break;
+            case 'b': c = '\b'; break;
+            case 'f': c = '\f'; break;
+            case 'u': {
+                uint16_t code = 0;
+                for (uint8_t i = 0; i < 4; i++) {
+                  int h = next();
+                  if (h < 0) return false;
+                  code = code * 16 + ((h <= '9') ? (h - '0') : ((h | 0x20) - 'a' + 10));
+                }
+                c = (code < 0x80) ? code : '?'; // the fonts are ASCII
+                break;
+              }
+            default: break; // \" \\ \/
+          }
+        }
+        if (dest != NULL && n < len - 1) dest[n++] = c;
+      }
+      if (dest != NULL) dest[n] = '\0';
+      return true;
+    }
+
+    // Read a number, true, false or null into dest, up to the next delimiter
+    bool readScalar(char *dest, uint8_t len) {
+      uint8_t n = 0;
+      for (;;) {
+        int c = peek();
+        if (c < 0) return false;
+        if (c == ',' || c == '}' || c == ']' || c == ' ' || c == '\t' || c == '\r' || c == '\n') break;
+        next();
+        if (n < len - 1) dest[n++] = c;
+      }
+      dest[n] = '\0';
+      return n > 0;
+    }
+
+    // Skip a whole value of any kind without keeping any of it
+    bool skipValue( void ) {
+      uint32_t startBytes = bodyBytes;
+      int c = nextToken();
+      if (c == '"') {
+        bool ok = readString(NULL, 0);
+        skippedBytes += bodyBytes - startBytes;
+        return ok;
+      }
+      if (c != '{' && c != '[') {
+        char scratch[OW_NUM_LEN];
+        ahead = c;
+        bool ok = readScalar(scratch, sizeof(scratch));
+        skippedBytes += bodyBytes - startBytes;
+        return ok;
+      }
+      uint16_t depth = 1;
+      while (depth > 0) {
+        c = next();
+        if (c < 0) return false;
+        if (c == '"') {
+          if (!readString(NULL, 0)) return false;
+        }
+        else if (c == '{' || c == '[') depth++;
+        else if (c == '}' || c == ']') depth--;
+      }
+      skippedBytes += bodyBytes - startBytes;
+      return true;
+    }
+
+    // Is path a field, or on the way to one? Returns the field, or NULL. *under is set if it's on
+    // the way.
+    static const owField *findField(const owField *fields, uint8_t count, const char *path, bool *under) {
+      size_t len = strlen(path);
+      *under = false;
+      for (uint8_t i = 0; i < count; i++) {
+        if (strncmp(fields[i].path, path, len) != 0) continue;
+        if (fields[i].path[len] == '\0') return &fields[i];
+        if (fields[i].path[len] == '.') *under = true;
+      }
+      return NULL;
+    }
+
+    bool store(const owField *field, uint8_t *base) {
+      uint8_t *dest = base + field->offset;
+      int c = nextToken();
+      if (c == '"' || c == '{' || c == '[') { // not what was expected. Leave it zero.
+        ahead = c;
+        return skipValue();
+      }
+      char num[OW_NUM_LEN];
+      ahead = c;
+      if (!readScalar(num, sizeof(num))) return false;
+      switch (field->type) {
+        case OW_U32: {
+            uint32_t v = strtoul(num, NULL, 10);
+            memcpy(dest, &v, sizeof(v));
+            break;
+          }
+        case OW_U16: {
+            uint16_t v = strtoul(num, NULL, 10);
+            memcpy(dest, &v, sizeof(v));
+            break;
+          }
+        case OW_U8: {
+            uint8_t v = strtoul(num, NULL, 10);
+            *dest = v;
+            break;
+          }
+        case OW_FLOAT: {
+            float v = strtof(num, NULL);
+            memcpy(dest, &v, sizeof(v));
+            break;
+          }
+        default: break;
+      }
+      return true;
+    }
+
+    // Parse a value within an entry. path is where it is. Wanted fields are stored in base.
+    bool parseValue(const owField *fields, uint8_t count, uint8_t *base, char *path, uint8_t depth) {
+      if (depth > OW_MAX_DEPTH) return false;
+      int c = nextToken();
+
+      if (c == '[') { // keep the first entry only
+        if (peekToken() == ']') return next() == ']';
+        for (uint16_t i = 0; ; i++) {
+          bool ok = (i == 0) ? parseValue(fields, count, base, path, depth + 1) : skipValue();
+          if (!ok) return false;
+          c = nextToken();
+          if (c == ']') return true;
+          if (c != ',') return false;
+        }
+      }
+
+      if (c != '{') { // a value nothing wants
+        ahead = c;
+        return skipValue();
+      }
+
+      if (peekToken() == '}') return next() == '}';
+      size_t pathLen = strlen(path);
+      for (;;) {
+        if (nextToken() != '"') return false;
+        char key[OW_KEY_LEN];
+        if (!readString(key, sizeof(key))) return false;
+        if (nextToken() != ':') return false;
+
+        bool ok;
+        if (pathLen + 1 + strlen(key) >= OW_PATH_LEN) {
+          ok = skipValue();
+        }
+        else {
+          if (pathLen) strcat(path, ".");
+          strcat(path, key);
+          bool under;
+          const owField *field = findField(fields, count, path, &under);
+          if (field != NULL) ok = store(field, base);
+          else if (under) ok = parseValue(fields, count, base, path, depth + 1);
+          else ok = skipValue();
+          path[pathLen] = '\0';
+        }
+        if (!ok) return false;
+
+        c = nextToken();
+        if (c == '}') return true;
+        if (c != ',') return false;
+      }
+    }
+
+    // Parse an array of entries, keeping the first max
+    bool parseEntries(const owField *fields, uint8_t count, uint8_t *base, size_t size, uint8_t max, uint8_t &got) {
+      got = 0;
+      if (nextToken() != '[') return false;
+      if (peekToken() == ']') return next() == ']';
+      for (;;) {
+        bool ok;
+        if (got < max) {
+          char path[OW_PATH_LEN] = "";
+          ok = parseValue(fields, count, base + got * size, path, 1);
+          if (ok) got++;
+        }
+        else {
+          ok = skipValue();
+        }
+        if (!ok) return false;
+        int c = nextToken();
+        if (c == ']') return true;
+        if (c != ',') return false;
+      }
+    }
+
+    // Read the status line and headers. Returns the HTTP status, or 0.
+    int readHeaders( void ) {
+      char line[64];
+      int status = 0;
+      bool first = true;
+      chunked = false;
+      maxAge = -1;
+      age = 0;
+      for (;;) {
+        uint8_t n = 0;
+        int c;
+        while ((c = rawByte()) >= 0 && c != '\n') {
+          if (c != '\r' && n < sizeof(line) - 1) line[n++] = c;
+        }
+        if (c < 0) return 0;
+        line[n] = '\0';
+        if (n == 0) return status; // the blank line after the headers
+        if (first) {
+          char *sp = strchr(line, ' ');
+          status = (sp != NULL) ? atoi(sp + 1) : 0;
+          first = false;
+        }
+        else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0 && strstr(line + 18, "chunked") != NULL) {
+          chunked = true;
+        }
+        else if (strncasecmp(line, "Cache-Control:", 14) == 0) {
+          const char *max = strstr(line + 14, "max-age=");
+          if (strstr(line + 14, "no-cache") != NULL || strstr(line + 14, "no-store") != NULL) maxAge = 0;
+          else if (max != NULL) maxAge = atol(max + 8);
+        }
+        else if (strncasecmp(line, "Age:", 4) == 0) {
+          age = atol(line + 4);
+        }
+      }
+    }
+
+    void attach(Client *client) {
+      src = client;
+      bufLen = bufPos = 0;
+      chunkLeft = 0;
+      ahead = -1;
+      failed = false;
+      startMs = millis();
+    }
+
+    // Parse the body into wx, which should be zeroed. Returns true if the current weather and all
+    // the hourly and daily entries kept were found.
+    bool parseBody(wxSnapshot *wx) {
+      gotCurrent = false;
+      gotHours = gotDays = 0;
+      bodyBytes = skippedBytes = 0;
+
+      bool ok = (nextToken() == '{');
+      if (ok && peekToken() == '}') ok = false; // an empty document
+      while (ok) {
+        char key[OW_KEY_LEN];
+        ok = nextToken() == '"' && readString(key, sizeof(key)) && nextToken() == ':';
+        if (!ok) break;
+
+        if (strcmp(key, "current") == 0) {
+          char path[OW_PATH_LEN] = "";
+          ok = parseValue(owCurrentFields, OW_FIELD_COUNT(owCurrentFields), (uint8_t *)&wx->current, path, 1);
+          gotCurrent = ok;
+        }
+        else if (strcmp(key, "hourly") == 0) {
+          ok = parseEntries(owHourFields, OW_FIELD_COUNT(owHourFields), (uint8_t *)wx->hourly, sizeof(wxHour), WX_HOURS, gotHours);
+        }
+        else if (strcmp(key, "daily") == 0) {
+          ok = parseEntries(owDayFields, OW_FIELD_COUNT(owDayFields), (uint8_t *)wx->daily, sizeof(wxDay), WX_DAYS, gotDays);
+        }
+        else {
+          ok = skipValue();
+        }
+        if (!ok) break;
+
+        int c = nextToken();
+        if (c == '}') break;
+        if (c != ',') ok = false;
+      }
+
+      if (!ok) {
+        Serial.println(failed ? "oneCallParser: Timed out or cut off after " + String(bodyBytes) + " bytes"
+                       : "oneCallParser: Bad JSON at byte " + String(bodyBytes));
+        return false;
+      }
+      if (!gotCurrent || gotHours < WX_HOURS || gotDays < WX_DAYS) {
+        Serial.println("oneCallParser: Incomplete forecast. Hours " + String(gotHours) + ", days " + String(gotDays));
+        return false;
+      }
+      return true;
+    }
+
+  public:
+
+    // Parse a whole OneCall HTTP response, headers and all, from client into wx, which should be
+    // zeroed. For a response that's already been fetched, e.g. a recorded one.
+    bool parse(Client &client, wxSnapshot *wx) {
+      attach(&client);
+      int status = readHeaders();
+      bool ok = (status == 200) && parseBody(wx);
+      if (status != 200) Serial.println("oneCallParser.parse: HTTP status " + String(status));
+      src = NULL;
+      return ok;
+    }
+
+    // Get the forecast into wx, which should be zeroed. Network task only, connected.
+    bool fetch(wxSnapshot *wx, const String &apiKey, const String &latitude, const String &longitude, const String &units, const String &language) {
+#ifdef OW_STANDIN_HOST
+      WiFiClient client;
+      const char *host = OW_STANDIN_HOST;
+      uint16_t port = OW_STANDIN_PORT;
+#else
+      WiFiClientSecure client;
+      client.setInsecure(); // as the OpenWeather library does. The forecast is public.
+      const char *host = OW_HOST;
+      uint16_t port = OW_PORT;
+#endif
+
+      uint32_t stageMs = millis();
+      if (!client.connect(host, port)) {
+        Serial.println("oneCallParser.fetch: Unable to connect to " + String(host));
+        return false;
+      }
+      net.timeStage(NET_STAGE_TLS, millis() - stageMs);
+
+      // HTTP/1.0 so the body normally isn't chunked
+      stageMs = millis();
+      client.print("GET " OW_PATH "?lat=" + latitude + "&lon=" + longitude + "&exclude=minutely,alerts&units=" + units +
+                   "&lang=" + language + "&appid=" + apiKey + " HTTP/1.0\r\nHost: " + String(host) + "\r\nConnection: close\r\n\r\n");
+      attach(&client);
+      int status = readHeaders();
+      net.timeStage(NET_STAGE_HTTP, millis() - stageMs);
+
+      bool ok = false;
+      if (status == 200) {
+        stageMs = millis();
+        ok = parseBody(wx);
+        net.timeStage(NET_STAGE_PARSE, millis() - stageMs);
+        Serial.println("oneCallParser.fetch: " + String(bodyBytes) + " bytes, " + String(skippedBytes) + " skipped");
+      }
+      else {
+        Serial.println("oneCallParser.fetch: HTTP status " + String(status));
+      }
+      src = NULL;
+      client.stop();
+      return ok;
+    }
+
+    // bytes in the last body, and how many of them were skipped
+    uint32_t getBodyBytes( void ) {
+      return bodyBytes;
+    }
+
+    uint32_t getSkippedBytes( void ) {
+      return skippedBytes;
+    }
+
+    // s the last response is fresh for, by its cache headers. 0 if they didn't say.
+    uint32_t getFreshFor( void ) {
+      return (maxAge > (int32_t)age) ? maxAge - age : 0;
+    }
+};
+
+extern oneCallParser oneCall;
@@ -0,0 +1,174 @@
+// This file defines the rtcDrift class
+// Learns how fast the DS3231 runs and trims it with the aging offset register. At each NTP sync,
+// before the RTC is set, its error against NTP is measured to about a millisecond by timing the
+// RTC's seconds tick with esp_timer. The error over the time since the last set is the drift in
+// ppm. Part of that is written to the aging register, about 0.1ppm a step, so the RTC slowly
+// converges on the right rate. The further it gets, the smaller the error at each sync, and the
+// longer the NTP poll interval is allowed to grow. The clock then needs WiFi less often, and
+// holds time well if the network is down for days.
+// The aging offset is kept by the RTC on its battery. The rest is saved in NVS.
+
+#include "globalInclude.h"
+
+#include <DS3232RTC.h>
+#include <Preferences.h>
+#include <esp_timer.h>
+
+#define DRIFT_KEY "rtcdrift"
+#define DRIFT_VERSION 1
+#define DRIFT_MIN_INTERVAL 3600 // s between NTP syncs. The starting point, and after a bad one.
+#define DRIFT_MAX_INTERVAL (4 * 86400L)
+#define DRIFT_MIN_SPAN 1800 // s since the last set before an error says anything about the rate
+#define DRIFT_MEASURE_ERROR 2000 // us we might be off measuring the RTC tick, plus the NTP error
+#define DRIFT_GOOD_ERROR 20000 // us at a sync to double the interval
+#define DRIFT_BAD_ERROR 100000 // us at a sync to halve it
+#define DRIFT_AGING_PPM 0.1f // ppm one aging step moves the rate (typical at 25C)
+#define DRIFT_AGING_MAX_STEP 8 // aging steps per sync, so a bad sample can't throw it far
+#define DRIFT_SANE_ERROR 10000000 // us. Any further off and the RTC was set wrong, it didn't drift.
+#define DRIFT_NO_MEASUREMENT INT64_MIN
+
+extern DS3232RTC RTC;
+extern Preferences prefs;
+
+struct __attribute__((packed)) driftState {
+  uint8_t version;
+  uint32_t lastSet; // UTC the RTC was last set from NTP, 0 if never
+  uint32_t interval; // s until the next NTP sync
+  float ppm; // filtered drift at the current aging offset. Positive is fast.
+  uint16_t syncs; // measured syncs
+};
+
+class rtcDrift {
+
+  private:
+    driftState state;
+    int8_t aging = 0;
+    uint32_t lastTry = 0; // UTC of the last NTP attempt
+    int64_t lastError = 0; // us at the last measured sync
+    float lastPpm = 0.0f;
+
+    void save( void ) {
+      prefs.putBytes(DRIFT_KEY, &state, sizeof(state));
+    }
+
+    // Call with rtcMutex held. Writes the aging offset and starts a temperature conversion, which
+    // is when the RTC applies it.
+    void writeAging(int8_t value) {
+      aging = value;
+      RTC.writeRTC(RTC_AGING, (uint8_t)aging);
+      RTC.writeRTC(RTC_CONTROL, RTC.readRTC(RTC_CONTROL) | _BV(CONV));
+    }
+
+  public:
+
+    // Call once the RTC is running, with rtcMutex held
+    void begin( void ) {
+      if (prefs.getBytes(DRIFT_KEY, &state, sizeof(state)) != sizeof(state) || state.version != DRIFT_VERSION) {
+        memset(&state, 0, sizeof(state));
+        state.version = DRIFT_VERSION;
+        state.interval = DRIFT_MIN_INTERVAL;
+      }
+      aging = (int8_t)RTC.readRTC(RTC_AGING);
+      Serial.println("rtcDrift.begin: aging offset " + String(aging) + ", drift " + String(state.ppm, 3) + "ppm, NTP every " + String(state.interval / 60) + " minutes");
+    }
+
+    // Call with rtcMutex held when the RTC was set some other way than synced(), so the time since
+    // the last set says nothing about its rate. If the oscillator stopped, everything learned goes,
+    // as a power loss also clears the aging offset.
+    void restart(uint32_t utc, bool oscStopped) {
+      state.lastSet = utc;
+      state.interval = DRIFT_MIN_INTERVAL;
+      if (oscStopped) {
+        aging = (int8_t)RTC.readRTC(RTC_AGING);
+        state.ppm = 0.0f;
+        state.syncs = 0;
+      }
+      save();
+    }
+
+    bool ntpDue(uint32_t utc) {
+      if (state.lastSet == 0) return true;
+      if (utc - lastTry < DRIFT_MIN_INTERVAL) return false; // failed recently
+      return utc - state.lastSet >= state.interval;
+    }
+
+    void ntpFailed(uint32_t utc) {
+      lastTry = utc;
+    }
+
+    // Call with rtcMutex held, after an NTP query, with its offset (UTC minus esp_timer in us).
+    // Waits for the RTC's next tick and returns how far ahead of UTC the RTC is, in us.
+    int64_t measure(int64_t ntpOffset) {
+      uint8_t startSecond = RTC.readRTC(RTC_SECONDS);
+      int64_t start = esp_timer_get_time();
+      int64_t before = start; // just after the last read of the old second
+      int64_t seen = start;
+      uint8_t tickSecond = startSecond;
+      while (tickSecond == startSecond) {
+        if (seen - start > 1100000) return DRIFT_NO_MEASUREMENT; // it isn't ticking
+        before = seen;
+        vTaskDelay(1);
+        tickSecond = RTC.readRTC(RTC_SECONDS);
+        seen = esp_timer_get_time();
+      }
+      int64_t tick = (before + seen) / 2; // it ticked between the two reads
+      time_t rtcTime = RTC.get(); // same second, as long as this is well under a second later
+      if (second(rtcTime) != ((tickSecond >> 4) * 10 + (tickSecond & 0x0F))) return DRIFT_NO_MEASUREMENT;
+      return (int64_t)rtcTime * 1000000 - (tick + ntpOffset);
+    }
+
+    // Call with rtcMutex held, once the RTC has been set from NTP. error is what measure() gave
+    // just before. Updates the rate, trims the aging offset and picks the next interval.
+    void synced(uint32_t utc, int64_t error) {
+      lastTry = utc;
+      uint32_t span = utc - state.lastSet;
+      if (error == DRIFT_NO_MEASUREMENT || error > DRIFT_SANE_ERROR || error < -DRIFT_SANE_ERROR || state.lastSet == 0 || span < DRIFT_MIN_SPAN) {
+        state.lastSet = utc;
+        save();
+        return;
+      }
+      lastError = error;
+      lastPpm = (float)error / span; // us per s is ppm
+      float noisePpm = (float)DRIFT_MEASURE_ERROR / span;
+
+      // The rate at the current aging offset. Short spans are noisy, so they count for less.
+      float weight = (span >= 6 * 3600) ? 0.5f : 0.25f;
+      state.ppm = (state.syncs == 0) ? lastPpm : state.ppm + weight * (lastPpm - state.ppm);
+      state.syncs++;
+
+      // Trim by half the filtered rate, past the noise. Fast needs more aging (more load capacitance).
+      if (fabsf(state.ppm) > noisePpm) {
+        int16_t steps = (int16_t)roundf(state.ppm / (2 * DRIFT_AGING_PPM));
+        steps = constrain(steps, -DRIFT_AGING_MAX_STEP, DRIFT_AGING_MAX_STEP);
+        int16_t newAging = constrain(aging + steps, -127, 127);
+        if (newAging != aging) {
+          state.ppm -= (newAging - aging) * DRIFT_AGING_PPM; // what's left once it takes effect
+          writeAging(newAging);
+        }
+      }
+
+      int64_t absError = (error < 0) ? -error : error;
+      if (absError < DRIFT_GOOD_ERROR && state.interval < DRIFT_MAX_INTERVAL) {
+        state.interval = min((uint32_t)DRIFT_MAX_INTERVAL, state.interval * 2);
+      }
+      else if (absError > DRIFT_BAD_ERROR && state.interval > DRIFT_MIN_INTERVAL) {
+        state.interval = max((uint32_t)DRIFT_MIN_INTERVAL, state.interval / 2);
+      }
+      state.lastSet = utc;
+      save();
+      report();
+    }
+
+    void report( void ) {
+      Serial.println("rtcDrift: last error " + String((int32_t)(lastError / 1000)) + "ms (" + String(lastPpm, 3) + "ppm), drift " + String(state.ppm, 3) +
+                     "ppm after " + String(state.syncs) + " syncs, aging offset " + String(aging) + ", NTP every " + String(state.interval / 60) + " minutes");
+    }
+
+    int8_t getAging( void ) {
+      return aging;
+    }
+
+    uint32_t getInterval( void ) {
+      return state.interval;
+    }
+};
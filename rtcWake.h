@@ -0,0 +1,159 @@
+// This file defines the rtcWake class
+// Keeps the DS3231's two hardware alarms pointed at the next alarm ring (alarm 1, ALARM_PREARM_TIME
+// early, so the sound can be pre-armed) and the next sunrise start (alarm 2). The RTC's INT line then wakes the ESP32 for those events, so with
+// RTC_LIGHT_SLEEP defined timeMgr can light-sleep through quiet periods instead of polling.
+//
+// NOTE: INT/SQW is not routed on the PCB. RTC_INT_PIN needs a wire from the RTC module's SQW pin.
+
+#include "globalInclude.h"
+
+#include <DS3232RTC.h>
+#include <esp_sleep.h>
+#include <driver/rtc_io.h>
+
+// #define RTC_LIGHT_SLEEP // light-sleep between events. Needs the RTC_INT_PIN wire.
+
+#define RTC_INT_PIN GPIO_NUM_27 // DS3231 INT/SQW, active low
+#define RTC_SLEEP_MIN_MS 200 // not worth sleeping for less than this
+#define RTC_SLEEP_MAX_MS 30000 // well inside the 60s task WDT
+
+extern DS3232RTC RTC;
+extern SemaphoreHandle_t rtcMutex;
+extern volatile bool rtcIntFlag; // set by the RTC INT ISR
+
+class rtcWake {
+
+  private:
+    time_t programmedAlarm = 0; // local times last written to the RTC
+    time_t programmedSunrise = 0;
+    uint32_t wakeCount = 0;
+    uint32_t sleepCount = 0;
+    unsigned long sleepMillisTotal = 0;
+
+    // Write one RTC alarm. Call with the rtcMutex held. The RTC holds UTC, so convert the local time
+    // with the zone's offset at that time, which may not be the offset now. Matching the date as
+    // well means it can't go off early in the month.
+    // toUtc() gives the first pass of an hour the clocks go back over. If that has gone, we are in the
+    // second pass, so use the offset now.
+    void writeAlarm(uint8_t alarmNumber, time_t localTs, time_t utcNow) {
+      if (localTs == 0) {
+        RTC.alarmInterrupt(alarmNumber, false);
+        return;
+      }
+      time_t utc = zone.toUtc(localTs);
+      if (utc <= utcNow) {
+        utc = localTs - zone.offsetAt(utcNow);
+      }
+      if (alarmNumber == ALARM_1) {
+        RTC.setAlarm(ALM1_MATCH_DATE, second(utc), minute(utc), hour(utc), day(utc));
+      }
+      else { // alarm 2 has no seconds register
+        RTC.setAlarm(ALM2_MATCH_DATE, 0, minute(utc), hour(utc), day(utc));
+      }
+      RTC.alarmInterrupt(alarmNumber, true);
+    }
+
+  public:
+
+    // Call once the RTC is running. Sets INT/SQW to interrupt mode and clears any stale alarm flags.
+    void begin( void ) {
+      if (xSemaphoreTake(rtcMutex, (TickType_t) 250) == pdTRUE ) {
+        RTC.squareWave(SQWAVE_NONE);
+        RTC.alarmInterrupt(ALARM_1, false);
+        RTC.alarmInterrupt(ALARM_2, false);
+        RTC.alarm(ALARM_1);
+        RTC.alarm(ALARM_2);
+        xSemaphoreGive(rtcMutex);
+      }
+      else {
+        Serial.println("rtcWake.begin: Unable to get RTC Mutex");
+      }
+      programmedAlarm = 0;
+      programmedSunrise = 0;
+    }
+
+    // Point the RTC alarms at the next ring and sunrise start (local times, 0 for none). Alarm 1 goes
+    // off ALARM_PREARM_TIME before the ring. Only touches the RTC if something changed.
+    void program(time_t alarmTs, time_t sunriseTs, time_t ts) {
+      if (alarmTs != 0) alarmTs -= ALARM_PREARM_TIME;
+      if (alarmTs <= ts) alarmTs = 0;
+      if (sunriseTs <= ts) sunriseTs = 0;
+      if (alarmTs == programmedAlarm && sunriseTs == programmedSunrise) {
+        return;
+      }
+      if (xSemaphoreTake(rtcMutex, (TickType_t) 250) == pdTRUE ) {
+        time_t utcNow = RTC.get();
+        writeAlarm(ALARM_1, alarmTs, utcNow);
+        writeAlarm(ALARM_2, sunriseTs, utcNow);
+        RTC.alarm(ALARM_1); // clear the flags so INT only goes low for the new times
+        RTC.alarm(ALARM_2);
+        xSemaphoreGive(rtcMutex);
+        programmedAlarm = alarmTs;
+        programmedSunrise = sunriseTs;
+        Serial.println("rtcWake.program: RTC alarm in " + String((int32_t)(alarmTs ? alarmTs - ts : -1)) + "s, sunrise in " + String((int32_t)(sunriseTs ? sunriseTs - ts : -1)) + "s (-1 is off)");
+      }
+      else {
+        Serial.println("rtcWake.program: Unable to get RTC Mutex");
+      }
+    }
+
+    // Call each pass of timeMgr. If INT went low, clear the RTC flags so it can fire again.
+    // Returns true if an RTC alarm fired.
+    bool service( void ) {
+      if (!rtcIntFlag) return false;
+      rtcIntFlag = false;
+      bool alarm1Fired = false;
+      bool alarm2Fired = false;
+      if (xSemaphoreTake(rtcMutex, (TickType_t) 250) == pdTRUE ) {
+        alarm1Fired = RTC.alarm(ALARM_1);
+        alarm2Fired = RTC.alarm(ALARM_2);
+        xSemaphoreGive(rtcMutex);
+      }
+      else {
+        Serial.println("rtcWake.service: Unable to get RTC Mutex");
+        rtcIntFlag = true; // try again next time
+        return false;
+      }
+      wakeCount++;
+      Serial.println("rtcWake.service: RTC INT. Alarm: " + String(alarm1Fired) + " Sunrise: " + String(alarm2Fired) + " Wakes: " + String(wakeCount));
+      if (alarm1Fired) programmedAlarm = 0;
+      if (alarm2Fired) programmedSunrise = 0;
+      return alarm1Fired || alarm2Fired;
+    }
+
+    // Light-sleep for up to ms, waking early on the RTC INT or a touch. Returns the ms slept.
+    uint32_t lightSleep(uint32_t ms) {
+#ifdef RTC_LIGHT_SLEEP
+      if (ms < RTC_SLEEP_MIN_MS) return 0;
+      if (ms > RTC_SLEEP_MAX_MS) ms = RTC_SLEEP_MAX_MS;
+
+      esp_sleep_enable_timer_wakeup((uint64_t)ms * 1000ULL);
+      esp_sleep_enable_ext0_wakeup(RTC_INT_PIN, 0);
+      esp_sleep_enable_ext1_wakeup(1ULL << TOUCH_IRQ_PIN, ESP_EXT1_WAKEUP_ALL_LOW); // so a tap wakes us
+
+      unsigned long startTime = millis();
+      Serial.flush();
+      esp_light_sleep_start();
+      uint32_t slept = millis() - startTime;
+
+      // hand the pins back to the GPIO matrix so the normal interrupts work again
+      rtc_gpio_deinit(RTC_INT_PIN);
+      rtc_gpio_deinit((gpio_num_t)TOUCH_IRQ_PIN);
+      esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_ALL);
+
+      if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_EXT0) {
+        rtcIntFlag = true; // the edge happened while asleep, so the ISR missed it
+      }
+      sleepCount++;
+      sleepMillisTotal += slept;
+      return slept;
+#else
+      (void)ms;
+      return 0;
+#endif
+    }
+
+    void reportStats( void ) {
+      Serial.println("rtcWake: RTC wakes: " + String(wakeCount) + " Light sleeps: " + String(sleepCount) + " Time asleep: " + String(sleepMillisTotal / 1000) + "s");
+    }
+};
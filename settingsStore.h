@@ -0,0 +1,287 @@
+// This file defines the settingsStore class
+// All of the persistent settings (alarms and light colours) are kept in one versioned, CRC checked
+// blob in NVS. Reads come from a RAM copy, and edits are written back once the user has stopped
+// changing things for a while, so a whole edit session costs a single flash write.
+
+#include "globalInclude.h"
+
+#include <Preferences.h>
+#include <rom/crc.h>
+extern Preferences prefs;
+
+#define SETTINGS_KEY "settings"
+#define SETTINGS_VERSION 1
+#define SETTINGS_QUIET_TIME 10000 // ms without an edit before dirty settings are written to flash
+#define DEFAULT_ALARM_COUNT 3
+
+// indexes for the light records
+#define SETTINGS_ROOM_LIGHT  0
+#define SETTINGS_READ_LIGHT  1
+#define SETTINGS_NIGHT_LIGHT 2
+
+// flags for the alarmRecord flags field
+#define ALARM_FLAG_SUNRISE   (1 << 0)
+
+struct __attribute__((packed)) alarmRecord {
+  int8_t hour; // 1-24
+  int8_t minute; // 0-59
+  uint8_t days; // bitfield for days and active state
+  uint8_t flags; // ALARM_FLAG_ bits
+};
+
+struct __attribute__((packed)) lightRecord {
+  float h;
+  float s;
+  float b;
+};
+
+// The blob is a settingsHeader, then alarmCount alarmRecords, then a CRC32 of everything before it
+struct __attribute__((packed)) settingsHeader {
+  uint16_t version;
+  uint16_t length; // total blob length including the CRC
+  uint16_t alarmCount;
+  uint8_t reserved[2];
+  lightRecord lights[3];
+};
+
+// as many alarms as keep the blob length inside the header's 16 bits (16371)
+#define SETTINGS_MAX_ALARMS ((0xFFFF - sizeof(settingsHeader) - sizeof(uint32_t)) / sizeof(alarmRecord))
+
+class settingsStore {
+
+  private:
+    settingsHeader header;
+    alarmRecord *alarms = NULL;
+    SemaphoreHandle_t settingsMutex = NULL;
+    volatile bool dirty = false;
+    volatile unsigned long lastEdit = 0;
+    uint32_t flashWrites = 0;
+
+    uint32_t blobLength(uint16_t alarmCount) {
+      return sizeof(settingsHeader) + (alarmCount * sizeof(alarmRecord)) + sizeof(uint32_t);
+    }
+
+    void markDirty( void ) {
+      dirty = true;
+      lastEdit = millis();
+    }
+
+    void setDefaults(uint16_t alarmCount) {
+      memset(&header, 0, sizeof(header));
+      header.version = SETTINGS_VERSION;
+      header.alarmCount = alarmCount;
+      header.length = blobLength(alarmCount);
+      header.lights[SETTINGS_ROOM_LIGHT] = {0.1, 0.5, 1.0};
+      header.lights[SETTINGS_READ_LIGHT] = {0.0, 0.0, 0.5};
+      header.lights[SETTINGS_NIGHT_LIGHT] = {0.1, 0.5, 1.0};
+
+      delete[] alarms;
+      alarms = new alarmRecord[alarmCount];
+      for (uint16_t i = 0; i < alarmCount; i++) {
+        alarms[i] = {12, 0, 127, 0};
+      }
+    }
+
+    // Read the blob from NVS. Returns false if it is missing or fails any check.
+    bool load( void ) {
+      size_t len = prefs.getBytesLength(SETTINGS_KEY);
+      if (len < blobLength(0)) {
+        return false;
+      }
+
+      uint8_t *buf = new uint8_t[len];
+      prefs.getBytes(SETTINGS_KEY, buf, len);
+
+      settingsHeader tmpHeader;
+      memcpy(&tmpHeader, buf, sizeof(tmpHeader));
+      uint32_t storedCrc;
+      memcpy(&storedCrc, buf + len - sizeof(uint32_t), sizeof(uint32_t));
+
+      if (tmpHeader.version != SETTINGS_VERSION || tmpHeader.length != len || blobLength(tmpHeader.alarmCount) != len) {
+        Serial.println("settingsStore.load: Stored settings version " + String(tmpHeader.version) + " length " + String(len) + " not recognised.");
+        delete[] buf;
+        return false;
+      }
+      if (crc32_le(0, buf, len - sizeof(uint32_t)) != storedCrc) {
+        Serial.println("settingsStore.load: Stored settings failed the CRC check.");
+        delete[] buf;
+        return false;
+      }
+
+      header = tmpHeader;
+      delete[] alarms;
+      alarms = new alarmRecord[header.alarmCount];
+      memcpy(alarms, buf + sizeof(settingsHeader), header.alarmCount * sizeof(alarmRecord));
+      delete[] buf;
+      return true;
+    }
+
+    // Pick up the settings written by the older one-key-per-value code
+    void loadLegacy( void ) {
+      char tmpID[11]; // fits "alarm65535"
+      char varName[sizeof(tmpID) + 7]; // and "alarm65535Sunrise"
+
+      setDefaults(DEFAULT_ALARM_COUNT);
+
+      header.lights[SETTINGS_ROOM_LIGHT] = {prefs.getFloat("RoomH", 0.1), prefs.getFloat("RoomS", 0.5), prefs.getFloat("RoomB", 1.0)};
+      header.lights[SETTINGS_READ_LIGHT] = {prefs.getFloat("ReadH", 0.0), prefs.getFloat("ReadS", 0.0), prefs.getFloat("ReadB", 0.5)};
+      header.lights[SETTINGS_NIGHT_LIGHT] = {prefs.getFloat("NightH", 0.1), prefs.getFloat("NightS", 0.5), prefs.getFloat("NightB", 1.0)};
+
+      for (uint8_t i = 0; i < DEFAULT_ALARM_COUNT; i++) {
+        snprintf(tmpID, sizeof(tmpID), "alarm%d", i + 1);
+        snprintf(varName, sizeof(varName), "%sHour", tmpID);
+        alarms[i].hour = prefs.getChar(varName, 12);
+        snprintf(varName, sizeof(varName), "%sMin", tmpID);
+        alarms[i].minute = prefs.getChar(varName, 0);
+        snprintf(varName, sizeof(varName), "%sDays", tmpID);
+        alarms[i].days = prefs.getUChar(varName, 127);
+        snprintf(varName, sizeof(varName), "%sSunrise", tmpID);
+        alarms[i].flags = prefs.getBool(varName, false) ? ALARM_FLAG_SUNRISE : 0;
+      }
+    }
+
+  public:
+
+    void begin( void ) {
+      if (settingsMutex == NULL) {
+        settingsMutex = xSemaphoreCreateMutex();
+      }
+
+      unsigned long startTime = micros();
+      if (load()) {
+        Serial.println("settingsStore.begin: Loaded settings v" + String(header.version) + " with " + String(header.alarmCount) + " alarms in " + String(micros() - startTime) + "us");
+      }
+      else {
+        Serial.println("settingsStore.begin: No valid settings blob. Migrating from the old keys.");
+        loadLegacy();
+        markDirty();
+      }
+    }
+
+    uint16_t getAlarmCount( void ) {
+      return header.alarmCount;
+    }
+
+    // Set how many alarms are stored, up to SETTINGS_MAX_ALARMS. New alarms get the default settings.
+    // The alarm table is sized from this once, at begin().
+    void setAlarmCount(uint16_t count) {
+      if (count > SETTINGS_MAX_ALARMS) {
+        Serial.println("settingsStore.setAlarmCount: " + String(count) + " alarms is too many. Keeping " + String(SETTINGS_MAX_ALARMS) + ".");
+        count = SETTINGS_MAX_ALARMS;
+      }
+      if (count == header.alarmCount) return;
+      if (xSemaphoreTake(settingsMutex, (TickType_t) 100) == pdTRUE ) {
+        alarmRecord *newAlarms = new alarmRecord[count];
+        for (uint16_t i = 0; i < count; i++) {
+          if (i < header.alarmCount) newAlarms[i] = alarms[i];
+          else newAlarms[i] = {12, 0, 127, 0};
+        }
+        delete[] alarms;
+        alarms = newAlarms;
+        header.alarmCount = count;
+        markDirty();
+        xSemaphoreGive(settingsMutex);
+      }
+      else {
+        Serial.println("settingsStore.setAlarmCount: Unable to get the settingsMutex.");
+      }
+    }
+
+    bool getAlarm(uint16_t index, alarmRecord &rec) {
+      if (index >= header.alarmCount) return false;
+      if (xSemaphoreTake(settingsMutex, (TickType_t) 50) == pdTRUE ) {
+        rec = alarms[index];
+        xSemaphoreGive(settingsMutex);
+        return true;
+      }
+      Serial.println("settingsStore.getAlarm: Unable to get the settingsMutex.");
+      return false;
+    }
+
+    void setAlarm(uint16_t index, const alarmRecord &rec) {
+      if (index >= header.alarmCount) return;
+      if (xSemaphoreTake(settingsMutex, (TickType_t) 50) == pdTRUE ) {
+        if (memcmp(&alarms[index], &rec, sizeof(alarmRecord)) != 0) {
+          alarms[index] = rec;
+          markDirty();
+        }
+        xSemaphoreGive(settingsMutex);
+      }
+      else {
+        Serial.println("settingsStore.setAlarm: Unable to get the settingsMutex. Alarm " + String(index) + " not saved!");
+      }
+    }
+
+    bool getLight(uint8_t index, lightRecord &rec) {
+      if (index > SETTINGS_NIGHT_LIGHT) return false;
+      if (xSemaphoreTake(settingsMutex, (TickType_t) 50) == pdTRUE ) {
+        rec = header.lights[index];
+        xSemaphoreGive(settingsMutex);
+        return true;
+      }
+      Serial.println("settingsStore.getLight: Unable to get the settingsMutex.");
+      return false;
+    }
+
+    void setLight(uint8_t index, const lightRecord &rec) {
+      if (index > SETTINGS_NIGHT_LIGHT) return;
+      if (xSemaphoreTake(settingsMutex, (TickType_t) 50) == pdTRUE ) {
+        if (memcmp(&header.lights[index], &rec, sizeof(lightRecord)) != 0) {
+          header.lights[index] = rec;
+          markDirty();
+        }
+        xSemaphoreGive(settingsMutex);
+      }
+      else {
+        Serial.println("settingsStore.setLight: Unable to get the settingsMutex. Light " + String(index) + " not saved!");
+      }
+    }
+
+    bool isDirty( void ) {
+      return dirty;
+    }
+
+    // Call regularly. Writes the settings once nothing has changed for SETTINGS_QUIET_TIME.
+    void flushIfQuiet( void ) {
+      if (dirty && (millis() - lastEdit > SETTINGS_QUIET_TIME)) {
+        flush();
+      }
+    }
+
+    // Write the settings now if they have changed
+    bool flush( void ) {
+      if (!dirty) return true;
+
+      uint32_t len;
+      uint8_t *buf;
+      if (xSemaphoreTake(settingsMutex, (TickType_t) 100) == pdTRUE ) {
+        len = blobLength(header.alarmCount);
+        header.length = len;
+        buf = new uint8_t[len];
+        memcpy(buf, &header, sizeof(settingsHeader));
+        memcpy(buf + sizeof(settingsHeader), alarms, header.alarmCount * sizeof(alarmRecord));
+        dirty = false; // anything edited from here on marks it dirty again
+        xSemaphoreGive(settingsMutex);
+      }
+      else {
+        Serial.println("settingsStore.flush: Unable to get the settingsMutex. Will try again.");
+        return false;
+      }
+
+      uint32_t crc = crc32_le(0, buf, len - sizeof(uint32_t));
+      memcpy(buf + len - sizeof(uint32_t), &crc, sizeof(uint32_t));
+
+      bool written = (prefs.putBytes(SETTINGS_KEY, buf, len) == len);
+      delete[] buf;
+
+      if (written) {
+        flashWrites++;
+        Serial.println("settingsStore.flush: Settings written to flash. Writes since boot: " + String(flashWrites));
+      }
+      else {
+        Serial.println("settingsStore.flush: Write to flash FAILED!");
+        markDirty();
+      }
+      return written;
+    }
+};
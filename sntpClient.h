@@ -0,0 +1,206 @@
+// This file defines the sntpClient class
+// Asks several NTP servers at once from one UDP socket and keeps the best answer. Each reply gives
+// all four timestamps: our send (T1), the server's receive (T2) and send (T3), and our receive
+// (T4). Our side is timed with esp_timer, so the offset it works out is UTC minus esp_timer, in
+// microseconds. The sample with the shortest round trip wins, since its offset has the smallest
+// possible error (half the round trip). Once a reply is in, anything still on its way has a
+// longer round trip and can't win, so a query ends one best round trip after the sends.
+// Server names can carry a port ("192.168.1.20:12300"), to test against tools/sntp_standin.py.
+
+#include "globalInclude.h"
+
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include <esp_timer.h>
+
+#define SNTP_PORT 123
+#define SNTP_PACKET_SIZE 48
+#define SNTP_MAX_SERVERS 8
+#define SNTP_TIMEOUT 1500 // ms to wait for any reply
+#define SNTP_HOLD_SLACK 5000 // us a server may hold a request. A later reply could still have a shorter round trip.
+#define SNTP_UNIX_OFFSET 2208988800UL // 1900 to 1970 in seconds
+
+struct sntpSample {
+  int64_t offset; // us. UTC = esp_timer_get_time() + offset.
+  int32_t delay; // us round trip, less the time the server held it
+  uint8_t server; // index into the server list
+  uint8_t stratum;
+};
+
+class sntpClient {
+
+  private:
+    struct pendingQuery {
+      IPAddress ip;
+      uint16_t port;
+      int64_t sent; // T1, esp_timer
+      uint8_t stamp[8]; // our transmit timestamp. The reply must echo it.
+      bool answered;
+    };
+
+    sntpSample best;
+    bool haveBest = false;
+    int64_t spread = 0; // us between the highest and lowest offsets in the last query
+    uint8_t replies = 0;
+    uint8_t asked = 0;
+
+    static void writeStamp(uint8_t *buf, int64_t micros) {
+      uint32_t secs = (uint32_t)(micros / 1000000);
+      uint32_t frac = (uint32_t)((((uint64_t)(micros % 1000000)) << 32) / 1000000);
+      for (uint8_t i = 0; i < 4; i++) {
+        buf[i] = secs >> (24 - 8 * i);
+        buf[4 + i] = frac >> (24 - 8 * i);
+      }
+    }
+
+    // An NTP timestamp as us since 1970. Seconds below 2^31 are taken to be after the 2036 rollover.
+    static int64_t readStamp(const uint8_t *buf) {
+      uint32_t secs = ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) | ((uint32_t)buf[2] << 8) | buf[3];
+      uint32_t frac = ((uint32_t)buf[4] << 24) | ((uint32_t)buf[5] << 16) | ((uint32_t)buf[6] << 8) | buf[7];
+      int64_t fullSecs = (int64_t)secs + ((secs & 0x80000000) ? 0 : 0x100000000LL);
+      return (fullSecs - SNTP_UNIX_OFFSET) * 1000000 + (int64_t)((((uint64_t)frac) * 1000000) >> 32);
+    }
+
+    static void splitName(const String &name, String &host, uint16_t &port) {
+      int colon = name.indexOf(':');
+      if (colon < 0) {
+        host = name;
+        port = SNTP_PORT;
+      }
+      else {
+        host = name.substring(0, colon);
+        port = name.substring(colon + 1).toInt();
+      }
+    }
+
+  public:
+
+    // Send to every server and wait for the replies. udp must already be bound to a local port.
+    // Returns true and sets sample to the best reply if any server answered properly.
+    bool query(WiFiUDP &udp, const String *servers, uint8_t count, sntpSample &sample) {
+      pendingQuery pending[SNTP_MAX_SERVERS];
+      uint8_t packet[SNTP_PACKET_SIZE];
+      if (count > SNTP_MAX_SERVERS) count = SNTP_MAX_SERVERS;
+
+      while (udp.parsePacket() > 0) ; // discard anything left over
+
+      // Resolve them all first, so the sends go out together
+      for (uint8_t i = 0; i < count; i++) {
+        String host;
+        splitName(servers[i], host, pending[i].port);
+        pending[i].answered = true; // until it's sent
+        if (!WiFi.hostByName(host.c_str(), pending[i].ip)) {
+          Serial.println("sntpClient.query: Unable to resolve " + host);
+        }
+      }
+
+      asked = 0;
+      int64_t lastSent = 0;
+      for (uint8_t i = 0; i < count; i++) {
+        if ((uint32_t)pending[i].ip == 0) continue;
+        memset(packet, 0, SNTP_PACKET_SIZE);
+        packet[0] = 0b00100011; // no leap warning, version 4, client
+        // Our transmit timestamp is the esp_timer time. Servers only echo it back, so it just
+        // has to be different for each request.
+        pending[i].sent = esp_timer_get_time();
+        writeStamp(packet + 40, pending[i].sent + i);
+        memcpy(pending[i].stamp, packet + 40, 8);
+        udp.beginPacket(pending[i].ip, pending[i].port);
+        udp.write(packet, SNTP_PACKET_SIZE);
+        if (udp.endPacket()) {
+          pending[i].answered = false;
+          asked++;
+          lastSent = pending[i].sent;
+        }
+      }
+      if (asked == 0) return false;
+
+      replies = 0;
+      uint8_t heard = 0; // replies matched to a request, good or not
+      haveBest = false;
+      int64_t lowOffset = 0, highOffset = 0;
+      uint32_t startMs = millis();
+      while (heard < asked) {
+        if (millis() - startMs >= SNTP_TIMEOUT) break;
+        if (haveBest && esp_timer_get_time() - lastSent > best.delay + SNTP_HOLD_SLACK) break; // nothing else can beat it
+
+        int size = udp.parsePacket();
+        int64_t received = esp_timer_get_time(); // T4. Polling makes this up to a tick late.
+        if (size <= 0) {
+          vTaskDelay(1);
+          continue;
+        }
+        if (size < SNTP_PACKET_SIZE) {
+          udp.flush();
+          continue;
+        }
+        udp.read(packet, SNTP_PACKET_SIZE);
+        IPAddress from = udp.remoteIP();
+
+        int8_t idx = -1;
+        for (uint8_t i = 0; i < count; i++) {
+          if (!pending[i].answered && pending[i].ip == from && memcmp(packet + 24, pending[i].stamp, 8) == 0) {
+            idx = i;
+            break;
+          }
+        }
+        if (idx < 0) continue; // late reply to an old query, or not ours
+
+        pending[idx].answered = true;
+        heard++;
+        uint8_t leap = packet[0] >> 6;
+        uint8_t mode = packet[0] & 0x07;
+        uint8_t stratum = packet[1];
+        if (leap == 3 || mode != 4 || stratum == 0 || stratum > 15) { // unsynchronised or a kiss-o'-death
+          Serial.println("sntpClient.query: " + servers[idx] + " refused. Stratum " + String(stratum) + " leap " + String(leap));
+          continue;
+        }
+
+        int64_t t1 = pending[idx].sent;
+        int64_t t2 = readStamp(packet + 32);
+        int64_t t3 = readStamp(packet + 40);
+        int64_t t4 = received;
+        int64_t offset = ((t2 - t1) + (t3 - t4)) / 2;
+        int32_t delay = (int32_t)((t4 - t1) - (t3 - t2));
+        if (delay < 0) delay = 0; // the server's clock ran faster than ours over the exchange
+        Serial.println("sntpClient.query: " + servers[idx] + " stratum " + String(stratum) + " delay " + String(delay) + "us");
+
+        if (replies == 0) {
+          lowOffset = offset;
+          highOffset = offset;
+        }
+        else {
+          if (offset < lowOffset) lowOffset = offset;
+          if (offset > highOffset) highOffset = offset;
+        }
+        replies++;
+        if (!haveBest || delay < best.delay) {
+          best.offset = offset;
+          best.delay = delay;
+          best.server = idx;
+          best.stratum = stratum;
+          haveBest = true;
+        }
+      }
+
+      if (!haveBest) return false;
+      spread = highOffset - lowOffset;
+      sample = best;
+      Serial.println("sntpClient.query: " + String(replies) + " of " + String(asked) + " replied in " + String(millis() - startMs) + "ms. Using " +
+                     servers[best.server] + ", delay " + String(best.delay) + "us. Offsets spread over " + String((int32_t)spread) + "us.");
+      return true;
+    }
+
+    // UTC in us at the given esp_timer time, from the last good query
+    int64_t utcMicros(int64_t timerMicros) {
+      return timerMicros + best.offset;
+    }
+
+    bool hasSample( void ) {
+      return haveBest;
+    }
+
+    sntpSample lastSample( void ) {
+      return best;
+    }
+};
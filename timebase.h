@@ -0,0 +1,165 @@
+// This file defines the timebase class
+// A microsecond view of the local clock, and second and minute edge events for the tasks that
+// care. TimeLib's now() counts whole seconds off millis(), from the millis() value it was set at.
+// setClock() sets it so that value is known exactly, so the edge of every second is known in
+// esp_timer time. A one-shot esp_timer is armed for each edge, and its callback sets notification
+// bits on the subscribed tasks. They wait on those instead of polling, so the clock face redraws
+// and the alarms are tested right as the second changes, not somewhere inside it.
+// The edges follow the RTC because the clock is set from it right on its tick (readRtcOnEdge).
+// The RTC's 1Hz square wave can't be used instead, as INT/SQW is taken by the rtcWake alarms.
+
+#include "globalInclude.h"
+
+#include <TimeLib.h>
+#include <esp_timer.h>
+
+#define TIMEBASE_SECOND 0x01 // notification bits
+#define TIMEBASE_MINUTE 0x02
+#define TIMEBASE_MAX_SUBSCRIBERS 4
+#define TIMEBASE_SET_TRIES 5
+
+class timebase {
+
+  private:
+    struct subscriber {
+      TaskHandle_t task;
+      uint32_t bits;
+    };
+
+    portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+    esp_timer_handle_t edgeTimer = NULL;
+    int64_t anchorMicros = 0; // esp_timer time the clock was set at, on a whole millisecond
+    time_t anchorTime = 0; // and the local time it was set to
+    time_t nextEdge = 0; // the second the timer is armed for
+    subscriber subs[TIMEBASE_MAX_SUBSCRIBERS];
+    uint8_t subCount = 0;
+    uint32_t edgeCount = 0;
+    int32_t worstLate = 0; // us the callback ran after an edge
+
+    static void edgeCallback(void *arg) {
+      ((timebase *)arg)->onEdge();
+    }
+
+    void onEdge( void ) {
+      int64_t fired = esp_timer_get_time();
+      portENTER_CRITICAL(&mux);
+      time_t ts = nextEdge;
+      int64_t edge = anchorMicros + (int64_t)(ts - anchorTime) * 1000000;
+      uint8_t count = subCount;
+      portEXIT_CRITICAL(&mux);
+
+      int32_t late = (int32_t)(fired - edge);
+      if (late > worstLate) worstLate = late;
+      edgeCount++;
+
+      uint32_t bits = TIMEBASE_SECOND | ((ts % 60 == 0) ? TIMEBASE_MINUTE : 0);
+      for (uint8_t i = 0; i < count; i++) {
+        if (subs[i].bits & bits) xTaskNotify(subs[i].task, subs[i].bits & bits, eSetBits);
+      }
+      arm(fired);
+    }
+
+    // Arm the timer for the first edge after timerNow
+    void arm(int64_t timerNow) {
+      portENTER_CRITICAL(&mux);
+      time_t ts = anchorTime + (time_t)((timerNow - anchorMicros) / 1000000) + 1;
+      int64_t wait = anchorMicros + (int64_t)(ts - anchorTime) * 1000000 - timerNow;
+      nextEdge = ts;
+      portEXIT_CRITICAL(&mux);
+      esp_timer_start_once(edgeTimer, (wait > 0) ? wait : 1);
+    }
+
+  public:
+
+    void begin( void ) {
+      const esp_timer_create_args_t args = {
+        .callback = &edgeCallback,
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "timebase"
+      };
+      esp_timer_create(&args, &edgeTimer);
+    }
+
+    // Set the local clock. Use in place of TimeLib's setTime(), right on the second edge.
+    // setTime() keeps millis() as the start of the second. Reading it either side and retrying
+    // until both agree means we know what it kept.
+    void setClock(time_t local) {
+      int64_t before = 0;
+      for (uint8_t i = 0; i < TIMEBASE_SET_TRIES; i++) {
+        before = esp_timer_get_time();
+        setTime(local);
+        if (esp_timer_get_time() / 1000 == before / 1000) break;
+      }
+      if (edgeTimer != NULL) esp_timer_stop(edgeTimer);
+      portENTER_CRITICAL(&mux);
+      anchorMicros = (before / 1000) * 1000; // millis() counts whole ms of esp_timer
+      anchorTime = local;
+      portEXIT_CRITICAL(&mux);
+      if (edgeTimer != NULL) arm(esp_timer_get_time());
+    }
+
+    // Move the clock a whole number of seconds (a DST change) without moving where the seconds start
+    void shiftClock(int32_t seconds) {
+      if (edgeTimer != NULL) esp_timer_stop(edgeTimer);
+      portENTER_CRITICAL(&mux);
+      adjustTime(seconds);
+      anchorTime += seconds;
+      portEXIT_CRITICAL(&mux);
+      if (edgeTimer != NULL) arm(esp_timer_get_time());
+    }
+
+    // Have the calling task's notification bits set on these edges. Wait with waitUntil().
+    bool subscribe(uint32_t bits) {
+      TaskHandle_t task = xTaskGetCurrentTaskHandle();
+      portENTER_CRITICAL(&mux);
+      bool added = subCount < TIMEBASE_MAX_SUBSCRIBERS;
+      if (added) {
+        subs[subCount].task = task;
+        subs[subCount].bits = bits;
+        subCount++;
+      }
+      portEXIT_CRITICAL(&mux);
+      if (!added) Serial.println("timebase.subscribe: Too many subscribers");
+      return added;
+    }
+
+    // Like vTaskDelayUntil(), but returns early with the edge bits if a subscribed edge comes
+    // first. The period carries on from where it was, so a task still runs on its usual beat.
+    uint32_t waitUntil(TickType_t *lastWake, TickType_t period) {
+      TickType_t due = *lastWake + period;
+      TickType_t left = due - xTaskGetTickCount();
+      if (left > period) left = 0; // already late
+      uint32_t bits = 0;
+      if (xTaskNotifyWait(0, ULONG_MAX, &bits, left) == pdFALSE) {
+        *lastWake = due;
+        return 0;
+      }
+      if (left == 0) *lastWake = due;
+      return bits;
+    }
+
+    // The local time in us since 1970, between TimeLib's whole seconds
+    int64_t nowMicros( void ) {
+      int64_t timerNow = esp_timer_get_time();
+      portENTER_CRITICAL(&mux);
+      int64_t local = (int64_t)anchorTime * 1000000 + (timerNow - anchorMicros);
+      portEXIT_CRITICAL(&mux);
+      return local;
+    }
+
+    // The esp_timer time the given local second starts
+    int64_t edgeMicros(time_t local) {
+      portENTER_CRITICAL(&mux);
+      int64_t edge = anchorMicros + (int64_t)(local - anchorTime) * 1000000;
+      portEXIT_CRITICAL(&mux);
+      return edge;
+    }
+
+    void reportStats( void ) {
+      Serial.println("timebase: " + String(edgeCount) + " edges, worst " + String(worstLate) + "us late");
+      worstLate = 0;
+    }
+};
+
+extern timebase clockBase;
@@ -0,0 +1,161 @@
+// Host stress test and benchmark for the alarm table (alarmTable.h over alarm.h).
+//
+// Fills tables of up to SETTINGS_MAX_ALARMS alarms with random times, weekday masks and snoozes,
+// then makes random edits while the clock runs forward. After
+// every edit the heap's top is checked against a brute force search of the whole table, and every
+// due() ring against the earliest alarm that should have rung.
+//
+// For each table size it times:
+// - nextFireTime(), the O(1) heap top
+// - an edit, which re-sifts one alarm, O(log n)
+// - rebuild(), O(n)
+// - walking every alarm for the earliest ring, which is what finding the next alarm costs without
+//   the heap
+//
+// It also round trips the settings blob at SETTINGS_MAX_ALARMS.
+//
+// build, from the top of the repo:
+//   g++ -std=c++17 -O2 -Itools/host -o alarm_stress tools/alarm_stress.cpp
+// usage: alarm_stress [edits]
+
+#include <Arduino.h>
+#include <TimeLib.h>
+#include <TFT_eSPI.h>
+#include <random>
+#include "host/check.h"
+
+#include "../settingsStore.h"
+#include "../alarm.h"
+#include "../alarmJournal.h"
+#include "../alarmTable.h"
+
+Preferences prefs;
+settingsStore settings;
+alarmJournal journal;
+
+static std::mt19937 rng(28);
+
+static uint32_t pick(uint32_t n) {
+  return rng() % n;
+}
+
+static void randomise(alarmData *workAlarm) {
+  workAlarm->hoursMod(pick(24));
+  workAlarm->minuteMod(pick(60));
+  for (uint8_t d = 0; d < 7; d++) {
+    if (pick(2)) workAlarm->toggleDay(d);
+  }
+  if (pick(4)) workAlarm->activate();
+  else workAlarm->deactivate();
+}
+
+// The earliest ring in the table, worked out the long way
+static time_t bruteNext(alarmTable *table) {
+  time_t best = 0;
+  for (uint16_t i = 0; i < table->size(); i++) {
+    time_t fire = table->getNextFire(i);
+    if (fire && (best == 0 || fire < best)) best = fire;
+  }
+  return best;
+}
+
+// What finding the next alarm costs with no heap: derive every alarm's next ring
+static time_t deriveNext(alarmTable *table, time_t ts) {
+  time_t best = 0;
+  for (uint16_t i = 0; i < table->size(); i++) {
+    time_t fire = table->get(i)->computeNextFire(ts);
+    if (fire && (best == 0 || fire < best)) best = fire;
+  }
+  return best;
+}
+
+static alarmTable *makeTable(uint16_t count) {
+  settings.setAlarmCount(count);
+  alarmTable *table = new alarmTable;
+  table->begin();
+  for (uint16_t i = 0; i < table->size(); i++) {
+    randomise(table->get(i));
+  }
+  return table;
+}
+
+template <class F> static double timeNs(long n, F f) {
+  auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < n; i++) f(i);
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / n;
+}
+
+// Random edits with the clock moving on, checking the heap after each
+static void stress(uint16_t count, long edits) {
+  alarmTable *table = makeTable(count);
+  long rings = 0;
+  for (long step = 0; step < edits; step++) {
+    hostTime += 1 + pick(120);
+    alarmData *workAlarm = table->get(pick(table->size()));
+    switch (pick(5)) {
+      case 0: workAlarm->hoursMod(1); break;
+      case 1: workAlarm->minuteMod(7); break;
+      case 2: workAlarm->toggleDay(pick(7)); break;
+      case 3: workAlarm->toggleStatus(); break;
+      default: workAlarm->snooze(); break;
+    }
+    if (table->nextFireTime() != bruteNext(table)) fail("heap top is not the earliest alarm", step);
+
+    int32_t idx;
+    while ((idx = table->due(now())) >= 0) {
+      rings++;
+      time_t fire = table->get(idx)->getNextFire();
+      if (fire != 0 && fire <= now()) fail("due() didn't move a rung alarm on", step);
+    }
+    time_t next = table->nextFireTime();
+    if (next && next < now() - ALARM_LATE_LIMIT) fail("due() left a stale alarm at the top", step);
+  }
+  printf("  %5u alarms, %ld edits, %ld rings: heap checked after every edit\n", count, edits, rings);
+}
+
+static void bench(uint16_t count) {
+  alarmTable *table = makeTable(count);
+  volatile time_t sink = 0;
+  long reps = max(20L, 2000000L / count);
+  double topNs = timeNs(1000000, [&](long) { sink = table->nextFireTime(); });
+  double editNs = timeNs(200000, [&](long i) { table->get(i % table->size())->hoursMod(1); });
+  double rebuildNs = timeNs(reps, [&](long) { table->rebuild(now()); });
+  double deriveNs = timeNs(reps, [&](long) { sink = deriveNext(table, now()); });
+  printf("  %5u alarms: next %6.1f ns  edit %7.1f ns  rebuild %10.0f ns  derive all %10.0f ns\n",
+         count, topNs, editNs, rebuildNs, deriveNs);
+}
+
+static void settingsCheck( void ) {
+  settings.setAlarmCount(60000);
+  if (settings.getAlarmCount() != SETTINGS_MAX_ALARMS) fail("alarm count not capped", settings.getAlarmCount());
+  alarmRecord rec = {7, 30, 0x85, ALARM_FLAG_SUNRISE};
+  settings.setAlarm(SETTINGS_MAX_ALARMS - 1, rec);
+  settings.flush();
+  settingsStore reloaded;
+  reloaded.begin();
+  alarmRecord back;
+  if (reloaded.getAlarmCount() != SETTINGS_MAX_ALARMS || !reloaded.getAlarm(SETTINGS_MAX_ALARMS - 1, back) || memcmp(&back, &rec, sizeof(rec))) {
+    fail("settings blob didn't round trip", reloaded.getAlarmCount());
+  }
+  printf("  settings blob: %u alarms, %u bytes, round trips\n", (unsigned)SETTINGS_MAX_ALARMS, (unsigned)prefs.getBytesLength(SETTINGS_KEY));
+}
+
+int main(int argc, char **argv) {
+  long edits = (argc > 1) ? atol(argv[1]) : 20000;
+  Serial.quiet = true;
+  hostTime = 1700000000;
+  settings.begin();
+
+  printf("correctness\n");
+  stress(3, edits);
+  stress(3000, edits);
+  stress(SETTINGS_MAX_ALARMS, edits / 10);
+  settingsCheck();
+
+  printf("cost\n");
+  for (uint16_t count : {3, 100, 1000, 5000, (int)SETTINGS_MAX_ALARMS}) {
+    bench(count);
+  }
+
+  return finish();
+}
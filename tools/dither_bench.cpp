@@ -0,0 +1,92 @@
+// Host benchmark for the LED dithering stage in ledCtrl.h (ledCtrl::ditherFrame()).
+//
+// Sets both light segments to a low grey level, as a night light or the start of a sunrise would
+// be, then times ditherFrame() over the whole 156 pixel strip. It also adds up what every pixel
+// was sent over 256 frames. A first order sigma-delta should send exactly the 8.8 target over
+// that many frames, so a change that makes it faster but wrong shows up here too.
+//
+// The device reports the same per-frame cost once a minute (ledCtrl.reportDitherStats), so the two
+// can be compared.
+//
+// build, from the top of the repo:
+//   g++ -std=c++17 -O2 -Itools/host -o dither_bench tools/dither_bench.cpp
+// usage: dither_bench [frames]
+
+#include <Arduino.h>
+#include <vector>
+
+#include "../settingsStore.h"
+#include "../ledCtrl.h"
+
+Preferences prefs;
+settingsStore settings;
+ledCtrl ledMaster;
+
+static const float levels[] = {0.02f, 0.05f, 0.12f, 0.25f, 0.4f, 1.0f};
+
+// ledCtrl::gamma16(), for what the targets should be
+static uint16_t expectedTarget(float unit) {
+  if (unit >= 1.0f) return 0xFF00;
+  uint16_t val = (uint16_t)((powf(unit, 1.0f / 0.45f) * 65280.0f) + 0.5f);
+  return (val < 0x40) ? 0 : val;
+}
+
+// Step the blend until the targets stop moving
+static void settle(HsbColor color) {
+  for (int i = 0; i < 200; i++) {
+    ledMaster.lightReadLight(color);
+    ledMaster.lightRoomLight(color);
+  }
+  ledMaster.ditherFrame();
+}
+
+// The most any pixel's 256 frame total is off the target, in 8 bit steps. Also counts the frames
+// that changed the strip and so needed a Show().
+static uint32_t worstTotalError(uint16_t target, uint32_t &shows) {
+  std::vector<uint32_t> total(PixelCount * 3, 0);
+  shows = 0;
+  for (int frame = 0; frame < 256; frame++) {
+    ledMaster.ditherFrame();
+    if (strip.IsDirty()) {
+      strip.Show();
+      shows++;
+    }
+    for (uint16_t i = 0; i < PixelCount; i++) {
+      RgbwColor c = strip.GetPixelColor(i);
+      total[(i * 3) + 0] += c.R;
+      total[(i * 3) + 1] += c.G;
+      total[(i * 3) + 2] += c.B;
+    }
+  }
+  uint32_t worst = 0;
+  for (uint32_t t : total) {
+    uint32_t error = (t > target) ? t - target : target - t;
+    if (error > worst) worst = error;
+  }
+  return worst;
+}
+
+int main(int argc, char **argv) {
+  long frames = (argc > 1) ? atol(argv[1]) : 200000;
+  Serial.quiet = true;
+  settings.begin();
+  ledMaster.ledInit();
+
+  printf("ditherFrame() over %u pixels, %ld frames a level\n", PixelCount, frames);
+  for (float level : levels) {
+    settle(HsbColor(0.0f, 0.0f, level));
+    uint16_t target = expectedTarget(level);
+
+    auto start = std::chrono::steady_clock::now();
+    for (long f = 0; f < frames; f++) {
+      ledMaster.ditherFrame();
+    }
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / frames;
+
+    uint32_t shows;
+    uint32_t worst = worstTotalError(target, shows);
+    printf("  %3.0f%%  target 0x%04X  dithering %-3s  %7.0f ns a frame  %5.2f ns a pixel  256 frame total off by %u  shown %3u/256\n",
+           level * 100, target, ledMaster.isDithering() ? "yes" : "no", ns, ns / PixelCount, worst, shows);
+  }
+  return 0;
+}
@@ -0,0 +1,160 @@
+// Host benchmark for the alarm gain stage (AudioOutputGainRamp in audioGainRamp.h).
+//
+// Times 1 KB of samples (256 stereo frames) through the ramp into a sink that takes everything,
+// the same loop as AudioOutputGainRamp::benchmark(), which audioPlayer reports at start up. For
+// comparison it times the library's own Q6 float gain (AudioOutput::Amplify()), which is what set
+// the alarm volume before the ramp. It also checks that:
+// - the crescendo starts at ALARM_CRESCENDO_START, only rises, and reaches full at its end
+// - a knob step moves the gain smoothly, with no jump big enough to click
+// - the snooze boost adds ALARM_SNOOZE_STEP a snooze
+// - full scale samples at GAIN_MAX clip rather than wrap
+//
+// build, from the top of the repo:
+//   g++ -std=c++17 -O2 -Itools/host -o gain_bench tools/gain_bench.cpp
+// usage: gain_bench [passes]
+
+#include <Arduino.h>
+#include <vector>
+#include "host/check.h"
+
+#include "../audioGainRamp.h"
+
+
+class captureOutput : public AudioOutput {
+  public:
+    std::vector<int16_t> left;
+    virtual bool ConsumeSample(int16_t sample[2]) override {
+      left.push_back(sample[LEFTCHANNEL]);
+      return true;
+    }
+};
+
+class nullOutput : public AudioOutput {
+  public:
+    int64_t lastSum = 0; // so the work isn't optimised away
+    virtual bool ConsumeSample(int16_t sample[2]) override {
+      lastSum += sample[0] + sample[1];
+      return true;
+    }
+};
+
+// The library's gain, as AudioOutputI2S applies it
+class amplifyOutput : public AudioOutput {
+  public:
+    AudioOutput *sink;
+    amplifyOutput(AudioOutput *out) : sink(out) {}
+    virtual bool ConsumeSample(int16_t sample[2]) override {
+      int16_t out[2] = {Amplify(sample[LEFTCHANNEL]), Amplify(sample[RIGHTCHANNEL])};
+      return sink->ConsumeSample(out);
+    }
+};
+
+static void push(AudioOutput *out, int16_t value, long frames) {
+  int16_t frame[2] = {value, value};
+  for (long i = 0; i < frames; i++) out->ConsumeSample(frame);
+}
+
+static void crescendoCheck( void ) {
+  captureOutput capture;
+  AudioOutputGainRamp ramp(&capture);
+  ramp.SetRate(1000);
+  ramp.setKnobGain(GAIN_ONE);
+  ramp.setSnoozeCount(0);
+  ramp.restartCrescendo(ALARM_CRESCENDO_TIME);
+  ramp.begin();
+  push(&ramp, 16000, (ALARM_CRESCENDO_TIME + 2) * 1000);
+
+  int32_t start = (16000 * ALARM_CRESCENDO_START) >> 12;
+  if (abs(capture.left[0] - start) > 16) fail("crescendo didn't start at ALARM_CRESCENDO_START", capture.left[0]);
+  for (size_t i = 1; i < capture.left.size(); i++) {
+    if (capture.left[i] < capture.left[i - 1]) {
+      fail("crescendo went down", i);
+      break;
+    }
+  }
+  if (abs(capture.left.back() - 16000) > 16) fail("crescendo didn't reach full", capture.left.back());
+  printf("  crescendo: %d at the start, %d at %ds, %d at the end\n", capture.left[0],
+         capture.left[ALARM_CRESCENDO_TIME * 500], ALARM_CRESCENDO_TIME / 2, capture.left.back());
+}
+
+static void knobCheck( void ) {
+  captureOutput capture;
+  AudioOutputGainRamp ramp(&capture);
+  ramp.SetRate(22050);
+  ramp.setKnobGain(GAIN_ONE);
+  ramp.restartCrescendo(0);
+  ramp.begin();
+  push(&ramp, 16000, 2000);
+  ramp.setKnobGain(GAIN_ONE * 2);
+  push(&ramp, 16000, 4000);
+
+  int32_t biggest = 0;
+  for (size_t i = 1; i < capture.left.size(); i++) {
+    biggest = max(biggest, (int32_t)abs(capture.left[i] - capture.left[i - 1]));
+  }
+  if (biggest > 16000 >> GAIN_SMOOTH_SHIFT) fail("knob step jumped", biggest);
+  if (abs(capture.left.back() - 32000) > 16) fail("knob step didn't settle", capture.left.back());
+  printf("  knob x1 > x2: biggest step %d a sample, settles at %d\n", biggest, capture.left.back());
+}
+
+static void snoozeCheck( void ) {
+  captureOutput capture;
+  AudioOutputGainRamp ramp(&capture);
+  ramp.SetRate(22050);
+  ramp.setKnobGain(ALARM_BASE_GAIN);
+  ramp.setSnoozeCount(2);
+  ramp.restartCrescendo(0);
+  ramp.begin();
+  push(&ramp, 16000, 100);
+  int32_t expect = (16000 * (ALARM_BASE_GAIN + 2 * ALARM_SNOOZE_STEP)) >> 12;
+  if (abs(capture.left.back() - expect) > 4) fail("snooze boost wrong", capture.left.back());
+
+  ramp.setKnobGain(GAIN_MAX);
+  push(&ramp, 32767, 3000);
+  if (capture.left.back() != 32767) fail("full scale didn't clip high", capture.left.back());
+  push(&ramp, -32768, 3);
+  if (capture.left.back() != -32768) fail("full scale didn't clip low", capture.left.back());
+  printf("  two snoozes: %d (expect %d), clips at %d and %d\n", capture.left[99], expect, 32767, capture.left.back());
+}
+
+// us per 1 KB of samples through out
+static double timeKb(AudioOutput *out, long passes) {
+  int16_t frame[2];
+  auto start = std::chrono::steady_clock::now();
+  for (long p = 0; p < passes; p++) {
+    for (int16_t i = 0; i < 256; i++) {
+      frame[0] = i * 97;
+      frame[1] = -i * 97;
+      out->ConsumeSample(frame);
+    }
+  }
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / passes;
+}
+
+int main(int argc, char **argv) {
+  long passes = (argc > 1) ? atol(argv[1]) : 200000;
+
+  printf("correctness\n");
+  crescendoCheck();
+  knobCheck();
+  snoozeCheck();
+
+  printf("cost per 1 KB of samples\n");
+  nullOutput rampSink;
+  AudioOutputGainRamp ramp(&rampSink);
+  ramp.SetRate(22050);
+  ramp.setKnobGain(GAIN_ONE * 2);
+  ramp.setSnoozeCount(2);
+  ramp.restartCrescendo(ALARM_CRESCENDO_TIME);
+  ramp.begin();
+  double rampUs = timeKb(&ramp, passes);
+
+  nullOutput amplifySink;
+  amplifyOutput amplify(&amplifySink);
+  amplify.SetGain(2.3);
+  double amplifyUs = timeKb(&amplify, passes);
+
+  printf("  gain ramp %.2f us   library Amplify() %.2f us   (sums %lld %lld)\n", rampUs, amplifyUs, (long long)rampSink.lastSum, (long long)amplifySink.lastSum);
+
+  return finish();
+}
@@ -0,0 +1,189 @@
+// Host harness for the LED target hand-off between ledMgr and ledDriver (ledCtrl.h), run the old
+// way and the new way side by side.
+//
+// Two threads stand in for the two tasks:
+// - ledMgr publishes a new target every tick (1000 / LED_CTRL_LOOP_FREQUENCY ms), as a sunrise
+//   blend does. Then again every 5ms, as the old colour setters did from modeMgr while the knob
+//   was turned on a light colour screen.
+// - ledDriver takes the newest target every 10ms dither frame, then Show()s it
+// Show() is modelled as a blocking 6.24ms send, 156 RGBW pixels at 800kHz. The dither maths is
+// left out, as it costs the same both ways.
+//
+// "ledMutex" is the baseline: ledDriver holds ledMutex across the frame and Show(), and ledMgr
+// waits up to 10 ticks for it, then gives up on that target until its next tick.
+// "targetMux" is the current code: both sides hold a spinlock for the 8 byte copy and nothing else.
+//
+// For each it prints the targets published, the ones ledMgr gave up on, the ones replaced before
+// ledDriver took them, ledMgr's worst wait for the lock, and how long a target took from when
+// ledMgr had it to the end of the Show() that sent it. These are host thread timings, not device ones. The
+// device prints the targetMux side once a minute (ledCtrl.reportHandoffStats).
+//
+// build, from the top of the repo:
+//   g++ -std=c++17 -O2 -Itools/host -o handoff_bench tools/handoff_bench.cpp -pthread
+// usage: handoff_bench [seconds per run]
+
+#include <Arduino.h>
+#include <atomic>
+#include <mutex>
+#include "host/check.h"
+
+#define LED_CTRL_LOOP_FREQUENCY 15 // as LedMgmt.ino
+#define FRAME_MS 10 // ledDriver's dither frame period
+#define SHOW_US 6240 // 156 pixels x 32 bits x 1.25us
+#define LOCK_TIMEOUT_MS 10 // the old xSemaphoreTake(ledMutex, 10)
+
+using hostClock = std::chrono::steady_clock;
+
+static long usSince(hostClock::time_point from) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(hostClock::now() - from).count();
+}
+
+// ledMgr's side and ledDriver's side are each only written by that thread
+struct handoffStats {
+  long published = 0;
+  long gaveUp = 0; // ledMgr timed out on the lock
+  long replaced = 0; // published again before ledDriver took it
+  long waitMax = 0; // us ledMgr waited for the lock
+  long shown = 0;
+  long latencyTotal = 0; // us from ledMgr having it to the end of the Show() that sent it
+  long latencyMax = 0;
+
+  void noteWait(hostClock::time_point start) {
+    long us = usSince(start);
+    if (us > waitMax) waitMax = us;
+  }
+
+  void noteShown(hostClock::time_point publishedAt) {
+    long latency = usSince(publishedAt);
+    latencyTotal += latency;
+    if (latency > latencyMax) latencyMax = latency;
+    shown++;
+  }
+};
+
+// What the lock guards
+struct handoff {
+  long target = 0; // stands in for the 8 bytes of targets
+  bool changed = false;
+  hostClock::time_point publishedAt;
+};
+
+// Baseline: one mutex over the targets, the frame and the Show()
+class mutexHandoff {
+  public:
+    std::timed_mutex ledMutex;
+    handoff shared;
+    handoffStats stats;
+
+    void publish(long target) {
+      auto start = hostClock::now();
+      if (!ledMutex.try_lock_for(std::chrono::milliseconds(LOCK_TIMEOUT_MS))) {
+        stats.noteWait(start);
+        stats.gaveUp++;
+        return;
+      }
+      stats.noteWait(start);
+      if (shared.changed) stats.replaced++;
+      shared.target = target;
+      shared.publishedAt = start;
+      shared.changed = true;
+      stats.published++;
+      ledMutex.unlock();
+    }
+
+    void frame( void ) {
+      if (!ledMutex.try_lock_for(std::chrono::milliseconds(LOCK_TIMEOUT_MS))) return;
+      bool changed = shared.changed;
+      hostClock::time_point publishedAt = shared.publishedAt;
+      shared.changed = false;
+      std::this_thread::sleep_for(std::chrono::microseconds(SHOW_US)); // Show(), still holding it
+      if (changed) stats.noteShown(publishedAt);
+      ledMutex.unlock();
+    }
+};
+
+// Current: a spinlock over an 8 byte copy
+class spinHandoff {
+  public:
+    std::atomic_flag targetMux = ATOMIC_FLAG_INIT;
+    handoff shared;
+    handoffStats stats;
+
+    void lock( void ) {
+      while (targetMux.test_and_set(std::memory_order_acquire)) {}
+    }
+
+    void unlock( void ) {
+      targetMux.clear(std::memory_order_release);
+    }
+
+    void publish(long target) {
+      auto start = hostClock::now();
+      lock();
+      stats.noteWait(start);
+      if (shared.changed) stats.replaced++;
+      shared.target = target;
+      shared.publishedAt = start;
+      shared.changed = true;
+      stats.published++;
+      unlock();
+    }
+
+    void frame( void ) {
+      lock();
+      bool changed = shared.changed;
+      hostClock::time_point publishedAt = shared.publishedAt;
+      shared.changed = false;
+      unlock();
+      std::this_thread::sleep_for(std::chrono::microseconds(SHOW_US)); // Show(), from our own buffer
+      if (changed) stats.noteShown(publishedAt);
+    }
+};
+
+template <class H> static handoffStats run(long seconds, long periodMs) {
+  H h;
+  std::atomic<bool> stop(false);
+  auto end = hostClock::now() + std::chrono::seconds(seconds);
+
+  std::thread driver([&]() {
+    auto next = hostClock::now();
+    while (!stop) {
+      h.frame();
+      next += std::chrono::milliseconds(FRAME_MS);
+      std::this_thread::sleep_until(next);
+    }
+  });
+
+  auto next = hostClock::now();
+  long target = 0;
+  while (hostClock::now() < end) {
+    h.publish(++target);
+    next += std::chrono::milliseconds(periodMs);
+    std::this_thread::sleep_until(next);
+  }
+  stop = true;
+  driver.join();
+  return h.stats;
+}
+
+static void print(const char *name, const handoffStats &s) {
+  printf("  %-10s %9ld %9ld %9ld %9ld us %9ld us %9ld us\n", name, s.published, s.gaveUp, s.replaced, s.waitMax,
+         s.shown ? s.latencyTotal / s.shown : 0, s.latencyMax);
+}
+
+int main(int argc, char **argv) {
+  long seconds = (argc > 1) ? atol(argv[1]) : 5;
+
+  for (long periodMs : {1000L / LED_CTRL_LOOP_FREQUENCY, 5L}) {
+    printf("%ld s each, a target every %ld ms, a %d ms frame, %.2f ms Show()\n", seconds, periodMs, FRAME_MS, SHOW_US / 1000.0);
+    printf("  %-10s %9s %9s %9s %12s %12s %12s\n", "", "published", "gave up", "replaced", "worst wait", "mean latency", "max latency");
+    handoffStats before = run<mutexHandoff>(seconds, periodMs);
+    print("ledMutex", before);
+    handoffStats after = run<spinHandoff>(seconds, periodMs);
+    print("targetMux", after);
+
+    if (after.gaveUp != 0) fail("targetMux gave up on a target", after.gaveUp);
+    if (after.waitMax >= SHOW_US) fail("targetMux waited as long as a Show()", after.waitMax);
+  }
+  return finish();
+}
@@ -0,0 +1,155 @@
+// Just enough of the Arduino core and FreeRTOS to build the clock's headers on a PC, for the host
+// checks and benchmarks in tools/. Everything runs on one thread, so the semaphores and critical
+// sections do nothing. Serial goes to stdout.
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <thread>
+
+using std::max;
+using std::min;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#ifndef PI
+#define PI 3.1415926535897932384626433832795
+#endif
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define RISING 1
+#define FALLING 2
+#define CHANGE 3
+#define IRAM_ATTR
+#define RTC_NOINIT_ATTR
+#define F(x) x
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+class String {
+  public:
+    String() {}
+    String(const char *c) : s(c ? c : "") {}
+    String(const std::string &c) : s(c) {}
+    String(char c) : s(1, c) {}
+    String(int v) : s(std::to_string(v)) {}
+    String(unsigned int v) : s(std::to_string(v)) {}
+    String(long v) : s(std::to_string(v)) {}
+    String(unsigned long v) : s(std::to_string(v)) {}
+    String(long long v) : s(std::to_string(v)) {}
+    String(unsigned long long v) : s(std::to_string(v)) {}
+    String(double v, unsigned int places = 2) { char b[32]; snprintf(b, sizeof(b), "%.*f", places, v); s = b; }
+    String(float v, unsigned int places = 2) : String((double)v, places) {}
+
+    String operator+(const String &o) const { return String(s + o.s); }
+    String &operator+=(const String &o) { s += o.s; return *this; }
+    friend String operator+(const char *a, const String &b) { return String(std::string(a) + b.s); }
+    bool operator==(const String &o) const { return s == o.s; }
+    bool operator!=(const String &o) const { return s != o.s; }
+    char &operator[](unsigned int i) { return s[i]; }
+    unsigned int length() const { return s.size(); }
+    const char *c_str() const { return s.c_str(); }
+    void toCharArray(char *buf, unsigned int len) const { strncpy(buf, s.c_str(), len); if (len) buf[len - 1] = 0; }
+    int indexOf(char c) const { size_t p = s.find(c); return p == std::string::npos ? -1 : (int)p; }
+    int indexOf(const char *c) const { size_t p = s.find(c); return p == std::string::npos ? -1 : (int)p; }
+    String substring(unsigned int from, int to = -1) const { return String(to < 0 ? s.substr(from) : s.substr(from, to - from)); }
+    bool startsWith(const String &o) const { return s.compare(0, o.s.size(), o.s) == 0; }
+    long toInt() const { return atol(s.c_str()); }
+    float toFloat() const { return atof(s.c_str()); }
+    void toLowerCase() { for (char &c : s) c = tolower(c); }
+    void toUpperCase() { for (char &c : s) c = toupper(c); }
+
+  private:
+    std::string s;
+};
+
+class HostSerial {
+  public:
+    bool quiet = false; // set to keep the headers' log lines out of a benchmark's output
+    void begin(unsigned long) {}
+    void flush() { fflush(stdout); }
+    void print(const String &v) { if (!quiet) fputs(v.c_str(), stdout); }
+    void println(const String &v) { if (!quiet) puts(v.c_str()); }
+    void println() { if (!quiet) putchar('\n'); }
+    void print(long v, int base) { print(base == 16 ? hex(v) : String(v)); }
+    void println(long v, int base) { println(base == 16 ? hex(v) : String(v)); }
+    void printf(const char *fmt, ...) { if (quiet) return; va_list a; va_start(a, fmt); vprintf(fmt, a); va_end(a); }
+
+  private:
+    static String hex(long v) { char b[20]; snprintf(b, sizeof(b), "%lX", v); return String(b); }
+};
+
+inline HostSerial Serial;
+
+inline std::chrono::steady_clock::time_point hostStart = std::chrono::steady_clock::now();
+inline unsigned long micros() { return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - hostStart).count(); }
+inline unsigned long millis() { return micros() / 1000; }
+inline void delay(unsigned long ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+inline void delayMicroseconds(unsigned int us) { std::this_thread::sleep_for(std::chrono::microseconds(us)); }
+
+inline void pinMode(int, int) {}
+inline int digitalRead(int) { return HIGH; }
+inline void digitalWrite(int, int) {}
+inline int analogRead(int) { return 0; }
+inline void attachInterrupt(int, void (*)(), int) {}
+inline void attachInterruptArg(int, void (*)(void *), void *, int) {}
+inline void detachInterrupt(int) {}
+
+// FreeRTOS
+typedef void *SemaphoreHandle_t;
+typedef void *TaskHandle_t;
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef struct { int owner; } portMUX_TYPE;
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define portMAX_DELAY 0xFFFFFFFF
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) (ms)
+#define portMUX_INITIALIZER_UNLOCKED {0}
+#define portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL(mux)
+#define portENTER_CRITICAL_ISR(mux)
+#define portEXIT_CRITICAL_ISR(mux)
+#define portYIELD_FROM_ISR()
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { static int handle; return &handle; }
+inline SemaphoreHandle_t xSemaphoreCreateBinary() { static int handle; return &handle; }
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t) { return pdTRUE; }
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t) { return pdTRUE; }
+// A queue is a FIFO of fixed size items. Nothing waits, so a full or empty queue fails at once.
+struct hostQueue {
+  std::string items;
+  size_t itemSize, length;
+};
+typedef hostQueue *QueueHandle_t;
+inline QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) { return new hostQueue{std::string(), itemSize, length}; }
+inline BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t) {
+  if (q->items.size() >= q->length * q->itemSize) return pdFALSE;
+  q->items.append((const char *)item, q->itemSize);
+  return pdTRUE;
+}
+inline BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t) {
+  if (q->items.empty()) return pdFALSE;
+  memcpy(item, q->items.data(), q->itemSize);
+  q->items.erase(0, q->itemSize);
+  return pdTRUE;
+}
+inline UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q) { return q->items.size() / q->itemSize; }
+
+inline TickType_t xTaskGetTickCount() { return millis(); }
+inline void vTaskDelay(TickType_t ticks) { delay(ticks); }
@@ -0,0 +1,48 @@
+// ESP8266Audio's AudioOutput base class for the host tools, as the library has it, less the
+// metadata callbacks.
+
+#pragma once
+
+#include <Arduino.h>
+
+class AudioOutput {
+
+  public:
+    AudioOutput() {};
+    virtual ~AudioOutput() {};
+    virtual bool SetRate(int hz) { hertz = hz; return true; }
+    virtual bool SetBitsPerSample(int bits) { bps = bits; return true; }
+    virtual bool SetChannels(int chan) { channels = chan; return true; }
+    virtual bool SetGain(float f) {
+      if (f > 4.0) f = 4.0;
+      if (f < 0.0) f = 0.0;
+      gainF2P6 = (uint8_t)(f * (1 << 6));
+      return true;
+    }
+    virtual bool begin() { return false; };
+    typedef enum { LEFTCHANNEL = 0, RIGHTCHANNEL = 1 } SampleIndex;
+    virtual bool ConsumeSample(int16_t sample[2]) = 0;
+    virtual uint16_t ConsumeSamples(int16_t *samples, uint16_t count) {
+      for (uint16_t i = 0; i < count; i++) {
+        if (!ConsumeSample(samples)) return i;
+        samples += 2;
+      }
+      return count;
+    }
+    virtual bool stop() { return false; }
+    virtual void flush() { return; };
+    virtual bool loop() { return true; };
+
+  protected:
+    inline int16_t Amplify(int16_t s) {
+      int32_t v = (s * gainF2P6) >> 6;
+      if (v < -32767) return -32767;
+      else if (v > 32767) return 32767;
+      else return (int16_t)(v & 0xffff);
+    }
+
+    uint16_t hertz;
+    uint8_t bps;
+    uint8_t channels;
+    uint8_t gainF2P6;
+};
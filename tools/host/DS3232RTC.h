@@ -0,0 +1,115 @@
+// A DS3231 for the host tools, with the calls the clock makes of the DS3232RTC library. The RTC's
+// time only moves when the tool calls tick(), which runs it forward a second at a time and sets
+// the alarm flags as the real chip would. The INT line is low while an enabled alarm's flag is set
+// and INTCN is on, so a tool can see when the ESP32 would be woken.
+//
+// Only the alarm modes the clock uses are matched: ALM1_MATCH_DATE (second, minute, hour and day
+// of the month) and ALM2_MATCH_DATE (the same at second 0).
+
+#pragma once
+
+#include <TimeLib.h>
+
+enum ALARM_TYPES_t { ALM1_MATCH_DATE = 0x00, ALM2_MATCH_DATE = 0x80 };
+enum SQWAVE_FREQS_t { SQWAVE_1_HZ, SQWAVE_1024_HZ, SQWAVE_4096_HZ, SQWAVE_8192_HZ, SQWAVE_NONE };
+
+#define ALARM_1 1
+#define ALARM_2 2
+#define RTC_SECONDS 0x00
+#define RTC_CONTROL 0x0E
+#define RTC_STATUS 0x0F
+#define RTC_AGING 0x10
+#define A1IE 0
+#define A2IE 1
+#define INTCN 2
+#define CONV 5
+#define A1F 0
+#define A2F 1
+#ifndef _BV
+#define _BV(b) (1 << (b))
+#endif
+
+class DS3232RTC {
+
+  private:
+    time_t clock = 0; // UTC, as the clock keeps it
+    uint8_t regs[0x14] = {};
+    struct { uint8_t second, minute, hour, day; } alarms[2] = {};
+
+    bool matches(uint8_t n, time_t t) {
+      uint8_t wantSecond = (n == ALARM_2) ? 0 : alarms[0].second;
+      return second(t) == wantSecond && minute(t) == alarms[n - 1].minute && hour(t) == alarms[n - 1].hour &&
+             day(t) == alarms[n - 1].day;
+    }
+
+  public:
+    uint32_t alarmWrites = 0; // setAlarm() calls, as I2C traffic
+
+    DS3232RTC(bool initialize = true) {
+      if (initialize) begin();
+    }
+
+    void begin( void ) {
+      regs[RTC_CONTROL] = _BV(INTCN) | 0x18; // power on: INTCN set, 8 kHz selected, alarms off
+    }
+
+    time_t get( void ) {
+      return clock;
+    }
+
+    uint8_t set(time_t t) {
+      clock = t;
+      return 0;
+    }
+
+    uint8_t readRTC(uint8_t addr) {
+      if (addr == RTC_SECONDS) return (uint8_t)(((second(clock) / 10) << 4) | (second(clock) % 10));
+      return regs[addr];
+    }
+
+    uint8_t writeRTC(uint8_t addr, uint8_t value) {
+      regs[addr] = value;
+      return 0;
+    }
+
+    void setAlarm(ALARM_TYPES_t alarmType, uint8_t seconds, uint8_t minutes, uint8_t hours, uint8_t daydate) {
+      uint8_t n = (alarmType == ALM2_MATCH_DATE) ? ALARM_2 : ALARM_1;
+      alarms[n - 1] = {seconds, minutes, hours, daydate};
+      alarmWrites++;
+    }
+
+    void alarmInterrupt(uint8_t alarmNumber, bool alarmEnabled) {
+      uint8_t bit = _BV(alarmNumber == ALARM_2 ? A2IE : A1IE);
+      regs[RTC_CONTROL] = alarmEnabled ? (regs[RTC_CONTROL] | bit) : (regs[RTC_CONTROL] & ~bit);
+    }
+
+    // Reads and clears the alarm's flag
+    bool alarm(uint8_t alarmNumber) {
+      uint8_t bit = _BV(alarmNumber == ALARM_2 ? A2F : A1F);
+      bool fired = regs[RTC_STATUS] & bit;
+      regs[RTC_STATUS] &= ~bit;
+      return fired;
+    }
+
+    void squareWave(SQWAVE_FREQS_t freq) {
+      regs[RTC_CONTROL] &= ~(_BV(INTCN) | 0x18);
+      regs[RTC_CONTROL] |= (freq == SQWAVE_NONE) ? _BV(INTCN) : (freq << 3);
+    }
+
+    // Host only. Run the clock forward to t, setting the flags of any alarm whose time comes up.
+    // Flags are set whether or not the alarm's interrupt is enabled, as on the chip.
+    void tick(time_t t) {
+      while (clock < t) {
+        clock++;
+        if (matches(ALARM_1, clock)) regs[RTC_STATUS] |= _BV(A1F);
+        if (matches(ALARM_2, clock)) regs[RTC_STATUS] |= _BV(A2F);
+      }
+    }
+
+    // Host only. The INT/SQW pin, which is active low.
+    bool intLow( void ) {
+      if (!(regs[RTC_CONTROL] & _BV(INTCN))) return false;
+      return ((regs[RTC_STATUS] & _BV(A1F)) && (regs[RTC_CONTROL] & _BV(A1IE))) ||
+             ((regs[RTC_STATUS] & _BV(A2F)) && (regs[RTC_CONTROL] & _BV(A2IE)));
+    }
+};
@@ -0,0 +1,214 @@
+// A stand-in for Bodmer's JSON_Decoder library, for tools/onecall_bench's OLD_PATH. It is not the
+// library. It works the way the library does: one byte at a time through parse(), a state stack,
+// a fixed text buffer, and key() and value() calls on a listener with each finished token as text.
+// Numbers, true, false and null all come out as their text.
+
+#pragma once
+
+#include <Arduino.h>
+
+#define JSON_BUF_LEN 512
+#define JSON_STACK_LEN 20
+
+class JsonListener {
+  public:
+    virtual ~JsonListener() {}
+    virtual void whitespace(char c) = 0;
+    virtual void startDocument() = 0;
+    virtual void key(const char *key) = 0;
+    virtual void value(const char *value) = 0;
+    virtual void endArray() = 0;
+    virtual void endObject() = 0;
+    virtual void endDocument() = 0;
+    virtual void startArray() = 0;
+    virtual void startObject() = 0;
+    virtual void error(const char *message) = 0;
+};
+
+class JSON_Decoder {
+
+  private:
+    enum parseState { START_DOCUMENT, DONE, IN_ARRAY, IN_OBJECT, END_KEY, AFTER_KEY, IN_STRING, START_ESCAPE, IN_NUMBER, IN_WORD, AFTER_VALUE };
+    enum stackEntry { STACK_OBJECT, STACK_ARRAY, STACK_KEY, STACK_STRING };
+
+    JsonListener *listener = NULL;
+    parseState state = START_DOCUMENT;
+    stackEntry stack[JSON_STACK_LEN];
+    uint8_t stackPos = 0;
+    char buffer[JSON_BUF_LEN];
+    uint16_t bufferPos = 0;
+
+    void push(stackEntry e) {
+      if (stackPos < JSON_STACK_LEN) stack[stackPos++] = e;
+      else listener->error("nested too deep");
+    }
+
+    stackEntry top( void ) {
+      return stackPos ? stack[stackPos - 1] : STACK_OBJECT;
+    }
+
+    void add(char c) {
+      if (bufferPos < JSON_BUF_LEN - 1) buffer[bufferPos++] = c;
+    }
+
+    const char *text( void ) {
+      buffer[bufferPos] = 0;
+      bufferPos = 0;
+      return buffer;
+    }
+
+    // After a value closes, the container decides what comes next
+    void valueDone( void ) {
+      state = stackPos ? AFTER_VALUE : DONE;
+    }
+
+    void endString( void ) {
+      if (top() == STACK_KEY) {
+        stackPos--;
+        listener->key(text());
+        state = END_KEY;
+      }
+      else {
+        stackPos--;
+        listener->value(text());
+        valueDone();
+      }
+    }
+
+    void endToken( void ) {
+      listener->value(text());
+      valueDone();
+    }
+
+    void startValue(char c) {
+      if (c == '{') {
+        push(STACK_OBJECT);
+        listener->startObject();
+        state = IN_OBJECT;
+      }
+      else if (c == '[') {
+        push(STACK_ARRAY);
+        listener->startArray();
+        state = IN_ARRAY;
+      }
+      else if (c == '"') {
+        push(STACK_STRING);
+        state = IN_STRING;
+      }
+      else if (c == '-' || (c >= '0' && c <= '9')) {
+        add(c);
+        state = IN_NUMBER;
+      }
+      else if (c == 't' || c == 'f' || c == 'n') {
+        add(c);
+        state = IN_WORD;
+      }
+      else {
+        listener->error("unexpected character");
+      }
+    }
+
+    void close(char c) {
+      if (c == '}' && top() == STACK_OBJECT) {
+        stackPos--;
+        listener->endObject();
+      }
+      else if (c == ']' && top() == STACK_ARRAY) {
+        stackPos--;
+        listener->endArray();
+      }
+      else {
+        listener->error("unmatched close");
+        return;
+      }
+      valueDone();
+      if (state == DONE) listener->endDocument();
+    }
+
+  public:
+
+    void setListener(JsonListener *l) {
+      listener = l;
+    }
+
+    void reset( void ) {
+      state = START_DOCUMENT;
+      stackPos = 0;
+      bufferPos = 0;
+    }
+
+    void parse(char c) {
+      bool space = (c == ' ' || c == '\t' || c == '\n' || c == '\r');
+      if (space && state != IN_STRING && state != START_ESCAPE && state != IN_NUMBER && state != IN_WORD) {
+        listener->whitespace(c);
+        return;
+      }
+
+      switch (state) {
+        case START_DOCUMENT:
+          listener->startDocument();
+          startValue(c);
+          break;
+
+        case IN_OBJECT:
+          if (c == '}') close(c);
+          else if (c == '"') {
+            push(STACK_KEY);
+            state = IN_STRING;
+          }
+          else listener->error("expected a key");
+          break;
+
+        case END_KEY:
+          if (c == ':') state = AFTER_KEY;
+          else listener->error("expected ':'");
+          break;
+
+        case AFTER_KEY:
+          startValue(c);
+          break;
+
+        case IN_ARRAY:
+          if (c == ']') close(c);
+          else startValue(c);
+          break;
+
+        case IN_STRING:
+          if (c == '"') endString();
+          else if (c == '\\') state = START_ESCAPE;
+          else add(c);
+          break;
+
+        case START_ESCAPE:
+          switch (c) {
+            case 'n': add('\n'); break;
+            case 't': add('\t'); break;
+            case 'r': add('\r'); break;
+            case 'b': add('\b'); break;
+            case 'f': add('\f'); break;
+            default: add(c); break; // ", \ and /. \u is kept as text.
+          }
+          state = IN_STRING;
+          break;
+
+        case IN_NUMBER:
+        case IN_WORD:
+          if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c == '.' || c == '-' || c == '+' || c == 'E') {
+            add(c);
+            break;
+          }
+          endToken();
+          parse(c); // the byte that ended it is the next token's
+          break;
+
+        case AFTER_VALUE:
+          if (c == ',') state = (top() == STACK_OBJECT) ? IN_OBJECT : IN_ARRAY;
+          else if (c == '}' || c == ']') close(c);
+          else listener->error("expected ',' or a close");
+          break;
+
+        case DONE:
+          break;
+      }
+    }
+};
@@ -0,0 +1,3 @@
+// Nothing from NeoPixelAnimator is used by the code the host tools build
+
+#pragma once
@@ -0,0 +1,48 @@
+// The NeoPixelBus colour types and strip the LED code uses, for the host tools. The strip keeps
+// its pixels in RAM, as the real one does until Show().
+
+#pragma once
+
+#include <vector>
+
+struct RgbColor {
+  uint8_t R, G, B;
+  RgbColor(uint8_t r = 0, uint8_t g = 0, uint8_t b = 0) : R(r), G(g), B(b) {}
+};
+
+struct HsbColor {
+  float H, S, B;
+  HsbColor(float h = 0, float s = 0, float b = 0) : H(h), S(s), B(b) {}
+  template <class T> static HsbColor LinearBlend(const HsbColor &left, const HsbColor &right, float progress) {
+    return HsbColor(left.H + ((right.H - left.H) * progress), left.S + ((right.S - left.S) * progress), left.B + ((right.B - left.B) * progress));
+  }
+};
+
+struct RgbwColor {
+  uint8_t R, G, B, W;
+  RgbwColor(uint8_t r = 0, uint8_t g = 0, uint8_t b = 0, uint8_t w = 0) : R(r), G(g), B(b), W(w) {}
+  bool operator==(const RgbwColor &o) const { return R == o.R && G == o.G && B == o.B && W == o.W; }
+  bool operator!=(const RgbwColor &o) const { return !(*this == o); }
+};
+
+struct NeoHueBlendShortestDistance {};
+struct NeoGrbwFeature {};
+struct NeoSk6812Method {};
+
+template <class Feature, class Method> class NeoPixelBus {
+  public:
+    NeoPixelBus(uint16_t count, uint8_t) : pixels(count) {}
+    void Begin() {}
+    void Show() { dirty = false; }
+    void Dirty() { dirty = true; }
+    bool IsDirty() { return dirty; }
+    bool CanShow() { return true; }
+    void SetPixelColor(uint16_t i, RgbwColor color) { pixels[i] = color; dirty = true; }
+    RgbwColor GetPixelColor(uint16_t i) { return pixels[i]; }
+    void ClearTo(RgbwColor color, uint16_t first, uint16_t last) { for (uint16_t i = first; i <= last; i++) pixels[i] = color; }
+    uint16_t PixelCount() { return pixels.size(); }
+
+  private:
+    std::vector<RgbwColor> pixels;
+    bool dirty = true;
+};
@@ -0,0 +1,243 @@
+// A stand-in for Bodmer's OpenWeather library (the OneCall getForecast()), for
+// tools/onecall_bench's OLD_PATH. It is not the library, and its numbers are only a guide to the
+// library's. It works the way the library does: the header lines are read as Strings, then the
+// body goes through JSON_Decoder a byte at a time from the client, each key and value is turned
+// into a String, and every value is matched to its field by comparing the parent and key Strings.
+// The forecast lands in OW_ structs of String and array fields, MAX_HOURS and MAX_DAYS long as the
+// library's User_Setup.h has them. It doesn't decode chunked bodies.
+
+#pragma once
+
+#include <Arduino.h>
+#include <WiFiClientSecure.h>
+#include "JSON_Decoder.h"
+
+#define MAX_HOURS 6
+#define MAX_DAYS 8
+
+struct OW_current {
+  uint32_t dt = 0, sunrise = 0, sunset = 0;
+  float temp = 0, feels_like = 0, pressure = 0, dew_point = 0, uvi = 0, wind_speed = 0, wind_gust = 0, rain = 0, snow = 0;
+  uint8_t humidity = 0, clouds = 0;
+  uint32_t visibility = 0;
+  uint16_t wind_deg = 0, id = 0;
+  String main, description, icon;
+};
+
+struct OW_hourly {
+  uint32_t dt[MAX_HOURS] = {};
+  float temp[MAX_HOURS] = {}, feels_like[MAX_HOURS] = {}, pressure[MAX_HOURS] = {}, dew_point[MAX_HOURS] = {};
+  uint8_t humidity[MAX_HOURS] = {}, clouds[MAX_HOURS] = {};
+  float wind_speed[MAX_HOURS] = {}, wind_gust[MAX_HOURS] = {}, rain[MAX_HOURS] = {}, snow[MAX_HOURS] = {}, pop[MAX_HOURS] = {};
+  uint16_t wind_deg[MAX_HOURS] = {}, id[MAX_HOURS] = {};
+  String main[MAX_HOURS], description[MAX_HOURS], icon[MAX_HOURS];
+};
+
+struct OW_daily {
+  uint32_t dt[MAX_DAYS] = {}, sunrise[MAX_DAYS] = {}, sunset[MAX_DAYS] = {}, moonrise[MAX_DAYS] = {}, moonset[MAX_DAYS] = {};
+  float moon_phase[MAX_DAYS] = {};
+  float temp_morn[MAX_DAYS] = {}, temp_day[MAX_DAYS] = {}, temp_eve[MAX_DAYS] = {}, temp_night[MAX_DAYS] = {};
+  float temp_min[MAX_DAYS] = {}, temp_max[MAX_DAYS] = {};
+  float feels_like_morn[MAX_DAYS] = {}, feels_like_day[MAX_DAYS] = {}, feels_like_eve[MAX_DAYS] = {}, feels_like_night[MAX_DAYS] = {};
+  float pressure[MAX_DAYS] = {}, dew_point[MAX_DAYS] = {}, wind_speed[MAX_DAYS] = {}, wind_gust[MAX_DAYS] = {};
+  uint8_t humidity[MAX_DAYS] = {}, clouds[MAX_DAYS] = {};
+  uint16_t wind_deg[MAX_DAYS] = {}, id[MAX_DAYS] = {};
+  float uvi[MAX_DAYS] = {}, pop[MAX_DAYS] = {}, rain[MAX_DAYS] = {}, snow[MAX_DAYS] = {};
+  String main[MAX_DAYS], description[MAX_DAYS], icon[MAX_DAYS];
+};
+
+class OW_Weather : public JsonListener {
+
+  private:
+    OW_current *current = NULL;
+    OW_hourly *hourly = NULL;
+    OW_daily *daily = NULL;
+
+    String currentParent; // "current", "hourly" or "daily"
+    String currentSet; // the object inside it, e.g. "temp" or "weather"
+    String currentKey;
+    uint16_t objectLevel = 0;
+    uint16_t arrayLevel = 0;
+    uint16_t arrayIndex = 0; // which hour or day
+    bool parseOK = false;
+
+    bool parseRequest(const String &url) {
+      WiFiClientSecure client;
+      client.setInsecure();
+      JSON_Decoder parser;
+      parser.setListener(this);
+      const char *host = "api.openweathermap.org";
+      if (!client.connect(host, 443)) return false;
+
+      parseOK = false;
+      client.print(String("GET ") + url + " HTTP/1.1\r\nHost: " + host + "\r\nConnection: close\r\n\r\n");
+      while (client.connected()) {
+        String line = client.readStringUntil('\n');
+        if (line == "\r") break;
+      }
+      while (client.available() > 0 || client.connected()) {
+        while (client.available() > 0) {
+          char c = client.read();
+          parser.parse(c);
+        }
+      }
+      client.stop();
+      return parseOK;
+    }
+
+    void fullDataSet(const char *val) {
+      String value = val;
+
+      if (currentParent == "current") {
+        if (currentKey == "dt") current->dt = (uint32_t)value.toInt();
+        else if (currentKey == "sunrise") current->sunrise = (uint32_t)value.toInt();
+        else if (currentKey == "sunset") current->sunset = (uint32_t)value.toInt();
+        else if (currentKey == "temp") current->temp = value.toFloat();
+        else if (currentKey == "feels_like") current->feels_like = value.toFloat();
+        else if (currentKey == "pressure") current->pressure = value.toFloat();
+        else if (currentKey == "humidity") current->humidity = value.toInt();
+        else if (currentKey == "dew_point") current->dew_point = value.toFloat();
+        else if (currentKey == "uvi") current->uvi = value.toFloat();
+        else if (currentKey == "clouds") current->clouds = value.toInt();
+        else if (currentKey == "visibility") current->visibility = value.toInt();
+        else if (currentKey == "wind_speed") current->wind_speed = value.toFloat();
+        else if (currentKey == "wind_gust") current->wind_gust = value.toFloat();
+        else if (currentKey == "wind_deg") current->wind_deg = (uint16_t)value.toInt();
+        else if (currentKey == "1h" && currentSet == "rain") current->rain = value.toFloat();
+        else if (currentKey == "1h" && currentSet == "snow") current->snow = value.toFloat();
+        else if (currentKey == "id") current->id = value.toInt();
+        else if (currentKey == "main") current->main = value;
+        else if (currentKey == "description") current->description = value;
+        else if (currentKey == "icon") current->icon = value;
+        return;
+      }
+
+      if (currentParent == "hourly") {
+        if (arrayIndex >= MAX_HOURS) return;
+        if (currentKey == "dt") hourly->dt[arrayIndex] = (uint32_t)value.toInt();
+        else if (currentKey == "temp") hourly->temp[arrayIndex] = value.toFloat();
+        else if (currentKey == "feels_like") hourly->feels_like[arrayIndex] = value.toFloat();
+        else if (currentKey == "pressure") hourly->pressure[arrayIndex] = value.toFloat();
+        else if (currentKey == "humidity") hourly->humidity[arrayIndex] = value.toInt();
+        else if (currentKey == "dew_point") hourly->dew_point[arrayIndex] = value.toFloat();
+        else if (currentKey == "clouds") hourly->clouds[arrayIndex] = value.toInt();
+        else if (currentKey == "wind_speed") hourly->wind_speed[arrayIndex] = value.toFloat();
+        else if (currentKey == "wind_gust") hourly->wind_gust[arrayIndex] = value.toFloat();
+        else if (currentKey == "wind_deg") hourly->wind_deg[arrayIndex] = (uint16_t)value.toInt();
+        else if (currentKey == "1h" && currentSet == "rain") hourly->rain[arrayIndex] = value.toFloat();
+        else if (currentKey == "1h" && currentSet == "snow") hourly->snow[arrayIndex] = value.toFloat();
+        else if (currentKey == "pop") hourly->pop[arrayIndex] = value.toFloat();
+        else if (currentKey == "id") hourly->id[arrayIndex] = value.toInt();
+        else if (currentKey == "main") hourly->main[arrayIndex] = value;
+        else if (currentKey == "description") hourly->description[arrayIndex] = value;
+        else if (currentKey == "icon") hourly->icon[arrayIndex] = value;
+        return;
+      }
+
+      if (currentParent == "daily") {
+        if (arrayIndex >= MAX_DAYS) return;
+        if (currentKey == "dt") daily->dt[arrayIndex] = (uint32_t)value.toInt();
+        else if (currentKey == "sunrise") daily->sunrise[arrayIndex] = (uint32_t)value.toInt();
+        else if (currentKey == "sunset") daily->sunset[arrayIndex] = (uint32_t)value.toInt();
+        else if (currentKey == "moonrise") daily->moonrise[arrayIndex] = (uint32_t)value.toInt();
+        else if (currentKey == "moonset") daily->moonset[arrayIndex] = (uint32_t)value.toInt();
+        else if (currentKey == "moon_phase") daily->moon_phase[arrayIndex] = value.toFloat();
+        else if (currentSet == "temp") {
+          if (currentKey == "morn") daily->temp_morn[arrayIndex] = value.toFloat();
+          else if (currentKey == "day") daily->temp_day[arrayIndex] = value.toFloat();
+          else if (currentKey == "eve") daily->temp_eve[arrayIndex] = value.toFloat();
+          else if (currentKey == "night") daily->temp_night[arrayIndex] = value.toFloat();
+          else if (currentKey == "min") daily->temp_min[arrayIndex] = value.toFloat();
+          else if (currentKey == "max") daily->temp_max[arrayIndex] = value.toFloat();
+        }
+        else if (currentSet == "feels_like") {
+          if (currentKey == "morn") daily->feels_like_morn[arrayIndex] = value.toFloat();
+          else if (currentKey == "day") daily->feels_like_day[arrayIndex] = value.toFloat();
+          else if (currentKey == "eve") daily->feels_like_eve[arrayIndex] = value.toFloat();
+          else if (currentKey == "night") daily->feels_like_night[arrayIndex] = value.toFloat();
+        }
+        else if (currentKey == "pressure") daily->pressure[arrayIndex] = value.toFloat();
+        else if (currentKey == "humidity") daily->humidity[arrayIndex] = value.toInt();
+        else if (currentKey == "dew_point") daily->dew_point[arrayIndex] = value.toFloat();
+        else if (currentKey == "wind_speed") daily->wind_speed[arrayIndex] = value.toFloat();
+        else if (currentKey == "wind_gust") daily->wind_gust[arrayIndex] = value.toFloat();
+        else if (currentKey == "wind_deg") daily->wind_deg[arrayIndex] = (uint16_t)value.toInt();
+        else if (currentKey == "clouds") daily->clouds[arrayIndex] = value.toInt();
+        else if (currentKey == "uvi") daily->uvi[arrayIndex] = value.toFloat();
+        else if (currentKey == "pop") daily->pop[arrayIndex] = value.toFloat();
+        else if (currentKey == "rain") daily->rain[arrayIndex] = value.toFloat();
+        else if (currentKey == "snow") daily->snow[arrayIndex] = value.toFloat();
+        else if (currentKey == "id") daily->id[arrayIndex] = value.toInt();
+        else if (currentKey == "main") daily->main[arrayIndex] = value;
+        else if (currentKey == "description") daily->description[arrayIndex] = value;
+        else if (currentKey == "icon") daily->icon[arrayIndex] = value;
+      }
+    }
+
+  public:
+
+    bool getForecast(OW_current *current, OW_hourly *hourly, OW_daily *daily, String api_key, String latitude,
+                     String longitude, String units, String language) {
+      this->current = current;
+      this->hourly = hourly;
+      this->daily = daily;
+      String url = "https://api.openweathermap.org/data/2.5/onecall?lat=" + latitude + "&lon=" + longitude +
+                   "&exclude=minutely,alerts&units=" + units + "&lang=" + language + "&appid=" + api_key;
+      return parseRequest(url);
+    }
+
+    // ===== JsonListener =====
+    void whitespace(char) override {}
+
+    void startDocument() override {
+      currentParent = currentSet = currentKey = "";
+      objectLevel = arrayLevel = arrayIndex = 0;
+      parseOK = true;
+    }
+
+    void key(const char *key) override {
+      currentKey = key;
+    }
+
+    void value(const char *val) override {
+      fullDataSet(val);
+    }
+
+    void startObject() override {
+      if (objectLevel == 1 && arrayLevel == 0) currentParent = currentKey; // "current"
+      else if (arrayLevel == 0 || objectLevel >= 2) currentSet = currentKey; // "temp", "rain", "weather"...
+      objectLevel++;
+    }
+
+    void endObject() override {
+      objectLevel--;
+      if (objectLevel == 1 && arrayLevel == 0) currentParent = "";
+      else if (objectLevel == 1 && arrayLevel == 1) arrayIndex++; // the end of an hour or a day
+      currentSet = "";
+    }
+
+    void startArray() override {
+      if (objectLevel == 1 && arrayLevel == 0) {
+        currentParent = currentKey; // "hourly" or "daily"
+        arrayIndex = 0;
+      }
+      else {
+        currentSet = currentKey; // "weather"
+      }
+      arrayLevel++;
+    }
+
+    void endArray() override {
+      arrayLevel--;
+      if (objectLevel == 1 && arrayLevel == 0) currentParent = "";
+    }
+
+    void endDocument() override {
+      currentParent = currentSet = currentKey = "";
+      objectLevel = arrayLevel = arrayIndex = 0;
+    }
+
+    void error(const char *) override {
+      parseOK = false;
+    }
+};
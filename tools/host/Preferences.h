@@ -0,0 +1,51 @@
+// NVS Preferences for the host tools, kept in memory
+
+#pragma once
+
+#include <map>
+#include <vector>
+
+class Preferences {
+  public:
+    bool begin(const char *, bool = false) { return true; }
+    void end() {}
+    bool clear() { store.clear(); return true; }
+    bool remove(const char *key) { return store.erase(key) > 0; }
+
+    size_t putBytes(const char *key, const void *value, size_t len) {
+      const uint8_t *bytes = (const uint8_t *)value;
+      store[key].assign(bytes, bytes + len);
+      writes++;
+      return len;
+    }
+    size_t getBytesLength(const char *key) {
+      auto it = store.find(key);
+      return it == store.end() ? 0 : it->second.size();
+    }
+    size_t getBytes(const char *key, void *buf, size_t maxLen) {
+      auto it = store.find(key);
+      if (it == store.end() || it->second.size() > maxLen) return 0;
+      memcpy(buf, it->second.data(), it->second.size());
+      return it->second.size();
+    }
+    float getFloat(const char *key, float defaultValue = 0) { return get(key, defaultValue); }
+    int8_t getChar(const char *key, int8_t defaultValue = 0) { return get(key, defaultValue); }
+    uint8_t getUChar(const char *key, uint8_t defaultValue = 0) { return get(key, defaultValue); }
+    bool getBool(const char *key, bool defaultValue = false) { return get(key, defaultValue); }
+    uint32_t getUInt(const char *key, uint32_t defaultValue = 0) { return get(key, defaultValue); }
+    size_t putFloat(const char *key, float value) { return putBytes(key, &value, sizeof(value)); }
+    size_t putChar(const char *key, int8_t value) { return putBytes(key, &value, sizeof(value)); }
+    size_t putUChar(const char *key, uint8_t value) { return putBytes(key, &value, sizeof(value)); }
+    size_t putBool(const char *key, bool value) { return putBytes(key, &value, sizeof(value)); }
+    size_t putUInt(const char *key, uint32_t value) { return putBytes(key, &value, sizeof(value)); }
+
+    uint32_t writes = 0; // puts since start, for counting flash wear
+
+  private:
+    std::map<std::string, std::vector<uint8_t>> store;
+
+    template <class T> T get(const char *key, T defaultValue) {
+      T value;
+      return getBytes(key, &value, sizeof(T)) == sizeof(T) ? value : defaultValue;
+    }
+};
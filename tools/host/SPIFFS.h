@@ -0,0 +1,50 @@
+// SPIFFS for the host tools, with the files kept in memory
+
+#pragma once
+
+#include <map>
+#include <vector>
+
+class File {
+  public:
+    File() {}
+    File(std::vector<uint8_t> *d) : data(d) {}
+    operator bool() const { return data != nullptr; }
+    size_t size() { return data->size(); }
+    bool seek(size_t p) { if (p > data->size()) return false; pos = p; return true; }
+    size_t read(uint8_t *buf, size_t len) {
+      len = min(len, data->size() - pos);
+      memcpy(buf, data->data() + pos, len);
+      pos += len;
+      return len;
+    }
+    size_t write(const uint8_t *buf, size_t len) {
+      if (pos + len > data->size()) data->resize(pos + len);
+      memcpy(data->data() + pos, buf, len);
+      pos += len;
+      return len;
+    }
+    void close() { data = nullptr; }
+
+  private:
+    std::vector<uint8_t> *data = nullptr;
+    size_t pos = 0;
+};
+
+class HostFS {
+  public:
+    bool begin(bool = false) { return true; }
+    bool exists(const String &path) { return files.count(path.c_str()) > 0; }
+    bool remove(const String &path) { return files.erase(path.c_str()) > 0; }
+    File open(const String &path, const char *mode) {
+      std::string name = path.c_str();
+      if (mode[0] == 'r' && !files.count(name)) return File();
+      if (mode[0] == 'w') files[name].clear();
+      return File(&files[name]);
+    }
+
+  private:
+    std::map<std::string, std::vector<uint8_t>> files;
+};
+
+inline HostFS SPIFFS;
@@ -0,0 +1,16 @@
+// The TFT_eSPI pieces the alarm code keeps, for the host tools. Nothing is drawn.
+
+#pragma once
+
+class TFT_eSPI_Button {
+  public:
+    bool contains(int16_t, int16_t) { return false; }
+    void press(bool p) { pressed = p; }
+    bool isPressed() { return pressed; }
+    bool justPressed() { return false; }
+    bool justReleased() { return false; }
+    void drawButton(bool = false) {}
+
+  private:
+    bool pressed = false;
+};
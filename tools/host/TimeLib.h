@@ -0,0 +1,57 @@
+// TimeLib for the host tools. now() returns hostTime, which the tools set, so a test can step the
+// clock wherever it likes. Times break down as TimeLib's do, with no zone applied.
+
+#pragma once
+
+#include <ctime>
+
+#define SECS_PER_MIN 60
+#define SECS_PER_HOUR 3600
+#define SECS_PER_DAY 86400
+#define timeNotSet 0
+#define timeNeedsSync 1
+#define timeSet 2
+#define CalendarYrToTm(Y) ((Y) - 1970)
+#define tmYearToCalendar(Y) ((Y) + 1970)
+
+typedef struct {
+  uint8_t Second, Minute, Hour, Wday, Day, Month, Year; // Wday 1 is Sunday, Year from 1970
+} tmElements_t;
+
+inline time_t hostTime = 0;
+
+inline time_t now() { return hostTime; }
+inline void setTime(time_t t) { hostTime = t; }
+inline int timeStatus() { return timeSet; }
+
+inline struct tm hostBreak(time_t t) { struct tm out; gmtime_r(&t, &out); return out; }
+inline int second(time_t t) { return hostBreak(t).tm_sec; }
+inline int minute(time_t t) { return hostBreak(t).tm_min; }
+inline int hour(time_t t) { return hostBreak(t).tm_hour; }
+inline int day(time_t t) { return hostBreak(t).tm_mday; }
+inline int weekday(time_t t) { return hostBreak(t).tm_wday + 1; }
+inline int month(time_t t) { return hostBreak(t).tm_mon + 1; }
+inline int year(time_t t) { return hostBreak(t).tm_year + 1900; }
+inline int second() { return second(now()); }
+inline int minute() { return minute(now()); }
+inline int hour() { return hour(now()); }
+inline int day() { return day(now()); }
+inline int weekday() { return weekday(now()); }
+inline int month() { return month(now()); }
+inline int year() { return year(now()); }
+
+inline void breakTime(time_t t, tmElements_t &tm) {
+  struct tm b = hostBreak(t);
+  tm = {(uint8_t)b.tm_sec, (uint8_t)b.tm_min, (uint8_t)b.tm_hour, (uint8_t)(b.tm_wday + 1), (uint8_t)b.tm_mday, (uint8_t)(b.tm_mon + 1), (uint8_t)(b.tm_year - 70)};
+}
+
+inline time_t makeTime(const tmElements_t &tm) {
+  struct tm b = {};
+  b.tm_sec = tm.Second;
+  b.tm_min = tm.Minute;
+  b.tm_hour = tm.Hour;
+  b.tm_mday = tm.Day;
+  b.tm_mon = tm.Month - 1;
+  b.tm_year = tm.Year + 70;
+  return timegm(&b);
+}
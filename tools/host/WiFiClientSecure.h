@@ -0,0 +1,77 @@
+// WiFi clients for the host tools. There's no network: every connection is answered with
+// hostResponse, handed out at most hostStep bytes per read(), so a tool can play back a recorded
+// response as a slow or bursty socket would deliver it.
+
+#pragma once
+
+#include <Arduino.h>
+#include <vector>
+
+inline std::vector<uint8_t> hostResponse;
+inline size_t hostStep = 512;
+
+class Client {
+
+  protected:
+    size_t pos = 0;
+
+  public:
+    virtual ~Client() {}
+
+    // Start playing hostResponse from the top
+    void rewind( void ) {
+      pos = 0;
+    }
+
+    int connect(const char *, uint16_t) {
+      rewind();
+      return 1;
+    }
+
+    size_t print(const String &s) {
+      return s.length();
+    }
+
+    int available( void ) {
+      return (int)(hostResponse.size() - pos);
+    }
+
+    uint8_t connected( void ) {
+      return pos < hostResponse.size();
+    }
+
+    int read(uint8_t *buf, size_t size) {
+      size_t n = min(size, min(hostStep, hostResponse.size() - pos));
+      memcpy(buf, hostResponse.data() + pos, n);
+      pos += n;
+      return (int)n;
+    }
+
+    int read( void ) {
+      return (pos < hostResponse.size()) ? hostResponse[pos++] : -1;
+    }
+
+    int peek( void ) {
+      return (pos < hostResponse.size()) ? hostResponse[pos] : -1;
+    }
+
+    String readStringUntil(char terminator) {
+      std::string s;
+      int c;
+      while ((c = read()) >= 0 && c != terminator) s += (char)c;
+      return String(s);
+    }
+
+    void flush( void ) {}
+
+    void stop( void ) {
+      pos = hostResponse.size();
+    }
+};
+
+class WiFiClient : public Client {};
+
+class WiFiClientSecure : public Client {
+  public:
+    void setInsecure( void ) {}
+};
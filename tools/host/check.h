@@ -0,0 +1,22 @@
+// Pass/fail bookkeeping for the host tools. Each tool counts its failures here, prints the first
+// few, and ends with finish(), which prints "all good" or the count and gives the exit status.
+
+#pragma once
+
+#include <stdio.h>
+
+static int failures = 0;
+
+// Count a failure. True for the first few, the ones worth printing.
+inline bool failed(int shown = 10) {
+  return failures++ < shown;
+}
+
+inline void fail(const char *what, long detail) {
+  if (failed()) printf("  FAIL: %s (%ld)\n", what, detail);
+}
+
+inline int finish( void ) {
+  printf(failures ? "%d FAILURES\n" : "all good\n", failures);
+  return failures != 0;
+}
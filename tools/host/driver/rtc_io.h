@@ -0,0 +1,7 @@
+// ESP-IDF RTC GPIO calls for the host tools. They do nothing.
+
+#pragma once
+
+#include <esp_sleep.h>
+
+inline int rtc_gpio_deinit(gpio_num_t) { return 0; }
@@ -0,0 +1,18 @@
+// ESP-IDF sleep calls for the host tools. Nothing sleeps: esp_light_sleep_start() returns at once
+// and reports a timer wake.
+
+#pragma once
+
+#include <cstdint>
+
+typedef enum { GPIO_NUM_4 = 4, GPIO_NUM_27 = 27 } gpio_num_t;
+typedef enum { ESP_SLEEP_WAKEUP_ALL, ESP_SLEEP_WAKEUP_EXT0, ESP_SLEEP_WAKEUP_EXT1, ESP_SLEEP_WAKEUP_TIMER } esp_sleep_wakeup_cause_t;
+typedef esp_sleep_wakeup_cause_t esp_sleep_source_t;
+typedef enum { ESP_EXT1_WAKEUP_ALL_LOW, ESP_EXT1_WAKEUP_ANY_HIGH } esp_sleep_ext1_wakeup_mode_t;
+
+inline int esp_sleep_enable_timer_wakeup(uint64_t) { return 0; }
+inline int esp_sleep_enable_ext0_wakeup(gpio_num_t, int) { return 0; }
+inline int esp_sleep_enable_ext1_wakeup(uint64_t, esp_sleep_ext1_wakeup_mode_t) { return 0; }
+inline int esp_sleep_disable_wakeup_source(esp_sleep_source_t) { return 0; }
+inline int esp_light_sleep_start() { return 0; }
+inline esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause() { return ESP_SLEEP_WAKEUP_TIMER; }
@@ -0,0 +1,16 @@
+// The ESP32 ROM's crc32_le, for the host tools. Same result as zlib's crc32().
+
+#pragma once
+
+#include <cstdint>
+
+inline uint32_t crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len) {
+  crc = ~crc;
+  while (len--) {
+    crc ^= *buf++;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
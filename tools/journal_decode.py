@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+"""Decode the alarm journal written by alarmJournal.h.
+
+Reads either a copy of /journal.bin pulled from SPIFFS, or a serial log containing the
+"journal: <hex> ..." lines that alarmJournal.dump() prints. Records that fail their CRC are
+reported and skipped. The rest are printed oldest first.
+
+usage: journal_decode.py [--last N] journal.bin|serial.log
+"""
+
+import argparse
+import re
+import struct
+import sys
+import time
+import zlib
+
+RECORD = struct.Struct('<IIBBHI')  # seq, time, type, alarm, detail, crc. Same as journalRecord.
+
+TYPE_NAMES = {
+    1: 'rang',
+    2: 'snoozed',
+    3: 'dismissed',
+    4: 'timed out',
+    5: 'turned off',
+    6: 'missed',
+    7: 'onset',
+}
+
+DETAIL_UNITS = {
+    1: 'snoozes',
+    2: 'snoozes',
+    3: 's rang',
+    6: 's late',
+    7: 'us error',
+}
+
+
+def decode_record(raw):
+    """Return (seq, time, type, alarm, detail), None for a blank slot, or raise ValueError on a bad CRC."""
+    seq, ts, rtype, alarm, detail, crc = RECORD.unpack(raw)
+    if seq == 0:
+        return None
+    if zlib.crc32(raw[:RECORD.size - 4]) != crc:  # crc32_le(0, ...) on the ESP32 is the same CRC
+        raise ValueError(f'record #{seq}: bad CRC')
+    if rtype == 8:
+        detail = struct.unpack('<h', struct.pack('<H', detail))[0]
+    return seq, ts, rtype, alarm, detail
+
+
+def read_binary(data):
+    for offset in range(0, len(data) - RECORD.size + 1, RECORD.size):
+        yield data[offset:offset + RECORD.size]
+
+
+def read_log(text):
+    for match in re.finditer(r'journal: ([0-9a-fA-F]{%d})' % (2 * RECORD.size), text):
+        yield bytes.fromhex(match.group(1))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode the alarm clock journal.')
+    parser.add_argument('input', help='journal.bin, or a serial log with journal: lines')
+    parser.add_argument('--last', type=int, default=0, help='only show the newest N records')
+    args = parser.parse_args()
+
+    with open(args.input, 'rb') as f:
+        data = f.read()
+    if args.input.endswith('.bin'):
+        raws = read_binary(data)
+    else:
+        raws = read_log(data.decode('utf-8', errors='replace'))
+
+    records = {}
+    bad = 0
+    for raw in raws:
+        try:
+            record = decode_record(raw)
+        except ValueError as err:
+            print(err, file=sys.stderr)
+            bad += 1
+            continue
+        if record:
+            records[record[0]] = record  # a log can print the same record more than once
+
+    ordered = [records[seq] for seq in sorted(records)]
+    if args.last:
+        ordered = ordered[-args.last:]
+    for seq, ts, rtype, alarm, detail in ordered:
+        when = time.strftime('%Y-%m-%d %H:%M:%S', time.gmtime(ts))  # already local time on the clock
+        what = TYPE_NAMES.get(rtype, f'type {rtype}')
+        unit = DETAIL_UNITS.get(rtype)
+        extra = f' ({detail} {unit})' if unit else ''
+        who = f'alarm{alarm}' if alarm else 'audio'
+        print(f'#{seq:<6} {when}  {who:<8} {what}{extra}')
+
+    gaps = sum(1 for a, b in zip(ordered, ordered[1:]) if b[0] != a[0] + 1)
+    print(f'{len(ordered)} records, {bad} bad, {gaps} gaps in seq', file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,242 @@
+// Host benchmark for the OneCall forecast parser (oneCallParser.h).
+//
+// Plays back a recorded OneCall response (tools/onecall_fixture.json, in the shape the clock asks
+// for: no "minutely" or "alerts") through the parser as a socket would deliver it. It's sent in
+// 512 byte reads, in 1 byte reads as a slow link would trickle it in, and chunked. For each way it
+// reports the parse time per response and the peak heap in use while parsing, counted through
+// operator new. The parser should never allocate. It also checks the parsed snapshot against the
+// fixture, and that cut off and non-200 responses are refused.
+//
+// For comparison, build with OLD_PATH defined to run the same response through the old way as
+// well, and print the two side by side. The OpenWeather and JSON_Decoder libraries (Bodmer) that
+// the parser replaced aren't in this repo, so tools/host has stand-ins for them that work the way
+// they do: a byte at a time, String keys and values, and String compares to find each field. The
+// old columns are the stand-ins' numbers, not the libraries'. The stand-ins don't do chunked bodies.
+//
+// build, from the top of the repo:
+//   g++ -std=c++17 -O2 -Itools/host -o onecall_bench tools/onecall_bench.cpp
+//   g++ -std=c++17 -O2 -Itools/host -DOLD_PATH -o onecall_bench tools/onecall_bench.cpp
+// usage: onecall_bench [fixture] [repeats]
+
+#include <Arduino.h>
+#include <WiFiClientSecure.h>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include "host/check.h"
+
+#include "../netService.h"
+#include "../weatherStore.h"
+#include "../oneCallParser.h"
+
+#ifdef OLD_PATH
+#include <JSON_Decoder.h>
+#include <OpenWeather.h>
+#endif
+
+SemaphoreHandle_t owMutex = xSemaphoreCreateMutex();
+netService net;
+oneCallParser oneCall;
+
+
+// ===== Heap use, through operator new =====
+static bool counting = false;
+static size_t heapNow = 0, heapPeak = 0, heapCalls = 0;
+
+void *operator new(size_t size) {
+  size_t *block = (size_t *)malloc(size + sizeof(size_t));
+  if (block == NULL) throw std::bad_alloc();
+  *block = size;
+  if (counting) {
+    heapNow += size;
+    heapCalls++;
+    if (heapNow > heapPeak) heapPeak = heapNow;
+  }
+  return block + 1;
+}
+
+void operator delete(void *p) noexcept {
+  if (p == NULL) return;
+  size_t *block = (size_t *)p - 1;
+  if (counting) heapNow -= min(heapNow, *block);
+  free(block);
+}
+
+void operator delete(void *p, size_t) noexcept {
+  operator delete(p);
+}
+
+static void startCounting( void ) {
+  heapNow = heapPeak = heapCalls = 0;
+  counting = true;
+}
+
+// ===== Responses =====
+static std::string loadFile(const char *name) {
+  std::ifstream in(name, std::ios::binary);
+  std::stringstream s;
+  s << in.rdbuf();
+  return s.str();
+}
+
+static std::string plainResponse(const std::string &body) {
+  return "HTTP/1.1 200 OK\r\nServer: openresty\r\nContent-Type: application/json; charset=utf-8\r\nContent-Length: " +
+         std::to_string(body.size()) + "\r\nCache-Control: max-age=600\r\n\r\n" + body;
+}
+
+static std::string chunkedResponse(const std::string &body) {
+  std::string out = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nTransfer-Encoding: chunked\r\n\r\n";
+  for (size_t at = 0; at < body.size(); at += 1000) {
+    std::string piece = body.substr(at, 1000);
+    char size[16];
+    snprintf(size, sizeof(size), "%zx\r\n", piece.size());
+    out += size + piece + "\r\n";
+  }
+  return out + "0\r\n\r\n";
+}
+
+static void play(const std::string &response, size_t step) {
+  hostResponse.assign(response.begin(), response.end());
+  hostStep = step;
+}
+
+// The first number after key, found after section, read the slow way
+static double fixtureNumber(const std::string &body, const char *section, const char *key) {
+  size_t at = body.find(std::string("\"") + section + "\"");
+  at = body.find(std::string("\"") + key + "\":", at);
+  return atof(body.c_str() + at + strlen(key) + 3);
+}
+
+static void checkSnapshot(const std::string &body, const wxSnapshot &wx) {
+  if (wx.current.dt != (uint32_t)fixtureNumber(body, "current", "dt")) fail("current dt", wx.current.dt);
+  if (fabs(wx.current.temp - fixtureNumber(body, "current", "temp")) > 0.01) fail("current temp", wx.current.temp);
+  if (wx.current.id != (uint16_t)fixtureNumber(body, "current", "id")) fail("current weather id", wx.current.id);
+  if (wx.hourly[0].dt != (uint32_t)fixtureNumber(body, "hourly", "dt")) fail("first hour dt", wx.hourly[0].dt);
+  if (wx.daily[0].dt != (uint32_t)fixtureNumber(body, "daily", "dt")) fail("first day dt", wx.daily[0].dt);
+  if (fabs(wx.daily[0].temp_min - fixtureNumber(body, "daily", "min")) > 0.01) fail("first day min", wx.daily[0].temp_min);
+  if (wx.hourly[WX_HOURS - 1].dt != wx.hourly[0].dt + (WX_HOURS - 1) * 3600) fail("last hour kept", wx.hourly[WX_HOURS - 1].dt);
+  if (wx.daily[WX_DAYS - 1].dt != wx.daily[0].dt + (WX_DAYS - 1) * 86400) fail("last day kept", wx.daily[WX_DAYS - 1].dt);
+}
+
+struct benchResult {
+  double us; // per response
+  size_t heapPeak, heapCalls;
+};
+
+template <class F> static double timeUs(long repeats, F f) {
+  auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < repeats; i++) f();
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / repeats;
+}
+
+static benchResult bench(const std::string &body, const std::string &response, size_t step, long repeats) {
+  static wxSnapshot wx;
+  play(response, step);
+
+  Client client;
+  memset(&wx, 0, sizeof(wx));
+  startCounting();
+  bool ok = oneCall.parse(client, &wx);
+  counting = false;
+  if (!ok) fail("parse failed", step);
+  checkSnapshot(body, wx);
+  if (heapPeak != 0) fail("the parser allocated", heapPeak);
+  benchResult result = {0, heapPeak, heapCalls};
+
+  result.us = timeUs(repeats, [&]() {
+    client.rewind();
+    memset(&wx, 0, sizeof(wx));
+    oneCall.parse(client, &wx);
+  });
+  return result;
+}
+
+static void refusals(const std::string &response) {
+  static wxSnapshot wx;
+  Client client;
+  for (size_t cut : {(size_t)200, response.size() / 2, response.size() - 2}) {
+    play(response.substr(0, cut), 512);
+    client.rewind();
+    memset(&wx, 0, sizeof(wx));
+    if (oneCall.parse(client, &wx)) fail("took a response cut off at", cut);
+  }
+  play("HTTP/1.1 401 Unauthorized\r\nContent-Type: application/json\r\n\r\n{\"cod\":401,\"message\":\"Invalid API key.\"}", 512);
+  client.rewind();
+  if (oneCall.parse(client, &wx)) fail("took a 401", 401);
+  printf("  cut off and 401 responses refused\n");
+}
+
+#ifdef OLD_PATH
+// The same response through the OpenWeather and JSON_Decoder stand-ins. The OW_ objects are made
+// outside the count, as the clock made them once. The Strings inside them are counted.
+static benchResult benchOld(const std::string &body, const std::string &response, size_t step, long repeats) {
+  OW_Weather ow;
+  OW_current *current = new OW_current;
+  OW_hourly *hourly = new OW_hourly;
+  OW_daily *daily = new OW_daily;
+  play(response, step);
+
+  startCounting();
+  bool ok = ow.getForecast(current, hourly, daily, "key", "40", "-70", "imperial", "en");
+  counting = false;
+  if (!ok) fail("OpenWeather stand-in parse failed", step);
+  if (current->dt != (uint32_t)fixtureNumber(body, "current", "dt")) fail("OpenWeather stand-in current dt", current->dt);
+  if (hourly->dt[0] != (uint32_t)fixtureNumber(body, "hourly", "dt")) fail("OpenWeather stand-in first hour dt", hourly->dt[0]);
+  if (daily->temp_min[0] != (float)fixtureNumber(body, "daily", "min")) fail("OpenWeather stand-in first day min", daily->temp_min[0]);
+  benchResult result = {0, heapPeak, heapCalls};
+
+  result.us = timeUs(repeats, [&]() {
+    ow.getForecast(current, hourly, daily, "key", "40", "-70", "imperial", "en");
+  });
+  delete current;
+  delete hourly;
+  delete daily;
+  return result;
+}
+#endif
+
+static void row(const char *name, const benchResult &r) {
+  printf("  %-24s %8.1f us %7zu bytes %6zu", name, r.us, r.heapPeak, r.heapCalls);
+}
+
+int main(int argc, char **argv) {
+  const char *fixture = (argc > 1) ? argv[1] : "tools/onecall_fixture.json";
+  long repeats = (argc > 2) ? atol(argv[2]) : 2000;
+  Serial.quiet = true;
+
+  std::string body = loadFile(fixture);
+  if (body.empty()) {
+    printf("Can't read %s. Run from the top of the repo, or give the fixture's path.\n", fixture);
+    return 1;
+  }
+  std::string response = plainResponse(body);
+  printf("%s: %zu byte body. Parser %zu bytes, snapshot %zu bytes, both static.\n", fixture, body.size(), sizeof(oneCallParser), sizeof(wxSnapshot));
+
+  printf("  %-24s %33s", "per response", "oneCallParser: time, peak heap, allocations");
+#ifdef OLD_PATH
+  printf("   %s", "OpenWeather stand-in: the same");
+#endif
+  printf("\n");
+
+  row("512 byte reads", bench(body, response, OW_BUF_LEN, repeats));
+#ifdef OLD_PATH
+  benchResult old = benchOld(body, response, OW_BUF_LEN, repeats / 10);
+  printf("   %8.1f us %7zu bytes %6zu", old.us, old.heapPeak, old.heapCalls);
+#endif
+  printf("\n");
+  row("1 byte reads", bench(body, response, 1, repeats / 10));
+#ifdef OLD_PATH
+  old = benchOld(body, response, 1, repeats / 10);
+  printf("   %8.1f us %7zu bytes %6zu", old.us, old.heapPeak, old.heapCalls);
+#endif
+  printf("\n");
+  row("chunked, 512 byte reads", bench(body, chunkedResponse(body), OW_BUF_LEN, repeats));
+#ifdef OLD_PATH
+  printf("   %s", "(the stand-in can't)");
+#endif
+  printf("\n");
+  printf("  the parser read %u body bytes and skipped %u\n", oneCall.getBodyBytes(), oneCall.getSkippedBytes());
+  refusals(response);
+
+  return finish();
+}
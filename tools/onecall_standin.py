@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+"""A stand-in OpenWeather OneCall server for testing the clock's weather schedule (weatherSchedule.h).
+
+Serves a made-up OneCall forecast over plain HTTP, in the same shape as the real one, and prints
+how long it's been since the last request, so the schedule's intervals can be watched. The
+forecast stays the same (so the schedule should back off) except every --change-every requests,
+when the conditions move (so it should drop back to its shortest interval). It can send cache
+headers, fail requests, or send the body chunked.
+
+Point the clock at it by defining OW_STANDIN_HOST in oneCallParser.h as this machine's IP (and
+OW_STANDIN_PORT if not 8080).
+
+usage: onecall_standin.py [--port 8080] [--max-age S] [--change-every N] [--fail-every N] [--chunked]
+
+examples:
+  onecall_standin.py                          a forecast that never changes
+  onecall_standin.py --change-every 3         it changes on every third request
+  onecall_standin.py --max-age 1200           and says each response is good for 20 minutes
+  onecall_standin.py --fail-every 4           every fourth request gets a 500
+"""
+
+import argparse
+import json
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlparse
+
+CONDITIONS = [(800, 'clear sky'), (802, 'scattered clouds'), (500, 'light rain'), (211, 'thunderstorm'), (601, 'snow')]
+
+
+def weather(n):
+    cond_id, description = CONDITIONS[n % len(CONDITIONS)]
+    return [{'id': cond_id, 'main': 'Test', 'description': description, 'icon': '01d'}]
+
+
+def forecast(version, now):
+    """A OneCall document. version moves the conditions and temperatures."""
+    hour = now - now % 3600
+    day = now - now % 86400 + 43200
+    temp = 50.0 + 5 * version
+    return {
+        'lat': 40.0, 'lon': -70.0, 'timezone': 'America/New_York', 'timezone_offset': -14400,
+        'current': {
+            'dt': now, 'sunrise': day - 21600, 'sunset': day + 21600, 'temp': temp, 'feels_like': temp - 2,
+            'pressure': 1012, 'humidity': 60, 'dew_point': 40.0, 'uvi': 2.0, 'clouds': 40, 'visibility': 10000,
+            'wind_speed': 8.0, 'wind_deg': 230, 'wind_gust': 15.0, 'weather': weather(version),
+        },
+        'minutely': [{'dt': hour + 60 * i, 'precipitation': 0} for i in range(61)],
+        'hourly': [{
+            'dt': hour + 3600 * i, 'temp': temp + i * 0.5, 'feels_like': temp - 2, 'pressure': 1012, 'humidity': 60,
+            'dew_point': 40.0, 'uvi': 1.0, 'clouds': 40, 'visibility': 10000, 'wind_speed': 6.0, 'wind_deg': 220,
+            'wind_gust': 12.0, 'weather': weather(version + i // 12), 'pop': 0.1,
+        } for i in range(48)],
+        'daily': [{
+            'dt': day + 86400 * i, 'sunrise': day - 21600 + 86400 * i, 'sunset': day + 21600 + 86400 * i,
+            'moonrise': 0, 'moonset': 0, 'moon_phase': 0.5,
+            'temp': {'day': temp + i, 'min': temp - 10, 'max': temp + 5, 'night': temp - 8, 'eve': temp - 2, 'morn': temp - 9},
+            'feels_like': {'day': temp, 'night': temp - 10, 'eve': temp - 4, 'morn': temp - 11},
+            'pressure': 1010, 'humidity': 55, 'dew_point': 38.0, 'wind_speed': 9.0, 'wind_deg': 200,
+            'wind_gust': 18.0, 'weather': weather(version + i), 'clouds': 30, 'pop': 0.1 * version % 1.0,
+            'rain': 0.5, 'uvi': 4.0,
+        } for i in range(8)],
+    }
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = 'HTTP/1.1'
+    count = 0
+    last = None
+
+    def do_GET(self):
+        cls = type(self)
+        args = self.server.args
+        cls.count += 1
+        now = time.time()
+        since = f'{now - cls.last:.0f} s since the last' if cls.last else 'the first'
+        cls.last = now
+
+        url = urlparse(self.path)
+        query = parse_qs(url.query)
+        if url.path != '/data/2.5/onecall' or 'appid' not in query:
+            print(f'request {cls.count}: {since}, bad request {self.path}')
+            self.send_error(404)
+            return
+        if args.fail_every and cls.count % args.fail_every == 0:
+            print(f'request {cls.count}: {since}, failing it')
+            self.send_error(500)
+            return
+
+        version = cls.count // args.change_every if args.change_every else 0
+        body = json.dumps(forecast(version, int(now))).encode()
+        print(f'request {cls.count}: {since}, forecast version {version}, {len(body)} bytes')
+
+        self.send_response(200)
+        self.send_header('Content-Type', 'application/json; charset=utf-8')
+        if args.max_age is not None:
+            self.send_header('Cache-Control', f'public, max-age={args.max_age}')
+        self.send_header('Connection', 'close')
+        if args.chunked:
+            self.send_header('Transfer-Encoding', 'chunked')
+            self.end_headers()
+            for i in range(0, len(body), 1000):
+                part = body[i:i + 1000]
+                self.wfile.write(b'%x\r\n%s\r\n' % (len(part), part))
+            self.wfile.write(b'0\r\n\r\n')
+        else:
+            self.send_header('Content-Length', str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+        self.close_connection = True
+
+    def log_message(self, *args):
+        pass
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Stand-in OpenWeather OneCall server for testing.')
+    parser.add_argument('--port', type=int, default=8080)
+    parser.add_argument('--max-age', type=int, help='send Cache-Control max-age, in seconds')
+    parser.add_argument('--change-every', type=int, default=0, help='change the forecast every N requests')
+    parser.add_argument('--fail-every', type=int, default=0, help='answer every Nth request with a 500')
+    parser.add_argument('--chunked', action='store_true', help='send the body chunked')
+    args = parser.parse_args()
+
+    server = ThreadingHTTPServer(('0.0.0.0', args.port), Handler)
+    server.args = args
+    print(f'listening on tcp {args.port}')
+    server.serve_forever()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,184 @@
+// Host check for the RTC wake scheduling (rtcWake.h), against the DS3231 stand-in in
+// tools/host/DS3232RTC.h.
+//
+// Runs the clock a second at a time through the days around each DST change of a few zones, doing
+// what timeMgr does each tick: run the RTC, latch its INT line as the ISR would, step the local
+// clock, service() and program() the wake, then ask the alarm table what is due. Every so often an
+// alarm is edited, snoozed or turned off. It checks that:
+// - RTC alarm 1 goes off ALARM_PREARM_TIME before an alarm comes due, and at no other time
+// - RTC alarm 2 goes off on the second a sunrise alarm's light should start, and at no other time
+// It also counts the RTC alarm writes, which should only happen when the next alarm or sunrise moves.
+//
+// Alarms at 1:30 and 2:30 land in the hours that repeat or get skipped at the changes.
+//
+// build, from the top of the repo:
+//   g++ -std=c++17 -O2 -Itools/host -o rtc_wake_check tools/rtc_wake_check.cpp
+// usage: rtc_wake_check [days either side of each change]
+
+#include <Arduino.h>
+#include <TimeLib.h>
+#include <TFT_eSPI.h>
+#include <random>
+#include "host/check.h"
+
+#include "../settingsStore.h"
+#include "../alarm.h"
+#include "../alarmJournal.h"
+#include "../alarmTable.h"
+#include "../tzRules.h"
+#include "../rtcWake.h"
+
+Preferences prefs;
+settingsStore settings;
+alarmJournal journal;
+tzRules zone;
+DS3232RTC RTC(false);
+SemaphoreHandle_t rtcMutex = xSemaphoreCreateMutex();
+volatile bool rtcIntFlag = false;
+rtcWake wake;
+
+static std::mt19937 rng(30);
+
+static uint32_t pick(uint32_t n) {
+  return rng() % n;
+}
+
+static void failAt(const char *what, time_t ts) {
+  if (failed(20)) {
+    struct tm b;
+    gmtime_r(&ts, &b);
+    printf("  FAIL: %s at %04d-%02d-%02d %02d:%02d:%02d local\n", what, b.tm_year + 1900, b.tm_mon + 1, b.tm_mday, b.tm_hour, b.tm_min, b.tm_sec);
+  }
+}
+
+struct testAlarm {
+  uint8_t hour, minute;
+  uint8_t days; // bit 0 is Sunday
+  bool sunrise;
+};
+
+static const testAlarm testAlarms[] = {
+  {6, 30, 0x7F, true},
+  {7, 15, 0x3E, false},
+  {2, 30, 0x7F, true}, // skipped or repeated at the changes, depending on the zone
+  {1, 30, 0x7F, true},
+  {23, 59, 0x40, false},
+  {12, 0, 0x01, true},
+};
+static const uint8_t testAlarmCount = sizeof(testAlarms) / sizeof(testAlarms[0]);
+
+// Is some sunrise alarm's light due to start at ts? Worked out the long way.
+static bool sunriseStarts(alarmTable *table, time_t ts) {
+  for (uint16_t i = 0; i < table->size(); i++) {
+    alarmData *workAlarm = table->get(i);
+    if (workAlarm->isSunriseActive() && workAlarm->getNextFire() && workAlarm->getNextFire() - SUNRISE_LEAD_TIME == ts) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void edit(alarmTable *table) {
+  alarmData *workAlarm = table->get(pick(table->size()));
+  switch (pick(5)) {
+    case 0: workAlarm->minuteMod(pick(2) ? 5 : -5); break;
+    case 1: workAlarm->toggleDay(pick(7)); break;
+    case 2: workAlarm->snooze(); break;
+    case 3: workAlarm->toggleStatus(); break;
+    default: workAlarm->toggleSunrise(); break;
+  }
+}
+
+// Run the clock from utc to end a second at a time, as timeMgr would
+static void run(alarmTable *table, time_t utc, time_t end) {
+  long rings = 0, wakes = 0;
+  uint32_t writesBefore = RTC.alarmWrites;
+  RTC.set(utc);
+  zone.service(utc);
+  time_t lastTs = zone.toLocal(utc);
+  hostTime = lastTs;
+  table->rebuild(lastTs);
+  wake.begin();
+  uint32_t lastAlarmChange = table->getChangeCount() - 1;
+  uint8_t minutePrevious = 60;
+
+  while (utc < end) {
+    utc++;
+    RTC.tick(utc);
+    if (RTC.intLow()) rtcIntFlag = true; // rtcIntISR
+    uint8_t fired = RTC.readRTC(RTC_STATUS) & RTC.readRTC(RTC_CONTROL) & (_BV(A1F) | _BV(A2F));
+
+    zone.service(utc);
+    hostTime = zone.toLocal(utc);
+    time_t ts = now();
+    table->timeChanged(lastTs, ts);
+    bool stepped = (ts != lastTs + 1); // the tick that steps the clock is awake anyway
+    lastTs = ts;
+
+    time_t alarmDue = table->nextFireTime();
+    bool sunriseDue = sunriseStarts(table, ts);
+    if (wake.service()) wakes++;
+    bool prearmDue = (alarmDue != 0 && alarmDue - ALARM_PREARM_TIME == ts);
+    if (!stepped && prearmDue != (bool)(fired & _BV(A1F))) {
+      failAt(prearmDue ? "pre-arm due with no RTC alarm 1" : "RTC alarm 1 with no pre-arm due", ts);
+    }
+    if (!stepped && sunriseDue != (bool)(fired & _BV(A2F))) {
+      failAt(sunriseDue ? "sunrise start with no RTC alarm 2" : "RTC alarm 2 with no sunrise starting", ts);
+    }
+
+    if (table->getChangeCount() != lastAlarmChange || minute(ts) != minutePrevious) {
+      lastAlarmChange = table->getChangeCount();
+      minutePrevious = minute(ts);
+      wake.program(table->nextFireTime(), table->nextSunriseStart(ts), ts);
+    }
+
+    int32_t idx;
+    while ((idx = table->due(ts)) >= 0) {
+      rings++;
+      table->get(idx)->dismiss();
+    }
+
+    if (pick(4 * 3600) == 0) edit(table);
+  }
+  printf("  %s: %ld rings, %ld RTC wakes, %u RTC alarm writes\n",
+         zone.name(end), rings, wakes, RTC.alarmWrites - writesBefore);
+}
+
+int main(int argc, char **argv) {
+  long days = (argc > 1) ? atol(argv[1]) : 4;
+  Serial.quiet = true;
+  settings.begin();
+  settings.setAlarmCount(testAlarmCount);
+
+  const char *rules[] = {"EST5EDT,M3.2.0,M11.1.0", "AEST-10AEDT,M10.1.0,M4.1.0/3", "GMT0BST,M3.5.0/1,M10.5.0", "IST-5:30"};
+  for (const char *rule : rules) {
+    printf("%s\n", rule);
+    zone = tzRules(); // begin() is once only
+    zone.begin(rule);
+    zone.service(1704067200);
+    alarmTable *table = new alarmTable;
+    table->begin();
+    for (uint8_t i = 0; i < testAlarmCount; i++) {
+      alarmData *workAlarm = table->get(i);
+      bool dayList[7];
+      for (uint8_t d = 0; d < 7; d++) dayList[d] = testAlarms[i].days & (1 << d);
+      workAlarm->setAlarmDays(dayList, 7);
+      workAlarm->setAlarmTime(testAlarms[i].hour * SECS_PER_HOUR + testAlarms[i].minute * SECS_PER_MIN);
+      workAlarm->setSunrise(testAlarms[i].sunrise);
+      workAlarm->activate();
+    }
+
+    time_t start = 1704067200; // 1 Jan 2024
+    time_t change = zone.nextTransition(start);
+    if (change == 0) {
+      run(table, start, start + 2 * days * SECS_PER_DAY);
+    }
+    for (int n = 0; n < 2 && change; n++) {
+      run(table, change - days * SECS_PER_DAY, change + days * SECS_PER_DAY);
+      change = zone.nextTransition(change);
+    }
+    delete table;
+  }
+
+  return finish();
+}
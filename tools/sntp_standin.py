@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+"""A stand-in NTP server for testing the clock's SNTP client (sntpClient.h).
+
+Answers SNTP requests on one or more UDP ports, using this machine's clock plus a chosen offset.
+Each port can add its own network delay, so several "servers" with different round trips can be
+run at once. The client should pick the one with the shortest delay and land within a
+millisecond or two of the offset given here.
+
+Point the clock at it by putting "<this machine's IP>:<port>" entries in ntpServerName.
+
+usage: sntp_standin.py [--offset 2.5] [--stratum 2] [--kod PORT] PORT[/DELAY_MS] ...
+
+examples:
+  sntp_standin.py 12300/5 12301/40 12302/150    three servers, 5, 40 and 150 ms away
+  sntp_standin.py --kod 12301 12300 12301        the second answers with a kiss-o'-death
+"""
+
+import argparse
+import select
+import socket
+import struct
+import threading
+import time
+
+NTP_UNIX_OFFSET = 2208988800
+
+
+def to_ntp(unix_time):
+    secs = int(unix_time)
+    frac = int((unix_time - secs) * (1 << 32)) & 0xFFFFFFFF
+    return struct.pack('!II', (secs + NTP_UNIX_OFFSET) & 0xFFFFFFFF, frac)
+
+
+def reply(sock, data, addr, args, port, delay):
+    time.sleep(delay / 2)  # half the delay on the way in, half on the way out
+    received = time.time() + args.offset
+    stratum = 0 if port in args.kod else args.stratum
+    leap_version_mode = (0 << 6) | (4 << 3) | 4  # no warning, version 4, server
+    packet = struct.pack('!BBbb', leap_version_mode, stratum, 6, -20)
+    packet += struct.pack('!II', 0, 0)  # root delay, root dispersion
+    packet += b'RATE' if port in args.kod else b'TEST'  # reference ID, or the kiss code
+    packet += to_ntp(received - 1)  # reference time
+    packet += data[40:48]  # originate: echo the client's transmit timestamp
+    packet += to_ntp(received)
+    packet += to_ntp(time.time() + args.offset)
+    time.sleep(delay / 2)  # a symmetric path, so the client can't tell this from distance
+    sock.sendto(packet, addr)
+    print(f'port {port}: answered {addr[0]}:{addr[1]} after {delay * 1000:.0f} ms')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Stand-in NTP server for testing.')
+    parser.add_argument('ports', nargs='+', help='PORT or PORT/DELAY_MS')
+    parser.add_argument('--offset', type=float, default=0.0, help='seconds to add to this clock')
+    parser.add_argument('--stratum', type=int, default=2)
+    parser.add_argument('--kod', type=int, action='append', default=[], help='answer on this port with a kiss-o\'-death')
+    args = parser.parse_args()
+
+    socks = {}
+    for spec in args.ports:
+        port, _, delay = spec.partition('/')
+        sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        sock.bind(('0.0.0.0', int(port)))
+        socks[sock] = (int(port), float(delay or 0) / 1000)
+        print(f'listening on udp {port}, delay {float(delay or 0):.0f} ms')
+
+    while True:
+        ready, _, _ = select.select(list(socks), [], [])
+        for sock in ready:
+            data, addr = sock.recvfrom(512)
+            if len(data) < 48 or (data[0] & 0x07) != 3:
+                continue
+            port, delay = socks[sock]
+            threading.Thread(target=reply, args=(sock, data, addr, args, port, delay), daemon=True).start()
+
+
+if __name__ == '__main__':
+    main()
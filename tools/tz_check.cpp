@@ -0,0 +1,102 @@
+// Host check for the time zone rules (tzRules.h), against glibc's own reading of the same POSIX TZ
+// strings (localtime_r() with TZ set).
+//
+// For each rule it builds the table from 1 Jan 2020, so it covers the decade to 2030, and checks
+// every transition in it: the offset from two seconds before to a second after must match glibc,
+// the table must be in order, and nextTransition() must find each one. Then random times from 2017
+// to 2049, inside and outside the table, are checked against glibc, and toUtc() is checked to give
+// back the first pass of each local time. It also times offsetAt() both ways, from the table and
+// worked out from the rule.
+//
+// The rules cover both hemispheres, half hour offsets, <+nn> names, Julian day dates and changes
+// at 24:00 and -1:00, as well as zones with no DST.
+//
+// build, from the top of the repo:
+//   g++ -std=c++17 -O2 -Itools/host -o tz_check tools/tz_check.cpp
+// usage: tz_check [random times per rule]
+
+#include <Arduino.h>
+#include <random>
+#include "host/check.h"
+
+#include "../tzRules.h"
+
+#define TABLE_FROM 1577836800 // 1 Jan 2020
+
+static const char *rules[] = {
+  "EST5EDT,M3.2.0,M11.1.0",
+  "EST5EDT", // no rule given, so TZ_DEFAULT_RULE
+  "CET-1CEST,M3.5.0,M10.5.0/3",
+  "AEST-10AEDT,M10.1.0,M4.1.0/3",
+  "NZST-12NZDT,M9.5.0,M4.1.0/3",
+  "GMT0BST,M3.5.0/1,M10.5.0",
+  "<+1030>-10:30<+11>-11,M10.1.0,M4.1.0",
+  "<-04>4<-03>,M9.1.6/24,M4.1.6/24",
+  "EST5EDT,J60/2,J300/2",
+  "CST6CDT,59,300/-1",
+  "<-03>3",
+  "IST-5:30",
+};
+
+static int32_t libcOffset(time_t utc) {
+  struct tm tm;
+  localtime_r(&utc, &tm);
+  return (int32_t)tm.tm_gmtoff;
+}
+
+static void check(const char *rule, long randoms) {
+  tzRules zone;
+  zone.begin(rule);
+  zone.service(TABLE_FROM);
+  setenv("TZ", rule, 1);
+  tzset();
+
+  int before = failures;
+  const tzTransition *transitions;
+  uint8_t count = zone.getTransitions(transitions);
+  for (uint8_t i = 0; i < count; i++) {
+    for (int d = -2; d <= 1; d++) {
+      time_t t = transitions[i].utc + d;
+      if (zone.offsetAt(t) != libcOffset(t)) {
+        if (failed(5)) printf("  %s: offset %d at %ld, glibc says %d\n", rule, zone.offsetAt(t), (long)t, libcOffset(t));
+      }
+    }
+    if (i && transitions[i].utc <= transitions[i - 1].utc) failed();
+    if (zone.nextTransition(transitions[i].utc - 1) != transitions[i].utc) failed();
+  }
+
+  std::mt19937 rng(43);
+  for (long i = 0; i < randoms; i++) {
+    time_t t = 1500000000 + (time_t)(rng() % 1000000000u);
+    if (zone.offsetAt(t) != libcOffset(t)) {
+      if (failed(5)) printf("  %s: offset %d at %ld, glibc says %d\n", rule, zone.offsetAt(t), (long)t, libcOffset(t));
+    }
+    time_t local = zone.toLocal(t);
+    time_t back = zone.toUtc(local);
+    if (zone.toLocal(back) != local || back > t) failed();
+  }
+
+  volatile int32_t sink = 0;
+  auto timeNs = [&](time_t from) {
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < 1000000; i++) sink = zone.offsetAt(from + i * 311);
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / 1000000;
+  };
+  double tableNs = timeNs(TABLE_FROM);
+  double ruleNs = timeNs(TABLE_FROM + 20L * 365 * 86400);
+
+  printf("%-38s %2u transitions  %3.0f ns table  %4.0f ns rule  %s\n", rule, count, tableNs, ruleNs, failures > before ? "BAD" : "ok");
+}
+
+int main(int argc, char **argv) {
+  long randoms = (argc > 1) ? atol(argv[1]) : 200000;
+  Serial.quiet = true;
+  for (const char *rule : rules) {
+    check(rule, randoms);
+  }
+
+  tzRules zone; // a rule that won't parse is UTC
+  if (zone.begin("garbage") || zone.offsetAt(TABLE_FROM) != 0) failed();
+
+  return finish();
+}
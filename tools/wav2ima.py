@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+"""Convert 16 bit PCM WAV files to mono IMA-ADPCM WAV (.ima) for the alarm clock.
+
+The output is a standard WAV container (format 0x11) that AudioGeneratorADPCM in audioAdpcm.h
+plays. Stereo input is mixed down to mono. Each block starts with a full sample and step index,
+so a glitch can never last longer than one block.
+
+usage: wav2ima.py [--block 512] [--check] input.wav [output.ima]
+
+--check decodes the result again and reports the error against the original, plus the flash
+bytes read per second of audio for both formats.
+"""
+
+import argparse
+import math
+import struct
+import sys
+import wave
+
+STEP_TABLE = [
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767,
+]
+
+INDEX_TABLE = [-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8]
+
+
+def clamp(val, low, high):
+    return max(low, min(high, val))
+
+
+def decode_nibble(code, predictor, index):
+    """One IMA step. Matches decodeBlock() in audioAdpcm.h bit for bit."""
+    step = STEP_TABLE[index]
+    diff = step >> 3
+    if code & 4:
+        diff += step
+    if code & 2:
+        diff += step >> 1
+    if code & 1:
+        diff += step >> 2
+    predictor = predictor - diff if code & 8 else predictor + diff
+    predictor = clamp(predictor, -32768, 32767)
+    index = clamp(index + INDEX_TABLE[code], 0, 88)
+    return predictor, index
+
+
+def encode_sample(sample, predictor, index):
+    step = STEP_TABLE[index]
+    delta = sample - predictor
+    code = 0
+    if delta < 0:
+        code = 8
+        delta = -delta
+    if delta >= step:
+        code |= 4
+        delta -= step
+    if delta >= step >> 1:
+        code |= 2
+        delta -= step >> 1
+    if delta >= step >> 2:
+        code |= 1
+    predictor, index = decode_nibble(code, predictor, index)
+    return code, predictor, index
+
+
+def best_index(samples):
+    """Pick a starting step index that suits the first few samples of a block."""
+    if len(samples) < 2:
+        return 0
+    delta = abs(samples[1] - samples[0])
+    index = 0
+    while index < 88 and STEP_TABLE[index] < delta:
+        index += 1
+    return index
+
+
+def encode(samples, block_align):
+    samples_per_block = (block_align - 4) * 2 + 1
+    out = bytearray()
+    index = 0
+    for start in range(0, len(samples), samples_per_block):
+        chunk = samples[start:start + samples_per_block]
+        predictor = chunk[0]
+        if start == 0:
+            index = best_index(chunk)
+        out += struct.pack('<hBB', predictor, index, 0)
+        codes = []
+        for sample in chunk[1:]:
+            code, predictor, index = encode_sample(sample, predictor, index)
+            codes.append(code)
+        if len(codes) % 2:
+            codes.append(0)
+        for i in range(0, len(codes), 2):
+            out.append(codes[i] | (codes[i + 1] << 4))
+    return out, samples_per_block
+
+
+def decode(data, block_align):
+    samples = []
+    for start in range(0, len(data), block_align):
+        block = data[start:start + block_align]
+        if len(block) < 4:
+            break
+        predictor, index = struct.unpack('<hB', block[:3])
+        index = min(index, 88)
+        samples.append(predictor)
+        for byte in block[4:]:
+            for code in (byte & 0x0F, byte >> 4):
+                predictor, index = decode_nibble(code, predictor, index)
+                samples.append(predictor)
+    return samples
+
+
+def read_pcm(path):
+    with wave.open(path, 'rb') as wav:
+        if wav.getsampwidth() != 2:
+            sys.exit(f'{path}: only 16 bit PCM is supported')
+        channels = wav.getnchannels()
+        rate = wav.getframerate()
+        frames = wav.readframes(wav.getnframes())
+    values = struct.unpack(f'<{len(frames) // 2}h', frames)
+    if channels > 1:
+        values = [sum(values[i:i + channels]) // channels for i in range(0, len(values), channels)]
+    return list(values), rate
+
+
+def write_ima(path, data, rate, block_align, samples_per_block, sample_count):
+    byte_rate = (rate * block_align) // samples_per_block
+    fmt = struct.pack('<HHIIHHHH', 0x11, 1, rate, byte_rate, block_align, 4, 2, samples_per_block)
+    fact = struct.pack('<I', sample_count)
+    pad = b'\0' if len(data) % 2 else b''
+    body = b'WAVE' + b'fmt ' + struct.pack('<I', len(fmt)) + fmt + b'fact' + struct.pack('<I', len(fact)) + fact
+    body += b'data' + struct.pack('<I', len(data)) + bytes(data) + pad
+    with open(path, 'wb') as out:
+        out.write(b'RIFF' + struct.pack('<I', len(body)) + body)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('input')
+    parser.add_argument('output', nargs='?')
+    parser.add_argument('--block', type=int, default=512, help='block size in bytes (default 512)')
+    parser.add_argument('--check', action='store_true', help='decode again and report the error')
+    args = parser.parse_args()
+
+    output = args.output or args.input.rsplit('.', 1)[0] + '.ima'
+    samples, rate = read_pcm(args.input)
+    data, samples_per_block = encode(samples, args.block)
+    write_ima(output, data, rate, args.block, samples_per_block, len(samples))
+
+    pcm_bytes = len(samples) * 2
+    print(f'{args.input}: {len(samples)} samples at {rate} Hz, {pcm_bytes} bytes PCM -> {len(data)} bytes ADPCM '
+          f'({100.0 * len(data) / pcm_bytes:.1f}%) in {output}')
+
+    if args.check:
+        decoded = decode(data, args.block)[:len(samples)]
+        err = [a - b for a, b in zip(samples, decoded)]
+        rms = math.sqrt(sum(e * e for e in err) / max(1, len(err)))
+        signal = math.sqrt(sum(s * s for s in samples) / max(1, len(samples)))
+        snr = 20 * math.log10(signal / rms) if rms and signal else float('inf')
+        seconds = len(samples) / rate
+        print(f'  check: rms error {rms:.1f}, SNR {snr:.1f} dB, max error {max(abs(e) for e in err)}')
+        print(f'  flash read per second of audio: PCM {pcm_bytes / seconds:.0f} bytes/s, '
+              f'ADPCM {len(data) / seconds:.0f} bytes/s')
+
+
+if __name__ == '__main__':
+    main()
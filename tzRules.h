@@ -0,0 +1,348 @@
+// This file defines the tzRules class
+// Local time from a POSIX TZ string, e.g. "EST5EDT,M3.2.0,M11.1.0" for US Eastern or
+// "AEST-10AEDT,M10.1.0,M4.1.0/3" for Sydney. The rule is turned into a sorted table of the UTC
+// times the offset changes over the next TZ_TABLE_YEARS, so finding the offset for any time is a
+// binary search, and the change happens on the second, not when something next checks.
+// Times outside the table are worked out from the rule directly, which is slower but right.
+// The table is only rebuilt by service(), from timeMgr. Everything else just reads it.
+
+#include "globalInclude.h"
+
+#define TZ_TABLE_YEARS 10
+#define TZ_MAX_TRANSITIONS (TZ_TABLE_YEARS * 2)
+#define TZ_NAME_LEN 8
+#define TZ_DEFAULT_RULE ",M3.2.0,M11.1.0" // if a DST zone has no rule, as glibc does
+#define TZ_DEFAULT_TIME 7200 // s into the day a change happens, if not given
+
+struct tzTransition {
+  time_t utc; // the first second the new offset applies
+  int32_t offset; // s ahead of UTC from then on
+};
+
+class tzRules {
+
+  private:
+    // the parsed rule
+    struct tzDate {
+      char kind; // 'J' day 1-365 without Feb 29, 'D' day 0-365, 'M' month.week.weekday
+      uint16_t day;
+      uint8_t month;
+      uint8_t week;
+      int32_t time; // s after local midnight, may be negative or past a day
+    };
+    char stdName[TZ_NAME_LEN] = "UTC";
+    char dstName[TZ_NAME_LEN] = "";
+    int32_t stdOffset = 0; // s ahead of UTC, east positive (POSIX writes it the other way)
+    int32_t dstOffset = 0;
+    bool hasDst = false;
+    tzDate dstStart;
+    tzDate dstEnd;
+
+    // the table
+    portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+    tzTransition table[TZ_MAX_TRANSITIONS];
+    uint8_t count = 0;
+    int32_t firstYear = 0;
+    time_t tableStart = 0; // UTC covered, start of firstYear in UTC to the end of the last year
+    time_t tableEnd = 0;
+
+    // Days from 1970-01-01 to a date. Works for any year in the Gregorian calendar.
+    static int32_t daysFromCivil(int32_t y, uint8_t m, uint8_t d) {
+      y -= (m <= 2);
+      int32_t era = (y >= 0 ? y : y - 399) / 400;
+      uint32_t yoe = (uint32_t)(y - era * 400);
+      uint32_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+      uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+      return era * 146097 + (int32_t)doe - 719468;
+    }
+
+    static int32_t yearOf(time_t utc) {
+      int32_t days = (int32_t)((utc >= 0) ? utc / 86400 : (utc - 86399) / 86400);
+      int32_t y = 1970 + days / 366;
+      while (daysFromCivil(y + 1, 1, 1) <= days) y++;
+      return y;
+    }
+
+    static bool isLeap(int32_t y) {
+      return (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+    }
+
+    static uint8_t monthLength(int32_t y, uint8_t m) {
+      static const uint8_t lengths[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+      return (m == 2 && isLeap(y)) ? 29 : lengths[m - 1];
+    }
+
+    // Local midnight (as seconds, no offset applied) of the day a rule date falls on in year y
+    static time_t ruleDay(const tzDate &date, int32_t y) {
+      int32_t days;
+      if (date.kind == 'J') {
+        days = daysFromCivil(y, 1, 1) + date.day - 1 + ((isLeap(y) && date.day >= 60) ? 1 : 0);
+      }
+      else if (date.kind == 'D') {
+        days = daysFromCivil(y, 1, 1) + date.day;
+      }
+      else {
+        int32_t first = daysFromCivil(y, date.month, 1);
+        uint8_t firstWeekday = (uint8_t)(((first % 7) + 11) % 7); // 1970-01-01 was a Thursday, 0 is Sunday
+        uint8_t dom = 1 + (date.day + 7 - firstWeekday) % 7 + (date.week - 1) * 7;
+        while (dom > monthLength(y, date.month)) dom -= 7; // week 5 is the last one
+        days = first + dom - 1;
+      }
+      return (time_t)days * 86400;
+    }
+
+    // The UTC times DST starts and ends in year y. The start is written in standard time and the
+    // end in daylight time.
+    void yearTransitions(int32_t y, time_t &start, time_t &end) {
+      start = ruleDay(dstStart, y) + dstStart.time - stdOffset;
+      end = ruleDay(dstEnd, y) + dstEnd.time - dstOffset;
+    }
+
+    // The offset at utc from the rule alone
+    int32_t offsetByRule(time_t utc) {
+      if (!hasDst) return stdOffset;
+      time_t start, end;
+      yearTransitions(yearOf(utc), start, end);
+      if (start < end) return (utc >= start && utc < end) ? dstOffset : stdOffset;
+      return (utc >= end && utc < start) ? stdOffset : dstOffset; // southern hemisphere
+    }
+
+    static bool parseName(const char *&p, char *name) {
+      uint8_t len = 0;
+      if (*p == '<') { // quoted, e.g. <+03>
+        p++;
+        while (*p && *p != '>') {
+          if (len < TZ_NAME_LEN - 1) name[len++] = *p;
+          p++;
+        }
+        if (*p != '>') return false;
+        p++;
+      }
+      else {
+        while (isalpha(*p)) {
+          if (len < TZ_NAME_LEN - 1) name[len++] = *p;
+          p++;
+        }
+      }
+      name[len] = '\0';
+      return len >= 3;
+    }
+
+    static long parseNumber(const char *&p) {
+      long n = 0;
+      while (isdigit(*p)) n = n * 10 + (*p++ - '0');
+      return n;
+    }
+
+    // [+-]hh[:mm[:ss]] in seconds
+    static bool parseTime(const char *&p, int32_t &secs) {
+      int32_t sign = 1;
+      if (*p == '+' || *p == '-') sign = (*p++ == '-') ? -1 : 1;
+      if (!isdigit(*p)) return false;
+      secs = parseNumber(p) * 3600;
+      if (*p == ':') {
+        p++;
+        secs += parseNumber(p) * 60;
+        if (*p == ':') {
+          p++;
+          secs += parseNumber(p);
+        }
+      }
+      secs *= sign;
+      return true;
+    }
+
+    static bool parseDate(const char *&p, tzDate &date) {
+      if (*p == 'M') {
+        p++;
+        date.kind = 'M';
+        date.month = parseNumber(p);
+        if (*p++ != '.') return false;
+        date.week = parseNumber(p);
+        if (*p++ != '.') return false;
+        date.day = parseNumber(p);
+        if (date.month < 1 || date.month > 12 || date.week < 1 || date.week > 5 || date.day > 6) return false;
+      }
+      else {
+        date.kind = (*p == 'J') ? 'J' : 'D';
+        if (*p == 'J') p++;
+        if (!isdigit(*p)) return false;
+        date.day = parseNumber(p);
+        if ((date.kind == 'J' && (date.day < 1 || date.day > 365)) || date.day > 365) return false;
+      }
+      date.time = TZ_DEFAULT_TIME;
+      if (*p == '/') {
+        p++;
+        if (!parseTime(p, date.time)) return false;
+      }
+      return true;
+    }
+
+    bool parse(const char *rule) {
+      const char *p = rule;
+      int32_t west;
+      if (!parseName(p, stdName) || !parseTime(p, west)) return false;
+      stdOffset = -west;
+      hasDst = false;
+      if (*p == '\0') return true;
+
+      if (!parseName(p, dstName)) return false;
+      dstOffset = stdOffset + 3600;
+      if (*p && *p != ',') {
+        if (!parseTime(p, west)) return false;
+        dstOffset = -west;
+      }
+      if (*p == '\0') p = TZ_DEFAULT_RULE;
+      if (*p++ != ',' || !parseDate(p, dstStart) || *p++ != ',' || !parseDate(p, dstEnd) || *p != '\0') return false;
+      hasDst = true;
+      return true;
+    }
+
+    // Fill the table with the transitions from the start of year y
+    void build(int32_t y) {
+      tzTransition fresh[TZ_MAX_TRANSITIONS];
+      uint8_t n = 0;
+      if (hasDst) {
+        for (int32_t year = y; year < y + TZ_TABLE_YEARS; year++) {
+          time_t start, end;
+          yearTransitions(year, start, end);
+          // in order within the year, whichever hemisphere
+          tzTransition first = {start, dstOffset};
+          tzTransition second = {end, stdOffset};
+          if (end < start) {
+            first = second;
+            second = {start, dstOffset};
+          }
+          fresh[n++] = first;
+          fresh[n++] = second;
+        }
+      }
+      time_t start = (time_t)daysFromCivil(y, 1, 1) * 86400 - max(stdOffset, dstOffset);
+      time_t end = (time_t)daysFromCivil(y + TZ_TABLE_YEARS, 1, 1) * 86400 - max(stdOffset, dstOffset);
+
+      portENTER_CRITICAL(&mux);
+      memcpy(table, fresh, sizeof(tzTransition) * n);
+      count = n;
+      firstYear = y;
+      tableStart = start;
+      tableEnd = end;
+      portEXIT_CRITICAL(&mux);
+    }
+
+  public:
+
+    // Call once, before the tasks start. Returns false and falls back to UTC if the rule won't parse.
+    // Until service() builds the table, offsets come from the rule directly.
+    bool begin(const char *rule) {
+      bool ok = parse(rule);
+      if (!ok) {
+        Serial.println("tzRules.begin: Can't read the time zone rule \"" + String(rule) + "\". Using UTC.");
+        strcpy(stdName, "UTC");
+        stdOffset = 0;
+        hasDst = false;
+      }
+      return ok;
+    }
+
+    // Call from timeMgr whenever the clock is set. Builds the table, or moves it on when time gets
+    // near its end or is before it (the clock was set back).
+    void service(time_t utc) {
+      int32_t y = yearOf(utc);
+      if (firstYear == 0 || y < firstYear || y >= firstYear + TZ_TABLE_YEARS - 1) {
+        build(y);
+        report();
+      }
+    }
+
+    // s ahead of UTC at this UTC time
+    int32_t offsetAt(time_t utc) {
+      portENTER_CRITICAL(&mux);
+      if (utc < tableStart || utc >= tableEnd) {
+        portEXIT_CRITICAL(&mux);
+        return offsetByRule(utc);
+      }
+      // the last transition at or before utc
+      int16_t lo = 0, hi = (int16_t)count - 1, found = -1;
+      while (lo <= hi) {
+        int16_t mid = (lo + hi) / 2;
+        if (table[mid].utc <= utc) {
+          found = mid;
+          lo = mid + 1;
+        }
+        else {
+          hi = mid - 1;
+        }
+      }
+      int32_t offset;
+      if (found >= 0) offset = table[found].offset;
+      else if (count > 0) offset = (table[0].offset == dstOffset) ? stdOffset : dstOffset; // before the first change
+      else offset = stdOffset;
+      portEXIT_CRITICAL(&mux);
+      return offset;
+    }
+
+    time_t toLocal(time_t utc) {
+      return utc + offsetAt(utc);
+    }
+
+    // The UTC time of a local time. A time that happens twice as the clocks go back gives the
+    // first. One skipped as they go forward is taken as the offset before the change, so 2:30 on
+    // spring forward day is 3:30 daylight time.
+    time_t toUtc(time_t local) {
+      int32_t hiOffset = hasDst ? max(stdOffset, dstOffset) : stdOffset;
+      int32_t loOffset = hasDst ? min(stdOffset, dstOffset) : stdOffset;
+      time_t early = local - hiOffset;
+      time_t late = local - loOffset;
+      if (toLocal(early) == local) return early;
+      if (toLocal(late) == local) return late;
+      return late;
+    }
+
+    bool isDst(time_t utc) {
+      return hasDst && offsetAt(utc) == dstOffset;
+    }
+
+    const char *name(time_t utc) {
+      return isDst(utc) ? dstName : stdName;
+    }
+
+    // The first change after utc, or 0 if the zone has none
+    time_t nextTransition(time_t utc) {
+      if (!hasDst) return 0;
+      time_t next = 0;
+      portENTER_CRITICAL(&mux);
+      for (uint8_t i = 0; i < count; i++) {
+        if (table[i].utc > utc) {
+          next = table[i].utc;
+          break;
+        }
+      }
+      portEXIT_CRITICAL(&mux);
+      if (next == 0) { // past the table
+        time_t start, end;
+        int32_t y = yearOf(utc);
+        for (int32_t year = y; year <= y + 1 && next == 0; year++) {
+          yearTransitions(year, start, end);
+          time_t first = min(start, end), second = max(start, end);
+          if (first > utc) next = first;
+          else if (second > utc) next = second;
+        }
+      }
+      return next;
+    }
+
+    // The table, for checking
+    uint8_t getTransitions(const tzTransition *&transitions) {
+      transitions = table;
+      return count;
+    }
+
+    void report( void ) {
+      String msg = "tzRules: " + String(stdName) + " " + String(stdOffset / 60) + "min";
+      if (hasDst) msg += ", " + String(dstName) + " " + String(dstOffset / 60) + "min";
+      msg += ". " + String(count) + " changes from " + String(firstYear) + " to " + String(firstYear + TZ_TABLE_YEARS - 1);
+      Serial.println(msg);
+    }
+};
+
+extern tzRules zone;
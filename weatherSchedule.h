@@ -0,0 +1,210 @@
+// This file defines the weatherSchedule class
+// Decides when to get the weather, instead of every five minutes. The interval starts at
+// WX_MIN_INTERVAL and doubles each time a fetch finds the forecast much the same as before, up to
+// WX_STABLE_MAX; any real change drops it back. While nobody has touched the screen for a while
+// it's stretched further, as nobody is looking. It's never sooner than the server's cache headers
+// say the last response stays fresh. Before an alarm it's shortened, so the forecast is no more
+// than WX_ALARM_FRESH old when the alarm rings.
+// OpenWeather allows so many calls a day, so calls are counted against WX_DAILY_BUDGET (per UTC
+// day, as the API counts them). The count is kept in NVS so a restart doesn't reset it, and what's
+// left is spread over what's left of the day. It's written when the day rolls over and then at
+// most every WX_BUDGET_SAVE_INTERVAL, not on every call, so a restart can forget the last few.
+// due() runs in timeMgr and the rest in netMgr, so the schedule's state is kept under a spinlock.
+// NVS is only written from netMgr, outside it.
+
+#include "globalInclude.h"
+
+#include <Preferences.h>
+
+#define WX_SCHEDULE_KEY "wxbudget"
+#define WX_SCHEDULE_VERSION 1
+#define WX_MIN_INTERVAL 300 // s between fetches. Where it starts, and after a change or a failure.
+#define WX_STABLE_MAX 1800 // s it can grow to while the forecast holds steady
+#define WX_IDLE_TIME 1800 // s without a touch before nobody is looking
+#define WX_IDLE_FACTOR 4 // and then the interval is this much longer
+#define WX_IDLE_MAX 3600
+#define WX_ALARM_LEAD 1800 // s before an alarm to start caring how old the forecast is
+#define WX_ALARM_FRESH 600 // s old the forecast can be when an alarm rings
+#define WX_ALARM_RETRY 120 // s between tries to freshen it for an alarm
+#define WX_DAILY_BUDGET 500 // API calls a day. The free OneCall plan allows 1000.
+#define WX_BUDGET_SAVE_INTERVAL 3600 // s between NVS writes of the day's call count
+#define WX_STABLE_TEMP 2.0f // degrees the temperature can move and still be the same forecast
+#define WX_STABLE_POP 0.2f // and the chance of rain
+#define WX_STABLE_HOURS 3 // hourly entries compared
+
+extern Preferences prefs;
+
+struct __attribute__((packed)) wxBudget {
+  uint8_t version;
+  uint32_t day; // UTC days since 1970
+  uint16_t calls; // made that day
+};
+
+class weatherSchedule {
+
+  private:
+    portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+    wxBudget budget;
+    uint32_t lastAttempt = 0; // UTC, 0 if none yet
+    uint32_t lastGood = 0;
+    bool lastOk = false;
+    uint32_t interval = WX_MIN_INTERVAL; // grows while the forecast is stable
+    uint32_t freshUntil = 0; // UTC the last response's cache headers allow
+    uint32_t lastTouch = 0; // UTC the screen was last seen touched
+    uint32_t lastDue = 0; // UTC of the next fetch, as last worked out
+
+    uint32_t budgetSaved = 0; // UTC the budget was last written. netMgr only.
+
+    // stats
+    uint32_t stableFetches = 0, changedFetches = 0, failedFetches = 0, refusedCalls = 0;
+
+    // netMgr only, with mux not held. NVS can't be written in a critical section.
+    void save(const wxBudget &copy, uint32_t utc) {
+      prefs.putBytes(WX_SCHEDULE_KEY, &copy, sizeof(wxBudget));
+      budgetSaved = utc;
+    }
+
+    // Call with mux held. Returns true if a new day started.
+    bool rollDay(uint32_t utc) {
+      if (utc / 86400 == budget.day) return false;
+      budget.day = utc / 86400;
+      budget.calls = 0;
+      return true;
+    }
+
+    // Is the new forecast close enough to the old one that it wasn't worth getting?
+    static bool isStable(const wxSnapshot *before, const wxSnapshot *after) {
+      if (before->fetched == 0) return false;
+      if (before->current.id != after->current.id) return false;
+      if (fabsf(before->current.temp - after->current.temp) > WX_STABLE_TEMP) return false;
+      // the old hourly entries are an hour on from the new ones once the hour turns
+      uint8_t shift = 0;
+      while (shift < WX_HOURS && before->hourly[shift].dt < after->hourly[0].dt) shift++;
+      for (uint8_t i = 0; i < WX_STABLE_HOURS && i + shift < WX_HOURS; i++) {
+        if (before->hourly[i + shift].id != after->hourly[i].id) return false;
+      }
+      if (before->daily[0].dt != after->daily[0].dt) return false; // a new day
+      if (before->daily[0].id != after->daily[0].id) return false;
+      if (fabsf(before->daily[0].pop - after->daily[0].pop) > WX_STABLE_POP) return false;
+      return true;
+    }
+
+    // When the next fetch should be (UTC). toAlarm is s until the next alarm, 0 if none.
+    // Call with mux held.
+    uint32_t nextDue(uint32_t utc, int32_t toAlarm) {
+      if (lastAttempt == 0) return utc;
+
+      uint32_t wait = lastOk ? interval : WX_MIN_INTERVAL;
+      if (lastOk && utc - lastTouch > WX_IDLE_TIME) {
+        wait = max(wait, min((uint32_t)(wait * WX_IDLE_FACTOR), (uint32_t)WX_IDLE_MAX));
+      }
+      uint32_t at = lastAttempt + wait;
+
+      // the forecast should be fresh when the alarm rings
+      if (toAlarm > 0 && toAlarm <= WX_ALARM_LEAD) {
+        uint32_t ring = utc + toAlarm;
+        if (ring - lastGood > WX_ALARM_FRESH) {
+          uint32_t want = max(ring - WX_ALARM_FRESH, lastAttempt + WX_ALARM_RETRY);
+          if (want < at) at = want;
+        }
+      }
+
+      // the server said the last one won't change before then
+      if (lastOk && freshUntil > at) at = freshUntil;
+
+      // spread what's left of the budget over what's left of the day. A fetch can take two calls.
+      uint32_t dayEnd = (utc / 86400 + 1) * 86400;
+      uint16_t left = (budget.calls < WX_DAILY_BUDGET) ? WX_DAILY_BUDGET - budget.calls : 0;
+      if (budget.day == utc / 86400 && left < 2) return dayEnd;
+      if (budget.day == utc / 86400) {
+        uint32_t pace = (dayEnd - utc) / (left / 2);
+        if (lastAttempt + pace > at) at = lastAttempt + pace;
+      }
+      return at;
+    }
+
+  public:
+
+    // Call from setup(), after prefs.begin()
+    void begin( void ) {
+      if (prefs.getBytes(WX_SCHEDULE_KEY, &budget, sizeof(budget)) != sizeof(budget) || budget.version != WX_SCHEDULE_VERSION) {
+        memset(&budget, 0, sizeof(budget));
+        budget.version = WX_SCHEDULE_VERSION;
+      }
+      Serial.println("weatherSchedule.begin: " + String(budget.calls) + " API calls on day " + String(budget.day));
+    }
+
+    // Call often (every pass of timeMgr). Returns true if it's time to get the weather.
+    bool due(uint32_t utc, int32_t toAlarm, bool touched) {
+      portENTER_CRITICAL(&mux);
+      if (touched || lastTouch == 0) lastTouch = utc;
+      lastDue = nextDue(utc, toAlarm);
+      bool isDue = (utc >= lastDue);
+      portEXIT_CRITICAL(&mux);
+      return isDue;
+    }
+
+    // Call before each API call. Returns false if the day's budget is spent.
+    bool takeCall(uint32_t utc) {
+      portENTER_CRITICAL(&mux);
+      bool newDay = rollDay(utc);
+      bool allowed = (budget.calls < WX_DAILY_BUDGET);
+      if (allowed) budget.calls++;
+      else refusedCalls++;
+      wxBudget copy = budget;
+      portEXIT_CRITICAL(&mux);
+
+      if (newDay || (allowed && utc - budgetSaved >= WX_BUDGET_SAVE_INTERVAL)) save(copy, utc);
+      if (!allowed) Serial.println("weatherSchedule.takeCall: Today's " + String(WX_DAILY_BUDGET) + " API calls are used up.");
+      return allowed;
+    }
+
+    // Call with the forecast that's about to be replaced, the new one, and how long the server
+    // says the new one stays fresh
+    void fetched(uint32_t utc, const wxSnapshot *before, const wxSnapshot *after, uint32_t freshFor) {
+      bool stable = isStable(before, after);
+      portENTER_CRITICAL(&mux);
+      lastAttempt = lastGood = utc;
+      lastOk = true;
+      freshUntil = utc + freshFor;
+      if (stable) {
+        interval = min(interval * 2, (uint32_t)WX_STABLE_MAX);
+        stableFetches++;
+      }
+      else {
+        interval = WX_MIN_INTERVAL;
+        changedFetches++;
+      }
+      portEXIT_CRITICAL(&mux);
+    }
+
+    void failed(uint32_t utc) {
+      portENTER_CRITICAL(&mux);
+      lastAttempt = utc;
+      lastOk = false;
+      failedFetches++;
+      portEXIT_CRITICAL(&mux);
+    }
+
+    uint16_t getCallsToday( void ) {
+      portENTER_CRITICAL(&mux);
+      uint16_t calls = budget.calls;
+      portEXIT_CRITICAL(&mux);
+      return calls;
+    }
+
+    void reportStats(uint32_t utc) {
+      portENTER_CRITICAL(&mux);
+      uint16_t calls = budget.calls;
+      uint32_t wait = interval, next = lastDue;
+      uint32_t stable = stableFetches, changed = changedFetches, failures = failedFetches, refused = refusedCalls;
+      portEXIT_CRITICAL(&mux);
+
+      String msg = "weatherSchedule: " + String(calls) + "/" + String(WX_DAILY_BUDGET) + " calls today. Interval " + String(wait / 60) + " minutes";
+      msg += ", next in " + String((next > utc) ? (next - utc) / 60 : 0) + ". Fetches " + String(stable) + " stable, " + String(changed) + " changed, " + String(failures) + " failed";
+      if (refused) msg += ", " + String(refused) + " calls refused";
+      Serial.println(msg);
+    }
+};
+
+extern weatherSchedule wxSchedule;
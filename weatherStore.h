@@ -0,0 +1,177 @@
+// This file defines the weatherStore class
+// The weather the display draws from. Two snapshots are allocated once, up front. The network task
+// fills the back one and swaps it to the front under owMutex, so a fetch doesn't allocate anything
+// and the display never sees a half-written forecast. Only what the screens use is kept, all
+// numbers. The condition is kept as its ID; see wxConditions.h for its text and icon.
+// The last good snapshot is also kept in NVS, about 500 bytes, CRC checked. At boot it's loaded
+// before the display starts, so the screen has weather straight away, marked stale until the
+// first fetch replaces it. One over WX_MAX_AGE old is dropped, as the screens don't say how old
+// it is. It's written at most every WX_SAVE_INTERVAL, to spare the flash.
+
+#include "globalInclude.h"
+
+#include <Preferences.h>
+#include <rom/crc.h>
+
+#define WX_HOURS 6 // hourly slots kept. The hourly screen shows up to hour 4.
+#define WX_DAYS 5 // daily slots kept. The forecast screen shows up to day 4.
+#define WX_SAVE_KEY "wxlast"
+#define WX_SAVE_VERSION 1
+#define WX_SAVE_INTERVAL 1800 // s between writes of a newer forecast to flash
+#define WX_MAX_AGE 86400 // s a saved forecast is good for at boot
+
+extern SemaphoreHandle_t owMutex;
+extern Preferences prefs;
+
+struct wxCurrent {
+  uint32_t dt;
+  uint32_t sunrise;
+  uint32_t sunset;
+  float temp;
+  float feels_like;
+  float pressure;
+  float wind_speed;
+  float wind_gust;
+  uint16_t wind_deg;
+  uint16_t id; // OpenWeather condition
+  uint8_t humidity;
+  uint8_t clouds;
+};
+
+struct wxHour {
+  uint32_t dt;
+  float temp;
+  float wind_speed;
+  float wind_gust;
+  uint16_t id;
+};
+
+struct wxDay {
+  uint32_t dt;
+  float temp_min;
+  float temp_max;
+  float temp_morn;
+  float temp_day;
+  float temp_eve;
+  float temp_night;
+  float feels_like_morn;
+  float feels_like_day;
+  float feels_like_eve;
+  float feels_like_night;
+  float wind_speed;
+  float wind_gust;
+  float pop; // probability of precipitation, 0 to 1
+  float rain; // mm
+  float snow;
+  uint16_t id;
+  uint8_t humidity;
+};
+
+struct wxSnapshot {
+  uint32_t fetched; // UTC it was fetched
+  wxCurrent current;
+  wxHour hourly[WX_HOURS];
+  wxDay daily[WX_DAYS];
+};
+
+struct wxSaved {
+  uint8_t version;
+  uint16_t size; // of the snapshot, so a change to it isn't read as the old layout
+  uint32_t crc; // of the snapshot
+  wxSnapshot snapshot;
+};
+
+class weatherStore {
+
+  private:
+    wxSnapshot snapshots[2];
+    uint8_t front = 0;
+    uint32_t swaps = 0;
+    bool stale = false; // the front snapshot was loaded from flash, not fetched
+    bool dirty = false; // the front snapshot is newer than the saved one
+    uint32_t lastSaved = 0; // UTC
+
+  public:
+
+    // The snapshot to draw from. Call with owMutex held, and don't keep the pointer after giving it.
+    const wxSnapshot *get( void ) {
+      return &snapshots[front];
+    }
+
+    // The snapshot to fill. Network task only.
+    wxSnapshot *back( void ) {
+      memset(&snapshots[front ^ 1], 0, sizeof(wxSnapshot));
+      return &snapshots[front ^ 1];
+    }
+
+    // Make the back snapshot the front one. Returns false if owMutex couldn't be had.
+    bool publish( void ) {
+      if (xSemaphoreTake(owMutex, (TickType_t) 100) != pdTRUE) {
+        return false;
+      }
+      front ^= 1;
+      swaps++;
+      stale = false;
+      dirty = true;
+      xSemaphoreGive(owMutex);
+      return true;
+    }
+
+    // Load the saved snapshot into the front. Call from setup(), after prefs.begin(), before the
+    // tasks start, with the RTC's UTC, or 0 if it isn't known. Returns false if there isn't a good
+    // one no older than WX_MAX_AGE.
+    bool load(uint32_t utc) {
+      wxSaved saved;
+      bool ok = prefs.getBytes(WX_SAVE_KEY, &saved, sizeof(wxSaved)) == sizeof(wxSaved) &&
+                saved.version == WX_SAVE_VERSION && saved.size == sizeof(wxSnapshot) &&
+                saved.crc == crc32_le(0, (const uint8_t *)&saved.snapshot, sizeof(wxSnapshot)) &&
+                saved.snapshot.fetched != 0;
+      if (ok && utc - saved.snapshot.fetched > WX_MAX_AGE) { // also one from the future, or an unknown time
+        Serial.println("weatherStore.load: Saved forecast from " + String(saved.snapshot.fetched) + " is too old at " + String(utc) + ". Dropped.");
+        ok = false;
+      }
+      if (ok) {
+        memcpy(&snapshots[front], &saved.snapshot, sizeof(wxSnapshot));
+        stale = true;
+        lastSaved = saved.snapshot.fetched;
+      }
+      Serial.println(ok ? "weatherStore.load: Saved forecast loaded" : "weatherStore.load: No saved forecast");
+      return ok;
+    }
+
+    // Write the front snapshot to flash if it's newer than the saved one
+    void flush( void ) {
+      if (!dirty) return;
+      wxSaved saved;
+      if (xSemaphoreTake(owMutex, (TickType_t) 100) != pdTRUE) return;
+      memcpy(&saved.snapshot, &snapshots[front], sizeof(wxSnapshot));
+      dirty = false;
+      xSemaphoreGive(owMutex);
+      saved.version = WX_SAVE_VERSION;
+      saved.size = sizeof(wxSnapshot);
+      saved.crc = crc32_le(0, (const uint8_t *)&saved.snapshot, sizeof(wxSnapshot));
+      if (prefs.putBytes(WX_SAVE_KEY, &saved, sizeof(wxSaved)) == sizeof(wxSaved)) {
+        lastSaved = saved.snapshot.fetched;
+      }
+      else {
+        Serial.println("weatherStore.flush: Unable to save the forecast");
+        dirty = true;
+      }
+    }
+
+    // Call after each fetch
+    void flushIfDue(uint32_t utc) {
+      if (dirty && utc - lastSaved >= WX_SAVE_INTERVAL) flush();
+    }
+
+    // True until a fetched forecast replaces the one loaded from flash. Call with owMutex held.
+    bool isStale( void ) {
+      return stale;
+    }
+
+    uint32_t getSwaps( void ) {
+      return swaps;
+    }
+};
+
+extern weatherStore weather;
@@ -0,0 +1,240 @@
+// This file defines the wifiLink class
+// Makes WiFi joins quick. A full join scans every channel for the network, associates, then waits
+// for DHCP, which can take several seconds. After a full join the access point's BSSID and
+// channel, and the DHCP lease, are kept in RTC memory (kept through a restart, not a power cut).
+// The next join goes straight to that access point on that channel, and reuses the lease as a
+// static address so DHCP is skipped too. That's only done until the lease's T1, the time the DHCP
+// server gave for renewing it (half the lease unless it said otherwise). After that, or if the
+// lease length isn't known, the fast join asks DHCP again. If the fast join fails the cache is
+// dropped and the caller does a full one.
+// A fixed address can be given instead of DHCP (see begin()).
+// With WIFI_STAY_CONNECTED defined the link is kept up between requests, with modem sleep to
+// save power, instead of joining each time. It can't light-sleep then (see RTC_LIGHT_SLEEP).
+// Join times and how long the radio was on are timed for both ways, to compare them. The charge
+// reportStats() gives is only an estimate from typical currents. Nothing here measures current.
+
+#include "globalInclude.h"
+
+#include <WiFi.h>
+#include <rom/crc.h>
+#include <esp_netif.h>
+#include <esp_netif_net_stack.h>
+#include <lwip/dhcp.h>
+
+// #define WIFI_STAY_CONNECTED // keep the link up with modem sleep, instead of joining for each request
+
+#define WIFI_FAST_TIMEOUT 3000 // ms to wait for a fast join before giving up on the cache
+#define WIFI_LEASE_MAGIC 0x57494649
+#define WIFI_ACTIVE_MA 100.0f // assumed ESP32 current with the radio on, for the charge estimate
+#define WIFI_MODEM_SLEEP_MA 20.0f // and associated in modem sleep
+
+struct __attribute__((packed)) wifiLease {
+  uint32_t magic;
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+  uint32_t leaseAgeMs; // how old the lease was when this was last saved
+  uint32_t renewSecs; // the lease's T1. It's reused as a static address until it's this old.
+  uint32_t crc;
+};
+
+extern wifiLease wifiLeaseCache; // RTC_NOINIT_ATTR
+
+class wifiLink {
+
+  private:
+    bool fixedAddress = false;
+    IPAddress fixedIP, fixedGateway, fixedSubnet, fixedDns;
+    uint32_t leaseBaseMs = 0; // the lease's age in ms is leaseBaseMs + millis()
+    bool leaseValid = false;
+    bool askedDhcp = false; // this join got its address from DHCP
+    bool lastFast = false;
+    uint32_t upSinceMs = 0; // when the link came up or went to sleep, 0 if down
+    bool sleeping = false; // up in modem sleep, between requests
+
+    // stats
+    uint32_t fastJoins = 0, fullJoins = 0, fastFails = 0;
+    uint32_t fastJoinMs = 0, fullJoinMs = 0; // totals
+    uint32_t activeMs = 0; // joining or connected and busy
+    uint32_t sleepingMs = 0; // connected in modem sleep between requests
+
+    bool checkCache( void ) {
+      return wifiLeaseCache.magic == WIFI_LEASE_MAGIC &&
+             wifiLeaseCache.crc == crc32_le(0, (const uint8_t *)&wifiLeaseCache, sizeof(wifiLease) - sizeof(uint32_t));
+    }
+
+    void sealCache( void ) {
+      wifiLeaseCache.magic = WIFI_LEASE_MAGIC;
+      wifiLeaseCache.crc = crc32_le(0, (const uint8_t *)&wifiLeaseCache, sizeof(wifiLease) - sizeof(uint32_t));
+    }
+
+    // in s
+    uint32_t leaseAge( void ) {
+      return (uint32_t)(leaseBaseMs + (uint32_t)millis()) / 1000;
+    }
+
+    // T1 of the lease DHCP just gave the station, in s, or 0 if there isn't one. The renew time if
+    // the server sent one, otherwise half the lease, as DHCP clients do.
+    uint32_t dhcpRenewSecs( void ) {
+      struct netif *staNetif = (struct netif *)esp_netif_get_netif_impl(esp_netif_get_handle_from_ifkey("WIFI_STA_DEF"));
+      if (staNetif == NULL) return 0;
+      struct dhcp *dhcpState = netif_dhcp_data(staNetif);
+      if (dhcpState == NULL || dhcpState->offered_t0_lease == 0) return 0;
+      if (dhcpState->offered_t1_renew != 0 && dhcpState->offered_t1_renew < dhcpState->offered_t0_lease) {
+        return dhcpState->offered_t1_renew;
+      }
+      return dhcpState->offered_t0_lease / 2;
+    }
+
+    void saveLeaseAge( void ) {
+      wifiLeaseCache.leaseAgeMs = leaseBaseMs + (uint32_t)millis();
+      sealCache();
+    }
+
+  public:
+
+    // Call from setup(). A non-zero ip means use that address and never DHCP.
+    void begin(IPAddress ip, IPAddress gateway, IPAddress subnet, IPAddress dns) {
+      fixedAddress = ((uint32_t)ip != 0);
+      fixedIP = ip;
+      fixedGateway = gateway;
+      fixedSubnet = subnet;
+      fixedDns = dns;
+      leaseValid = checkCache();
+      if (leaseValid) {
+        leaseBaseMs = wifiLeaseCache.leaseAgeMs - (uint32_t)millis();
+        Serial.println("wifiLink.begin: Cached access point on channel " + String(wifiLeaseCache.channel) + ", lease " + String(leaseAge() / 60) + " minutes old");
+      }
+      WiFi.persistent(false); // the cache does this. Don't wear the flash.
+    }
+
+    // Try to join the cached access point without a scan. Returns true if connected.
+    bool fastConnect(const char *ssid, const char *pass) {
+      if (!leaseValid) return false;
+      uint32_t startMs = millis();
+      askedDhcp = false;
+      if (fixedAddress) {
+        WiFi.config(fixedIP, fixedGateway, fixedSubnet, fixedDns);
+      }
+      else if (leaseAge() < wifiLeaseCache.renewSecs) {
+        WiFi.config(IPAddress(wifiLeaseCache.ip), IPAddress(wifiLeaseCache.gateway), IPAddress(wifiLeaseCache.subnet), IPAddress(wifiLeaseCache.dns));
+      }
+      else {
+        WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0)); // past T1, time to renew it
+        askedDhcp = true;
+      }
+      WiFi.begin(ssid, pass, wifiLeaseCache.channel, wifiLeaseCache.bssid);
+      while (WiFi.status() != WL_CONNECTED && millis() - startMs < WIFI_FAST_TIMEOUT) {
+        vTaskDelay(20 / portTICK_PERIOD_MS);
+      }
+      if (WiFi.status() != WL_CONNECTED) {
+        Serial.println("wifiLink.fastConnect: No answer from the cached access point. Dropping the cache.");
+        activeMs += millis() - startMs;
+        fastFails++;
+        leaseValid = false;
+        wifiLeaseCache.magic = 0;
+        WiFi.disconnect();
+        WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0));
+        return false;
+      }
+      return true;
+    }
+
+    // Set the address to use for a full join. Call before WiFi.begin(ssid, pass).
+    void prepareFullConnect( void ) {
+      askedDhcp = !fixedAddress;
+      if (fixedAddress) WiFi.config(fixedIP, fixedGateway, fixedSubnet, fixedDns);
+      else WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0));
+    }
+
+    // Call once connected, with how long the join took
+    void joined(bool fast, uint32_t ms) {
+      lastFast = fast;
+      activeMs += ms;
+      upSinceMs = millis();
+      if (fast) {
+        fastJoins++;
+        fastJoinMs += ms;
+      }
+      else {
+        fullJoins++;
+        fullJoinMs += ms;
+      }
+      // a join that went through DHCP gives a fresh lease to keep
+      memcpy(wifiLeaseCache.bssid, WiFi.BSSID(), 6);
+      wifiLeaseCache.channel = WiFi.channel();
+      if (askedDhcp || !leaseValid) {
+        wifiLeaseCache.ip = (uint32_t)WiFi.localIP();
+        wifiLeaseCache.gateway = (uint32_t)WiFi.gatewayIP();
+        wifiLeaseCache.subnet = (uint32_t)WiFi.subnetMask();
+        wifiLeaseCache.dns = (uint32_t)WiFi.dnsIP();
+        wifiLeaseCache.renewSecs = askedDhcp ? dhcpRenewSecs() : 0;
+        leaseBaseMs = 0 - (uint32_t)millis(); // so leaseAge() is 0 now
+        if (askedDhcp && wifiLeaseCache.renewSecs) {
+          Serial.println("wifiLink.joined: New DHCP lease. Fast joins reuse it for " + String(wifiLeaseCache.renewSecs / 60) + " minutes");
+        }
+        else if (askedDhcp) {
+          Serial.println("wifiLink.joined: No DHCP lease time. Fast joins will ask DHCP.");
+        }
+      }
+      saveLeaseAge();
+      leaseValid = true;
+#ifdef WIFI_STAY_CONNECTED
+      WiFi.setSleep(true); // modem sleep between beacons
+#endif
+    }
+
+    // Call when a request is finished. Returns true if the link should be taken down.
+    bool release( void ) {
+      if (upSinceMs != 0) {
+        activeMs += millis() - upSinceMs;
+        upSinceMs = 0;
+      }
+      if (leaseValid) saveLeaseAge(); // so a restart knows about how old it is
+#ifdef WIFI_STAY_CONNECTED
+      if (WiFi.status() != WL_CONNECTED) return true; // it failed. Tidy up.
+      upSinceMs = millis(); // from here it's modem sleep until the next request
+      sleeping = true;
+      return false;
+#else
+      return true;
+#endif
+    }
+
+    // Call when a request starts, in case the link was left up
+    void reuse( void ) {
+      if (sleeping && upSinceMs != 0) {
+        sleepingMs += millis() - upSinceMs;
+        upSinceMs = millis();
+      }
+      sleeping = false;
+    }
+
+    bool stayConnected( void ) {
+#ifdef WIFI_STAY_CONNECTED
+      return true;
+#else
+      return false;
+#endif
+    }
+
+    bool wasFast( void ) {
+      return lastFast;
+    }
+
+    void reportStats( void ) {
+      String msg = "wifiLink: ";
+      msg += String(fastJoins) + " fast joins";
+      if (fastJoins) msg += " avg " + String(fastJoinMs / fastJoins) + "ms";
+      msg += " (" + String(fastFails) + " failed), " + String(fullJoins) + " full";
+      if (fullJoins) msg += " avg " + String(fullJoinMs / fullJoins) + "ms";
+      float mAh = (activeMs * WIFI_ACTIVE_MA + sleepingMs * WIFI_MODEM_SLEEP_MA) / 3600000.0f; // not measured
+      msg += ". Radio busy " + String(activeMs / 1000) + "s, modem sleep " + String(sleepingMs / 1000) + "s, estimated " + String(mAh, 1) + "mAh at " + String((int)WIFI_ACTIVE_MA) + "/" + String((int)WIFI_MODEM_SLEEP_MA) + "mA";
+      Serial.println(msg);
+    }
+};
+
+extern wifiLink wlan;
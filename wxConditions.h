@@ -0,0 +1,151 @@
+// This file defines the wxConditions class
+// OpenWeather reports the weather as a condition ID, and there are only about 55 of them. The text
+// to show for each (already capitalised) and its icon are in a constant table here, sorted by ID,
+// so the weather snapshots only keep the ID. How wide each text is in the weather font is
+// measured once at start up and kept, so the screens don't measure it on every draw. The widths
+// can't be worked out at compile time; the font's glyph tables aren't constexpr.
+
+#include "globalInclude.h"
+
+// icons, see iconName()
+#define WX_ICON_UNKNOWN 0
+#define WX_ICON_THUNDERSTORM 1
+#define WX_ICON_DRIZZLE 2
+#define WX_ICON_LIGHT_RAIN 3
+#define WX_ICON_RAIN 4
+#define WX_ICON_SLEET 5
+#define WX_ICON_SNOW 6
+#define WX_ICON_HEAVY_SNOW 7
+#define WX_ICON_FOG 8
+#define WX_ICON_WIND 9
+#define WX_ICON_CLEAR_DAY 10
+#define WX_ICON_CLEAR_NIGHT 11
+#define WX_ICON_PARTLY_CLOUDY_DAY 12
+#define WX_ICON_PARTLY_CLOUDY_NIGHT 13
+#define WX_ICON_CLOUDY 14
+#define WX_ICON_COUNT 15
+
+struct wxCondition {
+  uint16_t id;
+  const char *text;
+  uint8_t dayIcon;
+  uint8_t nightIcon;
+};
+
+static constexpr wxCondition wxConditionTable[] = {
+  {200, "Thunderstorm with light rain", WX_ICON_THUNDERSTORM, WX_ICON_THUNDERSTORM},
+  {201, "Thunderstorm with rain", WX_ICON_THUNDERSTORM, WX_ICON_THUNDERSTORM},
+  {202, "Thunderstorm with heavy rain", WX_ICON_THUNDERSTORM, WX_ICON_THUNDERSTORM},
+  {210, "Light thunderstorm", WX_ICON_THUNDERSTORM, WX_ICON_THUNDERSTORM},
+  {211, "Thunderstorm", WX_ICON_THUNDERSTORM, WX_ICON_THUNDERSTORM},
+  {212, "Heavy thunderstorm", WX_ICON_THUNDERSTORM, WX_ICON_THUNDERSTORM},
+  {221, "Ragged thunderstorm", WX_ICON_THUNDERSTORM, WX_ICON_THUNDERSTORM},
+  {230, "Thunderstorm with light drizzle", WX_ICON_THUNDERSTORM, WX_ICON_THUNDERSTORM},
+  {231, "Thunderstorm with drizzle", WX_ICON_THUNDERSTORM, WX_ICON_THUNDERSTORM},
+  {232, "Thunderstorm with heavy drizzle", WX_ICON_THUNDERSTORM, WX_ICON_THUNDERSTORM},
+  {300, "Light intensity drizzle", WX_ICON_DRIZZLE, WX_ICON_DRIZZLE},
+  {301, "Drizzle", WX_ICON_DRIZZLE, WX_ICON_DRIZZLE},
+  {302, "Heavy intensity drizzle", WX_ICON_DRIZZLE, WX_ICON_DRIZZLE},
+  {310, "Light intensity drizzle rain", WX_ICON_DRIZZLE, WX_ICON_DRIZZLE},
+  {311, "Drizzle rain", WX_ICON_DRIZZLE, WX_ICON_DRIZZLE},
+  {312, "Heavy intensity drizzle rain", WX_ICON_DRIZZLE, WX_ICON_DRIZZLE},
+  {313, "Shower rain and drizzle", WX_ICON_DRIZZLE, WX_ICON_DRIZZLE},
+  {314, "Heavy shower rain and drizzle", WX_ICON_DRIZZLE, WX_ICON_DRIZZLE},
+  {321, "Shower drizzle", WX_ICON_DRIZZLE, WX_ICON_DRIZZLE},
+  {500, "Light rain", WX_ICON_LIGHT_RAIN, WX_ICON_LIGHT_RAIN},
+  {501, "Moderate rain", WX_ICON_RAIN, WX_ICON_RAIN},
+  {502, "Heavy intensity rain", WX_ICON_RAIN, WX_ICON_RAIN},
+  {503, "Very heavy rain", WX_ICON_RAIN, WX_ICON_RAIN},
+  {504, "Extreme rain", WX_ICON_RAIN, WX_ICON_RAIN},
+  {511, "Freezing rain", WX_ICON_SLEET, WX_ICON_SLEET},
+  {520, "Light intensity shower rain", WX_ICON_LIGHT_RAIN, WX_ICON_LIGHT_RAIN},
+  {521, "Shower rain", WX_ICON_RAIN, WX_ICON_RAIN},
+  {522, "Heavy intensity shower rain", WX_ICON_RAIN, WX_ICON_RAIN},
+  {531, "Ragged shower rain", WX_ICON_RAIN, WX_ICON_RAIN},
+  {600, "Light snow", WX_ICON_SNOW, WX_ICON_SNOW},
+  {601, "Snow", WX_ICON_SNOW, WX_ICON_SNOW},
+  {602, "Heavy snow", WX_ICON_HEAVY_SNOW, WX_ICON_HEAVY_SNOW},
+  {611, "Sleet", WX_ICON_SLEET, WX_ICON_SLEET},
+  {612, "Light shower sleet", WX_ICON_SLEET, WX_ICON_SLEET},
+  {613, "Shower sleet", WX_ICON_SLEET, WX_ICON_SLEET},
+  {615, "Light rain and snow", WX_ICON_SLEET, WX_ICON_SLEET},
+  {616, "Rain and snow", WX_ICON_SLEET, WX_ICON_SLEET},
+  {620, "Light shower snow", WX_ICON_SNOW, WX_ICON_SNOW},
+  {621, "Shower snow", WX_ICON_SNOW, WX_ICON_SNOW},
+  {622, "Heavy shower snow", WX_ICON_HEAVY_SNOW, WX_ICON_HEAVY_SNOW},
+  {701, "Mist", WX_ICON_FOG, WX_ICON_FOG},
+  {711, "Smoke", WX_ICON_FOG, WX_ICON_FOG},
+  {721, "Haze", WX_ICON_FOG, WX_ICON_FOG},
+  {731, "Sand/dust whirls", WX_ICON_FOG, WX_ICON_FOG},
+  {741, "Fog", WX_ICON_FOG, WX_ICON_FOG},
+  {751, "Sand", WX_ICON_FOG, WX_ICON_FOG},
+  {761, "Dust", WX_ICON_FOG, WX_ICON_FOG},
+  {762, "Volcanic ash", WX_ICON_FOG, WX_ICON_FOG},
+  {771, "Squalls", WX_ICON_WIND, WX_ICON_WIND},
+  {781, "Tornado", WX_ICON_WIND, WX_ICON_WIND},
+  {800, "Clear sky", WX_ICON_CLEAR_DAY, WX_ICON_CLEAR_NIGHT},
+  {801, "Few clouds", WX_ICON_PARTLY_CLOUDY_DAY, WX_ICON_PARTLY_CLOUDY_NIGHT},
+  {802, "Scattered clouds", WX_ICON_PARTLY_CLOUDY_DAY, WX_ICON_PARTLY_CLOUDY_NIGHT},
+  {803, "Broken clouds", WX_ICON_CLOUDY, WX_ICON_CLOUDY},
+  {804, "Overcast clouds", WX_ICON_CLOUDY, WX_ICON_CLOUDY},
+};
+
+#define WX_CONDITION_COUNT (sizeof(wxConditionTable) / sizeof(wxCondition))
+
+// for an ID that isn't in the table
+static constexpr wxCondition wxConditionUnknown = {0, "Unknown", WX_ICON_UNKNOWN, WX_ICON_UNKNOWN};
+
+class wxConditions {
+
+  private:
+    uint16_t widths[WX_CONDITION_COUNT + 1]; // the last is for wxConditionUnknown
+    bool measured = false;
+
+    static uint8_t indexOf(const wxCondition *cond) {
+      return (cond == &wxConditionUnknown) ? WX_CONDITION_COUNT : cond - wxConditionTable;
+    }
+
+  public:
+
+    // Measure every text in font. Call once the display is set up, holding tftMutex.
+    void measure(TFT_eSPI &screen, const GFXfont *font) {
+      screen.setFreeFont(font);
+      for (uint8_t i = 0; i < WX_CONDITION_COUNT; i++) {
+        widths[i] = screen.textWidth(wxConditionTable[i].text, GFXFF);
+      }
+      widths[WX_CONDITION_COUNT] = screen.textWidth(wxConditionUnknown.text, GFXFF);
+      measured = true;
+    }
+
+    // The condition for an ID. Never NULL.
+    static const wxCondition *find(uint16_t id) {
+      uint8_t lo = 0, hi = WX_CONDITION_COUNT;
+      while (lo < hi) {
+        uint8_t mid = (lo + hi) / 2;
+        if (wxConditionTable[mid].id < id) lo = mid + 1;
+        else hi = mid;
+      }
+      if (lo < WX_CONDITION_COUNT && wxConditionTable[lo].id == id) return &wxConditionTable[lo];
+      return &wxConditionUnknown;
+    }
+
+    // Width of the text in pixels, in the font measure() was given
+    uint16_t width(const wxCondition *cond) {
+      return measured ? widths[indexOf(cond)] : 0;
+    }
+
+    static uint8_t icon(const wxCondition *cond, bool night) {
+      return night ? cond->nightIcon : cond->dayIcon;
+    }
+
+    // The icon's file name in /icon and /icon50
+    static const char *iconName(uint8_t icon) {
+      static const char *names[WX_ICON_COUNT] = {"unknown", "thunderstorm", "drizzle", "lightRain", "rain", "sleet", "snow",
+                                                 "heavy-snow", "fog", "wind", "clear-day", "clear-night", "partly-cloudy-day",
+                                                 "partly-cloudy-night", "cloudy"
+                                                };
+      return (icon < WX_ICON_COUNT) ? names[icon] : names[WX_ICON_UNKNOWN];
+    }
+};
+
+extern wxConditions conditions;